@@ -5,31 +5,50 @@ namespace scudb {
 /*
  * BufferPoolManager Constructor
  * When log_manager is nullptr, logging is disabled (for test purpose)
- * WARNING: Do Not Edit This Function
  */
 BufferPoolManager::BufferPoolManager(size_t pool_size,
                                                  DiskManager *disk_manager,
                                                  LogManager *log_manager)
     : pool_size_(pool_size), disk_manager_(disk_manager),
-      log_manager_(log_manager) {
+      log_manager_(log_manager), frames_(nullptr),
+      read_only_(disk_manager->IsReadOnly()), verified_(nullptr) {
+  if (read_only_) {
+    // one page per page of the mapped file, nothing is ever evicted
+    pool_size_ = disk_manager_->GetNumPages();
+    pages_ = new Page[pool_size_];
+    // the mapping never changes, a page is verified on its first fetch only
+    verified_ = new std::atomic<bool>[pool_size_]();
+    for (size_t i = 0; i < pool_size_; ++i) {
+      pages_[i].data_ = disk_manager_->GetMappedPage(i);
+      pages_[i].page_id_ = i;
+    }
+    page_table_ = nullptr;
+    replacer_ = nullptr;
+    free_list_ = nullptr;
+    return;
+  }
   // a consecutive memory space for buffer pool
   pages_ = new Page[pool_size_];
+  frames_ = new char[pool_size_ * PAGE_SIZE];
   page_table_ = new ExtendibleHash<page_id_t, Page *>(BUCKET_SIZE);
   replacer_ = new LRUReplacer<Page *>;
   free_list_ = new std::list<Page *>;
 
   // put all the pages into free list
   for (size_t i = 0; i < pool_size_; ++i) {
+    pages_[i].data_ = frames_ + i * PAGE_SIZE;
+    pages_[i].ResetMemory();
     free_list_->push_back(&pages_[i]);
   }
 }
 
 /*
  * BufferPoolManager Deconstructor
- * WARNING: Do Not Edit This Function
  */
 BufferPoolManager::~BufferPoolManager() {
   delete[] pages_;
+  delete[] frames_;
+  delete[] verified_;
   delete page_table_;
   delete replacer_;
   delete free_list_;
@@ -45,12 +64,31 @@ BufferPoolManager::~BufferPoolManager() {
  * entry for the new page.
  * 4. Update page metadata, read page content from disk file and return page
  * pointer
+ * A page that fails its checksum is not cached and nullptr is returned
  */
 Page *BufferPoolManager::FetchPage(page_id_t page_id) 
 { 
+    if (read_only_)
+    {
+        if (page_id < 0 || page_id >= (page_id_t)pool_size_) return nullptr;
+        // no latch is taken, concurrent first fetches may both verify
+        if (!verified_[page_id].load(std::memory_order_acquire))
+        {
+            if (!disk_manager_->VerifyPage(page_id, pages_[page_id].GetData())) return nullptr;
+            verified_[page_id].store(true, std::memory_order_release);
+        }
+        pages_[page_id].pin_count_++;
+        return &pages_[page_id];
+    }
+    std::lock_guard<std::mutex> guard(latch_);
     Page* page=nullptr;
     page_table_->Find(page_id, page);
-    if (!page)
+    if (page)
+    {
+        // a pinned page must not be picked as victim
+        if (!page->pin_count_) replacer_->Erase(page);
+    }
+    else
     {
         if (free_list_->size())
         {
@@ -68,9 +106,18 @@ Page *BufferPoolManager::FetchPage(page_id_t page_id)
             page_table_->Remove(page->page_id_);
         }
         page->page_id_ = page_id;
+        page->is_dirty_ = false;
         //cout<<"PageId::"<<page_id<<endl;
         page_table_->Insert(page_id, page);
-        disk_manager_->ReadPage(page->page_id_, page->GetData());
+        if (!disk_manager_->ReadPage(page->page_id_, page->GetData()))
+        {
+            page_table_->Remove(page_id);
+            page->page_id_ = INVALID_PAGE_ID;
+            page->is_dirty_ = false;
+            page->ResetMemory();
+            free_list_->push_back(page);
+            return nullptr;
+        }
     }
     //disk_manager_->ReadPage(page->page_id_, page->GetData());
     page->pin_count_++;
@@ -84,6 +131,17 @@ Page *BufferPoolManager::FetchPage(page_id_t page_id)
  * dirty flag of this page
  */
 bool BufferPoolManager::UnpinPage(page_id_t page_id, bool is_dirty) {
+    if (read_only_)
+    {
+        if (page_id < 0 || page_id >= (page_id_t)pool_size_) return false;
+        int PinCount = pages_[page_id].pin_count_.load();
+        do
+        {
+            if (PinCount <= 0) return false;
+        } while (!pages_[page_id].pin_count_.compare_exchange_weak(PinCount, PinCount - 1));
+        return true;
+    }
+    std::lock_guard<std::mutex> guard(latch_);
     Page* Page = nullptr;
     page_table_->Find(page_id, Page);
     if (!Page || Page->pin_count_ <= 0)return false;
@@ -99,7 +157,17 @@ bool BufferPoolManager::UnpinPage(page_id_t page_id, bool is_dirty) {
  * if page is not found in page table, return false
  * NOTE: make sure page_id != INVALID_PAGE_ID
  */
-bool BufferPoolManager::FlushPage(page_id_t page_id) { return false; }
+bool BufferPoolManager::FlushPage(page_id_t page_id) 
+{
+    if (read_only_) return false;
+    std::lock_guard<std::mutex> guard(latch_);
+    Page* Page = nullptr;
+    page_table_->Find(page_id, Page);
+    if (!Page) return false;
+    disk_manager_->WritePage(page_id, Page->GetData());
+    Page->is_dirty_ = false;
+    return true;
+}
 
 /**
  * User should call this method for deleting a page. This routine will call
@@ -109,7 +177,25 @@ bool BufferPoolManager::FlushPage(page_id_t page_id) { return false; }
  * call disk manager's DeallocatePage() method to delete from disk file. If
  * the page is found within page table, but pin_count != 0, return false
  */
-bool BufferPoolManager::DeletePage(page_id_t page_id) { return false; }
+bool BufferPoolManager::DeletePage(page_id_t page_id) 
+{
+    if (read_only_) return false;
+    std::lock_guard<std::mutex> guard(latch_);
+    Page* page = nullptr;
+    page_table_->Find(page_id, page);
+    if (page)
+    {
+        if (page->pin_count_ > 0) return false;
+        replacer_->Erase(page);
+        page_table_->Remove(page_id);
+        page->page_id_ = INVALID_PAGE_ID;
+        page->is_dirty_ = false;
+        page->ResetMemory();
+        free_list_->push_back(page);
+    }
+    disk_manager_->DeallocatePage(page_id);
+    return true;
+}
 
 /**
  * User should call this method if needs to create a new page. This routine
@@ -118,11 +204,13 @@ bool BufferPoolManager::DeletePage(page_id_t page_id) { return false; }
  * from free list or lru replacer(NOTE: always choose from free list first),
  * update new page's metadata, zero out memory and add corresponding entry
  * into page table. return nullptr if all the pages in pool are pinned
+ * A page id already allocated on disk, e.g. out of an extent, is taken as is
  */
-Page *BufferPoolManager::NewPage(page_id_t &page_id) 
+Page *BufferPoolManager::NewPage(page_id_t &page_id, page_id_t allocated) 
 { 
+    if (read_only_) return nullptr;
+    std::lock_guard<std::mutex> guard(latch_);
     Page* page=nullptr;
-    page_id = disk_manager_->AllocatePage();
     if (free_list_->size())
     {
         page = *free_list_->begin();
@@ -138,10 +226,39 @@ Page *BufferPoolManager::NewPage(page_id_t &page_id)
         }
         page_table_->Remove(page->page_id_);
     }   
+    // only take a page id once a frame is available, the allocation is
+    // recorded on disk
+    page_id = allocated != INVALID_PAGE_ID ? allocated : disk_manager_->AllocatePage();
+    page->ResetMemory();
+    page->is_dirty_ = false;
     page->page_id_ = page_id;
     page->pin_count_++;
     page_table_->Insert(page_id, page);
     //replacer_->Insert(page);
     return page;
 }
+
+/**
+ * Hint the disk manager to read ahead the given pages, an ascending run of
+ * pages that are about to be fetched. Pages already in the pool are left out
+ */
+void BufferPoolManager::Prefetch(const std::vector<page_id_t> &page_ids)
+{
+    if (read_only_)
+    {
+        disk_manager_->Prefetch(page_ids);
+        return;
+    }
+    std::vector<page_id_t> missing;
+    {
+        std::lock_guard<std::mutex> guard(latch_);
+        for (page_id_t page_id : page_ids)
+        {
+            Page* page = nullptr;
+            page_table_->Find(page_id, page);
+            if (!page) missing.push_back(page_id);
+        }
+    }
+    if (missing.size()) disk_manager_->Prefetch(missing);
+}
 } // namespace scudb
@@ -0,0 +1,86 @@
+/**
+ * crc32c.cpp
+ */
+#include <cstring>
+
+#include "common/crc32c.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <nmmintrin.h>
+#define CRC32C_HAS_SSE42
+#endif
+
+namespace scudb {
+
+// reversed Castagnoli polynomial
+#define CRC32C_POLY 0x82F63B78
+
+/*
+ * Helper to fill the lookup table of the fallback, one entry per byte value
+ */
+static const uint32_t *GetTable() {
+  static uint32_t table[256];
+  static bool initialized = false;
+  if (!initialized) {
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t crc = i;
+      for (int bit = 0; bit < 8; bit++)
+        crc = (crc >> 1) ^ (crc & 1 ? CRC32C_POLY : 0);
+      table[i] = crc;
+    }
+    initialized = true;
+  }
+  return table;
+}
+
+static uint32_t ComputeTable(const char *data, size_t size) {
+  const uint32_t *table = GetTable();
+  uint32_t crc = ~0U;
+  for (size_t i = 0; i < size; i++)
+    crc = table[(crc ^ (uint8_t)data[i]) & 0xFF] ^ (crc >> 8);
+  return ~crc;
+}
+
+#ifdef CRC32C_HAS_SSE42
+__attribute__((target("sse4.2"))) static uint32_t
+ComputeHardware(const char *data, size_t size) {
+  uint64_t crc = ~0U;
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    uint64_t word;
+    memcpy(&word, data + i, 8);
+    crc = _mm_crc32_u64(crc, word);
+  }
+  uint32_t crc32 = crc;
+  for (; i < size; i++)
+    crc32 = _mm_crc32_u8(crc32, data[i]);
+  return ~crc32;
+}
+#endif
+
+/*
+ * Helper to pick the implementation on first use, the table is built up front
+ * so that Compute never races on it
+ */
+typedef uint32_t (*ComputeFunction)(const char *, size_t);
+static ComputeFunction SelectCompute() {
+#ifdef CRC32C_HAS_SSE42
+  if (__builtin_cpu_supports("sse4.2"))
+    return ComputeHardware;
+#endif
+  GetTable();
+  return ComputeTable;
+}
+
+static ComputeFunction GetCompute() {
+  static const ComputeFunction compute = SelectCompute();
+  return compute;
+}
+
+uint32_t CRC32C::Compute(const char *data, size_t size) {
+  return GetCompute()(data, size);
+}
+
+bool CRC32C::IsHardwareAccelerated() { return GetCompute() != ComputeTable; }
+
+} // namespace scudb
@@ -1,32 +1,77 @@
 /**
  * disk_manager.cpp
  */
+#include <algorithm>
 #include <assert.h>
 #include <cstring>
+#include <fcntl.h>
 #include <iostream>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <thread>
+#include <unistd.h>
 
+#include "common/crc32c.h"
 #include "common/logger.h"
 #include "disk/disk_manager.h"
+#include "disk/page_compressor.h"
 
 namespace scudb {
 
-static char *buffer_used = nullptr;
-
 /**
  * Constructor: open/create a single database file & log file
  * @input db_file: database file name
+ * @input read_only: map an existing database file read-only, no log file
+ * @input compressed: compress the pages of a new database file, an existing
+ * file keeps the format it was created with
  */
-DiskManager::DiskManager(const std::string &db_file)
-    : file_name_(db_file), next_page_id_(0), num_flushes_(0), flush_log_(false),
-      flush_log_f_(nullptr) {
+DiskManager::DiskManager(const std::string &db_file, bool read_only,
+                         bool compressed)
+    : log_fd_(-1), log_written_(0), log_synced_(0), log_syncing_(false),
+      num_log_syncs_(0), db_fd_(-1), file_name_(db_file), next_page_id_(0),
+      alloc_hint_(0), bitmap_dirty_(false),
+      num_flushes_(0), flush_log_(0), flush_log_f_(nullptr),
+      read_only_(read_only), mapped_data_(nullptr), mapped_size_(0),
+      compressed_(false), num_chunks_(0) {
   std::string::size_type n = file_name_.find(".");
   if (n == std::string::npos) {
     LOG_DEBUG("wrong file format");
     return;
   }
   log_name_ = file_name_.substr(0, n) + ".log";
+  map_name_ = file_name_.substr(0, n) + ".map";
+  compressed_ = GetFileSize(map_name_) >= 0 ||
+                (compressed && !read_only_ && GetFileSize(file_name_) <= 0);
+
+  if (read_only_ && compressed_) {
+    db_io_.open(db_file, std::ios::binary | std::ios::in);
+    map_io_.open(map_name_, std::ios::binary | std::ios::in);
+    LoadPageMap();
+    MapDecompressedFile();
+    LoadAllocationBitmap();
+    return;
+  }
+  if (read_only_) {
+    int fd = open(db_file.c_str(), O_RDONLY);
+    if (fd < 0) {
+      LOG_DEBUG("can't open db file");
+      return;
+    }
+    int file_size = GetFileSize(file_name_);
+    if (file_size > 0) {
+      void *data = mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0);
+      if (data == MAP_FAILED) {
+        LOG_DEBUG("can't map db file");
+      } else {
+        mapped_data_ = static_cast<char *>(data);
+        mapped_size_ = file_size;
+      }
+    }
+    // the mapping stays valid after the descriptor is closed
+    close(fd);
+    LoadAllocationBitmap();
+    return;
+  }
 
   log_io_.open(log_name_,
                std::ios::binary | std::ios::in | std::ios::app | std::ios::out);
@@ -41,6 +86,12 @@ DiskManager::DiskManager(const std::string &db_file)
     log_io_.open(log_name_, std::ios::binary | std::ios::in | std::ios::app |
                                 std::ios::out);
   }
+  log_fd_ = open(log_name_.c_str(), O_WRONLY);
+  if (log_fd_ < 0) {
+    LOG_DEBUG("can't open log file for sync");
+  }
+  // what is already in the log file made it to disk before
+  log_written_ = log_synced_ = std::max(GetFileSize(log_name_), 0);
 
   db_io_.open(db_file,
               std::ios::binary | std::ios::in | std::ios::out | std::ios::out);
@@ -53,21 +104,70 @@ DiskManager::DiskManager(const std::string &db_file)
     // reopen with original mode
     db_io_.open(db_file, std::ios::binary | std::ios::in | std::ios::out);
   }
+  db_fd_ = open(db_file.c_str(), O_RDONLY);
+  if (db_fd_ < 0) {
+    LOG_DEBUG("can't open db file for read ahead");
+  }
+  if (compressed_) {
+    map_io_.open(map_name_, std::ios::binary | std::ios::in | std::ios::out);
+    if (!map_io_.is_open()) {
+      map_io_.clear();
+      // create a new file
+      map_io_.open(map_name_, std::ios::binary | std::ios::trunc | std::ios::out);
+      map_io_.close();
+      // reopen with original mode
+      map_io_.open(map_name_, std::ios::binary | std::ios::in | std::ios::out);
+    }
+    LoadPageMap();
+  }
+  LoadAllocationBitmap();
 }
 
 DiskManager::~DiskManager() {
+  if (!read_only_)
+    FlushBitmapPages();
+  if (mapped_data_ != nullptr)
+    munmap(mapped_data_, mapped_size_);
+  if (log_fd_ >= 0)
+    close(log_fd_);
+  if (db_fd_ >= 0)
+    close(db_fd_);
   db_io_.close();
   log_io_.close();
+  map_io_.close();
 }
 
 /**
- * Write the contents of the specified page into disk file
+ * Write the contents of the specified page into disk file, together with the
+ * checksum of the page
  */
 void DiskManager::WritePage(page_id_t page_id, const char *page_data) {
+  if (read_only_) {
+    LOG_DEBUG("write to read-only db file");
+    return;
+  }
+  // the page may refer to pages allocated since, their bits go first
+  if (bitmap_dirty_)
+    FlushBitmapPages();
+  WritePageData(page_id, page_data);
+}
+
+/**
+ * Private helper function to write a page, see WritePage
+ */
+void DiskManager::WritePageData(page_id_t page_id, const char *page_data) {
+  char buffer[PAGE_SIZE];
+  memcpy(buffer, page_data, PAGE_CHECKSUM_OFFSET);
+  uint32_t checksum = CRC32C::Compute(buffer, PAGE_CHECKSUM_OFFSET);
+  memcpy(buffer + PAGE_CHECKSUM_OFFSET, &checksum, PAGE_CHECKSUM_SIZE);
+  if (compressed_) {
+    WriteCompressedPage(page_id, buffer);
+    return;
+  }
   size_t offset = page_id * PAGE_SIZE;
   // set write cursor to offset
   db_io_.seekp(offset);
-  db_io_.write(page_data, PAGE_SIZE);
+  db_io_.write(buffer, PAGE_SIZE);
   // check for I/O error
   if (db_io_.bad()) {
     LOG_DEBUG("I/O error while writing");
@@ -79,13 +179,27 @@ void DiskManager::WritePage(page_id_t page_id, const char *page_data) {
 
 /**
  * Read the contents of the specified page into the given memory area
+ * @return: false if the page can't be read or its checksum does not match
  */
-void DiskManager::ReadPage(page_id_t page_id, char *page_data) {
+bool DiskManager::ReadPage(page_id_t page_id, char *page_data) {
   int offset = page_id * PAGE_SIZE;
+  if (read_only_) {
+    if (page_id < 0 || page_id >= next_page_id_) {
+      LOG_DEBUG("I/O error while reading");
+      return false;
+    }
+    memcpy(page_data, GetMappedPage(page_id), PAGE_SIZE);
+    return VerifyPage(page_id, page_data);
+  }
+  if (compressed_) {
+    return ReadCompressedPage(page_id, page_data) &&
+           VerifyPage(page_id, page_data);
+  }
   // check if read beyond file length
   if (offset > GetFileSize(file_name_)) {
     LOG_DEBUG("I/O error while reading");
     // std::cerr << "I/O error while reading" << std::endl;
+    return false;
   } else {
     // set read cursor to offset
     db_io_.seekp(offset);
@@ -98,39 +212,60 @@ void DiskManager::ReadPage(page_id_t page_id, char *page_data) {
       memset(page_data + read_count, 0, PAGE_SIZE - read_count);
     }
   }
+  return VerifyPage(page_id, page_data);
+}
+
+/**
+ * Check the page content against the checksum stored with it
+ * @return: false if the page was torn or corrupted
+ */
+bool DiskManager::VerifyPage(page_id_t page_id, const char *page_data) {
+  uint32_t checksum;
+  memcpy(&checksum, page_data + PAGE_CHECKSUM_OFFSET, PAGE_CHECKSUM_SIZE);
+  if (checksum == CRC32C::Compute(page_data, PAGE_CHECKSUM_OFFSET))
+    return true;
+  // allocated but never written
+  if (checksum == 0 && page_data[0] == 0 &&
+      memcmp(page_data, page_data + 1, PAGE_CHECKSUM_OFFSET - 1) == 0)
+    return true;
+  LOG_DEBUG("checksum mismatch on page %d", page_id);
+  return false;
 }
 
 /**
  * Write the contents of the log into disk file
  * Only return when sync is done, and only perform sequence write
+ * Any number of threads may call it at once, each with a buffer of its own
  */
 void DiskManager::WriteLog(char *log_data, int size) {
-  // enforce swap log buffer
-  assert(log_data != buffer_used);
-  buffer_used = log_data;
-
   if (size == 0) // no effect on num_flushes_ if log buffer is empty
     return;
+  flush_log_++;
+  size_t log_end;
+  {
+    std::lock_guard<std::mutex> guard(log_latch_);
 
-  flush_log_ = true;
+    if (flush_log_f_ != nullptr)
+      // used for checking non-blocking flushing
+      assert(flush_log_f_->wait_for(std::chrono::seconds(10)) ==
+             std::future_status::ready);
 
-  if (flush_log_f_ != nullptr)
-    // used for checking non-blocking flushing
-    assert(flush_log_f_->wait_for(std::chrono::seconds(10)) ==
-           std::future_status::ready);
+    num_flushes_ += 1;
+    // sequence write
+    log_io_.write(log_data, size);
 
-  num_flushes_ += 1;
-  // sequence write
-  log_io_.write(log_data, size);
-
-  // check for I/O error
-  if (log_io_.bad()) {
-    LOG_DEBUG("I/O error while writing log");
-    return;
+    // check for I/O error
+    if (log_io_.bad()) {
+      LOG_DEBUG("I/O error while writing log");
+      flush_log_--;
+      return;
+    }
+    // hand the data to the kernel, SyncLog gets it onto the disk
+    log_io_.flush();
+    log_end = log_written_ += size;
   }
-  // needs to flush to keep disk file in sync
-  log_io_.flush();
-  flush_log_ = false;
+  SyncLog(log_end);
+  flush_log_--;
 }
 
 /**
@@ -139,6 +274,7 @@ void DiskManager::WriteLog(char *log_data, int size) {
  * @return: false means already reach the end
  */
 bool DiskManager::ReadLog(char *log_data, int size, int offset) {
+  std::lock_guard<std::mutex> guard(log_latch_);
   if (offset >= GetFileSize(log_name_)) {
     // LOG_DEBUG("end of log file");
     // LOG_DEBUG("file size is %d", GetFileSize(log_name_));
@@ -158,16 +294,150 @@ bool DiskManager::ReadLog(char *log_data, int size, int offset) {
 
 /**
  * Allocate new page (operations like create index/table)
- * For now just keep an increasing counter
+ * Hand out the lowest free page id according to the allocation bitmap, a new
+ * group of pages is added once every tracked page is in use
  */
-page_id_t DiskManager::AllocatePage() { return next_page_id_++; }
+page_id_t DiskManager::AllocatePage() {
+  if (read_only_)
+    return INVALID_PAGE_ID;
+  std::lock_guard<std::mutex> guard(alloc_latch_);
+  // skip the words in which every page is in use
+  while (alloc_hint_ < alloc_bitmap_.size() &&
+         alloc_bitmap_[alloc_hint_] == ~(uint64_t)0)
+    alloc_hint_++;
+  if (alloc_hint_ == alloc_bitmap_.size())
+    GrowAllocationBitmap();
+
+  page_id_t page_id =
+      alloc_hint_ * 64 + __builtin_ctzll(~alloc_bitmap_[alloc_hint_]);
+  SetAllocated(page_id, true);
+  dirty_groups_.insert(page_id / BITMAP_PAGE_CAPACITY);
+  bitmap_dirty_ = true;
+  if (page_id >= next_page_id_)
+    next_page_id_ = page_id + 1;
+  return page_id;
+}
+
+/**
+ * Allocate page_count contiguous pages (operations like bulk loading)
+ * @return: page id of the first page of the extent
+ */
+page_id_t DiskManager::AllocateExtent(int page_count) {
+  // a bitmap page splits every group, so longer runs never show up
+  assert(page_count > 0 && page_count <= BITMAP_PAGE_CAPACITY - 2);
+  if (read_only_)
+    return INVALID_PAGE_ID;
+  std::lock_guard<std::mutex> guard(alloc_latch_);
+  size_t cur = alloc_hint_ * 64;
+  page_id_t start = cur;
+  int run = 0;
+  while (run < page_count) {
+    if (cur / 64 == alloc_bitmap_.size())
+      GrowAllocationBitmap();
+    if (cur % 64 == 0 && alloc_bitmap_[cur / 64] == ~(uint64_t)0) {
+      run = 0;
+      cur += 64;
+      continue;
+    }
+    if (IsAllocated(cur))
+      run = 0;
+    else if (run++ == 0)
+      start = cur;
+    cur++;
+  }
+
+  for (page_id_t page_id = start; page_id < start + page_count; page_id++)
+    SetAllocated(page_id, true);
+  dirty_groups_.insert(start / BITMAP_PAGE_CAPACITY);
+  dirty_groups_.insert((start + page_count - 1) / BITMAP_PAGE_CAPACITY);
+  bitmap_dirty_ = true;
+  if (start + page_count > next_page_id_)
+    next_page_id_ = start + page_count;
+  return start;
+}
 
 /**
  * Deallocate page (operations like drop index/table)
- * Need bitmap in header page for tracking pages
+ * Clear the page's bit so that it can be handed out again, the header page and
+ * the bitmap pages are never released
  */
-void DiskManager::DeallocatePage(__attribute__((unused)) page_id_t page_id) {
-  return;
+void DiskManager::DeallocatePage(page_id_t page_id) {
+  std::lock_guard<std::mutex> guard(alloc_latch_);
+  if (read_only_ || page_id <= HEADER_PAGE_ID || page_id % BITMAP_PAGE_CAPACITY == 1 ||
+      (size_t)page_id >= alloc_bitmap_.size() * 64)
+    return;
+  SetAllocated(page_id, false);
+  alloc_hint_ = std::min(alloc_hint_, (size_t)page_id / 64);
+  dirty_groups_.insert(page_id / BITMAP_PAGE_CAPACITY);
+  bitmap_dirty_ = true;
+}
+
+/**
+ * Tell the kernel how the mapped file is going to be accessed, e.g. read ahead
+ * aggressively for sequential scans and not at all for random lookups.
+ * No effect unless the file is mapped
+ */
+void DiskManager::AdviseAccess(AccessPattern pattern) {
+  if (mapped_data_ == nullptr)
+    return;
+  int advice = MADV_NORMAL;
+  if (pattern == AccessPattern::SEQUENTIAL)
+    advice = MADV_SEQUENTIAL;
+  else if (pattern == AccessPattern::RANDOM)
+    advice = MADV_RANDOM;
+  if (madvise(mapped_data_, mapped_size_, advice) != 0) {
+    LOG_DEBUG("madvise failed");
+  }
+}
+
+/**
+ * Ask the kernel to start reading the given pages, so that later reads of
+ * them do not wait for the disk. Neighbouring pages are asked for in one go.
+ * Only a hint, nothing is read into the buffer pool
+ */
+void DiskManager::Prefetch(const std::vector<page_id_t> &page_ids) {
+  static const size_t system_page = sysconf(_SC_PAGESIZE);
+  auto advise = [this](size_t offset, size_t length) {
+    if (mapped_data_ != nullptr) {
+      size_t start = offset / system_page * system_page;
+      if (start < mapped_size_)
+        madvise(mapped_data_ + start,
+                std::min(offset + length, mapped_size_) - start, MADV_WILLNEED);
+    } else if (db_fd_ >= 0) {
+      posix_fadvise(db_fd_, offset, length, POSIX_FADV_WILLNEED);
+    }
+  };
+  if (compressed_ && mapped_data_ == nullptr) {
+    // the chunks of each page
+    std::lock_guard<std::mutex> guard(map_latch_);
+    for (page_id_t page_id : page_ids)
+      if (page_id >= 0 && (size_t)page_id < page_map_.size() &&
+          page_map_[page_id].size_ != 0)
+        advise((size_t)page_map_[page_id].chunk_offset_ * COMPRESSION_CHUNK_SIZE,
+               (size_t)page_map_[page_id].chunk_count_ * COMPRESSION_CHUNK_SIZE);
+    return;
+  }
+  for (size_t i = 0; i < page_ids.size();) {
+    size_t run = 1;
+    while (i + run < page_ids.size() &&
+           page_ids[i + run] == page_ids[i] + (page_id_t)run)
+      run++;
+    if (page_ids[i] >= 0)
+      advise((size_t)page_ids[i] * PAGE_SIZE, run * PAGE_SIZE);
+    i += run;
+  }
+}
+
+/**
+ * Returns the number of bytes of all pages divided by the number of bytes they
+ * take up on disk, 1 for a db file that is not compressed
+ */
+double DiskManager::GetCompressionRatio() {
+  std::lock_guard<std::mutex> guard(map_latch_);
+  if (!compressed_ || num_chunks_ == 0)
+    return 1;
+  return (double)page_map_.size() * PAGE_SIZE /
+         ((double)num_chunks_ * COMPRESSION_CHUNK_SIZE);
 }
 
 /**
@@ -176,9 +446,14 @@ void DiskManager::DeallocatePage(__attribute__((unused)) page_id_t page_id) {
 int DiskManager::GetNumFlushes() const { return num_flushes_; }
 
 /**
- * Returns true if the log is currently being flushed
+ * Returns number of log syncs made so far, a sync can cover several flushes
  */
-bool DiskManager::GetFlushState() const { return flush_log_; }
+int DiskManager::GetNumLogSyncs() const { return num_log_syncs_; }
+
+/**
+ * Returns true if the log is currently being flushed by any thread
+ */
+bool DiskManager::GetFlushState() const { return flush_log_ > 0; }
 
 /**
  * Private helper function to get disk file size
@@ -189,4 +464,299 @@ int DiskManager::GetFileSize(const std::string &file_name) {
   return rc == 0 ? stat_buf.st_size : -1;
 }
 
+/**
+ * Private helper function to wait until the log is on stable storage up to
+ * log_end. If no sync is running the caller syncs everything written so far,
+ * otherwise it waits for the running sync and checks again
+ */
+void DiskManager::SyncLog(size_t log_end) {
+  std::unique_lock<std::mutex> lock(sync_latch_);
+  while (log_synced_ < log_end) {
+    if (log_syncing_) {
+      sync_cv_.wait(lock);
+      continue;
+    }
+    log_syncing_ = true;
+    size_t target = log_written_;
+    lock.unlock();
+    bool synced = fdatasync(log_fd_) == 0;
+    lock.lock();
+    log_syncing_ = false;
+    if (synced) {
+      log_synced_ = std::max(log_synced_, target);
+      num_log_syncs_++;
+    }
+    sync_cv_.notify_all();
+    if (!synced) {
+      LOG_DEBUG("I/O error while syncing log");
+      return;
+    }
+  }
+}
+
+/**
+ * Private helper function to rebuild the in-memory allocation bitmap from the
+ * bitmap pages when the database file is opened
+ */
+void DiskManager::LoadAllocationBitmap() {
+  int file_size = GetFileSize(file_name_);
+  page_id_t num_pages =
+      file_size > 0 ? (file_size + PAGE_SIZE - 1) / PAGE_SIZE : 0;
+  if (compressed_)
+    num_pages = page_map_.size();
+  int num_groups =
+      (num_pages + BITMAP_PAGE_CAPACITY - 1) / BITMAP_PAGE_CAPACITY;
+  alloc_bitmap_.assign(num_groups * (BITMAP_PAGE_CAPACITY / 64), 0);
+  alloc_hint_ = 0;
+  next_page_id_ = num_pages;
+
+  char page_data[PAGE_SIZE];
+  for (int group = 0; group < num_groups; group++) {
+    // a torn bitmap page marks its whole group as used, so that no page can
+    // be handed out twice
+    if (ReadPage(group * BITMAP_PAGE_CAPACITY + 1, page_data))
+      memcpy(&alloc_bitmap_[group * (BITMAP_PAGE_CAPACITY / 64)],
+             page_data + BITMAP_PAGE_HEADER_SIZE, BITMAP_PAGE_CAPACITY / 8);
+    else
+      memset(&alloc_bitmap_[group * (BITMAP_PAGE_CAPACITY / 64)], 0xFF,
+             BITMAP_PAGE_CAPACITY / 8);
+    SetAllocated(group * BITMAP_PAGE_CAPACITY + 1, true);
+  }
+}
+
+/**
+ * Private helper function to start tracking one more group of pages, its
+ * bitmap page is written before any page of the group
+ */
+void DiskManager::GrowAllocationBitmap() {
+  int group = alloc_bitmap_.size() / (BITMAP_PAGE_CAPACITY / 64);
+  alloc_bitmap_.resize(alloc_bitmap_.size() + BITMAP_PAGE_CAPACITY / 64, 0);
+  SetAllocated(group * BITMAP_PAGE_CAPACITY + 1, true);
+  dirty_groups_.insert(group);
+  bitmap_dirty_ = true;
+}
+
+/**
+ * Private helper function to write the bitmap page of a group back to disk
+ */
+void DiskManager::WriteBitmapPage(int group) {
+  char page_data[PAGE_SIZE];
+  page_id_t page_id = group * BITMAP_PAGE_CAPACITY + 1;
+  lsn_t lsn = INVALID_LSN;
+  memcpy(page_data, &page_id, 4);
+  memcpy(page_data + 4, &lsn, 4);
+  memcpy(page_data + BITMAP_PAGE_HEADER_SIZE,
+         &alloc_bitmap_[group * (BITMAP_PAGE_CAPACITY / 64)],
+         BITMAP_PAGE_CAPACITY / 8);
+  WritePageData(page_id, page_data);
+}
+
+/**
+ * Private helper function to write the bitmap pages of all groups that
+ * changed since they were last written
+ */
+void DiskManager::FlushBitmapPages() {
+  std::lock_guard<std::mutex> guard(alloc_latch_);
+  for (int group : dirty_groups_)
+    WriteBitmapPage(group);
+  dirty_groups_.clear();
+  bitmap_dirty_ = false;
+}
+
+/**
+ * Private helper function to read the page map of a compressed db file, the
+ * free runs of chunks are whatever the page map does not cover
+ */
+void DiskManager::LoadPageMap() {
+  int map_size = GetFileSize(map_name_);
+  page_map_.assign(map_size > 0 ? map_size / sizeof(PageMapEntry) : 0,
+                   PageMapEntry{0, 0, 0});
+  if (!page_map_.empty()) {
+    map_io_.seekp(0);
+    map_io_.read(reinterpret_cast<char *>(page_map_.data()),
+                 page_map_.size() * sizeof(PageMapEntry));
+  }
+
+  std::vector<std::pair<uint32_t, uint32_t>> used;
+  for (auto &entry : page_map_)
+    if (entry.chunk_count_ > 0)
+      used.emplace_back(entry.chunk_offset_, entry.chunk_count_);
+  std::sort(used.begin(), used.end());
+  free_runs_.clear();
+  free_runs_by_length_.clear();
+  num_chunks_ = 0;
+  for (auto &run : used) {
+    uint32_t gap = num_chunks_;
+    num_chunks_ = std::max(num_chunks_, run.first + run.second);
+    if (run.first > gap)
+      FreeChunks(gap, run.first - gap);
+  }
+}
+
+/**
+ * Private helper function to decompress every page of a read-only compressed
+ * db file into an anonymous mapping, so that pages can be served from memory
+ * like those of a plain db file
+ */
+void DiskManager::MapDecompressedFile() {
+  size_t size = page_map_.size() * PAGE_SIZE;
+  if (size == 0)
+    return;
+  void *data = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (data == MAP_FAILED) {
+    LOG_DEBUG("can't map db file");
+    return;
+  }
+  mapped_data_ = static_cast<char *>(data);
+  mapped_size_ = size;
+  // checksums are verified when the buffer pool hands the pages out
+  for (page_id_t page_id = 0; page_id < (page_id_t)page_map_.size(); page_id++)
+    ReadCompressedPage(page_id, GetMappedPage(page_id));
+  mprotect(mapped_data_, mapped_size_, PROT_READ);
+}
+
+/**
+ * Private helper function to compress a page and write it to a new run of
+ * chunks. The page map entry is switched over once the new run is written, and
+ * the old run is released after that, so a crash leaves the entry on disk
+ * pointing at either complete copy of the page
+ */
+void DiskManager::WriteCompressedPage(page_id_t page_id,
+                                      const char *page_data) {
+  char buffer[PAGE_SIZE];
+  // a page that does not save at least a chunk is stored as is
+  int size = PageCompressor::Compress(page_data, PAGE_SIZE, buffer,
+                                      PAGE_SIZE - COMPRESSION_CHUNK_SIZE);
+  const char *stored = buffer;
+  if (size == 0) {
+    size = PAGE_SIZE;
+    stored = page_data;
+  }
+  int chunk_count = (size + COMPRESSION_CHUNK_SIZE - 1) / COMPRESSION_CHUNK_SIZE;
+
+  std::lock_guard<std::mutex> guard(map_latch_);
+  if ((size_t)page_id >= page_map_.size())
+    page_map_.resize(page_id + 1, PageMapEntry{0, 0, 0});
+  PageMapEntry entry;
+  entry.chunk_offset_ = AllocateChunks(chunk_count);
+  entry.size_ = size;
+  entry.chunk_count_ = chunk_count;
+
+  db_io_.seekp((size_t)entry.chunk_offset_ * COMPRESSION_CHUNK_SIZE);
+  db_io_.write(stored, size);
+  if (db_io_.bad()) {
+    LOG_DEBUG("I/O error while writing");
+    FreeChunks(entry.chunk_offset_, chunk_count);
+    return;
+  }
+  db_io_.flush();
+  map_io_.seekp((size_t)page_id * sizeof(PageMapEntry));
+  map_io_.write(reinterpret_cast<const char *>(&entry), sizeof(PageMapEntry));
+  if (map_io_.bad()) {
+    LOG_DEBUG("I/O error while writing page map");
+    FreeChunks(entry.chunk_offset_, chunk_count);
+    return;
+  }
+  map_io_.flush();
+
+  // release the old chunks only once nothing points to them any more
+  PageMapEntry &old_entry = page_map_[page_id];
+  if (old_entry.chunk_count_ > 0)
+    FreeChunks(old_entry.chunk_offset_, old_entry.chunk_count_);
+  old_entry = entry;
+}
+
+/**
+ * Private helper function to read a page from its chunks and decompress it, a
+ * page that was never written reads as zeros
+ * @return: false if the page can't be read or decompressed
+ */
+bool DiskManager::ReadCompressedPage(page_id_t page_id, char *page_data) {
+  PageMapEntry entry{0, 0, 0};
+  {
+    std::lock_guard<std::mutex> guard(map_latch_);
+    if (page_id >= 0 && (size_t)page_id < page_map_.size())
+      entry = page_map_[page_id];
+  }
+  if (entry.size_ == 0) {
+    memset(page_data, 0, PAGE_SIZE);
+    return true;
+  }
+
+  char buffer[PAGE_SIZE];
+  db_io_.seekp((size_t)entry.chunk_offset_ * COMPRESSION_CHUNK_SIZE);
+  db_io_.read(buffer, entry.size_);
+  if (db_io_.gcount() < entry.size_) {
+    LOG_DEBUG("I/O error while reading");
+    db_io_.clear();
+    memset(page_data, 0, PAGE_SIZE);
+    return false;
+  }
+  if (entry.size_ == PAGE_SIZE) {
+    memcpy(page_data, buffer, PAGE_SIZE);
+  } else if (PageCompressor::Decompress(buffer, entry.size_, page_data,
+                                        PAGE_SIZE) != PAGE_SIZE) {
+    LOG_DEBUG("corrupted compressed page");
+    memset(page_data, 0, PAGE_SIZE);
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Private helper function to find a run of chunk_count free chunks, the
+ * smallest free run that is long enough is split, the file grows if there is
+ * none
+ * @return: offset of the first chunk
+ */
+uint32_t DiskManager::AllocateChunks(int chunk_count) {
+  auto fit = free_runs_by_length_.lower_bound(
+      std::make_pair((uint32_t)chunk_count, (uint32_t)0));
+  if (fit == free_runs_by_length_.end()) {
+    uint32_t chunk_offset = num_chunks_;
+    num_chunks_ += chunk_count;
+    return chunk_offset;
+  }
+  uint32_t run_count = fit->first, chunk_offset = fit->second;
+  free_runs_by_length_.erase(fit);
+  free_runs_.erase(chunk_offset);
+  if (run_count > (uint32_t)chunk_count) {
+    free_runs_[chunk_offset + chunk_count] = run_count - chunk_count;
+    free_runs_by_length_.emplace(run_count - chunk_count,
+                                 chunk_offset + chunk_count);
+  }
+  return chunk_offset;
+}
+
+/**
+ * Private helper function to give back a run of chunks, it is merged with the
+ * free runs right before and after it. A run that reaches the end of the file
+ * is dropped, the file ends before it from then on
+ */
+void DiskManager::FreeChunks(uint32_t chunk_offset, int chunk_count) {
+  if (chunk_count <= 0)
+    return;
+  uint32_t run_end = chunk_offset + chunk_count;
+  auto next = free_runs_.find(run_end);
+  if (next != free_runs_.end()) {
+    run_end += next->second;
+    free_runs_by_length_.erase(std::make_pair(next->second, next->first));
+    free_runs_.erase(next);
+  }
+  auto prev = free_runs_.lower_bound(chunk_offset);
+  if (prev != free_runs_.begin() &&
+      (--prev)->first + prev->second == chunk_offset) {
+    chunk_offset = prev->first;
+    free_runs_by_length_.erase(std::make_pair(prev->second, prev->first));
+    free_runs_.erase(prev);
+  }
+  if (run_end >= num_chunks_) {
+    num_chunks_ = chunk_offset;
+    return;
+  }
+  free_runs_[chunk_offset] = run_end - chunk_offset;
+  free_runs_by_length_.emplace(run_end - chunk_offset, chunk_offset);
+}
+
 } // namespace scudb
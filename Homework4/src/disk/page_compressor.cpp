@@ -0,0 +1,158 @@
+/**
+ * page_compressor.cpp
+ */
+#include <cassert>
+#include <cstring>
+
+#include "disk/page_compressor.h"
+
+namespace scudb {
+
+#define MIN_MATCH 4
+#define HASH_BITS 10
+
+static inline uint32_t Read32(const char *p) {
+  uint32_t value;
+  memcpy(&value, p, 4);
+  return value;
+}
+
+static inline uint32_t Hash(uint32_t sequence) {
+  return (sequence * 2654435761U) >> (32 - HASH_BITS);
+}
+
+/*
+ * Helper to write the extra bytes of a length that did not fit into its
+ * token nibble
+ * @return: false if dst runs out of space
+ */
+static inline bool WriteLength(int length, char *dst, int &pos, int capacity) {
+  for (length -= 15; length >= 255; length -= 255) {
+    if (pos >= capacity)
+      return false;
+    dst[pos++] = (char)255;
+  }
+  if (pos >= capacity)
+    return false;
+  dst[pos++] = (char)length;
+  return true;
+}
+
+/*
+ * Helper to read the extra bytes of a length
+ * @return: false if src ends early
+ */
+static inline bool ReadLength(int &length, const char *src, int &pos,
+                              int size) {
+  uint8_t byte;
+  do {
+    if (pos >= size)
+      return false;
+    byte = (uint8_t)src[pos++];
+    length += byte;
+  } while (byte == 255);
+  return true;
+}
+
+/*
+ * Helper to write one sequence, match_length == 0 marks the last sequence
+ * @return: false if dst runs out of space
+ */
+static bool WriteSequence(const char *literals, int literal_length,
+                          int offset, int match_length, char *dst, int &pos,
+                          int capacity) {
+  if (pos >= capacity)
+    return false;
+  int match_code = match_length == 0 ? 0 : match_length - MIN_MATCH;
+  int token = pos++;
+  dst[token] = (char)(((literal_length < 15 ? literal_length : 15) << 4) |
+                      (match_code < 15 ? match_code : 15));
+  if (literal_length >= 15 && !WriteLength(literal_length, dst, pos, capacity))
+    return false;
+  if (pos + literal_length > capacity)
+    return false;
+  memcpy(dst + pos, literals, literal_length);
+  pos += literal_length;
+  if (match_length == 0)
+    return true;
+
+  if (pos + 2 > capacity)
+    return false;
+  dst[pos++] = (char)(offset & 0xFF);
+  dst[pos++] = (char)(offset >> 8);
+  if (match_code >= 15 && !WriteLength(match_code, dst, pos, capacity))
+    return false;
+  return true;
+}
+
+int PageCompressor::Compress(const char *src, int size, char *dst,
+                             int capacity) {
+  // offsets are stored in 2 bytes
+  assert(size <= 0xFFFF);
+  // position + 1 of the last sequence with the same hash, 0 means none
+  uint16_t table[1 << HASH_BITS];
+  memset(table, 0, sizeof(table));
+
+  int pos = 0;
+  int anchor = 0;
+  int out = 0;
+  while (pos + MIN_MATCH <= size) {
+    uint32_t sequence = Read32(src + pos);
+    uint32_t hash = Hash(sequence);
+    int candidate = table[hash] - 1;
+    table[hash] = pos + 1;
+    if (candidate < 0 || Read32(src + candidate) != sequence) {
+      pos++;
+      continue;
+    }
+    int match_length = MIN_MATCH;
+    while (pos + match_length < size &&
+           src[candidate + match_length] == src[pos + match_length])
+      match_length++;
+    if (!WriteSequence(src + anchor, pos - anchor, pos - candidate,
+                       match_length, dst, out, capacity))
+      return 0;
+    pos += match_length;
+    anchor = pos;
+  }
+  if (!WriteSequence(src + anchor, size - anchor, 0, 0, dst, out, capacity))
+    return 0;
+  return out;
+}
+
+int PageCompressor::Decompress(const char *src, int size, char *dst,
+                               int capacity) {
+  int pos = 0;
+  int out = 0;
+  while (pos < size) {
+    uint8_t token = (uint8_t)src[pos++];
+    int literal_length = token >> 4;
+    if (literal_length == 15 && !ReadLength(literal_length, src, pos, size))
+      return -1;
+    if (pos + literal_length > size || out + literal_length > capacity)
+      return -1;
+    memcpy(dst + out, src + pos, literal_length);
+    pos += literal_length;
+    out += literal_length;
+    // the last sequence has no match
+    if (pos == size)
+      break;
+
+    if (pos + 2 > size)
+      return -1;
+    int offset = (uint8_t)src[pos] | ((uint8_t)src[pos + 1] << 8);
+    pos += 2;
+    int match_length = token & 0xF;
+    if (match_length == 15 && !ReadLength(match_length, src, pos, size))
+      return -1;
+    match_length += MIN_MATCH;
+    if (offset == 0 || offset > out || out + match_length > capacity)
+      return -1;
+    // byte by byte, the match may overlap with its own output
+    for (int i = 0; i < match_length; i++, out++)
+      dst[out] = dst[out - offset];
+  }
+  return out;
+}
+
+} // namespace scudb
@@ -4,11 +4,15 @@
  * Functionality: The simplified Buffer Manager interface allows a client to
  * new/delete pages on disk, to read a disk page into the buffer pool and pin
  * it, also to unpin a page in the buffer pool.
+ * If the disk manager opened its file read-only, pages are served straight
+ * out of the mapped file: no frame copy, no page table and no replacer.
  */
 
 #pragma once
+#include <atomic>
 #include <list>
 #include <mutex>
+#include <vector>
 
 #include "buffer/lru_replacer.h"
 #include "disk/disk_manager.h"
@@ -30,15 +34,28 @@ public:
 
   bool FlushPage(page_id_t page_id);
 
-  Page *NewPage(page_id_t &page_id);
+  Page *NewPage(page_id_t &page_id, page_id_t allocated = INVALID_PAGE_ID);
+
+  inline page_id_t AllocateExtent(int page_count) {
+    return disk_manager_->AllocateExtent(page_count);
+  }
 
   bool DeletePage(page_id_t page_id);
 
+  inline void AdviseAccess(AccessPattern pattern) {
+    disk_manager_->AdviseAccess(pattern);
+  }
+
+  void Prefetch(const std::vector<page_id_t> &page_ids);
+
 private:
   size_t pool_size_; // number of pages in buffer pool
   Page *pages_;      // array of pages
   DiskManager *disk_manager_;
   LogManager *log_manager_;
+  char *frames_;   // memory of all the pages, nullptr when read-only
+  bool read_only_; // pages point into the mapped db file
+  std::atomic<bool> *verified_; // checksum ok, per page of the mapped file
   HashTable<page_id_t, Page *> *page_table_; // to keep track of pages
   Replacer<Page *> *replacer_;   // to find an unpinned page for replacement
   std::list<Page *> *free_list_; // to find a free page for replacement
@@ -20,11 +20,35 @@ extern std::atomic<bool> ENABLE_LOGGING;
 #define INVALID_TXN_ID -1  // representing an invalid txn id
 #define INVALID_LSN -1     // representing an invalid lsn
 #define HEADER_PAGE_ID 0   // the header page id
+#define DB_FILE_MAGIC 0x42445553 // "SUDB", starts the header page
+#define DB_FORMAT_VERSION 1 // bumped whenever the db file layout changes
 #define PAGE_SIZE 512     // size of a data page in byte
 #define LOG_BUFFER_SIZE                                                            \
   ((BUFFER_POOL_SIZE + 1) * PAGE_SIZE) // size of a log buffer in byte
 #define BUCKET_SIZE 50                 // size of extendible hash bucket
 #define BUFFER_POOL_SIZE 10            // size of buffer pool
+#define BITMAP_PAGE_HEADER_SIZE 8 // page id + lsn, same as other pages
+#define PAGE_CHECKSUM_SIZE 4 // crc32c at the end of every page
+#define PAGE_CHECKSUM_OFFSET                                                       \
+  (PAGE_SIZE - PAGE_CHECKSUM_SIZE) // end of the page content
+#define BITMAP_PAGE_CAPACITY                                                       \
+  ((PAGE_CHECKSUM_OFFSET - BITMAP_PAGE_HEADER_SIZE) / 8 *                          \
+   64) // pages tracked by a bitmap page, whole 64 bit words
+#define COMPRESSION_CHUNK_SIZE 32 // storage unit of compressed pages
+#define OPTIMISTIC_RESTART_LIMIT 4 // optimistic b+ tree descents before latching
+#define BULK_LOAD_FILL_FACTOR 0.9 // how full bulk loaded b+ tree pages are
+#define BULK_LOAD_RUN_SIZE 65536  // index entries sorted in memory per run
+#define BULK_LOAD_EXTENT_SIZE 32  // contiguous pages bulk loading takes at once
+#define ESTIMATED_TABLE_ROWS 1000000 // table size assumed by query planning
+#define INDEX_SCAN_BATCH_SIZE 64 // entries an index scan reads per descent
+#define INDEX_INSERT_BATCH_SIZE 1024 // index entries a table collects to insert
+#define INDEX_NORMALIZED_KEYS true // index pages hold memcmp ordered keys
+#define B_EPSILON_TREE_FANOUT 6 // most children of a b-epsilon tree internal page
+#define INDEX_STATS_SAMPLE_SIZE 64 // random descents behind index statistics
+#define INDEX_HISTOGRAM_BUCKETS 16 // parts the key histogram of an index has
+#define HEAP_ORDER_MIN_ROWS 64 // estimated matches for fetching rows page by page
+#define PREFETCH_DISTANCE 16 // pages a page ordered scan asks to read ahead
+#define VARIABLE_KEY_MIN_SIZE 16 // narrower index keys take fixed size entries
 
 typedef int32_t page_id_t; // page id type
 typedef int32_t txn_id_t;  // transaction id type
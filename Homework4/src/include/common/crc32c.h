@@ -0,0 +1,24 @@
+/**
+ * crc32c.h
+ *
+ * CRC-32C (Castagnoli) checksum, computed with the SSE4.2 crc32 instruction
+ * when the cpu has it and with a lookup table otherwise.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace scudb {
+
+class CRC32C {
+public:
+  // checksum of size bytes of data
+  static uint32_t Compute(const char *data, size_t size);
+
+  // true if Compute runs on the crc32 instruction
+  static bool IsHardwareAccelerated();
+};
+
+} // namespace scudb
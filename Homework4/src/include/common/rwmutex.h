@@ -47,6 +47,15 @@ public:
     reader_count_++;
   }
 
+  // take a read lock only if that does not need to wait
+  bool TryRLock() {
+    std::lock_guard<mutex_t> guard(mutex_);
+    if (writer_entered_ || reader_count_ == max_readers_)
+      return false;
+    reader_count_++;
+    return true;
+  }
+
   void RUnlock() {
     std::lock_guard<mutex_t> guard(mutex_);
     reader_count_--;
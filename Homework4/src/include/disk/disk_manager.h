@@ -5,49 +5,180 @@
  * database. It also performs read and write of pages to and from disk, and
  * provides a logical file layer within the context of a database management
  * system.
+ *
+ * Page allocation is tracked by bitmap pages stored inside the database file.
+ * Pages are grouped into runs of BITMAP_PAGE_CAPACITY pages and the second
+ * page of every group (page_id = group * BITMAP_PAGE_CAPACITY + 1) holds one
+ * bit per page of that group, set when the page is in use. The bitmap page
+ * itself is always marked as used, and page 0 stays the header page. All
+ * bitmap pages are read into memory when the file is opened. Changed bitmap
+ * pages are written in one go before the next page write, so a page on disk
+ * never refers to a page that is free on disk. Page 1 used to be an ordinary
+ * page, database files written before bitmap pages are told apart by the
+ * format version in their header page (see page/header_page.h).
+ *
+ * Bitmap page format (size in byte):
+ *  ----------------------------------------------------------
+ * | PageId (4) | LSN (4) | Bits for the pages of the group ... |
+ *  ----------------------------------------------------------
+ *
+ * Every page is stamped with a CRC-32C of its content in its last
+ * PAGE_CHECKSUM_SIZE bytes when it is written, and the checksum is verified
+ * when it is read back, so that a page torn by a crash is caught instead of
+ * being used. A page of zeros counts as valid, it was never written.
+ *
+ * WriteLog only returns once the log data is on stable storage. Writers that
+ * show up while a sync is running wait for it to finish, then one of them
+ * syncs the log for all of them at once (group commit).
+ *
+ * A database file can also be opened read-only, e.g. for an analytic copy of
+ * the database. The whole file is then mapped into memory and the buffer pool
+ * serves pages straight out of the mapping.
+ *
+ * A new database file can be created compressed. Every page is then compressed
+ * on its own with PageCompressor and stored in a run of COMPRESSION_CHUNK_SIZE
+ * byte chunks of the db file. The page map file (<db>.map) holds one entry per
+ * page id, its presence marks the db file as compressed:
+ *  ----------------------------------------------------
+ * | ChunkOffset (4) | StoredSize (2) | ChunkCount (2) |
+ *  ----------------------------------------------------
+ * StoredSize is PAGE_SIZE for a page that did not compress and is stored as
+ * is, and 0 for a page that was never written. A compressed file opened
+ * read-only is decompressed into an anonymous mapping.
  */
 
 #pragma once
 #include <atomic>
+#include <condition_variable>
 #include <fstream>
 #include <future>
+#include <map>
+#include <mutex>
+#include <set>
 #include <string>
+#include <vector>
 
 #include "common/config.h"
 
 namespace scudb {
 
+// expected access pattern of the mapped file, see madvise(2)
+enum class AccessPattern { NORMAL = 0, SEQUENTIAL, RANDOM };
+
 class DiskManager {
 public:
-  DiskManager(const std::string &db_file);
+  DiskManager(const std::string &db_file, bool read_only = false,
+              bool compressed = false);
   ~DiskManager();
 
   void WritePage(page_id_t page_id, const char *page_data);
-  void ReadPage(page_id_t page_id, char *page_data);
+  bool ReadPage(page_id_t page_id, char *page_data);
+  bool VerifyPage(page_id_t page_id, const char *page_data);
 
   void WriteLog(char *log_data, int size);
   bool ReadLog(char *log_data, int size, int offset);
 
   page_id_t AllocatePage();
+  page_id_t AllocateExtent(int page_count);
   void DeallocatePage(page_id_t page_id);
 
+  // read-only mapped mode
+  inline bool IsReadOnly() const { return read_only_; }
+  inline page_id_t GetNumPages() const { return next_page_id_; }
+  inline char *GetMappedPage(page_id_t page_id) {
+    return mapped_data_ + (size_t)page_id * PAGE_SIZE;
+  }
+  void AdviseAccess(AccessPattern pattern);
+  void Prefetch(const std::vector<page_id_t> &page_ids);
+
+  // compressed mode
+  inline bool IsCompressed() const { return compressed_; }
+  double GetCompressionRatio();
+
   int GetNumFlushes() const;
+  int GetNumLogSyncs() const;
   bool GetFlushState() const;
   inline void SetFlushLogFuture(std::future<void> *f) { flush_log_f_ = f; }
   inline bool HasFlushLogFuture() { return flush_log_f_ != nullptr; }
 
 private:
   int GetFileSize(const std::string &name);
+  void SyncLog(size_t log_end);
+  // allocation bitmap helpers
+  void LoadAllocationBitmap();
+  void GrowAllocationBitmap();
+  void WriteBitmapPage(int group);
+  void FlushBitmapPages();
+  void WritePageData(page_id_t page_id, const char *page_data);
+  inline bool IsAllocated(page_id_t page_id) const {
+    return (alloc_bitmap_[page_id / 64] >> (page_id % 64)) & 1;
+  }
+  inline void SetAllocated(page_id_t page_id, bool allocated) {
+    if (allocated)
+      alloc_bitmap_[page_id / 64] |= (uint64_t)1 << (page_id % 64);
+    else
+      alloc_bitmap_[page_id / 64] &= ~((uint64_t)1 << (page_id % 64));
+  }
+  // compressed mode helpers
+  void LoadPageMap();
+  void MapDecompressedFile();
+  void WriteCompressedPage(page_id_t page_id, const char *page_data);
+  bool ReadCompressedPage(page_id_t page_id, char *page_data);
+  uint32_t AllocateChunks(int chunk_count);
+  void FreeChunks(uint32_t chunk_offset, int chunk_count);
   // stream to write log file
   std::fstream log_io_;
   std::string log_name_;
+  // descriptor of the log file for fdatasync
+  int log_fd_;
+  std::mutex log_latch_;
+  // bytes handed to the kernel / known to be on stable storage
+  std::atomic<size_t> log_written_;
+  size_t log_synced_;
+  bool log_syncing_;
+  int num_log_syncs_;
+  std::mutex sync_latch_;
+  std::condition_variable sync_cv_;
   // stream to write db file
   std::fstream db_io_;
+  // descriptor of the db file for read ahead hints
+  int db_fd_;
   std::string file_name_;
+  // one past the largest page id ever handed out
   std::atomic<page_id_t> next_page_id_;
-  int num_flushes_;
-  bool flush_log_;
+  // in-memory copy of all bitmap pages, one bit per page
+  std::vector<uint64_t> alloc_bitmap_;
+  // no word below this index has a free bit
+  size_t alloc_hint_;
+  // groups whose bitmap page is not written since they changed
+  std::set<int> dirty_groups_;
+  std::atomic<bool> bitmap_dirty_;
+  std::mutex alloc_latch_;
+  std::atomic<int> num_flushes_;
+  // number of threads inside WriteLog
+  std::atomic<int> flush_log_;
   std::future<void> *flush_log_f_;
+  // read-only mapping of the whole db file
+  bool read_only_;
+  char *mapped_data_;
+  size_t mapped_size_;
+  // page map of a compressed db file, see above
+  struct PageMapEntry {
+    uint32_t chunk_offset_;
+    uint16_t size_;
+    uint16_t chunk_count_;
+  };
+  bool compressed_;
+  std::fstream map_io_;
+  std::string map_name_;
+  std::vector<PageMapEntry> page_map_;
+  // free runs of chunks, by chunk offset and by (length, chunk offset). runs
+  // next to each other are merged, there is none at the end of the file
+  std::map<uint32_t, uint32_t> free_runs_;
+  std::set<std::pair<uint32_t, uint32_t>> free_runs_by_length_;
+  // one past the last chunk in use
+  uint32_t num_chunks_;
+  std::mutex map_latch_;
 };
 
 } // namespace scudb
\ No newline at end of file
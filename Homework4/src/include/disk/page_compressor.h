@@ -0,0 +1,33 @@
+/**
+ * page_compressor.h
+ *
+ * Small LZ77 style codec used by the disk manager to compress pages.
+ *
+ * Compressed format is a list of sequences, each sequence is
+ *  -------------------------------------------------------------------------
+ * | Token (1) | LiteralLength+ | Literals | Offset (2) | MatchLength+ |
+ *  -------------------------------------------------------------------------
+ * The high 4 bits of the token hold the literal length and the low 4 bits the
+ * match length minus 4. A value of 15 is continued by extra length bytes,
+ * added up until a byte is not 255. The offset counts back from the current
+ * output position. The last sequence only has literals.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+namespace scudb {
+
+class PageCompressor {
+public:
+  // compress size bytes of src into dst
+  // @return: compressed size, 0 if the result does not fit into capacity
+  static int Compress(const char *src, int size, char *dst, int capacity);
+
+  // decompress size bytes of src into dst
+  // @return: decompressed size, -1 if src is malformed or dst is too small
+  static int Decompress(const char *src, int size, char *dst, int capacity);
+};
+
+} // namespace scudb
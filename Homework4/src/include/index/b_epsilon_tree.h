@@ -0,0 +1,164 @@
+/**
+ * b_epsilon_tree.h
+ *
+ * Write optimized alternative to the b+ tree, a b-epsilon tree. Internal
+ * pages have at most B_EPSILON_TREE_FANOUT children and use the rest of the
+ * page to buffer messages, inserts and deletes of entries on their way to a
+ * leaf. Messages go into the root. A page whose buffer runs over moves the
+ * messages for the child that has the most of them down in one batch, so a
+ * leaf is read and written once for many changes instead of once per change.
+ *
+ * (1) Entries are unique by key, or by key and value in a non-unique tree,
+ *     which keeps an entry per value instead of a posting list.
+ * (2) Inserts and deletes are blind, whether the entry was there shows once
+ *     the message is applied at its leaf. An insert of a key a unique tree
+ *     has already is dropped then, like BPlusTree::Insert does.
+ * (3) Readers take along the messages they find on the way down and apply
+ *     them to the leaves they reach. Messages further down are older.
+ * (4) Pages are split but never merged, a leaf emptied by deletes stays in
+ *     the tree until inserts fill it again.
+ * (5) Writers take the tree latch exclusively, readers shared. A reader
+ *     keeps no page pinned, iterators read a batch of entries per descent.
+ */
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "common/rwmutex.h"
+#include "concurrency/transaction.h"
+#include "page/b_epsilon_tree_page.h"
+
+namespace scudb {
+
+#define BEPSILONTREE_TYPE BEpsilonTree<KeyType, ValueType, KeyComparator>
+#define BEPSILONTREE_ITERATOR_TYPE                                             \
+  BEpsilonTreeIterator<KeyType, ValueType, KeyComparator>
+
+INDEX_TEMPLATE_ARGUMENTS
+class BEpsilonTree;
+
+/*
+ * Iterator over a b-epsilon tree, used like IndexIterator. It reads
+ * INDEX_SCAN_BATCH_SIZE entries at a time and resumes after the last one, so
+ * it holds neither pages nor latches.
+ */
+INDEX_TEMPLATE_ARGUMENTS
+class BEpsilonTreeIterator {
+public:
+  // from key, or from the first entry if key is nullptr
+  BEpsilonTreeIterator(BEPSILONTREE_TYPE *tree, const KeyType *key,
+                       bool reverse);
+
+  bool isEnd();
+
+  const MappingType &operator*();
+
+  BEpsilonTreeIterator &operator++();
+
+private:
+  BEPSILONTREE_TYPE *tree_;
+  bool reverse_;
+  std::vector<MappingType> entries_;
+  size_t position_ = 0;
+  // entries_ reaches the end of the tree
+  bool last_ = false;
+};
+
+INDEX_TEMPLATE_ARGUMENTS
+class BEpsilonTree {
+public:
+  explicit BEpsilonTree(const std::string &name,
+                        BufferPoolManager *buffer_pool_manager,
+                        const KeyComparator &comparator,
+                        page_id_t root_page_id = INVALID_PAGE_ID,
+                        bool unique = true);
+
+  // Returns true if this tree has no pages yet.
+  bool IsEmpty() const;
+
+  // Insert a key-value pair, once its message reaches the leaf.
+  void Insert(const KeyType &key, const ValueType &value,
+              Transaction *transaction = nullptr);
+
+  // Insert pairs in any order, in one batch of messages. Of pairs with the
+  // same key a unique tree keeps the first one.
+  void InsertBatch(std::vector<MappingType> &items,
+                   Transaction *transaction = nullptr);
+
+  // Remove the pair, once its message reaches the leaf.
+  void Remove(const KeyType &key, const ValueType &value,
+              Transaction *transaction = nullptr);
+
+  // return the values associated with a given key, in order
+  bool GetValue(const KeyType &key, std::vector<ValueType> &result,
+                Transaction *transaction = nullptr);
+
+  // the values an entry stands for, see BPlusTree::GetPostings
+  void GetPostings(const ValueType &value, std::vector<ValueType> &result);
+
+  // up to limit entries in order, or in reverse order, starting at key or
+  // right after entry after. both nullptr start at the end of the tree
+  void Read(const KeyType *key, const MappingType *after, bool reverse,
+            size_t limit, std::vector<MappingType> &result);
+
+  // index iterator
+  BEPSILONTREE_ITERATOR_TYPE Begin();
+  BEPSILONTREE_ITERATOR_TYPE Begin(const KeyType &key);
+  // reverse index iterator, from the last key or the last key not above key
+  BEPSILONTREE_ITERATOR_TYPE RBegin();
+  BEPSILONTREE_ITERATOR_TYPE RBegin(const KeyType &key);
+
+private:
+  typedef typename BEPSILONPAGE_TYPE::Message Message;
+  // first entry of a page split off and its page id
+  typedef std::pair<MappingType, page_id_t> Split;
+
+  // page read into memory. entries of a leaf, or pivots of an internal page
+  struct Node {
+    page_id_t page_id = INVALID_PAGE_ID;
+    bool leaf = true;
+    page_id_t next_page_id = INVALID_PAGE_ID;
+    std::vector<MappingType> entries;
+    std::vector<page_id_t> children;
+    std::vector<Message> messages;
+  };
+
+  // where a read starts and stops, see Read
+  struct Range {
+    const KeyType *key;
+    const MappingType *after;
+    const KeyType *until;
+    bool reverse;
+    size_t limit;
+  };
+
+  void Put(std::vector<Message> &messages);
+  void Push(Node &node, std::vector<Message> &messages,
+            std::vector<Split> &splits);
+  void Apply(std::vector<MappingType> &entries,
+             const std::vector<Message> &messages) const;
+  void Merge(std::vector<Message> &older,
+             const std::vector<Message> &newer) const;
+  void Collect(page_id_t page_id, const std::vector<Message> &pending,
+               const Range &range, std::vector<MappingType> &result);
+
+  int Compare(const MappingType &left, const MappingType &right) const;
+  int Route(const Node &node, const MappingType &entry) const;
+  bool BeforeStart(const MappingType &entry, const Range &range) const;
+  bool PastEnd(const MappingType &entry, const Range &range) const;
+
+  void Load(page_id_t page_id, Node &node);
+  void Store(Node &node, std::vector<Split> &splits);
+  void UpdateRootPageId(int insert_record = false);
+
+  // member variable
+  std::string index_name_;
+  page_id_t root_page_id_;
+  BufferPoolManager *buffer_pool_manager_;
+  KeyComparator comparator_;
+  bool unique_;
+  RWMutex latch_;
+};
+
+} // namespace scudb
@@ -0,0 +1,71 @@
+/**
+ * b_epsilon_tree_index.h
+ *
+ * Index on a b-epsilon tree, see b_epsilon_tree.h, for tables that see many
+ * more inserts and deletes than lookups. Chosen by a "buffered" index spec.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "index/b_epsilon_tree.h"
+#include "index/b_plus_tree_index.h"
+
+namespace scudb {
+
+#define BEPSILONTREE_INDEX_TYPE                                                \
+  BEpsilonTreeIndex<KeyType, ValueType, KeyComparator>
+
+INDEX_TEMPLATE_ARGUMENTS
+class BEpsilonTreeIndex : public Index {
+
+public:
+  BEpsilonTreeIndex(IndexMetadata *metadata,
+                    BufferPoolManager *buffer_pool_manager,
+                    page_id_t root_page_id = INVALID_PAGE_ID);
+
+  ~BEpsilonTreeIndex() {}
+
+  void InsertEntry(const Tuple &key, RID rid,
+                   Transaction *transaction = nullptr) override;
+
+  void InsertEntries(const std::vector<std::pair<Tuple, RID>> &entries,
+                     Transaction *transaction = nullptr) override;
+
+  void DeleteEntry(const Tuple &key, RID rid,
+                   Transaction *transaction = nullptr) override;
+
+  void ScanKey(const Tuple &key, std::vector<RID> &result,
+               Transaction *transaction = nullptr) override;
+
+  void ScanKeys(const std::vector<Tuple> &keys, std::vector<RID> &result,
+                Transaction *transaction = nullptr) override;
+
+  void ScanRange(const std::vector<Value> &low, bool low_inclusive,
+                 const std::vector<Value> &high, bool high_inclusive,
+                 std::vector<RID> &result,
+                 Transaction *transaction = nullptr) override;
+
+  IndexScan *OpenScan(const std::vector<Value> &low, bool low_inclusive,
+                      const std::vector<Value> &high, bool high_inclusive,
+                      bool descending = false,
+                      Transaction *transaction = nullptr) override;
+
+  bool BulkLoad(const std::function<bool(Tuple &, RID &)> &next,
+                Transaction *transaction = nullptr) override;
+
+  bool StoresKeyValues() const override;
+
+protected:
+  // index key of the key tuple
+  void SetIndexKey(KeyType &index_key, const Tuple &key);
+
+  // comparator for key
+  KeyComparator comparator_;
+  // container
+  BEpsilonTree<KeyType, ValueType, KeyComparator> container_;
+};
+
+} // namespace scudb
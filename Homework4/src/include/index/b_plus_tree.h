@@ -3,18 +3,33 @@
  *
  * Implementation of simple b+ tree data structure where internal pages direct
  * the search and leaf pages contain actual data.
- * (1) We only support unique key
+ * (1) Keys are unique unless the tree is created otherwise, the values of a
+ *     key then form a posting list, see posting_list.h
  * (2) support insert & remove
  * (3) The structure should shrink and grow dynamically
  * (4) Implement index iterator for range scan
+ * (5) Concurrent access with latch crabbing: readers hold at most one page
+ *     latch on the way down, writers keep the latches of the pages that may
+ *     change in the transaction's page set and release them as soon as a
+ *     child is safe. The root page id is guarded by a latch of its own, kept
+ *     in the page set as nullptr. Every descent is tried optimistically
+ *     first, see FindLeafOptimistic().
+ * (6) Wide normalized keys are prefix compressed between fence keys, see
+ *     b_plus_tree_page.h, and leaves are split at the shortest separator.
+ * (7) Wide keys take as many bytes as they need, pages are split, merged and
+ *     filled by bytes rather than by number of entries.
  */
 #pragma once
 
+#include <atomic>
+#include <functional>
 #include <queue>
 #include <vector>
 
+#include "common/rwmutex.h"
 #include "concurrency/transaction.h"
 #include "index/index_iterator.h"
+#include "index/posting_list.h"
 #include "page/b_plus_tree_internal_page.h"
 #include "page/b_plus_tree_leaf_page.h"
 
@@ -23,6 +38,35 @@ namespace scudb {
 #define BPLUSTREE_TYPE BPlusTree<KeyType, ValueType, KeyComparator>
 #define LEAFPAGE_TYPE BPlusTreeLeafPage<KeyType, ValueType, KeyComparator>
 #define INTERNALPAGE_TYPE BPlusTreeInternalPage<KeyType, page_id_t, KeyComparator>
+
+// what a descent to a leaf is going to do there
+enum class Operation { READONLY = 0, INSERT, DELETE };
+
+// leaf a lookup ended on, a later one may start there instead of at the root
+// as long as the tree has not changed its structure since
+struct LeafFinger {
+  page_id_t page_id = INVALID_PAGE_ID;
+  uint64_t version = 0;
+};
+
+// size of a tree estimated out of random descents, see BPlusTree::Sample
+template <typename KeyType> struct TreeSample {
+  // leaf a descent reached, the number of leaves it stands for and its keys
+  // with the number of values of each
+  struct Leaf {
+    double weight;
+    std::vector<std::pair<KeyType, size_t>> keys;
+  };
+
+  int height = 0;
+  double leaf_count = 0;
+  // leaf entries, one per key
+  double key_count = 0;
+  // values of all keys, more than keys with posting lists
+  double value_count = 0;
+  std::vector<Leaf> leaves;
+};
+
 // Main class providing the API for the Interactive B+ Tree.
 INDEX_TEMPLATE_ARGUMENTS
 class BPlusTree {
@@ -30,7 +74,8 @@ public:
   explicit BPlusTree(const std::string &name,
                            BufferPoolManager *buffer_pool_manager,
                            const KeyComparator &comparator,
-                           page_id_t root_page_id = INVALID_PAGE_ID);
+                           page_id_t root_page_id = INVALID_PAGE_ID,
+                           bool unique = true);
 
   // Returns true if this B+ tree has no keys and values.
   bool IsEmpty() const;
@@ -39,16 +84,45 @@ public:
   bool Insert(const KeyType &key, const ValueType &value,
               Transaction *transaction = nullptr);
 
+  // Insert pairs in any order, those landing in one leaf at once.
+  int InsertBatch(std::vector<MappingType> &items,
+                  Transaction *transaction = nullptr);
+
   // Remove a key and its value from this B+ tree.
   void Remove(const KeyType &key, Transaction *transaction = nullptr);
+  // Remove value from the values of key, the key goes with the last one.
+  bool Remove(const KeyType &key, const ValueType &value,
+              Transaction *transaction = nullptr);
+
+  // Build an empty B+ tree bottom up out of strictly ascending pairs, handed
+  // out by next until it returns false.
+  bool BulkLoad(const std::function<bool(KeyType &, ValueType &)> &next,
+                double fill_factor = BULK_LOAD_FILL_FACTOR);
 
   // return the value associated with a given key
   bool GetValue(const KeyType &key, std::vector<ValueType> &result,
                 Transaction *transaction = nullptr);
+  // return the values of keys with as few descents as possible, keys in
+  // ascending order share them. finger, if given, is where to start and is
+  // left at the last leaf
+  void GetValues(const std::vector<KeyType> &keys,
+                 std::vector<ValueType> &result, LeafFinger *finger = nullptr,
+                 Transaction *transaction = nullptr);
+
+  // the values a leaf entry stands for, in order; the caller holds the leaf
+  void GetPostings(const ValueType &value, std::vector<ValueType> &result);
+  // leaf entry standing for ascending values, to bulk load a non-unique tree
+  ValueType MakePostings(const std::vector<ValueType> &values);
+
+  // estimate the size of the tree out of count random descents
+  void Sample(size_t count, TreeSample<KeyType> &sample);
 
   // index iterator
   INDEXITERATOR_TYPE Begin();
   INDEXITERATOR_TYPE Begin(const KeyType &key);
+  // reverse index iterator, from the last key or the last key not above key
+  INDEXITERATOR_TYPE RBegin();
+  INDEXITERATOR_TYPE RBegin(const KeyType &key);
 
   // Print this B+ tree to stdout using a simple command-line
   std::string ToString(bool verbose = false);
@@ -61,41 +135,92 @@ public:
   void RemoveFromFile(const std::string &file_name,
                       Transaction *transaction = nullptr);
   // expose for test purpose
-  B_PLUS_TREE_LEAF_PAGE_TYPE *FindLeafPage(const KeyType &key,
-                                           bool leftMost = false);
+  // returns the pinned leaf, read latched for READONLY, otherwise write
+  // latched and kept in the transaction's page set
+  Page *FindLeafPage(const KeyType &key, bool leftMost = false,
+                     Operation op = Operation::READONLY,
+                     Transaction *transaction = nullptr);
 
 private:
   void StartNewTree(const KeyType &key, const ValueType &value);
 
-  bool InsertIntoLeaf(const KeyType &key, const ValueType &value,
-                      Transaction *transaction = nullptr);
+  // value nullptr removes the key with all its values
+  bool RemoveEntry(const KeyType &key, const ValueType *value,
+                   Transaction *transaction);
+
+  int InsertIntoLeaf(const MappingType *items, size_t count, size_t &done,
+                     Transaction *transaction = nullptr);
 
   void InsertIntoParent(BPlusTreePage *old_node, const KeyType &key,
                         BPlusTreePage *new_node,
                         Transaction *transaction = nullptr);
 
-  template <typename N> N *Split(N *node);
+  template <typename N, typename Item>
+  N *Split(N *node, const std::vector<Item> &items, KeyType &separator);
 
   template <typename N>
   bool CoalesceOrRedistribute(N *node, Transaction *transaction = nullptr);
 
-  template <typename N>
-  bool Coalesce(
-      N *&neighbor_node, N *&node,
-      BPlusTreeInternalPage<KeyType, page_id_t, KeyComparator> *&parent,
-      int index, Transaction *transaction = nullptr);
+  template <typename N, typename Item>
+  bool Coalesce(N *left, N *right, INTERNALPAGE_TYPE *parent, int index,
+                const std::vector<Item> &items, const KeyType *low,
+                const KeyType *high, Transaction *transaction = nullptr);
 
-  template <typename N> void Redistribute(N *neighbor_node, N *node, int index);
+  template <typename N, typename Item>
+  bool Redistribute(N *left, N *right, INTERNALPAGE_TYPE *parent, int index,
+                    const std::vector<Item> &items, const KeyType *low,
+                    const KeyType *high);
 
   bool AdjustRoot(BPlusTreePage *node);
 
+  std::vector<std::pair<KeyType, page_id_t>>
+  BuildLevel(const std::vector<std::pair<KeyType, page_id_t>> &children,
+             double fill_factor);
+  Page *NewExtentPage(page_id_t &page_id);
+  void ReleaseExtent();
+
+  // prefix compression helpers
+  bool CompressKeys() const;
+  KeyType Separator(const KeyType &left, const KeyType &right) const;
+  const KeyType *Fence(const KeyType *key) const;
+  template <typename N>
+  const KeyType *FenceOf(N *node, bool high, KeyType &key) const;
+  template <typename N, typename Item>
+  int SplitPoint(const Item *items, int count, const KeyType *low,
+                 const KeyType *high, bool leaf, KeyType &separator);
+
   void UpdateRootPageId(int insert_record = false);
+  void PublishRoot(page_id_t page_id, bool insert_record);
+
+  // batched lookup helpers
+  Page *FetchFinger(const LeafFinger &finger);
+  bool Covers(LEAFPAGE_TYPE *leaf, const KeyType &key);
+
+  // latch crabbing helpers
+  Page *FindLeafOptimistic(const KeyType &key, bool leftMost, Operation op);
+  bool IsSafe(BPlusTreePage *node, Operation op);
+  bool IsRoot(const BPlusTreePage *node) const;
+  INTERNALPAGE_TYPE *ParentOf(const BPlusTreePage *node, Transaction *transaction);
+  void ReleaseLatches(Transaction *transaction, bool is_dirty);
+  Page *FindLastLeafPage();
+  void SetPrevLeaf(page_id_t page_id, page_id_t prev_page_id);
 
   // member variable
   std::string index_name_;
-  page_id_t root_page_id_;
+  // read without any latch by optimistic descents, see PublishRoot
+  std::atomic<page_id_t> root_page_id_;
   BufferPoolManager *buffer_pool_manager_;
   KeyComparator comparator_;
+  // serializes writers of root_page_id_
+  RWMutex root_latch_;
+  // pages of the extent bulk loading takes its pages from that are still
+  // unused, guarded by root_latch_
+  page_id_t extent_next_ = INVALID_PAGE_ID;
+  page_id_t extent_end_ = INVALID_PAGE_ID;
+  // bumped whenever the key range of a page may change, or a page goes
+  std::atomic<uint64_t> structure_version_{0};
+  bool unique_;
+  PostingList postings_;
 };
 
 } // namespace scudb
@@ -4,7 +4,9 @@
 
 #pragma once
 
+#include <atomic>
 #include <map>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -14,6 +16,64 @@
 namespace scudb {
 
 #define BPLUSTREE_INDEX_TYPE BPlusTreeIndex<KeyType, ValueType, KeyComparator>
+#define BPLUSTREE_INDEX_SCAN_TYPE                                              \
+  BPlusTreeIndexScan<KeyType, ValueType, KeyComparator, TreeType>
+#define INDEX_SCAN_TEMPLATE_ARGUMENTS                                          \
+  template <typename KeyType, typename ValueType, typename KeyComparator,      \
+            typename TreeType>
+
+/*
+ * Range scan over a b+ tree, or another tree with the same iterators. Every
+ * batch descends from the root again and resumes after the last key handed
+ * out, so the scan keeps no page pinned.
+ */
+template <typename KeyType, typename ValueType, typename KeyComparator,
+          typename TreeType = BPlusTree<KeyType, ValueType, KeyComparator>>
+class BPlusTreeIndexScan : public IndexScan {
+public:
+  BPlusTreeIndexScan(TreeType *tree,
+                     const KeyComparator &comparator, Schema *key_schema,
+                     const std::vector<Value> &low, bool low_inclusive,
+                     const std::vector<Value> &high, bool high_inclusive,
+                     bool descending,
+                     size_t batch_size = INDEX_SCAN_BATCH_SIZE);
+
+  bool Next(std::vector<RID> &batch) override;
+
+  bool Next(std::vector<RID> &batch, std::vector<Tuple> &keys) override;
+
+private:
+  // append the RIDs of keys until there are batch_size_, from where the last
+  // call stopped, and their key tuples to keys unless it is nullptr
+  void Collect(std::vector<RID> &batch, std::vector<Tuple> *keys);
+  bool SeekKey(KeyType &key);
+  // key lies outside of the low or high bound
+  bool BelowLow(const KeyType &key);
+  bool AboveHigh(const KeyType &key);
+  // bound columns before the rest of the key
+  int ComparePrefix(const KeyType &key, const std::vector<Value> &bound,
+                    const KeyType &bound_key, size_t bound_length);
+
+  TreeType *tree_;
+  KeyComparator comparator_;
+  Schema *key_schema_;
+  std::vector<Value> low_;
+  bool low_inclusive_;
+  std::vector<Value> high_;
+  bool high_inclusive_;
+  // normalized bounds, only with normalized keys
+  KeyType low_key_;
+  size_t low_length_ = 0;
+  KeyType high_key_;
+  size_t high_length_ = 0;
+  bool descending_;
+  size_t batch_size_;
+  // last key handed out, valid once started_
+  KeyType last_;
+  bool started_ = false;
+  bool done_ = false;
+};
+
 
 INDEX_TEMPLATE_ARGUMENTS
 class BPlusTreeIndex : public Index {
@@ -28,17 +88,55 @@ public:
   void InsertEntry(const Tuple &key, RID rid,
                    Transaction *transaction = nullptr) override;
 
-  void DeleteEntry(const Tuple &key,
+  void InsertEntries(const std::vector<std::pair<Tuple, RID>> &entries,
+                     Transaction *transaction = nullptr) override;
+
+  void DeleteEntry(const Tuple &key, RID rid,
                    Transaction *transaction = nullptr) override;
 
   void ScanKey(const Tuple &key, std::vector<RID> &result,
                Transaction *transaction = nullptr) override;
 
+  void ScanKeys(const std::vector<Tuple> &keys, std::vector<RID> &result,
+                Transaction *transaction = nullptr) override;
+
+  void ScanRange(const std::vector<Value> &low, bool low_inclusive,
+                 const std::vector<Value> &high, bool high_inclusive,
+                 std::vector<RID> &result,
+                 Transaction *transaction = nullptr) override;
+
+  IndexScan *OpenScan(const std::vector<Value> &low, bool low_inclusive,
+                      const std::vector<Value> &high, bool high_inclusive,
+                      bool descending = false,
+                      Transaction *transaction = nullptr) override;
+
+  bool BulkLoad(const std::function<bool(Tuple &, RID &)> &next,
+                Transaction *transaction = nullptr) override;
+
+  bool StoresKeyValues() const override;
+
+  bool GetStatistics(IndexStatistics &statistics,
+                     Transaction *transaction = nullptr) override;
+
 protected:
+  // index key of the key tuple
+  void SetIndexKey(KeyType &index_key, const Tuple &key);
+  // key columns of an index key
+  void GetKeyValues(const KeyType &index_key, std::vector<Value> &values);
+
   // comparator for key
   KeyComparator comparator_;
   // container
   BPlusTree<KeyType, ValueType, KeyComparator> container_;
+  // leaf the last point lookup ended on, SQLite looks up the values of an IN
+  // list one after another in ascending order
+  LeafFinger finger_;
+  std::mutex finger_latch_;
+  // statistics, sampled again once enough entries changed since
+  IndexStatistics statistics_;
+  bool sampled_ = false;
+  std::atomic<size_t> changes_{0};
+  std::mutex statistics_latch_;
 };
 
 } // namespace scudb
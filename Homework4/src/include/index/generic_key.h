@@ -6,11 +6,22 @@
  * This key type uses an fixed length array to hold data for indexing
  * purposes, the actual size of which is specified and instantiated
  * with a template argument.
+ *
+ * A key is either the raw tuple data, or a normalized key ordered by plain
+ * memcmp. The normalized key concatenates the key columns:
+ *  integers   big endian with the sign bit flipped
+ *  decimal    big endian, sign bit flipped if positive, all bits if negative
+ *  timestamp  big endian
+ *  varchar    bytes with 0x00 escaped as 0x00 0xFF, terminated by 0x00 0x00
+ * Keys longer than KeySize are cut off, so are the bounds built from values.
  */
 #pragma once
 
+#include <algorithm>
 #include <cstring>
+#include <string>
 
+#include "index/key_search.h"
 #include "table/tuple.h"
 #include "type/value.h"
 
@@ -23,10 +34,87 @@ public:
     memcpy(data, tuple.GetData(), tuple.GetLength());
   }
 
+  // normalized key of the key columns of tuple
+  inline void SetFromKey(const Tuple &tuple, Schema *key_schema) {
+    memset(data, 0, KeySize);
+    const char *tuple_data = tuple.GetData();
+    size_t position = 0;
+    for (int i = 0; i < key_schema->GetColumnCount(); i++) {
+      const char *column = tuple_data + key_schema->GetOffset(i);
+      if (!key_schema->IsInlined(i)) {
+        int32_t offset;
+        memcpy(&offset, column, sizeof(int32_t));
+        column = tuple_data + offset;
+      }
+      position +=
+          Normalize(key_schema->GetType(i), column, data + position,
+                    KeySize - position);
+      if (position >= KeySize)
+        break;
+    }
+  }
+
+  // normalized key of the leading key columns, one per value
+  // @return: bytes written, a key starting with them has these columns
+  inline size_t SetFromValues(const std::vector<Value> &values,
+                              Schema *key_schema) {
+    memset(data, 0, KeySize);
+    char buffer[KeySize + sizeof(uint32_t)];
+    size_t position = 0;
+    for (size_t i = 0; i < values.size() && position < KeySize; i++) {
+      TypeId type = key_schema->GetType(i);
+      Value value = values[i].GetTypeId() == type ? values[i]
+                                                  : values[i].CastAs(type);
+      const char *column = buffer;
+      std::string serialized;
+      if (type == TypeId::VARCHAR) {
+        serialized.resize(sizeof(uint32_t) +
+                          (value.IsNull() ? 0 : value.GetLength()));
+        value.SerializeTo(&serialized[0]);
+        column = serialized.data();
+      } else {
+        value.SerializeTo(buffer);
+      }
+      position += Normalize(type, column, data + position, KeySize - position);
+    }
+    return position < KeySize ? position : KeySize;
+  }
+
+  // decode a column of a normalized key
+  inline Value FromNormalized(Schema *schema, int column_id) const {
+    size_t position = 0;
+    for (int i = 0; i < column_id; i++)
+      position += Denormalize(schema->GetType(i), position, nullptr);
+    TypeId type = schema->GetType(column_id);
+    if (type == TypeId::VARCHAR) {
+      std::string str;
+      Denormalize(type, position, &str);
+      return Value(type, str);
+    }
+    char buffer[sizeof(uint64_t)] = {0};
+    Denormalize(type, position, buffer);
+    return Value::DeserializeFrom(buffer, type);
+  }
+
+  // shortest normalized key above lhs and not above rhs, for lhs < rhs: rhs
+  // cut off after the first byte the two differ in
+  static inline GenericKey Separator(const GenericKey &lhs,
+                                     const GenericKey &rhs) {
+    GenericKey key;
+    size_t size = 0;
+    while (size < KeySize && lhs.data[size] == rhs.data[size])
+      size++;
+    size = size < KeySize ? size + 1 : KeySize;
+    memset(key.data, 0, KeySize);
+    memcpy(key.data, rhs.data, size);
+    return key;
+  }
+
   // NOTE: for test purpose only
+  // keys narrower than 8 bytes keep the low-order bytes only
   inline void SetFromInteger(int64_t key) {
     memset(data, 0, KeySize);
-    memcpy(data, &key, sizeof(int64_t));
+    memcpy(data, &key, std::min(KeySize, sizeof(int64_t)));
   }
 
   inline Value ToValue(Schema *schema, int column_id) const {
@@ -46,7 +134,9 @@ public:
   // NOTE: for test purpose only
   // interpret the first 8 bytes as int64_t from data vector
   inline int64_t ToString() const {
-    return *reinterpret_cast<int64_t *>(const_cast<char *>(data));
+    int64_t value = 0;
+    memcpy(&value, data, std::min(KeySize, sizeof(int64_t)));
+    return value;
   }
 
   // NOTE: for test purpose only
@@ -58,18 +148,164 @@ public:
 
   // actual location of data, extends past the end.
   char data[KeySize];
+
+private:
+  /*
+   * Helper to write the normalized form of a column, in the storage format of
+   * its type, to dst, writing no more than capacity bytes
+   * @return: size of the normalized column
+   */
+  static size_t Normalize(TypeId type, const char *column, char *dst,
+                          size_t capacity) {
+    uint64_t bits = 0;
+    size_t size = Type::GetTypeSize(type);
+    switch (type) {
+    case TypeId::BOOLEAN:
+    case TypeId::TINYINT:
+      bits = (uint8_t)column[0] ^ 0x80;
+      break;
+    case TypeId::SMALLINT: {
+      int16_t value;
+      memcpy(&value, column, sizeof(value));
+      bits = (uint16_t)value ^ 0x8000;
+      break;
+    }
+    case TypeId::INTEGER: {
+      int32_t value;
+      memcpy(&value, column, sizeof(value));
+      bits = (uint32_t)value ^ 0x80000000U;
+      break;
+    }
+    case TypeId::BIGINT: {
+      int64_t value;
+      memcpy(&value, column, sizeof(value));
+      bits = (uint64_t)value ^ 0x8000000000000000ULL;
+      break;
+    }
+    case TypeId::DECIMAL: {
+      double value;
+      memcpy(&value, column, sizeof(value));
+      // -0.0 equals 0.0
+      if (value == 0)
+        value = 0;
+      memcpy(&bits, &value, sizeof(bits));
+      bits = (bits >> 63) ? ~bits : bits ^ 0x8000000000000000ULL;
+      break;
+    }
+    case TypeId::TIMESTAMP:
+      memcpy(&bits, column, sizeof(bits));
+      break;
+    case TypeId::VARCHAR: {
+      uint32_t len;
+      memcpy(&len, column, sizeof(len));
+      // the length counts the trailing '\0', null sorts like ""
+      len = (len == PELOTON_VALUE_NULL || len == 0) ? 0 : len - 1;
+      column += sizeof(uint32_t);
+      size_t written = 0;
+      for (uint32_t i = 0; i < len && written < capacity; i++) {
+        dst[written++] = column[i];
+        if (column[i] == 0 && written < capacity)
+          dst[written++] = (char)0xFF;
+      }
+      for (int i = 0; i < 2 && written < capacity; i++)
+        dst[written++] = 0;
+      return written;
+    }
+    default:
+      return 0;
+    }
+    for (size_t i = 0; i < size && i < capacity; i++)
+      dst[i] = (char)(bits >> (8 * (size - 1 - i)));
+    return size;
+  }
+
+  /*
+   * Helper to decode the normalized column at position, into the storage
+   * format of its type at dst, or into *str for varchars. Both may be null
+   * to skip the column.
+   * @return: size of the normalized column
+   */
+  size_t Denormalize(TypeId type, size_t position, void *dst) const {
+    if (type == TypeId::VARCHAR) {
+      std::string *str = static_cast<std::string *>(dst);
+      size_t i = position;
+      while (i < KeySize) {
+        if (data[i] == 0) {
+          if (i + 1 >= KeySize || data[i + 1] == 0) {
+            i += 2;
+            break;
+          }
+          // escaped 0x00
+          i++;
+          if (str != nullptr)
+            str->push_back(0);
+        } else if (str != nullptr) {
+          str->push_back(data[i]);
+        }
+        i++;
+      }
+      return i - position;
+    }
+    size_t size = Type::GetTypeSize(type);
+    if (dst == nullptr)
+      return size;
+    uint64_t bits = 0;
+    for (size_t i = 0; i < size; i++) {
+      uint8_t byte = position + i < KeySize ? data[position + i] : 0;
+      bits = (bits << 8) | byte;
+    }
+    switch (type) {
+    case TypeId::BOOLEAN:
+    case TypeId::TINYINT:
+    case TypeId::SMALLINT:
+    case TypeId::INTEGER:
+    case TypeId::BIGINT:
+      bits ^= 1ULL << (8 * size - 1);
+      break;
+    case TypeId::DECIMAL:
+      bits = (bits >> 63) ? bits ^ 0x8000000000000000ULL : ~bits;
+      break;
+    default:
+      break;
+    }
+    // little endian storage format, as memcpy of the value
+    for (size_t i = 0; i < size; i++)
+      static_cast<char *>(dst)[i] = (char)(bits >> (8 * i));
+    return size;
+  }
 };
 
 /**
  * Function object returns true if lhs < rhs, used for trees
+ *
+ * The key schema is turned into a compare plan once, at construction, so that
+ * the common key shapes (integers, decimals, timestamps and varchars) are
+ * compared straight from the key bytes. Schemas the plan can not describe
+ * fall back to comparing deserialized values column by column. Normalized
+ * keys are compared with memcmp only.
  */
 template <size_t KeySize> class GenericComparator {
 public:
   inline int operator()(const GenericKey<KeySize> &lhs,
                         const GenericKey<KeySize> &rhs) const {
-    int column_count = key_schema_->GetColumnCount();
+    if (shape_ == SHAPE_NORMALIZED)
+      return memcmp(lhs.data, rhs.data, KeySize);
+    // single integer column, the most common index
+    if (shape_ == SHAPE_INTEGER)
+      return CompareRaw<int32_t>(lhs.data, rhs.data);
+    if (shape_ == SHAPE_BIGINT)
+      return CompareRaw<int64_t>(lhs.data, rhs.data);
 
-    for (int i = 0; i < column_count; i++) {
+    if (shape_ == SHAPE_COLUMNS) {
+      for (int i = 0; i < column_count_; i++) {
+        int cmp = CompareColumn(lhs.data, rhs.data, i);
+        if (cmp != 0)
+          return cmp;
+      }
+      return 0;
+    }
+
+    for (int i = 0; i < column_count_; i++) {
       Value lhs_value = (lhs.ToValue(key_schema_, i));
       Value rhs_value = (rhs.ToValue(key_schema_, i));
 
@@ -85,13 +321,130 @@ public:
 
   GenericComparator(const GenericComparator &other) {
     this->key_schema_ = other.key_schema_;
+    this->shape_ = other.shape_;
+    this->column_count_ = other.column_count_;
+    memcpy(this->columns_, other.columns_, sizeof(columns_));
   }
 
   // constructor
-  GenericComparator(Schema *key_schema) : key_schema_(key_schema) {}
+  GenericComparator(Schema *key_schema, bool normalized = false)
+      : key_schema_(key_schema) {
+    column_count_ = key_schema_->GetColumnCount();
+    shape_ = normalized ? SHAPE_NORMALIZED : SHAPE_COLUMNS;
+    if (normalized)
+      return;
+    if (column_count_ > MAX_PLANNED_COLUMNS) {
+      shape_ = SHAPE_VALUES;
+      return;
+    }
+    for (int i = 0; i < column_count_; i++) {
+      columns_[i].type = key_schema_->GetType(i);
+      columns_[i].offset = key_schema_->GetOffset(i);
+      columns_[i].inlined = key_schema_->IsInlined(i);
+      if (columns_[i].type == TypeId::INVALID ||
+          (columns_[i].type == TypeId::VARCHAR) == columns_[i].inlined)
+        shape_ = SHAPE_VALUES;
+    }
+    if (shape_ == SHAPE_COLUMNS && column_count_ == 1 &&
+        columns_[0].offset == 0) {
+      if (columns_[0].type == TypeId::INTEGER)
+        shape_ = SHAPE_INTEGER;
+      else if (columns_[0].type == TypeId::BIGINT)
+        shape_ = SHAPE_BIGINT;
+    }
+  }
+
+  // keys are normalized, see GenericKey
+  inline bool IsNormalized() const { return shape_ == SHAPE_NORMALIZED; }
+
+  // how keys order like integers for KeySearch, if they do
+  inline KeySearch::Format GetSearchFormat() const {
+    if (shape_ == SHAPE_INTEGER)
+      return KeySearch::INT32;
+    if (shape_ == SHAPE_BIGINT)
+      return KeySearch::INT64;
+    if (shape_ == SHAPE_NORMALIZED && KeySize == 4)
+      return KeySearch::NORMALIZED4;
+    if (shape_ == SHAPE_NORMALIZED && KeySize == 8)
+      return KeySearch::NORMALIZED8;
+    return KeySearch::NONE;
+  }
 
 private:
+  // how operator() compares keys
+  enum Shape {
+    SHAPE_NORMALIZED,
+    SHAPE_INTEGER,
+    SHAPE_BIGINT,
+    SHAPE_COLUMNS,
+    SHAPE_VALUES
+  };
+  static const int MAX_PLANNED_COLUMNS = 8;
+
+  struct ColumnPlan {
+    TypeId type;
+    uint32_t offset;
+    bool inlined;
+  };
+
+  template <typename T>
+  static inline int CompareRaw(const char *lhs, const char *rhs) {
+    T lhs_value, rhs_value;
+    memcpy(&lhs_value, lhs, sizeof(T));
+    memcpy(&rhs_value, rhs, sizeof(T));
+    return lhs_value < rhs_value ? -1 : (rhs_value < lhs_value ? 1 : 0);
+  }
+
+  /*
+   * Helper to compare column i of two keys from the raw bytes, same order as
+   * the Value comparisons of its type
+   */
+  inline int CompareColumn(const char *lhs, const char *rhs, int i) const {
+    const ColumnPlan &column = columns_[i];
+    lhs += column.offset;
+    rhs += column.offset;
+    switch (column.type) {
+    case TypeId::BOOLEAN:
+    case TypeId::TINYINT:
+      return CompareRaw<int8_t>(lhs, rhs);
+    case TypeId::SMALLINT:
+      return CompareRaw<int16_t>(lhs, rhs);
+    case TypeId::INTEGER:
+      return CompareRaw<int32_t>(lhs, rhs);
+    case TypeId::BIGINT:
+      return CompareRaw<int64_t>(lhs, rhs);
+    case TypeId::DECIMAL:
+      return CompareRaw<double>(lhs, rhs);
+    case TypeId::TIMESTAMP:
+      return CompareRaw<uint64_t>(lhs, rhs);
+    default:
+      break;
+    }
+    // varchar, the slot holds the offset of [length | bytes] inside the key,
+    // the length counts the trailing '\0'
+    int32_t lhs_offset, rhs_offset;
+    memcpy(&lhs_offset, lhs, sizeof(int32_t));
+    memcpy(&rhs_offset, rhs, sizeof(int32_t));
+    lhs = lhs - column.offset + lhs_offset;
+    rhs = rhs - column.offset + rhs_offset;
+    uint32_t lhs_len, rhs_len;
+    memcpy(&lhs_len, lhs, sizeof(uint32_t));
+    memcpy(&rhs_len, rhs, sizeof(uint32_t));
+    if (lhs_len == PELOTON_VALUE_NULL || rhs_len == PELOTON_VALUE_NULL)
+      return 0;
+    lhs_len = lhs_len ? lhs_len - 1 : 0;
+    rhs_len = rhs_len ? rhs_len - 1 : 0;
+    int cmp = memcmp(lhs + sizeof(uint32_t), rhs + sizeof(uint32_t),
+                     lhs_len < rhs_len ? lhs_len : rhs_len);
+    if (cmp != 0)
+      return cmp < 0 ? -1 : 1;
+    return lhs_len < rhs_len ? -1 : (rhs_len < lhs_len ? 1 : 0);
+  }
+
   Schema *key_schema_;
+  Shape shape_;
+  int column_count_;
+  ColumnPlan columns_[MAX_PLANNED_COLUMNS];
 };
 
 } // namespace scudb
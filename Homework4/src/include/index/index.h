@@ -4,11 +4,13 @@
 
 #pragma once
 
+#include <functional>
 #include <memory>
 #include <string>
 #include <vector>
 
 #include "catalog/schema.h"
+#include "common/config.h"
 #include "table/tuple.h"
 #include "type/value.h"
 
@@ -28,8 +30,14 @@ class IndexMetadata {
 
 public:
   IndexMetadata(std::string index_name, std::string table_name,
-                const Schema *tuple_schema, const std::vector<int> &key_attrs)
-      : name_(index_name), table_name_(table_name), key_attrs_(key_attrs) {
+                const Schema *tuple_schema, const std::vector<int> &key_attrs,
+                bool normalized_keys = INDEX_NORMALIZED_KEYS,
+                bool unique = true, bool buffered = false, bool clustered = false,
+                int included_count = 0)
+      : name_(index_name), table_name_(table_name), key_attrs_(key_attrs),
+        normalized_keys_(normalized_keys), unique_(unique),
+        buffered_(buffered), clustered_(clustered),
+        included_count_(included_count) {
     key_schema_ = Schema::CopySchema(tuple_schema, key_attrs_);
   }
 
@@ -51,13 +59,33 @@ public:
   //  columns
   inline const std::vector<int> &GetKeyAttrs() const { return key_attrs_; }
 
+  // Whether index keys are stored normalized, ordered by memcmp
+  inline bool HasNormalizedKeys() const { return normalized_keys_; }
+
+  // Whether a key maps to one RID at most, otherwise to any number of them
+  inline bool IsUnique() const { return unique_; }
+
+  // Number of trailing key columns named after "include". They are kept in
+  // the key but left out of its uniqueness
+  inline int GetIncludedColumnCount() const { return included_count_; }
+
+  // Whether the index buffers changes in a b-epsilon tree
+  inline bool IsBuffered() const { return buffered_; }
+
+  // Whether the table keeps its tuples in the index, see
+  // table/clustered_tree.h
+  inline bool IsClustered() const { return clustered_; }
+
   // Get a string representation for debugging
   const std::string ToString() const {
     std::stringstream os;
 
     os << "IndexMetadata["
        << "Name = " << name_ << ", "
-       << "Type = B+Tree, "
+       << "Type = "
+       << (clustered_ ? "Clustered tree"
+                      : buffered_ ? "B-epsilon tree" : "B+Tree")
+       << ", "
        << "Table name = " << table_name_ << "] :: ";
     os << key_schema_->ToString();
 
@@ -69,10 +97,55 @@ private:
   std::string table_name_;
   // The mapping relation between key schema and tuple schema
   const std::vector<int> key_attrs_;
+  const bool normalized_keys_;
+  const bool unique_;
+  const bool buffered_;
+  const bool clustered_;
+  const int included_count_;
   // schema of the indexed key
   Schema *key_schema_;
 };
 
+/**
+ * IndexStatistics - Estimated size and key distribution of an index
+ *
+ * Estimates come from a sample of the index and are meant for query
+ * planning only.
+ */
+struct IndexStatistics {
+  // levels from the root down to the leaves
+  int height = 0;
+  double leaf_count = 0;
+  // entries (RIDs) in the index
+  double entry_count = 0;
+  // distinct values of the first i + 1 key columns, the last one is the
+  // number of distinct keys
+  std::vector<double> distinct;
+  // ascending keys that split the entries into parts of the same size
+  std::vector<Tuple> histogram;
+};
+
+/////////////////////////////////////////////////////////////////////
+// IndexScan class definition
+/////////////////////////////////////////////////////////////////////
+/**
+ * class IndexScan - Open range scan handed out by Index::OpenScan
+ *
+ * Entries come in batches. No latch is held between two batches, so the
+ * table may be modified while the scan is open.
+ */
+class IndexScan {
+public:
+  virtual ~IndexScan() {}
+
+  // replace batch with the next entries of the scan
+  // @return: false if the scan is exhausted
+  virtual bool Next(std::vector<RID> &batch) = 0;
+
+  // same as above, keys gets the key tuple of each entry as well
+  virtual bool Next(std::vector<RID> &batch, std::vector<Tuple> &keys) = 0;
+};
+
 /////////////////////////////////////////////////////////////////////
 // Index class definition
 /////////////////////////////////////////////////////////////////////
@@ -126,13 +199,55 @@ public:
   virtual void InsertEntry(const Tuple &key, RID rid,
                            Transaction *transaction = nullptr) = 0;
 
-  // delete the index entry linked to given tuple
-  virtual void DeleteEntry(const Tuple &key,
+  // insert entries in any order at once. designed for multi-row inserts
+  virtual void InsertEntries(const std::vector<std::pair<Tuple, RID>> &entries,
+                             Transaction *transaction = nullptr) = 0;
+
+  // delete the index entry of key linked to given tuple
+  virtual void DeleteEntry(const Tuple &key, RID rid,
                            Transaction *transaction = nullptr) = 0;
 
   virtual void ScanKey(const Tuple &key, std::vector<RID> &result,
                        Transaction *transaction = nullptr) = 0;
 
+  // collect the entries of all keys, in key order. designed for IN lists and
+  // index nested loop joins
+  virtual void ScanKeys(const std::vector<Tuple> &keys,
+                        std::vector<RID> &result,
+                        Transaction *transaction = nullptr) = 0;
+
+  // collect the entries between low and high in key order. a bound holds
+  // values for the leading key columns only, an empty bound leaves that side
+  // open. designed for range predicates
+  virtual void ScanRange(const std::vector<Value> &low, bool low_inclusive,
+                         const std::vector<Value> &high, bool high_inclusive,
+                         std::vector<RID> &result,
+                         Transaction *transaction = nullptr) = 0;
+
+  // same range as ScanRange, handed out a batch at a time in key order, or in
+  // reverse key order if descending. the caller owns the returned scan
+  virtual IndexScan *OpenScan(const std::vector<Value> &low,
+                              bool low_inclusive,
+                              const std::vector<Value> &high,
+                              bool high_inclusive, bool descending = false,
+                              Transaction *transaction = nullptr) = 0;
+
+  // build an empty index out of entries in any order, handed out by next
+  // until it returns false. designed for indexing an existing table
+  virtual bool BulkLoad(const std::function<bool(Tuple &, RID &)> &next,
+                        Transaction *transaction = nullptr) = 0;
+
+  // whether index keys keep the exact values of all key columns, so that a
+  // scan can answer for them without reading the table
+  virtual bool StoresKeyValues() const { return false; }
+
+  // estimates for query planning, kept by the index as it changes
+  // @return: false if the index has no statistics
+  virtual bool GetStatistics(IndexStatistics &statistics,
+                             Transaction *transaction = nullptr) {
+    return false;
+  }
+
 private:
   //===--------------------------------------------------------------------===//
   //  Data members
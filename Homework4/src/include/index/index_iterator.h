@@ -7,6 +7,9 @@
 
 namespace scudb {
 
+template <typename KeyType, typename ValueType, typename KeyComparator>
+class BPlusTree;
+
 #define INDEXITERATOR_TYPE                                                     \
   IndexIterator<KeyType, ValueType, KeyComparator>
 
@@ -14,7 +17,10 @@ INDEX_TEMPLATE_ARGUMENTS
 class IndexIterator {
 public:
   // you may define your own constructor based on your member variables
-	IndexIterator(BPlusTreeLeafPage<KeyType, ValueType, KeyComparator>*,int, BufferPoolManager*);
+  // the leaf comes pinned and read latched, the iterator releases it. a
+  // reverse iterator walks the keys backwards
+	IndexIterator(BPlusTree<KeyType, ValueType, KeyComparator>*, scudb::Page*,int, BufferPoolManager*, const KeyComparator&, bool = false);
+  IndexIterator(IndexIterator &&);
   ~IndexIterator();
 
   bool isEnd();
@@ -24,10 +30,21 @@ public:
   IndexIterator &operator++();
 
 private:
+  // moves on to the next leaf while the current one is used up
+  void SkipFinishedLeaves();
+  void SkipFinishedLeavesBackward();
+
   // add your own private member variables here
+  // looks the position up again when the next leaf was merged away
+  BPlusTree<KeyType, ValueType, KeyComparator>* Tree;
+  scudb::Page* Frame;
   BPlusTreeLeafPage<KeyType, ValueType, KeyComparator>* Page;
   int Index;
   BufferPoolManager* Manager;
+  KeyComparator Comparator;
+  bool Reverse;
+  // the pair operator* hands out
+  MappingType Item;
 };
 
 } // namespace scudb
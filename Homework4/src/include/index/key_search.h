@@ -0,0 +1,67 @@
+/**
+ * key_search.h
+ *
+ * Search of the sorted keys of a b+ tree page, for keys whose bytes order
+ * like an integer. The search is narrowed down by a binary search and ends
+ * with counting a small window of keys, with avx2 or sse4.2 comparisons when
+ * the cpu has them and a branchless loop otherwise.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace scudb {
+
+class KeySearch {
+public:
+  // how the bytes of a key map to an int64 of the same order
+  enum Format {
+    NONE,        // keys do not order like integers
+    INT32,       // little endian int32
+    INT64,       // little endian int64
+    NORMALIZED4, // 4 bytes ordered by memcmp
+    NORMALIZED8, // 8 bytes ordered by memcmp
+  };
+
+  // int64 of the same order as the key at key
+  static inline int64_t Load(const char *key, Format format) {
+    switch (format) {
+    case INT32: {
+      int32_t value;
+      memcpy(&value, key, sizeof(value));
+      return value;
+    }
+    case INT64: {
+      int64_t value;
+      memcpy(&value, key, sizeof(value));
+      return value;
+    }
+    case NORMALIZED4: {
+      uint32_t value;
+      memcpy(&value, key, sizeof(value));
+      return (int64_t)(((uint64_t)__builtin_bswap32(value) << 32) ^
+                       0x8000000000000000ULL);
+    }
+    case NORMALIZED8: {
+      uint64_t value;
+      memcpy(&value, key, sizeof(value));
+      return (int64_t)(__builtin_bswap64(value) ^ 0x8000000000000000ULL);
+    }
+    default:
+      return 0;
+    }
+  }
+
+  // number of the count sorted keys, stride bytes apart from keys on, that
+  // are less than key, or less than or equal to key if inclusive
+  static int Count(const char *keys, size_t stride, int count, int64_t key,
+                   Format format, bool inclusive);
+
+  // true if the window is counted with avx2 or sse4.2
+  static bool IsHardwareAccelerated();
+};
+
+} // namespace scudb
@@ -0,0 +1,84 @@
+/**
+ * posting_list.h
+ *
+ * RIDs of a key of a non-unique b+ tree. A key with a single RID keeps it in
+ * its leaf entry. With more RIDs the entry refers to a posting list instead,
+ * a chain of segments in posting pages (see page/b_plus_tree_posting_page.h)
+ * that starts with the highest RIDs, so the RID of a newly appended tuple
+ * only touches the first segment.
+ *
+ * Segment format:
+ *  ----------------------------------------------------------------
+ * | NextSegment (8) | Count (2) | FirstRid (8) | DELTA(2) | ... | DELTA(n) |
+ *  ----------------------------------------------------------------
+ * RIDs within a segment ascend. A delta to the next RID within the same page
+ * is the varint of the slot difference shifted left by one, a delta to a later
+ * page the varint of the page difference shifted left by one with the low bit
+ * set, followed by the varint of the slot.
+ *
+ * The caller holds the latch of the leaf of the key, so nothing else touches
+ * its list. Other lists share the pages, they are latched one at a time.
+ */
+
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "buffer/buffer_pool_manager.h"
+#include "common/rid.h"
+
+namespace scudb {
+
+class PostingList {
+public:
+  explicit PostingList(BufferPoolManager *buffer_pool_manager);
+
+  // whether the value of a leaf entry refers to a posting list
+  static bool IsList(const RID &value);
+
+  // append the RIDs value stands for to result, in RID order
+  void Read(const RID &value, std::vector<RID> &result);
+  // add rid to the RIDs of value, which may become a posting list
+  // @return: false if rid is there already
+  bool Add(RID &value, const RID &rid);
+  // remove rid from posting list value, the last RID left replaces value
+  // @return: false if rid is not there
+  bool Remove(RID &value, const RID &rid);
+  // value standing for rids, which ascend
+  RID Build(const std::vector<RID> &rids);
+  // give back the segments of posting list value
+  void Free(const RID &value);
+
+private:
+  // decoded segment, ref is where it is stored
+  struct Segment {
+    RID ref;
+    RID next;
+    std::vector<RID> rids;
+  };
+
+  // slot numbers of segments are flagged, those of tuples never get there
+  static const int LIST_FLAG = 1 << 30;
+
+  static bool Less(const RID &left, const RID &right);
+  static std::string Encode(const Segment &segment);
+  static void Decode(const char *data, size_t size, Segment &segment);
+
+  void Load(const RID &ref, Segment &segment);
+  bool Store(const Segment &segment);
+  RID Allocate(const Segment &segment);
+  void Release(const RID &ref);
+  // find the segment rid belongs in, prev is the one before it
+  void Find(const RID &value, const RID &rid, Segment &prev, Segment &segment);
+  // point value or prev at ref
+  void Relink(RID &value, Segment &prev, const RID &ref);
+
+  BufferPoolManager *buffer_pool_manager_;
+  // posting page new segments go to, guarded by latch_
+  page_id_t page_id_ = INVALID_PAGE_ID;
+  std::mutex latch_;
+};
+
+} // namespace scudb
@@ -0,0 +1,80 @@
+/**
+ * b_epsilon_tree_page.h
+ *
+ * Pages of a b-epsilon tree, see index/b_epsilon_tree.h. Pages are read and
+ * written whole by the tree, so they only store arrays of fixed size.
+ *
+ * Leaf page format:
+ *  ---------------------------------------------------------------------------
+ * | HEADER | ENTRY(1) | ENTRY(2) | ... | ENTRY(n) |
+ *  ---------------------------------------------------------------------------
+ *
+ * Internal page format (pivot(0) is left out, each pivot is the first entry
+ * its child may hold):
+ *  ---------------------------------------------------------------------------
+ * | HEADER | PIVOT(0)+CHILD(0) | ... | PIVOT(f)+CHILD(f) | MESSAGE(1) | ... |
+ *  ---------------------------------------------------------------------------
+ * There is room for MaxChildren children, the rest of the page buffers
+ * messages, Size children and MessageCount messages are in use.
+ *
+ *  Header format (size in byte, 24 bytes in total):
+ *  ---------------------------------------------------------------------
+ * | PageType (4) | LSN (4) | PageId (4) | NextPageId (4) | Size (4) |
+ *  ---------------------------------------------------------------------
+ * | MessageCount (4) |
+ *  ---------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <vector>
+
+#include "page/b_plus_tree_page.h"
+
+namespace scudb {
+
+#define BEPSILONPAGE_TYPE BEpsilonTreePage<KeyType, ValueType, KeyComparator>
+
+INDEX_TEMPLATE_ARGUMENTS
+class BEpsilonTreePage {
+public:
+  // insert or delete of an entry on its way to a leaf
+  struct Message {
+    MappingType entry;
+    bool remove;
+  };
+
+  // must call initialize method after "create" a new page
+  void Init(page_id_t page_id, bool leaf);
+  bool IsLeafPage() const;
+  page_id_t GetPageId() const;
+  page_id_t GetNextPageId() const;
+  void SetNextPageId(page_id_t next_page_id);
+
+  static int GetMaxEntries();
+  static int GetMaxChildren();
+  static int GetMaxMessages();
+
+  // entries of a leaf page, pivots and children of an internal page
+  void GetEntries(std::vector<MappingType> &entries) const;
+  void SetEntries(const MappingType *entries, int count);
+  void GetChildren(std::vector<MappingType> &pivots,
+                   std::vector<page_id_t> &children) const;
+  void SetChildren(const MappingType *pivots, const page_id_t *children,
+                   int count);
+  void GetMessages(std::vector<Message> &messages) const;
+  void SetMessages(const Message *messages, int count);
+
+private:
+  const char *MessageArea() const;
+
+  IndexPageType page_type_;
+  lsn_t lsn_;
+  page_id_t page_id_;
+  page_id_t next_page_id_;
+  int size_;
+  int message_count_;
+  char data_[0];
+};
+
+} // namespace scudb
@@ -8,10 +8,12 @@
  * the first key always remains invalid. That is to say, any search/lookup
  * should ignore the first key.
  *
- * Internal page format (keys are stored in increasing order):
- *  --------------------------------------------------------------------------
- * | HEADER | KEY(1)+PAGE_ID(1) | KEY(2)+PAGE_ID(2) | ... | KEY(n)+PAGE_ID(n) |
- *  --------------------------------------------------------------------------
+ * Internal page format (keys are stored in increasing order, without the
+ * prefix the fences have in common, see b_plus_tree_page.h; slotted pages
+ * keep the invalid first key empty):
+ *  ---------------------------------------------------------------------------
+ * | HEADER | FENCES | KEY(1)+PAGE_ID(1) | KEY(2)+PAGE_ID(2) | ... | KEY(n)+PAGE_ID(n) |
+ *  ---------------------------------------------------------------------------
  */
 
 #pragma once
@@ -29,17 +31,32 @@ INDEX_TEMPLATE_ARGUMENTS
 class BPlusTreeInternalPage : public BPlusTreePage {
 public:
   // must call initialize method after "create" a new node
-  void Init(page_id_t page_id, page_id_t parent_id = INVALID_PAGE_ID);
+  void Init(page_id_t page_id);
 
   KeyType KeyAt(int index) const;
   void SetKeyAt(int index, const KeyType &key);
   int ValueIndex(const ValueType &value) const;
   ValueType ValueAt(int index) const;
-  void SetValueAt(int index,const ValueType &value)
-  {
-	  array[index].second=value;
-  }
+  void SetValueAt(int index, const ValueType &value);
   ValueType Lookup(const KeyType &key, const KeyComparator &comparator) const;
+  MappingType GetItem(int index) const;
+
+  // fence keys, nullptr stands for an open side
+  bool GetFence(bool high, KeyType &key) const;
+  void SetFences(const KeyType *low, const KeyType *high);
+
+  // room for fences and entries, in bytes
+  static size_t GetAreaSize();
+  static size_t SpaceFor(const MappingType *items, int count,
+                         const KeyType *low, const KeyType *high);
+  bool HasRoomFor(const KeyType &key, int replaced = -1) const;
+  bool IsFull() const;
+  bool IsUnderfull() const;
+  bool CanLoseEntry() const;
+  // replace all entries and the fences
+  void Assign(const MappingType *items, int count, const KeyType *low,
+              const KeyType *high);
+
   void PopulateNewRoot(const ValueType &old_value, const KeyType &new_key,
                        const ValueType &new_value);
   int InsertNodeAfter(const ValueType &old_value, const KeyType &new_key,
@@ -47,15 +64,6 @@ public:
   void Remove(int index);
   ValueType RemoveAndReturnOnlyChild();
 
-  void MoveHalfTo(BPlusTreeInternalPage *recipient,
-                  BufferPoolManager *buffer_pool_manager);
-  void MoveAllTo(BPlusTreeInternalPage *recipient, int index_in_parent,
-                 BufferPoolManager *buffer_pool_manager);
-  void MoveFirstToEndOf(BPlusTreeInternalPage *recipient,
-                        BufferPoolManager *buffer_pool_manager);
-  void MoveLastToFrontOf(BPlusTreeInternalPage *recipient,
-                         int parent_index,
-                         BufferPoolManager *buffer_pool_manager);
   // DEUBG and PRINT
   std::string ToString(bool verbose) const;
   void QueueUpChildren(std::queue<BPlusTreePage *> *queue,
@@ -69,14 +77,8 @@ public:
       return reinterpret_cast<BPlusTreePage*>(buffer_pool_manager->FetchPage(PageId)->GetData());
   }
 private:
-  void CopyHalfFrom(MappingType *items, int size,
-                    BufferPoolManager *buffer_pool_manager);
-  void CopyAllFrom(MappingType *items, int size,
-                   BufferPoolManager *buffer_pool_manager);
-  void CopyLastFrom(const MappingType &pair,
-                    BufferPoolManager *buffer_pool_manager);
-  void CopyFirstFrom(const MappingType &pair, int parent_index,
-                     BufferPoolManager *buffer_pool_manager);
-  MappingType array[0];
+  size_t MaxEntrySize() const;
+  const KeyType &KeyRef(int index, KeyType &scratch) const;
+  char data_[0];
 };
 } // namespace scudb
@@ -3,20 +3,19 @@
  *
  * Store indexed key and record id(record id = page id combined with slot id,
  * see include/common/rid.h for detailed implementation) together within leaf
- * page. Only support unique key.
+ * page. A key appears once, a key of a non-unique tree with more than one
+ * RID refers to a posting list instead, see index/posting_list.h.
 
- * Leaf page format (keys are stored in order):
+ * Leaf page format (keys are stored in order, without the prefix the fences
+ * have in common, wide keys in slots, see b_plus_tree_page.h):
  *  ----------------------------------------------------------------------
- * | HEADER | KEY(1) + RID(1) | KEY(2) + RID(2) | ... | KEY(n) + RID(n)
+ * | HEADER | FENCES | KEY(1) + RID(1) | KEY(2) + RID(2) | ... | KEY(n) + RID(n)
  *  ----------------------------------------------------------------------
  *
- *  Header format (size in byte, 24 bytes in total):
+ *  Header format (size in byte, 36 bytes in total):
  *  ---------------------------------------------------------------------
- * | PageType (4) | CurrentSize (4) | MaxSize (4) | ParentPageId (4) |
+ * | BPlusTreePage header (28) | NextPageId (4) | PrevPageId (4) |
  *  ---------------------------------------------------------------------
- *  ------------------------------
- * | PageId (4) | NextPageId (4)
- *  ------------------------------
  */
 #pragma once
 #include <utility>
@@ -34,13 +33,33 @@ class BPlusTreeLeafPage : public BPlusTreePage {
 public:
   // After creating a new leaf page from buffer pool, must call initialize
   // method to set default values
-  void Init(page_id_t page_id, page_id_t parent_id = INVALID_PAGE_ID);
+  void Init(page_id_t page_id);
   // helper methods
   page_id_t GetNextPageId() const;
   void SetNextPageId(page_id_t next_page_id);
+  page_id_t GetPrevPageId() const;
+  void SetPrevPageId(page_id_t prev_page_id);
   KeyType KeyAt(int index) const;
+  ValueType ValueAt(int index) const;
+  void SetValueAt(int index, const ValueType &value);
   int KeyIndex(const KeyType &key, const KeyComparator &comparator) const;
-  const MappingType &GetItem(int index);
+  MappingType GetItem(int index) const;
+
+  // fence keys, nullptr stands for an open side
+  bool GetFence(bool high, KeyType &key) const;
+  void SetFences(const KeyType *low, const KeyType *high);
+
+  // room for fences and entries, in bytes
+  static size_t GetAreaSize();
+  static size_t SpaceFor(const MappingType *items, int count,
+                         const KeyType *low, const KeyType *high);
+  bool HasRoomFor(const KeyType &key) const;
+  bool IsFull() const;
+  bool IsUnderfull() const;
+  bool CanLoseEntry() const;
+  // replace all entries and the fences
+  void Assign(const MappingType *items, int count, const KeyType *low,
+              const KeyType *high);
 
   // insert and delete methods
   int Insert(const KeyType &key, const ValueType &value,
@@ -49,24 +68,15 @@ public:
               const KeyComparator &comparator) const;
   int RemoveAndDeleteRecord(const KeyType &key,
                             const KeyComparator &comparator);
-  // Split and Merge utility methods
-  void MoveHalfTo(BPlusTreeLeafPage *recipient,
-                  BufferPoolManager *buffer_pool_manager /* Unused */);
-  void MoveAllTo(BPlusTreeLeafPage *recipient, int /* Unused */,
-                 BufferPoolManager * /* Unused */);
-  void MoveFirstToEndOf(BPlusTreeLeafPage *recipient,
-                        BufferPoolManager *buffer_pool_manager);
-  void MoveLastToFrontOf(BPlusTreeLeafPage *recipient, int parentIndex,
-                         BufferPoolManager *buffer_pool_manager);
   // Debug
   std::string ToString(bool verbose = false) const;
 private:
-  void CopyHalfFrom(MappingType *items, int size);
-  void CopyAllFrom(MappingType *items, int size);
-  void CopyLastFrom(const MappingType &item);
-  void CopyFirstFrom(const MappingType &item, int parentIndex,
-                     BufferPoolManager *buffer_pool_manager);
+  size_t MaxEntrySize() const;
+  int CompareAt(int index, const KeyType &key,
+                const KeyComparator &comparator) const;
+  const KeyType &KeyRef(int index, KeyType &scratch) const;
   page_id_t next_page_id_;
-  MappingType array[0];
+  page_id_t prev_page_id_;
+  char data_[0];
 };
 } // namespace scudb
@@ -6,12 +6,37 @@
  * It actually serves as a header part for each B+ tree page and
  * contains information shared by both leaf page and internal page.
  *
- * Header format (size in byte, 20 bytes in total):
+ * Header format (size in byte, 28 bytes in total):
  * ----------------------------------------------------------------------------
  * | PageType (4) | LSN (4) | CurrentSize (4) | MaxSize (4) |
  * ----------------------------------------------------------------------------
- * | ParentPageId (4) | PageId(4) |
+ * | PageId(4) | PrefixSize (2) | LowFenceSize (2) | HighFenceSize (2) |
  * ----------------------------------------------------------------------------
+ * | HeapSize (2) |
+ * ----------------------------------------------------------------------------
+ *
+ * Pages do not keep their parent page id. A writer that splits or merges a
+ * page has its parent latched right before it on the way down, see
+ * BPlusTree::ParentOf, so moving children between pages leaves them alone.
+ *
+ * Fence keys: the keys of a page lie within [low fence, high fence), the
+ * separators around it in its parent. Trees with wide normalized keys store
+ * them in front of the entries, cut off after their last non-zero byte, with
+ * the high fence left out up to the prefix. All keys of the page then start
+ * with the common prefix of the fences, so the entries leave it out. An open
+ * side (the low fence of the left most page, the high fence of the right most
+ * one) gives no prefix. Other trees keep both sides open.
+ *
+ * Entries: keys narrower than VARIABLE_KEY_MIN_SIZE take fixed size entries,
+ * the key without the prefix followed by the value. Wider keys are cut off
+ * after their last non-zero byte as well and go into a slotted page:
+ *  ---------------------------------------------------------------------------
+ * | FENCES | SLOT(1) | SLOT(2) | ... | SLOT(n) | free | ENTRY(k) | ... |
+ *  ---------------------------------------------------------------------------
+ * Slots are kept in key order, each one is the 2 byte offset of its entry.
+ * Entries (KeyLength (1) | KEY | VALUE) fill the heap at the end of the page,
+ * which is kept without gaps. MaxSize is the most entries a page can hold
+ * then, pages are split and merged by bytes instead.
  */
 
 #pragma once
@@ -32,13 +57,17 @@ namespace scudb {
   template <typename KeyType, typename ValueType, typename KeyComparator>
 
 // define page type enum
-enum class IndexPageType { INVALID_INDEX_PAGE = 0, LEAF_PAGE, INTERNAL_PAGE };
+enum class IndexPageType {
+  INVALID_INDEX_PAGE = 0,
+  LEAF_PAGE,
+  INTERNAL_PAGE,
+  POSTING_PAGE
+};
 
 // Abstract class.
 class BPlusTreePage {
 public:
   bool IsLeafPage() const;
-  bool IsRootPage() const;
   void SetPageType(IndexPageType page_type);
 
   int GetSize() const;
@@ -49,22 +78,57 @@ public:
   void SetMaxSize(int max_size);
   int GetMinSize() const;
 
-  page_id_t GetParentPageId() const;
-  void SetParentPageId(page_id_t parent_page_id);
-
   page_id_t GetPageId() const;
   void SetPageId(page_id_t page_id);
 
   void SetLSN(lsn_t lsn = INVALID_LSN);
 
 protected:
+  // fence keys and entries, kept at data in front of area bytes that reach
+  // the end of the page. Keys are key_size bytes, values value_size bytes
+  static bool IsSlotted(size_t key_size);
+  void InitEntries(size_t area, size_t key_size, size_t value_size);
+  size_t FenceSize() const;
+  bool GetFence(const char *data, bool high, char *key, size_t key_size) const;
+  void GetPrefix(const char *data, char *key) const;
+  int ComparePrefix(const char *data, const char *key) const;
+  void SetFences(char *data, size_t area, size_t key_size, size_t value_size,
+                 const char *low, const char *high, bool keep_first_key);
+
+  // bytes taken by fences low and high and an entry for key between them
+  static size_t FencesSize(const char *low, const char *high, size_t key_size,
+                           size_t &prefix);
+  static size_t EntrySize(const char *key, size_t key_size, size_t value_size,
+                          size_t prefix);
+  size_t EntrySizeAt(const char *data, size_t area, size_t key_size,
+                     size_t value_size, int index) const;
+  size_t FreeSpace(size_t area, size_t key_size, size_t value_size) const;
+
+  const char *StoredKey(const char *data, size_t area, size_t key_size,
+                        size_t value_size, int index, size_t &length) const;
+  void GetKey(const char *data, size_t area, size_t key_size,
+              size_t value_size, int index, char *key) const;
+  int CompareKey(const char *data, size_t area, size_t key_size,
+                 size_t value_size, int index, const char *key) const;
+  void InsertEntry(char *data, size_t area, size_t key_size, size_t value_size,
+                   int index, const char *key, const char *value);
+  void RemoveEntry(char *data, size_t area, size_t key_size, size_t value_size,
+                   int index);
+
   // member variable, attributes that both internal and leaf page share
   IndexPageType page_type_;
   lsn_t lsn_;
   int size_;
   int max_size_;
-  page_id_t parent_page_id_;
   page_id_t page_id_;
+  uint16_t prefix_size_;
+  uint16_t low_fence_size_;
+  // UNBOUNDED while the high side is open
+  uint16_t high_fence_size_;
+  // bytes of the entries of a slotted page
+  uint16_t heap_size_;
+
+  static const uint16_t UNBOUNDED = 0xFFFF;
 };
 
 } // namespace scudb
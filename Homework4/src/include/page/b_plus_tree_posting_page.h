@@ -0,0 +1,57 @@
+/**
+ * b_plus_tree_posting_page.h
+ *
+ * Segments of the posting lists of a non-unique b+ tree, see
+ * index/posting_list.h. A page holds segments of any number of lists.
+ *
+ * Posting page format:
+ *  ---------------------------------------------------------------------------
+ * | HEADER | SLOT(0) | SLOT(1) | ... | SLOT(n) | free | SEGMENT(k) | ... |
+ *  ---------------------------------------------------------------------------
+ * Slots keep their number while the page changes, so a segment is referred
+ * to by page id and slot. Each one is Offset (2) | Size (2), size 0 marks a
+ * free slot. Segments fill the heap at the end of the page, which is kept
+ * without gaps.
+ *
+ *  Header format (size in byte, 16 bytes in total):
+ *  ---------------------------------------------------------------------
+ * | PageType (4) | LSN (4) | PageId (4) | SlotCount (2) | HeapSize (2) |
+ *  ---------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include "page/b_plus_tree_page.h"
+
+namespace scudb {
+
+class BPlusTreePostingPage {
+public:
+  // must call initialize method after "create" a new page
+  void Init(page_id_t page_id);
+  page_id_t GetPageId() const;
+
+  // largest segment a page can hold
+  static size_t GetMaxSegmentSize();
+  // bytes of the segment in slot, nullptr for a free slot
+  const char *GetSegment(int slot, size_t &size) const;
+  // @return: slot of the new segment, -1 if it does not fit
+  int InsertSegment(const char *segment, size_t size);
+  // @return: false if the new bytes do not fit, the segment stays as it is
+  bool UpdateSegment(int slot, const char *segment, size_t size);
+  void RemoveSegment(int slot);
+  bool IsEmpty() const;
+
+private:
+  size_t FreeSpace() const;
+  void PlaceSegment(int slot, const char *segment, size_t size);
+
+  IndexPageType page_type_;
+  lsn_t lsn_;
+  page_id_t page_id_;
+  uint16_t slot_count_;
+  uint16_t heap_size_;
+  char data_[0];
+};
+
+} // namespace scudb
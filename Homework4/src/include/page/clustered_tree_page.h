@@ -0,0 +1,64 @@
+/**
+ * clustered_tree_page.h
+ *
+ * Pages of a clustered tree, see table/clustered_tree.h. Pages are read and
+ * written whole by the tree, records are packed one after the other.
+ *
+ * Leaf page format, a row is its key followed by the tuple as written by
+ * Tuple::SerializeTo:
+ *  ---------------------------------------------------------------------------
+ * | HEADER | KEY(1) | TUPLE(1) | KEY(2) | TUPLE(2) | ... | KEY(n) | TUPLE(n) |
+ *  ---------------------------------------------------------------------------
+ *
+ * Internal page format (key(0) is left out, each key is the smallest key its
+ * child may hold):
+ *  ---------------------------------------------------------------------------
+ * | HEADER | KEY(0)+CHILD(0) | KEY(1)+CHILD(1) | ... | KEY(n)+CHILD(n) |
+ *  ---------------------------------------------------------------------------
+ *
+ *  Header format (size in byte, 20 bytes in total):
+ *  ---------------------------------------------------------------------
+ * | PageType (4) | LSN (4) | PageId (4) | NextPageId (4) | Size (4) |
+ *  ---------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "page/b_plus_tree_page.h"
+
+namespace scudb {
+
+class ClusteredTreePage {
+public:
+  // must call initialize method after "create" a new page
+  void Init(page_id_t page_id, bool leaf);
+  bool IsLeafPage() const;
+  page_id_t GetPageId() const;
+  page_id_t GetNextPageId() const;
+  void SetNextPageId(page_id_t next_page_id);
+
+  // bytes for the records of a page, and the bytes a record takes
+  static size_t GetCapacity();
+  static size_t GetRowSize(const std::string &row);
+  static size_t GetChildSize();
+
+  // rows of a leaf page, keys and children of an internal page
+  void GetRows(std::vector<int64_t> &keys, std::vector<std::string> &rows) const;
+  void SetRows(const int64_t *keys, const std::string *rows, int count);
+  void GetChildren(std::vector<int64_t> &keys,
+                   std::vector<page_id_t> &children) const;
+  void SetChildren(const int64_t *keys, const page_id_t *children, int count);
+
+private:
+  IndexPageType page_type_;
+  lsn_t lsn_;
+  page_id_t page_id_;
+  page_id_t next_page_id_;
+  int size_;
+  char data_[0];
+};
+
+} // namespace scudb
@@ -6,9 +6,15 @@
  * 32 bytes) and their corresponding root_id
  *
  * Format (size in byte):
- *  -----------------------------------------------------------------
- * | RecordCount (4) | Entry_1 name (32) | Entry_1 root_id (4) | ... |
- *  -----------------------------------------------------------------
+ *  ---------------------------------------------------------------------
+ * | Magic (4) | Version (4) | RecordCount (4) | Entry_1 name (32) | ...
+ *  ---------------------------------------------------------------------
+ *  -------------------------------
+ *  | Entry_1 root_id (4) | ... |
+ *  -------------------------------
+ * Magic is DB_FILE_MAGIC and Version is DB_FORMAT_VERSION of the code that
+ * created the file. Files written before the header page had them are not
+ * accepted, since their layout differs too.
  */
 
 #pragma once
@@ -21,7 +27,9 @@ namespace scudb {
 
 class HeaderPage : public Page {
 public:
-  void Init() { SetRecordCount(0); }
+  void Init();
+  // whether the file was created in the format this code reads
+  bool HasCurrentFormat();
   /**
    * Record related
    */
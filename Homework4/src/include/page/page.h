@@ -4,10 +4,15 @@
  * Wrapper around actual data page in main memory and also contains bookkeeping
  * information used by buffer pool manager like pin_count/dirty_flag/page_id.
  * Use page as a basic unit within the database system
+ * The page content lives in a frame owned by the buffer pool manager, or in
+ * the mapped db file when the database is opened read-only.
+ * The last PAGE_CHECKSUM_SIZE bytes of every page belong to the disk manager,
+ * which keeps a checksum of the rest of the page there.
  */
 
 #pragma once
 
+#include <atomic>
 #include <cstring>
 #include <iostream>
 
@@ -20,7 +25,7 @@ class Page {
   friend class BufferPoolManager;
 
 public:
-  Page() { ResetMemory(); }
+  Page() {}
   ~Page(){};
   // get actual data page content
   inline char *GetData() { return data_; }
@@ -29,10 +34,20 @@ public:
   // get page pin count
   inline int GetPinCount() { return pin_count_; }
   // method use to latch/unlatch page content
-  inline void WUnlatch() { rwlatch_.WUnlock(); }
-  inline void WLatch() { rwlatch_.WLock(); }
+  inline void WUnlatch() {
+    version_++;
+    rwlatch_.WUnlock();
+  }
+  inline void WLatch() {
+    rwlatch_.WLock();
+    version_++;
+  }
   inline void RUnlatch() { rwlatch_.RUnlock(); }
   inline void RLatch() { rwlatch_.RLock(); }
+  inline bool TryRLatch() { return rwlatch_.TryRLock(); }
+  // odd while the page is write latched, changes with every write latch, so
+  // a reader that does not latch can tell whether the content it read holds
+  inline uint64_t GetVersion() { return version_.load(); }
 
   inline lsn_t GetLSN() { return *reinterpret_cast<lsn_t *>(GetData() + 4); }
   inline void SetLSN(lsn_t lsn) { memcpy(GetData() + 4, &lsn, 4); }
@@ -41,11 +56,13 @@ private:
   // method used by buffer pool manager
   inline void ResetMemory() { memset(data_, 0, PAGE_SIZE); }
   // members
-  char data_[PAGE_SIZE]; // actual data
+  char *data_ = nullptr; // actual data
   page_id_t page_id_ = INVALID_PAGE_ID;
-  int pin_count_ = 0;
+  // changed without the pool latch when the pool is read-only
+  std::atomic<int> pin_count_{0};
   bool is_dirty_ = false;
   RWMutex rwlatch_;
+  std::atomic<uint64_t> version_{0};
 };
 
 } // namespace scudb
@@ -0,0 +1,110 @@
+/**
+ * clustered_tree.h
+ *
+ * Storage of a clustered (index-organized) table: a b+ tree on an integer
+ * key whose leaves hold the tuples themselves, in key order. A lookup is one
+ * descent and a key range is read leaf after leaf, there is no table heap.
+ *
+ * (1) Keys are unique, an insert of a key the tree has fails.
+ * (2) Pages are read into memory, changed and written back whole. A page
+ *     that runs over is split into pages of about even size.
+ * (3) Pages are split but never merged, a leaf emptied by deletes stays in
+ *     the tree until inserts fill it again.
+ * (4) Writers take the tree latch exclusively, readers shared. A reader
+ *     keeps no page pinned, scans read a batch of rows per descent.
+ */
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "buffer/buffer_pool_manager.h"
+#include "common/rwmutex.h"
+#include "page/clustered_tree_page.h"
+#include "table/tuple.h"
+
+namespace scudb {
+
+class ClusteredTree {
+public:
+  // opens the tree at root_page_id, or starts one with an empty leaf
+  ClusteredTree(const std::string &name, BufferPoolManager *buffer_pool_manager,
+                page_id_t root_page_id = INVALID_PAGE_ID);
+
+  inline page_id_t GetRootPageId() const { return root_page_id_; }
+
+  // whether the row of a tuple fits in a leaf page
+  static bool Fits(const Tuple &tuple);
+
+  // insert the row, false if the key is taken
+  bool Insert(int64_t key, const Tuple &tuple);
+
+  // replace the tuple of key, false if there is none
+  bool Update(int64_t key, const Tuple &tuple);
+
+  // remove the row of key, false if there is none
+  bool Remove(int64_t key);
+
+  bool GetTuple(int64_t key, Tuple &tuple);
+
+  // up to limit rows with keys from low to high, in order, or in reverse
+  // order starting at high
+  void Read(int64_t low, int64_t high, bool reverse, size_t limit,
+            std::vector<std::pair<int64_t, Tuple>> &result);
+
+private:
+  enum class Change { INSERT, UPDATE, REMOVE };
+  // first key of a page split off and its page id
+  typedef std::pair<int64_t, page_id_t> Split;
+
+  // page read into memory, rows of a leaf or children of an internal page
+  struct Node {
+    page_id_t page_id = INVALID_PAGE_ID;
+    bool leaf = true;
+    page_id_t next_page_id = INVALID_PAGE_ID;
+    std::vector<int64_t> keys;
+    std::vector<std::string> rows;
+    std::vector<page_id_t> children;
+  };
+
+  bool Write(int64_t key, Change change, const Tuple *tuple);
+  bool Apply(Node &node, int64_t key, Change change, const std::string &row,
+             std::vector<Split> &splits);
+  void FindLeaf(int64_t key, Node &leaf, int64_t &low_fence);
+  int Route(const Node &node, int64_t key) const;
+
+  void Load(page_id_t page_id, Node &node);
+  void Store(Node &node, std::vector<Split> &splits);
+  void UpdateRootPageId();
+
+  std::string name_;
+  page_id_t root_page_id_;
+  BufferPoolManager *buffer_pool_manager_;
+  RWMutex latch_;
+};
+
+/*
+ * Key range scan over a clustered tree, like IndexScan. It reads
+ * INDEX_SCAN_BATCH_SIZE rows at a time and resumes after the last key.
+ */
+class ClusteredTreeScan {
+public:
+  ClusteredTreeScan(ClusteredTree *tree, int64_t low, int64_t high,
+                    bool descending)
+      : tree_(tree), low_(low), high_(high), descending_(descending) {}
+
+  // replace batch with the next rows of the scan
+  // @return: false if the scan is exhausted
+  bool Next(std::vector<std::pair<int64_t, Tuple>> &batch);
+
+private:
+  ClusteredTree *tree_;
+  // keys not read yet
+  int64_t low_;
+  int64_t high_;
+  bool descending_;
+  bool done_ = false;
+};
+
+} // namespace scudb
@@ -4,17 +4,44 @@
 
 #pragma once
 
+#include <algorithm>
+#include <vector>
+
 #include "buffer/lru_replacer.h"
 #include "catalog/schema.h"
 #include "concurrency/transaction_manager.h"
+#include "index/b_epsilon_tree_index.h"
 #include "index/b_plus_tree_index.h"
 #include "logging/log_manager.h"
 #include "sqlite/sqlite3ext.h"
+#include "table/clustered_tree.h"
 #include "table/table_heap.h"
 #include "table/tuple.h"
 #include "type/value.h"
 
 namespace scudb {
+/*
+ * idxNum of an index scan. INDEX_POINT_SCAN has an equality on every key
+ * column, INDEX_RANGE_SCAN has equalities on the leading key columns, their
+ * count shifted by INDEX_EQ_SHIFT, followed by the range bounds flagged below
+ * and walks the keys backwards if INDEX_DESCENDING is set. Either scan sets
+ * INDEX_COVERING if the query reads key columns only, which are then taken
+ * from the index entries instead of the table. A range scan sets
+ * INDEX_HEAP_ORDER if many rows match and SQLite does not need them in key
+ * order: all matches are collected first and fetched page by page.
+ * argv holds the equality values in key column order, then the bounds.
+ */
+#define INDEX_POINT_SCAN 1
+#define INDEX_RANGE_SCAN 2
+#define INDEX_LOW_BOUND 4
+#define INDEX_LOW_INCLUSIVE 8
+#define INDEX_HIGH_BOUND 16
+#define INDEX_HIGH_INCLUSIVE 32
+#define INDEX_DESCENDING 64
+#define INDEX_COVERING 128
+#define INDEX_HEAP_ORDER 256
+#define INDEX_EQ_SHIFT 9
+
 /* Helpers */
 Schema *ParseCreateStatement(const std::string &sql);
 
@@ -24,6 +51,11 @@ IndexMetadata *ParseIndexStatement(std::string &sql,
 
 Tuple ConstructTuple(Schema *schema, sqlite3_value **argv);
 
+Value ConstructValue(TypeId type, sqlite3_value *value);
+
+bool ConstructBound(TypeId type, sqlite3_value *value, bool low, Value &bound,
+                    bool &inclusive);
+
 Index *ConstructIndex(IndexMetadata *metadata,
                       BufferPoolManager *buffer_pool_manager,
                       page_id_t root_id = INVALID_PAGE_ID);
@@ -62,11 +94,14 @@ int VtabBegin(sqlite3_vtab *pVTab);
 // storage engine
 class StorageEngine {
 public:
-  StorageEngine(std::string db_file_name) {
+  // read_only: map the db file and serve pages from the mapping
+  // compressed: compress the pages of a new db file
+  StorageEngine(std::string db_file_name, bool read_only = false,
+                bool compressed = false) {
     ENABLE_LOGGING = false;
 
     // storage related
-    disk_manager_ = new DiskManager(db_file_name);
+    disk_manager_ = new DiskManager(db_file_name, read_only, compressed);
 
     // log related
     log_manager_ = new LogManager(disk_manager_);
@@ -121,10 +156,22 @@ public:
     }
   }
 
+  // clustered table, its tuples are kept in a tree on key_column whose root
+  // is recorded under the table name
+  VirtualTable(Schema *schema, BufferPoolManager *buffer_pool_manager,
+               const std::string &name, int key_column,
+               page_id_t root_page_id = INVALID_PAGE_ID)
+      : schema_(schema), table_heap_(nullptr),
+        clustered_tree_(
+            new ClusteredTree(name, buffer_pool_manager, root_page_id)),
+        key_column_(key_column) {}
+
   ~VirtualTable() {
+    FlushEntries();
     delete schema_;
     delete table_heap_;
     delete index_;
+    delete clustered_tree_;
   }
 
   // insert into table heap
@@ -132,7 +179,7 @@ public:
     return table_heap_->InsertTuple(tuple, rid, GetTransaction());
   }
 
-  // insert into index
+  // insert into index, entries are collected and inserted in batches
   inline void InsertEntry(const Tuple &tuple, const RID &rid) {
     if (index_ == nullptr)
       return;
@@ -141,8 +188,68 @@ public:
 
     for (auto &i : index_->GetKeyAttrs())
       key_values.push_back(tuple.GetValue(schema_, i));
-    Tuple key(key_values, index_->GetKeySchema());
-    index_->InsertEntry(key, rid, GetTransaction());
+    if (IsKeyTaken(key_values))
+      return;
+    pending_entries_.emplace_back(Tuple(key_values, index_->GetKeySchema()),
+                                  rid);
+    if (pending_entries_.size() >= INDEX_INSERT_BATCH_SIZE)
+      FlushEntries();
+  }
+
+  // insert the collected entries, before the index is read or deleted from
+  // and at commit
+  inline void FlushEntries() {
+    if (pending_entries_.empty())
+      return;
+    index_->InsertEntries(pending_entries_, GetTransaction());
+    pending_entries_.clear();
+  }
+
+  // a unique index with included columns is unique over the columns in front
+  // of "include" only, an entry is dropped if they are taken, like an entry
+  // of a unique index whose whole key is taken
+  inline bool IsKeyTaken(const std::vector<Value> &key_values) {
+    int included = index_->GetMetadata()->GetIncludedColumnCount();
+    if (!index_->GetMetadata()->IsUnique() || included == 0)
+      return false;
+    FlushEntries();
+    std::vector<Value> key(key_values.begin(), key_values.end() - included);
+    std::vector<RID> result;
+    index_->ScanRange(key, true, key, true, result, GetTransaction());
+    return !result.empty();
+  }
+
+  // bulk load the index out of the tuples already in the table heap
+  inline bool BuildIndex() {
+    if (index_ == nullptr)
+      return true;
+    Transaction *txn = storage_engine_->transaction_manager_->Begin();
+    TableIterator iterator = table_heap_->begin(txn);
+    // bulk loading drops duplicate keys only, included columns are part of it
+    if (index_->GetMetadata()->IsUnique() &&
+        index_->GetMetadata()->GetIncludedColumnCount() > 0) {
+      for (; iterator != table_heap_->end(); ++iterator)
+        InsertEntry(*iterator, iterator->GetRid());
+      FlushEntries();
+      storage_engine_->transaction_manager_->Commit(txn);
+      delete txn;
+      return true;
+    }
+    bool ok = index_->BulkLoad([&](Tuple &key, RID &rid) {
+      if (iterator == table_heap_->end())
+        return false;
+      // construct indexed key tuple
+      std::vector<Value> key_values;
+      for (auto &i : index_->GetKeyAttrs())
+        key_values.push_back(iterator->GetValue(schema_, i));
+      key = Tuple(key_values, index_->GetKeySchema());
+      rid = iterator->GetRid();
+      ++iterator;
+      return true;
+    });
+    storage_engine_->transaction_manager_->Commit(txn);
+    delete txn;
+    return ok;
   }
 
   // delete from table heap
@@ -155,6 +262,7 @@ public:
   inline void DeleteEntry(const RID &rid) {
     if (index_ == nullptr)
       return;
+    FlushEntries();
     Tuple deleted_tuple(rid);
     table_heap_->GetTuple(rid, deleted_tuple, GetTransaction());
     // construct indexed key tuple
@@ -163,7 +271,7 @@ public:
     for (auto &i : index_->GetKeyAttrs())
       key_values.push_back(deleted_tuple.GetValue(schema_, i));
     Tuple key(key_values, index_->GetKeySchema());
-    index_->DeleteEntry(key, GetTransaction());
+    index_->DeleteEntry(key, rid, GetTransaction());
   }
 
   // update table heap tuple
@@ -172,7 +280,12 @@ public:
     return table_heap_->UpdateTuple(tuple, rid, GetTransaction());
   }
 
-  inline TableIterator begin() { return table_heap_->begin(GetTransaction()); }
+  // a clustered table is scanned through its tree, see Cursor
+  inline TableIterator begin() {
+    if (clustered_tree_ != nullptr)
+      return TableIterator(nullptr, RID(), nullptr);
+    return table_heap_->begin(GetTransaction());
+  }
 
   inline TableIterator end() { return table_heap_->end(); }
 
@@ -182,7 +295,26 @@ public:
 
   inline TableHeap *GetTableHeap() { return table_heap_; }
 
-  inline page_id_t GetFirstPageId() { return table_heap_->GetFirstPageId(); }
+  inline page_id_t GetFirstPageId() {
+    if (clustered_tree_ != nullptr)
+      return clustered_tree_->GetRootPageId();
+    return table_heap_->GetFirstPageId();
+  }
+
+  inline bool IsClustered() { return clustered_tree_ != nullptr; }
+
+  inline ClusteredTree *GetClusteredTree() { return clustered_tree_; }
+
+  inline int GetKeyColumn() { return key_column_; }
+
+  // key of a clustered table, which is also the rowid of the tuple
+  inline int64_t GetClusteredKey(const Value &value) {
+    return value.CastAs(TypeId::BIGINT).GetAs<int64_t>();
+  }
+
+  inline int64_t GetClusteredKey(const Tuple &tuple) {
+    return GetClusteredKey(tuple.GetValue(schema_, key_column_));
+  }
 
 private:
   sqlite3_vtab base_;
@@ -192,12 +324,29 @@ private:
   TableHeap *table_heap_;
   // to insert/delete index entry
   Index *index_ = nullptr;
+  // holds the tuples of a clustered table instead of the table heap
+  ClusteredTree *clustered_tree_ = nullptr;
+  int key_column_ = -1;
+  // index entries of inserted tuples, not in the index yet
+  std::vector<std::pair<Tuple, RID>> pending_entries_;
 };
 
 class Cursor {
 public:
   Cursor(VirtualTable *virtual_table)
-      : table_iterator_(virtual_table->begin()), virtual_table_(virtual_table) {
+      : table_iterator_(virtual_table->begin()),
+        is_clustered_(virtual_table->IsClustered()),
+        virtual_table_(virtual_table) {
+    // key column of each table column, if any
+    Index *index = virtual_table->index_;
+    key_columns_.assign(virtual_table->schema_->GetColumnCount(), -1);
+    for (int i = 0; index != nullptr && i < index->GetIndexColumnCount(); i++)
+      key_columns_[index->GetKeyAttrs()[i]] = i;
+  }
+
+  ~Cursor() {
+    delete index_scan_;
+    delete clustered_scan_;
   }
 
   inline void SetScanFlag(bool is_index_scan) {
@@ -213,19 +362,29 @@ public:
   }
   // return rid at which cursor is currently pointed
   inline int64_t GetCurrentRid() {
+    if (is_clustered_)
+      return rows_[offset_].first;
     if (is_index_scan_)
       return results[offset_].Get();
     else
       return (*table_iterator_).GetRid().Get();
   }
 
-  // return tuple at which cursor is currently pointed
+  // return tuple at which cursor is currently pointed. a covering index scan
+  // answers for key columns from the index entry, otherwise the tuple is
+  // fetched once per row
   inline Value GetCurrentValue(Schema *schema, int column) {
+    if (is_clustered_)
+      return rows_[offset_].second.GetValue(schema, column);
     if (is_index_scan_) {
-      RID rid = results[offset_];
-      Tuple tuple(rid);
-      virtual_table_->table_heap_->GetTuple(rid, tuple, GetTransaction());
-      return tuple.GetValue(schema, column);
+      if (!keys_.empty() && key_columns_[column] >= 0)
+        return keys_[offset_].GetValue(GetKeySchema(), key_columns_[column]);
+      if (!fetched_) {
+        virtual_table_->table_heap_->GetTuple(results[offset_], tuple_,
+                                              GetTransaction());
+        fetched_ = true;
+      }
+      return tuple_.GetValue(schema, column);
     } else {
       return table_iterator_->GetValue(schema, column);
     }
@@ -233,32 +392,138 @@ public:
 
   // move cursor up to next
   Cursor &operator++() {
-    if (is_index_scan_)
+    if (is_clustered_) {
+      // read the next batch of rows of the tree
+      if (++offset_ == static_cast<int>(rows_.size())) {
+        clustered_scan_->Next(rows_);
+        offset_ = 0;
+      }
+    } else if (is_index_scan_) {
+      fetched_ = false;
       ++offset_;
-    else
+      // rows in heap order reach the next page
+      if (!heap_pages_.empty() && !isEof() &&
+          results[offset_].GetPageId() != heap_pages_[page_index_]) {
+        page_index_++;
+        PrefetchPages();
+      }
+      // fetch the next batch of an open range scan
+      if (offset_ == static_cast<int>(results.size()) &&
+          index_scan_ != nullptr) {
+        if (keys_.empty())
+          index_scan_->Next(results);
+        else
+          index_scan_->Next(results, keys_);
+        offset_ = 0;
+      }
+    } else
       ++table_iterator_;
     return *this;
   }
   // is end of cursor(no more tuple)
   inline bool isEof() {
+    if (is_clustered_)
+      return offset_ == static_cast<int>(rows_.size());
     if (is_index_scan_)
       return offset_ == static_cast<int>(results.size());
     else
       return table_iterator_ == virtual_table_->end();
   }
 
-  // wrapper around poit scan methods
-  inline void ScanKey(const Tuple &key) {
+  // wrapper around poit scan methods, every entry found has the key looked up
+  inline void ScanKey(const Tuple &key, bool covering) {
+    delete index_scan_;
+    index_scan_ = nullptr;
+    results.clear();
+    keys_.clear();
+    heap_pages_.clear();
+    offset_ = 0;
+    fetched_ = false;
     virtual_table_->index_->ScanKey(key, results);
+    if (covering)
+      keys_.assign(results.size(), key);
+  }
+
+  // wrapper around range scan methods, rows are fetched a batch at a time,
+  // or all at once and sorted by RID in heap order
+  inline void OpenScan(const std::vector<Value> &low, bool low_inclusive,
+                       const std::vector<Value> &high, bool high_inclusive,
+                       bool descending, bool covering, bool heap_order) {
+    delete index_scan_;
+    index_scan_ = virtual_table_->index_->OpenScan(low, low_inclusive, high,
+                                                   high_inclusive, descending);
+    keys_.clear();
+    heap_pages_.clear();
+    offset_ = 0;
+    fetched_ = false;
+    if (covering) {
+      index_scan_->Next(results, keys_);
+      return;
+    }
+    index_scan_->Next(results);
+    if (!heap_order)
+      return;
+    std::vector<RID> batch;
+    while (index_scan_->Next(batch))
+      results.insert(results.end(), batch.begin(), batch.end());
+    delete index_scan_;
+    index_scan_ = nullptr;
+    std::sort(results.begin(), results.end(),
+              [](const RID &a, const RID &b) { return a.Get() < b.Get(); });
+    for (const RID &rid : results)
+      if (heap_pages_.empty() || heap_pages_.back() != rid.GetPageId())
+        heap_pages_.push_back(rid.GetPageId());
+    page_index_ = prefetched_ = 0;
+    PrefetchPages();
+  }
+
+  // scan over keys from low to high of a clustered table, rows are read a
+  // batch at a time
+  inline void OpenClusteredScan(int64_t low, int64_t high, bool descending) {
+    delete clustered_scan_;
+    clustered_scan_ = new ClusteredTreeScan(virtual_table_->clustered_tree_,
+                                            low, high, descending);
+    offset_ = 0;
+    clustered_scan_->Next(rows_);
   }
 
 private:
+  // ask for the heap pages up to PREFETCH_DISTANCE ahead of the current one,
+  // once half of those asked for before have been reached
+  inline void PrefetchPages() {
+    if (prefetched_ == heap_pages_.size() ||
+        prefetched_ > page_index_ + PREFETCH_DISTANCE / 2)
+      return;
+    size_t end = std::min(heap_pages_.size(), page_index_ + PREFETCH_DISTANCE);
+    storage_engine_->buffer_pool_manager_->Prefetch(std::vector<page_id_t>(
+        heap_pages_.begin() + prefetched_, heap_pages_.begin() + end));
+    prefetched_ = end;
+  }
+
   sqlite3_vtab_cursor base_; /* Base class - must be first */
   // for index scan
   std::vector<RID> results;
   int offset_ = 0;
+  // key tuple of each result, only for covering scans
+  std::vector<Tuple> keys_;
+  // key column of each table column, -1 if not indexed
+  std::vector<int> key_columns_;
+  // tuple of the current result, once fetched
+  Tuple tuple_;
+  bool fetched_ = false;
+  // pages of results in heap order, the current one and the end of those
+  // prefetched
+  std::vector<page_id_t> heap_pages_;
+  size_t page_index_ = 0;
+  size_t prefetched_ = 0;
+  // refills results for range scans
+  IndexScan *index_scan_ = nullptr;
+  // for clustered tables, keys and tuples of the current batch
+  std::vector<std::pair<int64_t, Tuple>> rows_;
+  ClusteredTreeScan *clustered_scan_ = nullptr;
   // for sequential scan
   TableIterator table_iterator_;
+  bool is_clustered_;
   // flag to indicate which scan method is currently used
   bool is_index_scan_ = false;
   VirtualTable *virtual_table_;
@@ -0,0 +1,494 @@
+/**
+ * b_epsilon_tree.cpp
+ */
+#include <algorithm>
+#include <cstdint>
+
+#include "common/rid.h"
+#include "index/b_epsilon_tree.h"
+#include "page/header_page.h"
+
+namespace scudb {
+
+INDEX_TEMPLATE_ARGUMENTS
+BEPSILONTREE_TYPE::BEpsilonTree(const std::string &name,
+                                BufferPoolManager *buffer_pool_manager,
+                                const KeyComparator &comparator,
+                                page_id_t root_page_id, bool unique)
+    : index_name_(name), root_page_id_(root_page_id),
+      buffer_pool_manager_(buffer_pool_manager), comparator_(comparator),
+      unique_(unique) {}
+
+INDEX_TEMPLATE_ARGUMENTS
+bool BEPSILONTREE_TYPE::IsEmpty() const
+{
+    return root_page_id_ == INVALID_PAGE_ID;
+}
+
+/*****************************************************************************
+ * INSERTION AND DELETION
+ *****************************************************************************/
+INDEX_TEMPLATE_ARGUMENTS
+void BEPSILONTREE_TYPE::Insert(const KeyType &key, const ValueType &value, Transaction *)
+{
+    std::vector<Message> Messages(1);
+    Messages[0].entry = std::make_pair(key, value);
+    Messages[0].remove = false;
+    Put(Messages);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void BEPSILONTREE_TYPE::InsertBatch(std::vector<MappingType> &items, Transaction *)
+{
+    // stable, so the first of equal entries is applied first
+    std::stable_sort(items.begin(), items.end(), [this](const MappingType &a, const MappingType &b) {
+        return Compare(a, b) < 0;
+    });
+    std::vector<Message> Messages(items.size());
+    for (size_t i = 0; i < items.size(); i++)
+    {
+        Messages[i].entry = items[i];
+        Messages[i].remove = false;
+    }
+    if (!Messages.empty()) Put(Messages);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void BEPSILONTREE_TYPE::Remove(const KeyType &key, const ValueType &value, Transaction *)
+{
+    std::vector<Message> Messages(1);
+    Messages[0].entry = std::make_pair(key, value);
+    Messages[0].remove = true;
+    Put(Messages);
+}
+
+/*
+ * Push sorted messages into the root, starting a tree with an empty leaf if
+ * there is none. Pages split off the root go under a new one, as many times
+ * as it takes.
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void BEPSILONTREE_TYPE::Put(std::vector<Message> &messages)
+{
+    latch_.WLock();
+    bool NewTree = root_page_id_ == INVALID_PAGE_ID;
+    Node Root;
+    std::vector<Split> Splits;
+    if (NewTree)
+    {
+        Push(Root, messages, Splits);
+        root_page_id_ = Root.page_id;
+        UpdateRootPageId(true);
+    }
+    else
+    {
+        Load(root_page_id_, Root);
+        Push(Root, messages, Splits);
+    }
+    while (!Splits.empty())
+    {
+        Node NewRoot;
+        NewRoot.leaf = false;
+        NewRoot.entries.push_back(Splits[0].first);
+        NewRoot.children.push_back(root_page_id_);
+        for (auto &Split : Splits)
+        {
+            NewRoot.entries.push_back(Split.first);
+            NewRoot.children.push_back(Split.second);
+        }
+        Splits.clear();
+        Store(NewRoot, Splits);
+        root_page_id_ = NewRoot.page_id;
+        UpdateRootPageId(false);
+    }
+    latch_.WUnlock();
+}
+
+/*
+ * A leaf applies the messages. An internal page adds them to its buffer and,
+ * while that is over capacity, flushes the messages for the child with the
+ * most of them down to it; the pages the child split into join the children.
+ * Pages node itself splits into are added to splits.
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void BEPSILONTREE_TYPE::Push(Node &node, std::vector<Message> &messages, std::vector<Split> &splits)
+{
+    if (node.leaf)
+    {
+        Apply(node.entries, messages);
+        Store(node, splits);
+        return;
+    }
+    Merge(node.messages, messages);
+    while ((int)node.messages.size() > BEPSILONPAGE_TYPE::GetMaxMessages())
+    {
+        std::vector<int> Counts(node.children.size(), 0);
+        for (auto &Message : node.messages) Counts[Route(node, Message.entry)]++;
+        int Child = std::max_element(Counts.begin(), Counts.end()) - Counts.begin();
+        std::vector<Message> Batch, Rest;
+        for (auto &Message : node.messages)
+            (Route(node, Message.entry) == Child ? Batch : Rest).push_back(Message);
+        node.messages.swap(Rest);
+
+        Node ChildNode;
+        std::vector<Split> ChildSplits;
+        Load(node.children[Child], ChildNode);
+        Push(ChildNode, Batch, ChildSplits);
+        for (size_t i = 0; i < ChildSplits.size(); i++)
+        {
+            node.entries.insert(node.entries.begin() + Child + 1 + i, ChildSplits[i].first);
+            node.children.insert(node.children.begin() + Child + 1 + i, ChildSplits[i].second);
+        }
+    }
+    Store(node, splits);
+}
+
+/*
+ * Apply messages, older first, to sorted entries. An insert adds its entry
+ * unless there is one already, a delete removes the entry if it has the value
+ * of the message.
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void BEPSILONTREE_TYPE::Apply(std::vector<MappingType> &entries, const std::vector<Message> &messages) const
+{
+    if (messages.empty()) return;
+    std::vector<MappingType> Result;
+    Result.reserve(entries.size() + messages.size());
+    size_t i = 0, j = 0;
+    while (i < entries.size() || j < messages.size())
+    {
+        if (j == messages.size() || (i < entries.size() && Compare(entries[i], messages[j].entry) < 0))
+        {
+            Result.push_back(entries[i++]);
+            continue;
+        }
+        bool Present = i < entries.size() && Compare(entries[i], messages[j].entry) == 0;
+        MappingType Entry = Present ? entries[i++] : messages[j].entry;
+        for (; j < messages.size() && Compare(messages[j].entry, Entry) == 0; j++)
+        {
+            if (!messages[j].remove && !Present)
+            {
+                Entry = messages[j].entry;
+                Present = true;
+            }
+            else if (messages[j].remove && Present && Entry.second == messages[j].entry.second)
+            {
+                Present = false;
+            }
+        }
+        if (Present) Result.push_back(Entry);
+    }
+    entries.swap(Result);
+}
+
+/*
+ * Merge sorted messages into sorted older ones, behind older messages for the
+ * same entry
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void BEPSILONTREE_TYPE::Merge(std::vector<Message> &older, const std::vector<Message> &newer) const
+{
+    if (newer.empty()) return;
+    std::vector<Message> Result(older.size() + newer.size());
+    std::merge(older.begin(), older.end(), newer.begin(), newer.end(), Result.begin(),
+               [this](const Message &a, const Message &b) { return Compare(a.entry, b.entry) < 0; });
+    older.swap(Result);
+}
+
+/*****************************************************************************
+ * SEARCH
+ *****************************************************************************/
+INDEX_TEMPLATE_ARGUMENTS
+bool BEPSILONTREE_TYPE::GetValue(const KeyType &key, std::vector<ValueType> &result, Transaction *)
+{
+    Range Bounds = {&key, nullptr, &key, false, SIZE_MAX};
+    std::vector<MappingType> Entries;
+    latch_.RLock();
+    if (!IsEmpty()) Collect(root_page_id_, std::vector<Message>(), Bounds, Entries);
+    latch_.RUnlock();
+    for (auto &Entry : Entries) result.push_back(Entry.second);
+    return !Entries.empty();
+}
+
+/*
+ * Entries are not posting lists, each one stands for its own value
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void BEPSILONTREE_TYPE::GetPostings(const ValueType &value, std::vector<ValueType> &result)
+{
+    result.push_back(value);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void BEPSILONTREE_TYPE::Read(const KeyType *key, const MappingType *after, bool reverse, size_t limit,
+                             std::vector<MappingType> &result)
+{
+    Range Bounds = {key, after, nullptr, reverse, limit};
+    latch_.RLock();
+    if (!IsEmpty()) Collect(root_page_id_, std::vector<Message>(), Bounds, result);
+    latch_.RUnlock();
+}
+
+/*
+ * Depth first, in the order of the range: the messages of a page join the
+ * pending ones from above, each child gets those routed to it, and a leaf
+ * applies them before its entries are read. Children wholly outside of the
+ * range are skipped.
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void BEPSILONTREE_TYPE::Collect(page_id_t page_id, const std::vector<Message> &pending, const Range &range,
+                                std::vector<MappingType> &result)
+{
+    Node Current;
+    Load(page_id, Current);
+    if (Current.leaf)
+    {
+        Apply(Current.entries, pending);
+        int Count = Current.entries.size();
+        for (int k = 0; k < Count && result.size() < range.limit; k++)
+        {
+            const MappingType &Entry = Current.entries[range.reverse ? Count - 1 - k : k];
+            if (BeforeStart(Entry, range)) continue;
+            if (PastEnd(Entry, range)) break;
+            result.push_back(Entry);
+        }
+        return;
+    }
+    // pending messages are newer than those of the page
+    Merge(Current.messages, pending);
+    int Count = Current.children.size();
+    for (int k = 0; k < Count && result.size() < range.limit; k++)
+    {
+        int i = range.reverse ? Count - 1 - k : k;
+        // the entries of child i lie within [pivot i, pivot i + 1)
+        const MappingType *Low = i > 0 ? &Current.entries[i] : nullptr;
+        const MappingType *High = i + 1 < Count ? &Current.entries[i + 1] : nullptr;
+        const MappingType *Start = range.reverse ? Low : High;
+        const MappingType *End = range.reverse ? High : Low;
+        if (Start && BeforeStart(*Start, range)) continue;
+        if (End && PastEnd(*End, range)) break;
+        std::vector<Message> Messages;
+        for (auto &Message : Current.messages)
+            if (Route(Current, Message.entry) == i) Messages.push_back(Message);
+        Collect(Current.children[i], Messages, range, result);
+    }
+}
+
+/*****************************************************************************
+ * UTILITIES AND DEBUG
+ *****************************************************************************/
+/*
+ * Entries are ordered by key, in a non-unique tree by value next
+ */
+INDEX_TEMPLATE_ARGUMENTS
+int BEPSILONTREE_TYPE::Compare(const MappingType &left, const MappingType &right) const
+{
+    int Result = comparator_(left.first, right.first);
+    if (Result || unique_) return Result;
+    int64_t Left = left.second.Get(), Right = right.second.Get();
+    return Left < Right ? -1 : Left > Right;
+}
+
+/*
+ * Child of an internal node entry belongs to: the last one whose pivot is
+ * not above it
+ */
+INDEX_TEMPLATE_ARGUMENTS
+int BEPSILONTREE_TYPE::Route(const Node &node, const MappingType &entry) const
+{
+    int Low = 1, High = node.children.size();
+    while (Low < High)
+    {
+        int Mid = (Low + High) / 2;
+        if (Compare(node.entries[Mid], entry) <= 0)
+            Low = Mid + 1;
+        else
+            High = Mid;
+    }
+    return Low - 1;
+}
+
+/*
+ * Whether entry comes before the start of the range, in the order of the range
+ */
+INDEX_TEMPLATE_ARGUMENTS
+bool BEPSILONTREE_TYPE::BeforeStart(const MappingType &entry, const Range &range) const
+{
+    if (range.key)
+    {
+        int Result = comparator_(entry.first, *range.key);
+        return range.reverse ? Result > 0 : Result < 0;
+    }
+    if (range.after)
+    {
+        int Result = Compare(entry, *range.after);
+        return range.reverse ? Result >= 0 : Result <= 0;
+    }
+    return false;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+bool BEPSILONTREE_TYPE::PastEnd(const MappingType &entry, const Range &range) const
+{
+    if (!range.until) return false;
+    int Result = comparator_(entry.first, *range.until);
+    return range.reverse ? Result < 0 : Result > 0;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void BEPSILONTREE_TYPE::Load(page_id_t page_id, Node &node)
+{
+    auto Frame = buffer_pool_manager_->FetchPage(page_id);
+    Frame->RLatch();
+    auto Current = reinterpret_cast<BEPSILONPAGE_TYPE*>(Frame->GetData());
+    node.page_id = page_id;
+    node.leaf = Current->IsLeafPage();
+    node.next_page_id = Current->GetNextPageId();
+    if (node.leaf)
+    {
+        Current->GetEntries(node.entries);
+    }
+    else
+    {
+        Current->GetChildren(node.entries, node.children);
+        Current->GetMessages(node.messages);
+    }
+    Frame->RUnlatch();
+    buffer_pool_manager_->UnpinPage(page_id, false);
+}
+
+/*
+ * Write node back, split into as few pages of even size as its entries or
+ * children fit in. The first one keeps the page id of node, a new node gets
+ * one. The pages after it are added to splits, leaves are chained in order.
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void BEPSILONTREE_TYPE::Store(Node &node, std::vector<Split> &splits)
+{
+    int Count = node.leaf ? node.entries.size() : node.children.size();
+    int Max = node.leaf ? BEPSILONPAGE_TYPE::GetMaxEntries() : BEPSILONPAGE_TYPE::GetMaxChildren();
+    int Parts = std::max(1, (Count + Max - 1) / Max);
+    std::vector<page_id_t> PageIds(Parts, node.page_id);
+    size_t Messages = node.messages.size();
+    // backwards, so that the page a leaf links to exists
+    for (int p = Parts - 1; p >= 0; p--)
+    {
+        int Begin = (int64_t)Count * p / Parts, End = (int64_t)Count * (p + 1) / Parts;
+        Page *Frame;
+        if (p == 0 && node.page_id != INVALID_PAGE_ID)
+            Frame = buffer_pool_manager_->FetchPage(node.page_id);
+        else
+            Frame = buffer_pool_manager_->NewPage(PageIds[p]);
+        Frame->WLatch();
+        auto Current = reinterpret_cast<BEPSILONPAGE_TYPE*>(Frame->GetData());
+        Current->Init(PageIds[p], node.leaf);
+        Current->SetNextPageId(p + 1 < Parts ? PageIds[p + 1] : node.next_page_id);
+        if (node.leaf)
+        {
+            Current->SetEntries(node.entries.data() + Begin, End - Begin);
+        }
+        else
+        {
+            Current->SetChildren(node.entries.data() + Begin, node.children.data() + Begin, End - Begin);
+            size_t First = Messages;
+            while (First > 0 && Route(node, node.messages[First - 1].entry) >= Begin) First--;
+            Current->SetMessages(node.messages.data() + First, Messages - First);
+            Messages = First;
+        }
+        Frame->WUnlatch();
+        buffer_pool_manager_->UnpinPage(PageIds[p], true);
+    }
+    node.page_id = PageIds[0];
+    for (int p = 1; p < Parts; p++)
+        splits.push_back(std::make_pair(node.entries[(int64_t)Count * p / Parts], PageIds[p]));
+}
+
+/*
+ * Update/Insert root page id in header page, see BPlusTree::UpdateRootPageId
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void BEPSILONTREE_TYPE::UpdateRootPageId(int insert_record)
+{
+    HeaderPage *header_page = static_cast<HeaderPage *>(buffer_pool_manager_->FetchPage(HEADER_PAGE_ID));
+    header_page->WLatch();
+    if (!insert_record || !header_page->InsertRecord(index_name_, root_page_id_))
+        header_page->UpdateRecord(index_name_, root_page_id_);
+    header_page->WUnlatch();
+    buffer_pool_manager_->UnpinPage(HEADER_PAGE_ID, true);
+}
+
+/*****************************************************************************
+ * ITERATOR
+ *****************************************************************************/
+INDEX_TEMPLATE_ARGUMENTS
+BEPSILONTREE_ITERATOR_TYPE BEPSILONTREE_TYPE::Begin()
+{
+    return BEPSILONTREE_ITERATOR_TYPE(this, nullptr, false);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+BEPSILONTREE_ITERATOR_TYPE BEPSILONTREE_TYPE::Begin(const KeyType &key)
+{
+    return BEPSILONTREE_ITERATOR_TYPE(this, &key, false);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+BEPSILONTREE_ITERATOR_TYPE BEPSILONTREE_TYPE::RBegin()
+{
+    return BEPSILONTREE_ITERATOR_TYPE(this, nullptr, true);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+BEPSILONTREE_ITERATOR_TYPE BEPSILONTREE_TYPE::RBegin(const KeyType &key)
+{
+    return BEPSILONTREE_ITERATOR_TYPE(this, &key, true);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+BEPSILONTREE_ITERATOR_TYPE::BEpsilonTreeIterator(BEPSILONTREE_TYPE *tree, const KeyType *key, bool reverse)
+    : tree_(tree), reverse_(reverse)
+{
+    tree_->Read(key, nullptr, reverse_, INDEX_SCAN_BATCH_SIZE, entries_);
+    last_ = entries_.size() < INDEX_SCAN_BATCH_SIZE;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+bool BEPSILONTREE_ITERATOR_TYPE::isEnd()
+{
+    return position_ == entries_.size();
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+const MappingType &BEPSILONTREE_ITERATOR_TYPE::operator*()
+{
+    return entries_[position_];
+}
+
+/*
+ * The next batch starts right after the last entry of this one
+ */
+INDEX_TEMPLATE_ARGUMENTS
+BEPSILONTREE_ITERATOR_TYPE &BEPSILONTREE_ITERATOR_TYPE::operator++()
+{
+    if (++position_ < entries_.size() || last_) return *this;
+    MappingType After = entries_.back();
+    entries_.clear();
+    position_ = 0;
+    tree_->Read(nullptr, &After, reverse_, INDEX_SCAN_BATCH_SIZE, entries_);
+    last_ = entries_.size() < INDEX_SCAN_BATCH_SIZE;
+    return *this;
+}
+
+template class BEpsilonTree<GenericKey<4>, RID, GenericComparator<4>>;
+template class BEpsilonTree<GenericKey<8>, RID, GenericComparator<8>>;
+template class BEpsilonTree<GenericKey<16>, RID, GenericComparator<16>>;
+template class BEpsilonTree<GenericKey<32>, RID, GenericComparator<32>>;
+template class BEpsilonTree<GenericKey<64>, RID, GenericComparator<64>>;
+
+template class BEpsilonTreeIterator<GenericKey<4>, RID, GenericComparator<4>>;
+template class BEpsilonTreeIterator<GenericKey<8>, RID, GenericComparator<8>>;
+template class BEpsilonTreeIterator<GenericKey<16>, RID, GenericComparator<16>>;
+template class BEpsilonTreeIterator<GenericKey<32>, RID, GenericComparator<32>>;
+template class BEpsilonTreeIterator<GenericKey<64>, RID, GenericComparator<64>>;
+
+} // namespace scudb
@@ -0,0 +1,169 @@
+/**
+ * b_epsilon_tree_index.cpp
+ */
+
+#include <algorithm>
+#include <cstdint>
+
+#include "index/b_epsilon_tree_index.h"
+
+namespace scudb {
+/*
+ * Constructor
+ */
+INDEX_TEMPLATE_ARGUMENTS
+BEPSILONTREE_INDEX_TYPE::BEpsilonTreeIndex(
+    IndexMetadata *metadata, BufferPoolManager *buffer_pool_manager,
+    page_id_t root_page_id)
+    : Index(metadata),
+      comparator_(metadata->GetKeySchema(), metadata->HasNormalizedKeys()),
+      container_(metadata->GetName(), buffer_pool_manager, comparator_,
+                 root_page_id, metadata->IsUnique()) {}
+
+INDEX_TEMPLATE_ARGUMENTS
+void BEPSILONTREE_INDEX_TYPE::InsertEntry(const Tuple &key, RID rid,
+                                          Transaction *transaction) {
+  KeyType index_key;
+  SetIndexKey(index_key, key);
+
+  container_.Insert(index_key, rid, transaction);
+}
+
+/*
+ * All entries go down the tree as one batch of messages
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void BEPSILONTREE_INDEX_TYPE::InsertEntries(
+    const std::vector<std::pair<Tuple, RID>> &entries,
+    Transaction *transaction) {
+  std::vector<MappingType> items(entries.size());
+  for (size_t i = 0; i < entries.size(); i++) {
+    SetIndexKey(items[i].first, entries[i].first);
+    items[i].second = entries[i].second;
+  }
+  container_.InsertBatch(items, transaction);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void BEPSILONTREE_INDEX_TYPE::DeleteEntry(const Tuple &key, RID rid,
+                                          Transaction *transaction) {
+  KeyType index_key;
+  SetIndexKey(index_key, key);
+
+  container_.Remove(index_key, rid, transaction);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void BEPSILONTREE_INDEX_TYPE::ScanKey(const Tuple &key,
+                                      std::vector<RID> &result,
+                                      Transaction *transaction) {
+  KeyType index_key;
+  SetIndexKey(index_key, key);
+
+  container_.GetValue(index_key, result, transaction);
+}
+
+/*
+ * Keys are sorted first, so the RIDs come in key order
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void BEPSILONTREE_INDEX_TYPE::ScanKeys(const std::vector<Tuple> &keys,
+                                       std::vector<RID> &result,
+                                       Transaction *transaction) {
+  std::vector<KeyType> index_keys(keys.size());
+  for (size_t i = 0; i < keys.size(); i++)
+    SetIndexKey(index_keys[i], keys[i]);
+  std::sort(index_keys.begin(), index_keys.end(),
+            [this](const KeyType &a, const KeyType &b) {
+              return comparator_(a, b) < 0;
+            });
+  index_keys.erase(std::unique(index_keys.begin(), index_keys.end(),
+                               [this](const KeyType &a, const KeyType &b) {
+                                 return comparator_(a, b) == 0;
+                               }),
+                   index_keys.end());
+  for (const KeyType &index_key : index_keys)
+    container_.GetValue(index_key, result, transaction);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void BEPSILONTREE_INDEX_TYPE::SetIndexKey(KeyType &index_key,
+                                          const Tuple &key) {
+  if (comparator_.IsNormalized())
+    index_key.SetFromKey(key, GetKeySchema());
+  else
+    index_key.SetFromKey(key);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void BEPSILONTREE_INDEX_TYPE::ScanRange(const std::vector<Value> &low,
+                                        bool low_inclusive,
+                                        const std::vector<Value> &high,
+                                        bool high_inclusive,
+                                        std::vector<RID> &result,
+                                        Transaction *) {
+  BPlusTreeIndexScan<KeyType, ValueType, KeyComparator,
+                     BEpsilonTree<KeyType, ValueType, KeyComparator>>
+      scan(&container_, comparator_, GetKeySchema(), low, low_inclusive, high,
+           high_inclusive, false, SIZE_MAX);
+  std::vector<RID> batch;
+  scan.Next(batch);
+  result.insert(result.end(), batch.begin(), batch.end());
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+IndexScan *BEPSILONTREE_INDEX_TYPE::OpenScan(const std::vector<Value> &low,
+                                             bool low_inclusive,
+                                             const std::vector<Value> &high,
+                                             bool high_inclusive,
+                                             bool descending, Transaction *) {
+  return new BPlusTreeIndexScan<KeyType, ValueType, KeyComparator,
+                                BEpsilonTree<KeyType, ValueType, KeyComparator>>(
+      &container_, comparator_, GetKeySchema(), low, low_inclusive, high,
+      high_inclusive, descending);
+}
+
+/*
+ * Entries are inserted in batches of BULK_LOAD_RUN_SIZE, there is no bottom
+ * up build. Each batch is sorted, so its messages reach the leaves in key
+ * order.
+ * @return: false if the index is not empty
+ */
+INDEX_TEMPLATE_ARGUMENTS
+bool BEPSILONTREE_INDEX_TYPE::BulkLoad(
+    const std::function<bool(Tuple &, RID &)> &next, Transaction *transaction) {
+  if (!container_.IsEmpty())
+    return false;
+  std::vector<MappingType> run;
+  Tuple key;
+  RID rid;
+  bool more = next(key, rid);
+  while (more) {
+    run.resize(run.size() + 1);
+    SetIndexKey(run.back().first, key);
+    run.back().second = rid;
+    more = next(key, rid);
+    if (run.size() < BULK_LOAD_RUN_SIZE && more)
+      continue;
+    container_.InsertBatch(run, transaction);
+    run.clear();
+  }
+  return true;
+}
+
+/*
+ * Keys with varchars may be cut off, see GenericKey
+ */
+INDEX_TEMPLATE_ARGUMENTS
+bool BEPSILONTREE_INDEX_TYPE::StoresKeyValues() const {
+  return GetKeySchema()->GetUnlinedColumnCount() == 0 &&
+         GetKeySchema()->GetLength() <= (int32_t)sizeof(KeyType);
+}
+
+template class BEpsilonTreeIndex<GenericKey<4>, RID, GenericComparator<4>>;
+template class BEpsilonTreeIndex<GenericKey<8>, RID, GenericComparator<8>>;
+template class BEpsilonTreeIndex<GenericKey<16>, RID, GenericComparator<16>>;
+template class BEpsilonTreeIndex<GenericKey<32>, RID, GenericComparator<32>>;
+template class BEpsilonTreeIndex<GenericKey<64>, RID, GenericComparator<64>>;
+
+} // namespace scudb
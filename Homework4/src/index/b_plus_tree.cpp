@@ -1,8 +1,13 @@
 ﻿/**
  * b_plus_tree.cpp
  */
+#include <algorithm>
+#include <atomic>
 #include <iostream>
+#include <map>
+#include <random>
 #include <string>
+#include <thread>
 
 #include "common/exception.h"
 #include "common/logger.h"
@@ -16,9 +21,10 @@ INDEX_TEMPLATE_ARGUMENTS
 BPLUSTREE_TYPE::BPlusTree(const std::string &name,
                                 BufferPoolManager *buffer_pool_manager,
                                 const KeyComparator &comparator,
-                                page_id_t root_page_id)
+                                page_id_t root_page_id, bool unique)
     : index_name_(name), root_page_id_(root_page_id),
-      buffer_pool_manager_(buffer_pool_manager), comparator_(comparator) {}
+      buffer_pool_manager_(buffer_pool_manager), comparator_(comparator),
+      unique_(unique), postings_(buffer_pool_manager) {}
 
 /*
  * Helper function to decide whether current b+tree is empty
@@ -32,7 +38,8 @@ bool BPLUSTREE_TYPE::IsEmpty() const
  * SEARCH
  *****************************************************************************/
 /*
- * Return the only value that associated with input key
+ * Return the values associated with input key, one unless the tree is
+ * non-unique
  * This method is used for point query
  * @return : true means key exists
  */
@@ -41,19 +48,190 @@ bool BPLUSTREE_TYPE::GetValue(const KeyType &key,
                               std::vector<ValueType> &result,
                               Transaction *transaction) 
 {
-    auto* LeafPage = FindLeafPage(key, false);// , Operation::READONLY, transaction);
-    if (LeafPage) 
+    Page* Frame = FindLeafPage(key, false, Operation::READONLY, transaction);
+    if (!Frame) return false;
+    auto* LeafPage = reinterpret_cast<LEAFPAGE_TYPE*>(Frame->GetData());
+    ValueType Value;
+    bool Found = LeafPage->Lookup(key, Value, comparator_);
+    if (Found) postings_.Read(Value, result);
+    Frame->RUnlatch();
+    buffer_pool_manager_->UnpinPage(Frame->GetPageId(), false);
+    return Found;
+}
+
+/*
+ * Look up keys one after another. A key is searched in the leaf the last one
+ * was found in if it lies between the first and last key there, or in the
+ * next leaf up to its last key, otherwise the search descends from the root
+ * again. A finger whose tree changed its structure since is not used.
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void BPLUSTREE_TYPE::GetValues(const std::vector<KeyType> &keys,
+                               std::vector<ValueType> &result, LeafFinger *finger,
+                               Transaction *transaction)
+{
+    Page* Frame = finger ? FetchFinger(*finger) : nullptr;
+    uint64_t Version = finger ? finger->version : 0;
+    for (const KeyType &key : keys)
     {
+        auto* Leaf = Frame ? reinterpret_cast<LEAFPAGE_TYPE*>(Frame->GetData()) : nullptr;
+        if (Leaf && !Covers(Leaf, key))
+        {
+            // crab over like the iterator does, only trying the latch, a full
+            // pool or a failed latch falls back to a fresh descent below
+            Page* Next = nullptr;
+            if (Leaf->GetSize() && comparator_(key, Leaf->KeyAt(0)) > 0 &&
+                Leaf->GetNextPageId() != INVALID_PAGE_ID)
+            {
+                Next = buffer_pool_manager_->FetchPage(Leaf->GetNextPageId());
+                if (Next && !Next->TryRLatch())
+                {
+                    buffer_pool_manager_->UnpinPage(Next->GetPageId(), false);
+                    Next = nullptr;
+                }
+            }
+            Frame->RUnlatch();
+            buffer_pool_manager_->UnpinPage(Frame->GetPageId(), false);
+            Frame = Next;
+            auto* NextLeaf = Next ? reinterpret_cast<LEAFPAGE_TYPE*>(Next->GetData()) : nullptr;
+            if (NextLeaf && (!NextLeaf->GetSize() ||
+                             comparator_(key, NextLeaf->KeyAt(NextLeaf->GetSize() - 1)) > 0))
+            {
+                Next->RUnlatch();
+                buffer_pool_manager_->UnpinPage(Next->GetPageId(), false);
+                Frame = nullptr;
+            }
+        }
+        if (!Frame)
+        {
+            Frame = FindLeafPage(key, false, Operation::READONLY, transaction);
+            if (!Frame) return;
+            // the leaf is latched, whatever changes it bumps the version later
+            Version = structure_version_;
+        }
+        Leaf = reinterpret_cast<LEAFPAGE_TYPE*>(Frame->GetData());
         ValueType Value;
-        if (LeafPage->Lookup(key, Value, comparator_)) 
+        if (Leaf->Lookup(key, Value, comparator_)) postings_.Read(Value, result);
+    }
+    if (!Frame) return;
+    if (finger)
+    {
+        finger->page_id = Frame->GetPageId();
+        finger->version = Version;
+    }
+    Frame->RUnlatch();
+    buffer_pool_manager_->UnpinPage(Frame->GetPageId(), false);
+}
+
+/*
+ * Helper to latch the leaf of finger
+ * @return: nullptr if the tree changed its structure since
+ */
+INDEX_TEMPLATE_ARGUMENTS
+Page *BPLUSTREE_TYPE::FetchFinger(const LeafFinger &finger)
+{
+    if (finger.page_id == INVALID_PAGE_ID || finger.version != structure_version_) return nullptr;
+    Page* Frame = buffer_pool_manager_->FetchPage(finger.page_id);
+    if (!Frame) return nullptr;
+    Frame->RLatch();
+    if (finger.version == structure_version_) return Frame;
+    Frame->RUnlatch();
+    buffer_pool_manager_->UnpinPage(finger.page_id, false);
+    return nullptr;
+}
+
+/*
+ * Helper to check whether key belongs in leaf: it does if it lies between
+ * the first and the last key of the leaf
+ */
+INDEX_TEMPLATE_ARGUMENTS
+bool BPLUSTREE_TYPE::Covers(LEAFPAGE_TYPE *leaf, const KeyType &key)
+{
+    return leaf->GetSize() && comparator_(key, leaf->KeyAt(0)) >= 0 &&
+           comparator_(key, leaf->KeyAt(leaf->GetSize() - 1)) <= 0;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void BPLUSTREE_TYPE::GetPostings(const ValueType &value, std::vector<ValueType> &result)
+{
+    postings_.Read(value, result);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+ValueType BPLUSTREE_TYPE::MakePostings(const std::vector<ValueType> &values)
+{
+    return postings_.Build(values);
+}
+
+/*
+ * Knuth's estimator: each descent picks a child at random, every one with the
+ * same chance. The product of the sizes of the pages on the way is how many
+ * leaves the one reached stands for, averaged over the descents. The values
+ * of the keys of a leaf are counted in full, the descents are the same every
+ * time, so estimates only change with the tree.
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void BPLUSTREE_TYPE::Sample(size_t count, TreeSample<KeyType> &sample)
+{
+    std::minstd_rand Random;
+    std::vector<ValueType> Values;
+    std::map<page_id_t, size_t> Reached;
+    size_t Descents = 0;
+    for (; Descents < count; Descents++)
+    {
+        root_latch_.RLock();
+        if (IsEmpty())
         {
-            result.push_back(Value);
-            buffer_pool_manager_->UnpinPage(LeafPage->GetPageId(), false);
-            return true;
+            root_latch_.RUnlock();
+            break;
+        }
+        Page* Frame = buffer_pool_manager_->FetchPage(root_page_id_);
+        Frame->RLatch();
+        root_latch_.RUnlock();
+        auto* Node = reinterpret_cast<BPlusTreePage*>(Frame->GetData());
+        double Weight = 1;
+        int Height = 1;
+        while (!Node->IsLeafPage())
+        {
+            auto Internal = reinterpret_cast<INTERNALPAGE_TYPE*>(Node);
+            Weight *= Internal->GetSize();
+            Page* Child = buffer_pool_manager_->FetchPage(Internal->ValueAt(Random() % Internal->GetSize()));
+            Child->RLatch();
+            Frame->RUnlatch();
+            buffer_pool_manager_->UnpinPage(Frame->GetPageId(), false);
+            Frame = Child;
+            Node = reinterpret_cast<BPlusTreePage*>(Frame->GetData());
+            Height++;
         }
-        buffer_pool_manager_->UnpinPage(LeafPage->GetPageId(), false);
+        auto Leaf = reinterpret_cast<LEAFPAGE_TYPE*>(Node);
+        sample.height = Height;
+        sample.leaf_count += Weight;
+        sample.key_count += Weight * Leaf->GetSize();
+        // posting lists of a leaf reached before are not read again
+        auto Before = Reached.find(Leaf->GetPageId());
+        if (Before != Reached.end())
+        {
+            sample.leaves.push_back({Weight, sample.leaves[Before->second].keys});
+        }
+        else
+        {
+            Reached[Leaf->GetPageId()] = sample.leaves.size();
+            sample.leaves.push_back({Weight, {}});
+            for (int i = 0; i < Leaf->GetSize(); i++)
+            {
+                Values.clear();
+                GetPostings(Leaf->ValueAt(i), Values);
+                sample.leaves.back().keys.push_back(std::make_pair(Leaf->KeyAt(i), Values.size()));
+            }
+        }
+        for (auto &Key : sample.leaves.back().keys) sample.value_count += Weight * Key.second;
+        Frame->RUnlatch();
+        buffer_pool_manager_->UnpinPage(Frame->GetPageId(), false);
     }
-    return false;
+    if (!Descents) return;
+    sample.leaf_count /= Descents;
+    sample.key_count /= Descents;
+    sample.value_count /= Descents;
 }
 
 /*****************************************************************************
@@ -63,19 +241,47 @@ bool BPLUSTREE_TYPE::GetValue(const KeyType &key,
  * Insert constant key & value pair into b+ tree
  * if current tree is empty, start new tree, update root page id and insert
  * entry, otherwise insert into leaf page.
- * @return: since we only support unique key, if user try to insert duplicate
- * keys return false, otherwise return true.
+ * The pages latched on the way down are released once the insert is done.
+ * @return: false if the key is there already in a unique tree, or the pair in
+ * a non-unique one, otherwise true.
  */
 INDEX_TEMPLATE_ARGUMENTS
 bool BPLUSTREE_TYPE::Insert(const KeyType &key, const ValueType &value,
                             Transaction *transaction) 
 {
-    if (IsEmpty()) 
+    // the page set keeps track of the latches
+    Transaction Local(INVALID_TXN_ID);
+    if (!transaction) transaction = &Local;
+    MappingType Item(key, value);
+    size_t Done;
+    bool Inserted = InsertIntoLeaf(&Item, 1, Done, transaction) == 1;
+    ReleaseLatches(transaction, true);
+    return Inserted;
+}
+
+/*
+ * Insert pairs, sorted by key first. Pairs that land in the same leaf go in
+ * under one descent and latch, see InsertIntoLeaf.
+ * @return: number of pairs inserted
+ */
+INDEX_TEMPLATE_ARGUMENTS
+int BPLUSTREE_TYPE::InsertBatch(std::vector<MappingType> &items,
+                                Transaction *transaction)
+{
+    std::stable_sort(items.begin(), items.end(), [this](const MappingType &a, const MappingType &b)
     {
-        StartNewTree(key, value);
-        return true;
+        return comparator_(a.first, b.first) < 0;
+    });
+    Transaction Local(INVALID_TXN_ID);
+    if (!transaction) transaction = &Local;
+    int Inserted = 0;
+    size_t Done;
+    for (size_t i = 0; i < items.size(); i += Done)
+    {
+        Inserted += InsertIntoLeaf(items.data() + i, items.size() - i, Done, transaction);
+        ReleaseLatches(transaction, true);
     }
-    return InsertIntoLeaf(key, value, transaction);
+    return Inserted;
 }
 /*
  * Insert constant key & value pair into an empty tree
@@ -86,10 +292,11 @@ bool BPLUSTREE_TYPE::Insert(const KeyType &key, const ValueType &value,
 INDEX_TEMPLATE_ARGUMENTS
 void BPLUSTREE_TYPE::StartNewTree(const KeyType &key, const ValueType &value) 
 {
-    auto Root = reinterpret_cast<LEAFPAGE_TYPE*>(buffer_pool_manager_->NewPage(root_page_id_)->GetData());
-    UpdateRootPageId(true);
-    Root->Init(root_page_id_, INVALID_PAGE_ID);
+    page_id_t PageId;
+    auto Root = reinterpret_cast<LEAFPAGE_TYPE*>(buffer_pool_manager_->NewPage(PageId)->GetData());
+    Root->Init(PageId);
     Root->Insert(key, value, comparator_);
+    PublishRoot(PageId, true);
     buffer_pool_manager_->UnpinPage(Root->GetPageId(), true);
 }
 
@@ -98,38 +305,62 @@ void BPLUSTREE_TYPE::StartNewTree(const KeyType &key, const ValueType &value)
  * User needs to first find the right leaf page as insertion target, then look
  * through leaf page to see whether insert key exist or not. If exist, return
  * immdiately, otherwise insert entry. Remember to deal with split if necessary.
- * @return: since we only support unique key, if user try to insert duplicate
- * keys return false, otherwise return true.
+ * An empty tree is started here, under the root latch.
+ * In a non-unique tree a key that exists gets value added to its posting list,
+ * the leaf entry only changes its value.
+ * The pairs after the first one, sorted by key, go into the same leaf as long
+ * as they belong there, up to its last key unless it is the right most leaf,
+ * and fit. The leaf is only split for the first one.
+ * @param   done          set to the number of pairs dealt with
+ * @return: number of pairs inserted, a key that is there already in a unique
+ * tree or a pair that is there already in a non-unique one is not
  */
 INDEX_TEMPLATE_ARGUMENTS
-bool BPLUSTREE_TYPE::InsertIntoLeaf(const KeyType &key, const ValueType &value,
-                                    Transaction *transaction) 
+int BPLUSTREE_TYPE::InsertIntoLeaf(const MappingType *items, size_t count,
+                                   size_t &done, Transaction *transaction) 
 {
-    auto* Leaf = FindLeafPage(key, false);
-    if (!Leaf) return false;
-    ValueType v;
-    if (Leaf->Lookup(key, v, comparator_)) 
+    const KeyType &key = items[0].first;
+    const ValueType &value = items[0].second;
+    done = 1;
+    Page* Frame = FindLeafPage(key, false, Operation::INSERT, transaction);
+    if (!Frame) 
     {
-		buffer_pool_manager_->UnpinPage(Leaf->GetPageId(),false);
-		return false;
-	}
-    if (Leaf->GetSize() < Leaf->GetMaxSize()) Leaf->Insert(key, value, comparator_);
-    else 
+        StartNewTree(key, value);
+        return 1;
+    }
+    auto* Leaf = reinterpret_cast<LEAFPAGE_TYPE*>(Frame->GetData());
+    int Inserted = 0;
+    for (done = 0; done < count; done++)
     {
-        auto* Leaf2 = Split<BPlusTreeLeafPage<KeyType, ValueType, KeyComparator>>(Leaf);
-        if (comparator_(key, Leaf2->KeyAt(0)) < 0) Leaf->Insert(key, value, comparator_);
-        else Leaf2->Insert(key, value, comparator_);
-        if (comparator_(Leaf->KeyAt(0), Leaf2->KeyAt(0)) < 0) {
-
-            Leaf2->SetNextPageId(Leaf->GetNextPageId());
-            Leaf->SetNextPageId(Leaf2->GetPageId());
+        const KeyType &Key = items[done].first;
+        if (done && Leaf->GetNextPageId() != INVALID_PAGE_ID &&
+            comparator_(Key, Leaf->KeyAt(Leaf->GetSize() - 1)) > 0) break;
+        ValueType Head;
+        if (Leaf->Lookup(Key, Head, comparator_))
+        {
+            if (unique_ || !postings_.Add(Head, items[done].second)) continue;
+            Leaf->SetValueAt(Leaf->KeyIndex(Key, comparator_), Head);
         }
-        else Leaf2->SetNextPageId(Leaf->GetPageId());
-        InsertIntoParent(Leaf, Leaf2->KeyAt(0), Leaf2, transaction);
-        buffer_pool_manager_->UnpinPage(Leaf2->GetPageId(),true);
+        else if (Leaf->HasRoomFor(Key)) Leaf->Insert(Key, items[done].second, comparator_);
+        else break;
+        Inserted++;
     }
-    buffer_pool_manager_->UnpinPage(Leaf->GetPageId(),true);
-    return true;
+    if (done) return Inserted;
+    // the first pair does not fit, the leaf is split for it
+    std::vector<MappingType> Items;
+    for (int i = 0; i < Leaf->GetSize(); i++) Items.push_back(Leaf->GetItem(i));
+    Items.insert(Items.begin() + Leaf->KeyIndex(key, comparator_), std::make_pair(key, value));
+    KeyType Middle;
+    auto* Leaf2 = Split(Leaf, Items, Middle);
+    // the upper half moved, so the new leaf goes right after the old one
+    Leaf2->SetNextPageId(Leaf->GetNextPageId());
+    Leaf2->SetPrevPageId(Leaf->GetPageId());
+    Leaf->SetNextPageId(Leaf2->GetPageId());
+    if (Leaf2->GetNextPageId() != INVALID_PAGE_ID) SetPrevLeaf(Leaf2->GetNextPageId(), Leaf2->GetPageId());
+    InsertIntoParent(Leaf, Middle, Leaf2, transaction);
+    buffer_pool_manager_->UnpinPage(Leaf2->GetPageId(),true);
+    done = 1;
+    return 1;
 }
 
 /*
@@ -138,15 +369,27 @@ bool BPLUSTREE_TYPE::InsertIntoLeaf(const KeyType &key, const ValueType &value,
  * User needs to first ask for new page from buffer pool manager(NOTICE: throw
  * an "out of memory" exception if returned value is nullptr), then move half
  * of key & value pairs from input page to newly created page
+ * items are the entries of node and the one that did not fit, they are split
+ * where the bytes come out about even, see SplitPoint. separator is the key
+ * between the two pages.
+ * The new page stays pinned, the caller unpins it when done. It needs no latch,
+ * no other thread can reach it before the latched parent points to it.
  */
 INDEX_TEMPLATE_ARGUMENTS
-template <typename N> N *BPLUSTREE_TYPE::Split(N *node) 
+template <typename N, typename Item>
+N *BPLUSTREE_TYPE::Split(N *node, const std::vector<Item> &items, KeyType &separator) 
 { 
+    structure_version_++;
+    KeyType Low, High;
+    const KeyType* LowFence = FenceOf(node, false, Low);
+    const KeyType* HighFence = FenceOf(node, true, High);
+    int Count = SplitPoint<N>(items.data(), items.size(), LowFence, HighFence, node->IsLeafPage(), separator);
+    assert(Count > 0);
     page_id_t PageId;
     auto NewNode = reinterpret_cast<N*>(buffer_pool_manager_->NewPage(PageId)->GetData());
     NewNode->Init(PageId);
-    node->MoveHalfTo(NewNode, buffer_pool_manager_);
-    buffer_pool_manager_->UnpinPage(PageId,true);
+    node->Assign(items.data(), Count, LowFence, Fence(&separator));
+    NewNode->Assign(items.data() + Count, items.size() - Count, Fence(&separator), HighFence);
     return NewNode;
 }
 
@@ -158,6 +401,10 @@ template <typename N> N *BPLUSTREE_TYPE::Split(N *node)
  * User needs to first find the parent page of old_node, parent node must be
  * adjusted to take info of new_node into account. Remember to deal with split
  * recursively if necessary.
+ * The parent is write latched already, it is in the page set since old_node
+ * was not safe. A full parent is split around the entries with key in place,
+ * the key in the middle moves up. The children that move to the new page are
+ * not touched, pages do not point back at their parent.
  */
 INDEX_TEMPLATE_ARGUMENTS
 void BPLUSTREE_TYPE::InsertIntoParent(BPlusTreePage *old_node,
@@ -165,64 +412,36 @@ void BPLUSTREE_TYPE::InsertIntoParent(BPlusTreePage *old_node,
                                       BPlusTreePage *new_node,
                                       Transaction *transaction) 
 {
-    if (old_node->IsRootPage()) 
+    if (IsRoot(old_node)) 
     {
-        auto Root = reinterpret_cast<INTERNALPAGE_TYPE*>(buffer_pool_manager_->NewPage(root_page_id_)->GetData());
-        Root->Init(root_page_id_);
+        page_id_t PageId;
+        auto Root = reinterpret_cast<INTERNALPAGE_TYPE*>(buffer_pool_manager_->NewPage(PageId)->GetData());
+        Root->Init(PageId);
         Root->PopulateNewRoot(old_node->GetPageId(), key, new_node->GetPageId());
-        old_node->SetParentPageId(root_page_id_);
-        new_node->SetParentPageId(root_page_id_);
-        UpdateRootPageId(false);
+        PublishRoot(PageId, false);
         buffer_pool_manager_->UnpinPage(Root->GetPageId(), true);
     }
     else 
     {
-        auto Internal = reinterpret_cast<INTERNALPAGE_TYPE*>(buffer_pool_manager_->FetchPage(old_node->GetParentPageId())->GetData());
-        if (Internal->GetSize() < Internal->GetMaxSize()) 
+        auto Internal = ParentOf(old_node, transaction);
+        if (Internal->HasRoomFor(key)) 
         {
             Internal->InsertNodeAfter(old_node->GetPageId(), key, new_node->GetPageId());
-            new_node->SetParentPageId(Internal->GetPageId());
         }
         else 
         {
-            page_id_t PageId;
-            auto* Copy = reinterpret_cast<INTERNALPAGE_TYPE*>(buffer_pool_manager_->NewPage(PageId)->GetData());
-            Copy->Init(PageId);
-            Copy->SetSize(Internal->GetSize());
-            for (int i = 1, j = 0; i <= Internal->GetSize(); ++i, ++j) 
-            {
-                if (Internal->ValueAt(i - 1) == old_node->GetPageId()) 
-                {
-                    Copy->SetKeyAt(j, key);
-                    Copy->SetValueAt(j, new_node->GetPageId());
-                    ++j;
-                }
-                if (i < Internal->GetSize()) 
-                {
-                    Copy->SetKeyAt(j, Internal->KeyAt(i));
-                    Copy->SetValueAt(j, Internal->ValueAt(i));
-                }
-            }
-            auto Internal2 = Split<BPlusTreeInternalPage<KeyType, page_id_t, KeyComparator>>(Copy);
-            Internal->SetSize(Copy->GetSize() + 1);
-            for (int i = 0; i < Copy->GetSize(); ++i) 
-            {
-                Internal->SetKeyAt(i + 1, Copy->KeyAt(i));
-                Internal->SetValueAt(i + 1, Copy->ValueAt(i));
-            }
-
-            if (comparator_(key, Internal2->KeyAt(0)) < 0) new_node->SetParentPageId(Internal->GetPageId());
-            else if (comparator_(key, Internal2->KeyAt(0)) == 0)  new_node->SetParentPageId(Internal2->GetPageId());
-            else 
+            std::vector<std::pair<KeyType, page_id_t>> Entries;
+            for (int i = 0; i < Internal->GetSize(); i++)
             {
-                new_node->SetParentPageId(Internal2->GetPageId());
-                old_node->SetParentPageId(Internal2->GetPageId());
+                Entries.push_back(Internal->GetItem(i));
+                if (Internal->ValueAt(i) == old_node->GetPageId())
+                    Entries.push_back(std::make_pair(key, new_node->GetPageId()));
             }
-            buffer_pool_manager_->UnpinPage(Copy->GetPageId(), false);
-            buffer_pool_manager_->DeletePage(Copy->GetPageId());
-            InsertIntoParent(Internal, Internal2->KeyAt(0), Internal2);
+            KeyType Middle;
+            auto* Internal2 = Split(Internal, Entries, Middle);
+            InsertIntoParent(Internal, Middle, Internal2, transaction);
+            buffer_pool_manager_->UnpinPage(Internal2->GetPageId(), true);
         }
-        buffer_pool_manager_->UnpinPage(Internal->GetPageId(), true);
     }
 }
 
@@ -235,19 +454,59 @@ void BPLUSTREE_TYPE::InsertIntoParent(BPlusTreePage *old_node,
  * If not, User needs to first find the right leaf page as deletion target, then
  * delete entry from leaf page. Remember to deal with redistribute or merge if
  * necessary.
+ * Pages emptied by a merge are collected in the deleted page set and given
+ * back to the buffer pool once all latches are released.
  */
 INDEX_TEMPLATE_ARGUMENTS
 void BPLUSTREE_TYPE::Remove(const KeyType &key, Transaction *transaction) 
 {
-    if (IsEmpty()) return;
-    auto* Leaf = FindLeafPage(key, false);
-    if (Leaf) 
+    RemoveEntry(key, nullptr, transaction);
+}
+
+/*
+ * Delete value from the values of key. The posting list of a non-unique key
+ * shrinks, the entry is deleted like above once value was its last one.
+ * @return: false if key does not have value
+ */
+INDEX_TEMPLATE_ARGUMENTS
+bool BPLUSTREE_TYPE::Remove(const KeyType &key, const ValueType &value,
+                            Transaction *transaction)
+{
+    return RemoveEntry(key, &value, transaction);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+bool BPLUSTREE_TYPE::RemoveEntry(const KeyType &key, const ValueType *value,
+                                 Transaction *transaction)
+{
+    // the page set keeps track of the latches
+    Transaction Local(INVALID_TXN_ID);
+    if (!transaction) transaction = &Local;
+    Page* Frame = FindLeafPage(key, false, Operation::DELETE, transaction);
+    auto* Leaf = Frame ? reinterpret_cast<LEAFPAGE_TYPE*>(Frame->GetData()) : nullptr;
+    ValueType Head;
+    bool Removed = false;
+    if (Leaf && Leaf->Lookup(key, Head, comparator_)) 
     {
-        int size_before_deletion = Leaf->GetSize();
-        if (Leaf->RemoveAndDeleteRecord(key, comparator_) != size_before_deletion)
-            CoalesceOrRedistribute(Leaf, transaction);
-        buffer_pool_manager_->UnpinPage(Leaf->GetPageId(), true);
+        if (value && PostingList::IsList(Head))
+        {
+            Removed = postings_.Remove(Head, *value);
+            Leaf->SetValueAt(Leaf->KeyIndex(key, comparator_), Head);
+        }
+        else if (!value || Head == *value)
+        {
+            postings_.Free(Head);
+            Leaf->RemoveAndDeleteRecord(key, comparator_);
+            if (CoalesceOrRedistribute(Leaf, transaction))
+                transaction->AddIntoDeletedPageSet(Leaf->GetPageId());
+            Removed = true;
+        }
     }
+    ReleaseLatches(transaction, true);
+    for (page_id_t PageId : *transaction->GetDeletedPageSet())
+        buffer_pool_manager_->DeletePage(PageId);
+    transaction->GetDeletedPageSet()->clear();
+    return Removed;
 }
 
 /*
@@ -256,40 +515,53 @@ void BPLUSTREE_TYPE::Remove(const KeyType &key, Transaction *transaction)
  * Using template N to represent either internal page or leaf page.
  * @return: true means target leaf page should be deleted, false means no
  * deletion happens
+ * The parent is write latched already, it is in the page set since node was
+ * not safe. The sibling is latched here.
+ * Sizes are in bytes: node is merged if the entries of both fit in one page
+ * with fences that cover both, otherwise they are shared out evenly. If no
+ * way of sharing them out fits, node stays as it is.
  */
 INDEX_TEMPLATE_ARGUMENTS
 template <typename N>
 bool BPLUSTREE_TYPE::CoalesceOrRedistribute(N *node, Transaction *transaction) 
 {
-    if (node->IsRootPage()) return AdjustRoot(node);
-    if (node->IsLeafPage()&& node->GetSize() >= node->GetMinSize()) return false;
-    if (node->GetSize() > node->GetMinSize())  return false;
-    auto Parent = reinterpret_cast<INTERNALPAGE_TYPE*>(buffer_pool_manager_->FetchPage(node->GetParentPageId())->GetData());
+    if (IsRoot(node)) return AdjustRoot(node);
+    if (!node->IsUnderfull()) return false;
+    auto Parent = ParentOf(node, transaction);
     int ValueIndex = Parent->ValueIndex(node->GetPageId());
     int SiblingId = ValueIndex ? Parent->ValueAt(ValueIndex - 1) : Parent->ValueAt(ValueIndex + 1);
     auto* Page = buffer_pool_manager_->FetchPage(SiblingId);
+    Page->WLatch();
     auto Sibling = reinterpret_cast<N*>(Page->GetData());
-    if (Sibling->GetSize() + node->GetSize() > node->GetMaxSize()) 
+    bool NodeDeleted = false;
+    N* Left = ValueIndex ? Sibling : node;
+    N* Right = ValueIndex ? node : Sibling;
+    int Index = ValueIndex ? ValueIndex : 1;
+    std::vector<decltype(node->GetItem(0))> Items;
+    for (int i = 0; i < Left->GetSize(); i++) Items.push_back(Left->GetItem(i));
+    for (int i = 0; i < Right->GetSize(); i++) Items.push_back(Right->GetItem(i));
+    // the separator in the parent comes down in front of the children of right
+    if (!node->IsLeafPage()) Items[Left->GetSize()].first = Parent->KeyAt(Index);
+    KeyType Low, High;
+    const KeyType* LowFence = FenceOf(Left, false, Low);
+    const KeyType* HighFence = FenceOf(Right, true, High);
+    if (N::SpaceFor(Items.data(), Items.size(), LowFence, HighFence) > N::GetAreaSize()) 
     {
-        buffer_pool_manager_->UnpinPage(Parent->GetPageId(), true);
-        if (ValueIndex == 0) Redistribute<N>(Sibling, node, 1);
-                buffer_pool_manager_->UnpinPage(Sibling->GetPageId(), true);
-        return false;
+        Redistribute<N>(Left, Right, Parent, Index, Items, LowFence, HighFence);
     }
-    if (ValueIndex == 0) 
+    else if (ValueIndex == 0) 
     {
-        Coalesce<N>(node, Sibling, Parent, 1, transaction);
-        buffer_pool_manager_->UnpinPage(Parent->GetPageId(), true);
-        buffer_pool_manager_->UnpinPage(Sibling->GetPageId(), true);
-        return false;
+        Coalesce<N>(Left, Right, Parent, Index, Items, LowFence, HighFence, transaction);
+        transaction->AddIntoDeletedPageSet(SiblingId);
     }
     else 
     {
-        Coalesce<N>(Sibling, node, Parent, ValueIndex, transaction);
-        buffer_pool_manager_->UnpinPage(Parent->GetPageId(), true);
-        buffer_pool_manager_->UnpinPage(Sibling->GetPageId(), true);
-        return true;
+        Coalesce<N>(Left, Right, Parent, Index, Items, LowFence, HighFence, transaction);
+        NodeDeleted = true;
     }
+    Page->WUnlatch();
+    buffer_pool_manager_->UnpinPage(SiblingId, true);
+    return NodeDeleted;
 }
 
 /*
@@ -298,45 +570,61 @@ bool BPLUSTREE_TYPE::CoalesceOrRedistribute(N *node, Transaction *transaction)
  * take info of deletion into account. Remember to deal with coalesce or
  * redistribute recursively if necessary.
  * Using template N to represent either internal page or leaf page.
- * @param   neighbor_node      sibling page of input "node"
- * @param   node               input from method coalesceOrRedistribute()
- * @param   parent             parent page of input "node"
+ * @param   left, right        neighbouring pages, right is merged into left
+ * @param   parent             parent page of both, index is that of right
+ * @param   items              the entries of both, low and high the outer
+ *                             fences
  * @return  true means parent node should be deleted, false means no deletion
  * happend
  */
 INDEX_TEMPLATE_ARGUMENTS
-template <typename N>
-bool BPLUSTREE_TYPE::Coalesce(
-    N *&neighbor_node, N *&node,
-    BPlusTreeInternalPage<KeyType, page_id_t, KeyComparator> *&parent,
-    int index, Transaction *transaction) 
+template <typename N, typename Item>
+bool BPLUSTREE_TYPE::Coalesce(N *left, N *right, INTERNALPAGE_TYPE *parent, int index,
+                              const std::vector<Item> &items, const KeyType *low,
+                              const KeyType *high, Transaction *transaction) 
 {
-    node->MoveAllTo(neighbor_node, index, buffer_pool_manager_);
+    structure_version_++;
+    left->Assign(items.data(), items.size(), low, high);
+    if (left->IsLeafPage())
+    {
+        auto* Leaf = reinterpret_cast<LEAFPAGE_TYPE*>(left);
+        Leaf->SetNextPageId(reinterpret_cast<LEAFPAGE_TYPE*>(right)->GetNextPageId());
+        if (Leaf->GetNextPageId() != INVALID_PAGE_ID) SetPrevLeaf(Leaf->GetNextPageId(), Leaf->GetPageId());
+    }
+    // an iterator still waiting on right can tell it was merged away
+    right->SetSize(0);
     parent->Remove(index);
-    return CoalesceOrRedistribute(parent, transaction);
+    if (!CoalesceOrRedistribute(parent, transaction)) return false;
+    transaction->AddIntoDeletedPageSet(parent->GetPageId());
+    return true;
 }
 
 /*
- * Redistribute key & value pairs from one page to its sibling page. If index ==
- * 0, move sibling page's first key & value pair into end of input "node",
- * otherwise move sibling page's last key & value pair into head of input
- * "node".
+ * Redistribute key & value pairs from one page to its sibling page, so that
+ * both take about as many bytes. The separator in the parent moves with them.
  * Using template N to represent either internal page or leaf page.
- * @param   neighbor_node      sibling page of input "node"
- * @param   node               input from method coalesceOrRedistribute()
+ * @param   left, right        neighbouring pages, index is that of right in
+ *                             parent
+ * @param   items              the entries of both, low and high the outer
+ *                             fences
+ * @return: false if no split fits both pages, or the new separator does not
+ * fit the parent, nothing is moved then
  */
 INDEX_TEMPLATE_ARGUMENTS
-template <typename N>
-void BPLUSTREE_TYPE::Redistribute(N *neighbor_node, N *node, int index) 
+template <typename N, typename Item>
+bool BPLUSTREE_TYPE::Redistribute(N *left, N *right, INTERNALPAGE_TYPE *parent, int index,
+                                  const std::vector<Item> &items, const KeyType *low,
+                                  const KeyType *high) 
 {
-    if (!index) neighbor_node->MoveFirstToEndOf(node, buffer_pool_manager_);
-    else 
-    {
-        auto Parent =reinterpret_cast<INTERNALPAGE_TYPE*>(buffer_pool_manager_->FetchPage(node->GetParentPageId())->GetData());
-        buffer_pool_manager_->UnpinPage(Parent->GetPageId(), false);
-        neighbor_node->MoveLastToFrontOf(node, Parent->ValueIndex(node->GetPageId()), buffer_pool_manager_);
-        buffer_pool_manager_->UnpinPage(Parent->GetPageId(), true);
-    }
+    // the key that ends up in the parent, it becomes the fence between the two
+    KeyType Middle;
+    int Count = SplitPoint<N>(items.data(), items.size(), low, high, left->IsLeafPage(), Middle);
+    if (!Count || !parent->HasRoomFor(Middle, index)) return false;
+    structure_version_++;
+    left->Assign(items.data(), Count, low, Fence(&Middle));
+    right->Assign(items.data() + Count, items.size() - Count, Fence(&Middle), high);
+    parent->SetKeyAt(index, Middle);
+    return true;
 }
 /*
  * Update root page if necessary
@@ -345,6 +633,7 @@ void BPLUSTREE_TYPE::Redistribute(N *neighbor_node, N *node, int index)
  * case 1: when you delete the last element in root page, but root page still
  * has one last child
  * case 2: when you delete the last element in whole b+ tree
+ * The root latch is held, the root was not safe.
  * @return : true means root page should be deleted, false means no deletion
  * happend
  */
@@ -355,6 +644,7 @@ bool BPLUSTREE_TYPE::AdjustRoot(BPlusTreePage *old_root_node)
     {
         if (!old_root_node->GetSize())
         {
+            structure_version_++;
             root_page_id_ = INVALID_PAGE_ID;
             UpdateRootPageId(false);
             return true;
@@ -363,29 +653,254 @@ bool BPLUSTREE_TYPE::AdjustRoot(BPlusTreePage *old_root_node)
     }
     if (old_root_node->GetSize() == 1)
     {
-        root_page_id_ = reinterpret_cast<INTERNALPAGE_TYPE*>(old_root_node)->ValueAt(0);
-        UpdateRootPageId(false);
-        auto NewRoot =reinterpret_cast<INTERNALPAGE_TYPE*>(buffer_pool_manager_->FetchPage(root_page_id_)->GetData());
-        NewRoot->SetParentPageId(INVALID_PAGE_ID);
-        buffer_pool_manager_->UnpinPage(root_page_id_, true);
+        PublishRoot(reinterpret_cast<INTERNALPAGE_TYPE*>(old_root_node)->ValueAt(0), false);
         return true;
     }
     return false;
 }
 
+/*****************************************************************************
+ * BULK LOAD
+ *****************************************************************************/
+/*
+ * Fill leaves left to right up to fill_factor, then put internal levels on top
+ * until one page is left, which becomes the root. The root latch is held all
+ * along, so nothing else touches the tree before it is complete.
+ * The pairs of a leaf are held back until the pair after them shows where it
+ * ends, its high fence decides how many bytes they take.
+ * Pages are taken out of extents, so leaves follow each other on disk and a
+ * scan reads them sequentially.
+ * @return: false if the tree is not empty or the pairs are not strictly
+ * ascending, the tree stays empty then
+ */
+INDEX_TEMPLATE_ARGUMENTS
+bool BPLUSTREE_TYPE::BulkLoad(const std::function<bool(KeyType &, ValueType &)> &next,
+                              double fill_factor)
+{
+    root_latch_.WLock();
+    if (root_page_id_ != INVALID_PAGE_ID)
+    {
+        root_latch_.WUnlock();
+        return false;
+    }
+    size_t Area = LEAFPAGE_TYPE::GetAreaSize();
+    double Fill = std::max(0.5, std::min(1.0, fill_factor));
+    // low fence and page id of every page of the level just built
+    std::vector<std::pair<KeyType, page_id_t>> Level;
+    LEAFPAGE_TYPE* Prev = nullptr;
+    LEAFPAGE_TYPE* Leaf = nullptr;
+    std::vector<MappingType> Pending;
+    // low fences of Leaf and Prev, the first leaf has none
+    auto LowFence = [&](int back) -> const KeyType*
+    {
+        return (int)Level.size() > back + 1 ? Fence(&Level[Level.size() - 1 - back].first) : nullptr;
+    };
+    auto Space = [&](int count, const KeyType *high)
+    {
+        return LEAFPAGE_TYPE::SpaceFor(Pending.data(), count, LowFence(0), Fence(high));
+    };
+    // write the first count pending pairs to Leaf and start the next leaf at high
+    auto Flush = [&](int count, const KeyType &high)
+    {
+        Leaf->Assign(Pending.data(), count, LowFence(0), Fence(&high));
+        Pending.erase(Pending.begin(), Pending.begin() + count);
+        page_id_t PageId;
+        auto* NewLeaf = reinterpret_cast<LEAFPAGE_TYPE*>(NewExtentPage(PageId)->GetData());
+        NewLeaf->Init(PageId);
+        Leaf->SetNextPageId(PageId);
+        NewLeaf->SetPrevPageId(Leaf->GetPageId());
+        if (Prev) buffer_pool_manager_->UnpinPage(Prev->GetPageId(), true);
+        Prev = Leaf;
+        Leaf = NewLeaf;
+        Level.push_back(std::make_pair(high, PageId));
+    };
+    // the prefix shrinks as the leaf grows, write out the front of the pending
+    // pairs until the rest fit in a leaf ending at high
+    auto Shrink = [&](const KeyType *high)
+    {
+        while (Space(Pending.size(), high) > Area)
+        {
+            int Count = Pending.size() / 2;
+            Flush(Count, Separator(Pending[Count - 1].first, Pending[Count].first));
+        }
+    };
+    bool Sorted = true;
+    KeyType Key;
+    ValueType Value;
+    while (next(Key, Value))
+    {
+        if (!Leaf)
+        {
+            page_id_t PageId;
+            Leaf = reinterpret_cast<LEAFPAGE_TYPE*>(NewExtentPage(PageId)->GetData());
+            Leaf->Init(PageId);
+            Level.push_back(std::make_pair(Key, PageId));
+        }
+        else if (comparator_(Key, Pending.back().first) <= 0)
+        {
+            Sorted = false;
+            break;
+        }
+        else
+        {
+            KeyType High = Separator(Pending.back().first, Key);
+            // end the leaf in front of key once key would fill it beyond fill
+            Pending.push_back(std::make_pair(Key, Value));
+            bool Full = Space(Pending.size(), &Key) > Area * Fill;
+            Pending.pop_back();
+            if (Full)
+            {
+                Shrink(&High);
+                Flush(Pending.size(), High);
+            }
+        }
+        Pending.push_back(std::make_pair(Key, Value));
+    }
+    // the last leaf has no high fence
+    if (Sorted && Leaf) Shrink(nullptr);
+    // the last leaf may come up short, merge it or even out with the one before
+    if (Sorted && Prev && Space(Pending.size(), nullptr) < Area / 2)
+    {
+        std::vector<MappingType> Items;
+        for (int i = 0; i < Prev->GetSize(); i++) Items.push_back(Prev->GetItem(i));
+        Items.insert(Items.end(), Pending.begin(), Pending.end());
+        KeyType Middle;
+        int Count;
+        if (LEAFPAGE_TYPE::SpaceFor(Items.data(), Items.size(), LowFence(1), nullptr) <= Area)
+        {
+            Pending = Items;
+            Prev->SetNextPageId(INVALID_PAGE_ID);
+            buffer_pool_manager_->UnpinPage(Leaf->GetPageId(), false);
+            buffer_pool_manager_->DeletePage(Leaf->GetPageId());
+            Level.pop_back();
+            Leaf = Prev;
+            Prev = nullptr;
+        }
+        else if ((Count = SplitPoint<LEAFPAGE_TYPE>(Items.data(), Items.size(), LowFence(1), nullptr, true, Middle)))
+        {
+            Prev->Assign(Items.data(), Count, LowFence(1), Fence(&Middle));
+            Pending.assign(Items.begin() + Count, Items.end());
+            Level.back().first = Middle;
+        }
+    }
+    if (Sorted && Leaf) Leaf->Assign(Pending.data(), Pending.size(), LowFence(0), nullptr);
+    if (Prev) buffer_pool_manager_->UnpinPage(Prev->GetPageId(), true);
+    if (Leaf) buffer_pool_manager_->UnpinPage(Leaf->GetPageId(), true);
+    if (!Sorted)
+    {
+        LOG_DEBUG("bulk load input of %s is not sorted", index_name_.c_str());
+        for (auto &Entry : Level) buffer_pool_manager_->DeletePage(Entry.second);
+        ReleaseExtent();
+        root_latch_.WUnlock();
+        return false;
+    }
+    while (Level.size() > 1) Level = BuildLevel(Level, fill_factor);
+    ReleaseExtent();
+    if (!Level.empty()) PublishRoot(Level[0].second, true);
+    root_latch_.WUnlock();
+    return true;
+}
+
+/*
+ * Helper to put one level of internal pages on top of children, filled up to
+ * fill_factor by bytes; the last page is evened out with the one before if it
+ * comes up less than half full
+ * @return: low fence and page id of the new pages
+ */
+INDEX_TEMPLATE_ARGUMENTS
+std::vector<std::pair<KeyType, page_id_t>>
+BPLUSTREE_TYPE::BuildLevel(const std::vector<std::pair<KeyType, page_id_t>> &children,
+                           double fill_factor)
+{
+    std::vector<std::pair<KeyType, page_id_t>> Level;
+    int Count = children.size();
+    size_t Area = INTERNALPAGE_TYPE::GetAreaSize();
+    double Fill = std::max(0.5, std::min(1.0, fill_factor));
+    // bytes a node over children begin to end takes
+    auto Space = [&](int begin, int end)
+    {
+        return INTERNALPAGE_TYPE::SpaceFor(&children[begin], end - begin,
+                                           begin ? Fence(&children[begin].first) : nullptr,
+                                           end < Count ? Fence(&children[end].first) : nullptr);
+    };
+    // where every node begins
+    std::vector<int> Begins;
+    for (int Begin = 0; Begin < Count;)
+    {
+        int End = std::min(Count, Begin + 2);
+        while (End < Count && Space(Begin, End + 1) <= Area * Fill) End++;
+        Begins.push_back(Begin);
+        Begin = End;
+    }
+    int Last = Begins.back();
+    if (Begins.size() > 1 && Space(Last, Count) < Area / 2)
+    {
+        int Begin = Begins[Begins.size() - 2];
+        KeyType Middle;
+        if (Space(Begin, Count) <= Area) Begins.pop_back();
+        else if (int Split = SplitPoint<INTERNALPAGE_TYPE>(&children[Begin], Count - Begin,
+                                                           Begin ? Fence(&children[Begin].first) : nullptr,
+                                                           nullptr, false, Middle))
+            Begins.back() = Begin + Split;
+    }
+    Begins.push_back(Count);
+    for (int i = 0; i + 1 < (int)Begins.size(); i++)
+    {
+        int Begin = Begins[i];
+        int End = Begins[i + 1];
+        page_id_t PageId;
+        auto* Node = reinterpret_cast<INTERNALPAGE_TYPE*>(NewExtentPage(PageId)->GetData());
+        Node->Init(PageId);
+        Node->Assign(&children[Begin], End - Begin,
+                     Begin ? Fence(&children[Begin].first) : nullptr,
+                     End < Count ? Fence(&children[End].first) : nullptr);
+        Level.push_back(std::make_pair(children[Begin].first, PageId));
+        buffer_pool_manager_->UnpinPage(PageId, true);
+    }
+    return Level;
+}
+
+/*
+ * Helper to hand out the next page of the current extent, a new extent of
+ * BULK_LOAD_EXTENT_SIZE pages is allocated once it is used up
+ */
+INDEX_TEMPLATE_ARGUMENTS
+Page *BPLUSTREE_TYPE::NewExtentPage(page_id_t &page_id)
+{
+    if (extent_next_ == extent_end_)
+    {
+        extent_next_ = buffer_pool_manager_->AllocateExtent(BULK_LOAD_EXTENT_SIZE);
+        extent_end_ = extent_next_ + BULK_LOAD_EXTENT_SIZE;
+    }
+    return buffer_pool_manager_->NewPage(page_id, extent_next_++);
+}
+
+/*
+ * Helper to give back the pages of the current extent bulk loading left unused
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void BPLUSTREE_TYPE::ReleaseExtent()
+{
+    for (; extent_next_ != extent_end_; extent_next_++)
+        buffer_pool_manager_->DeletePage(extent_next_);
+    extent_next_ = extent_end_ = INVALID_PAGE_ID;
+}
+
 /*****************************************************************************
  * INDEX ITERATOR
  *****************************************************************************/
 /*
  * Input parameter is void, find the leaftmost leaf page first, then construct
  * index iterator
+ * The iterator holds a read latch on the leaf it is on.
  * @return : index iterator
  */
 INDEX_TEMPLATE_ARGUMENTS
 INDEXITERATOR_TYPE BPLUSTREE_TYPE::Begin() 
 { 
-    KeyType key;
-    return IndexIterator<KeyType, ValueType, KeyComparator>(FindLeafPage(key, true), 0, buffer_pool_manager_);
+    // only read by FindLeafPage when leftMost is false
+    KeyType key{};
+    return IndexIterator<KeyType, ValueType, KeyComparator>(this, FindLeafPage(key, true), 0, buffer_pool_manager_, comparator_);
 }
 
 /*
@@ -396,9 +911,41 @@ INDEXITERATOR_TYPE BPLUSTREE_TYPE::Begin()
 INDEX_TEMPLATE_ARGUMENTS
 INDEXITERATOR_TYPE BPLUSTREE_TYPE::Begin(const KeyType &key) 
 {
-    auto* Leaf = FindLeafPage(key, false);
-    int index = Leaf? Leaf->KeyIndex(key, comparator_):0;
-    return IndexIterator<KeyType, ValueType, KeyComparator>(Leaf, index, buffer_pool_manager_);
+    Page* Frame = FindLeafPage(key, false);
+    int index = Frame? reinterpret_cast<LEAFPAGE_TYPE*>(Frame->GetData())->KeyIndex(key, comparator_):0;
+    return IndexIterator<KeyType, ValueType, KeyComparator>(this, Frame, index, buffer_pool_manager_, comparator_);
+}
+
+/*
+ * Input parameter is void, find the right most leaf page and construct a
+ * reverse index iterator on its last key
+ * @return : reverse index iterator
+ */
+INDEX_TEMPLATE_ARGUMENTS
+INDEXITERATOR_TYPE BPLUSTREE_TYPE::RBegin()
+{
+    Page* Frame = FindLastLeafPage();
+    int index = Frame ? reinterpret_cast<LEAFPAGE_TYPE*>(Frame->GetData())->GetSize() - 1 : 0;
+    return IndexIterator<KeyType, ValueType, KeyComparator>(this, Frame, index, buffer_pool_manager_, comparator_, true);
+}
+
+/*
+ * Input parameter is high key, find the leaf page that contains the input key
+ * and construct a reverse index iterator on the last key not above it
+ * @return : reverse index iterator
+ */
+INDEX_TEMPLATE_ARGUMENTS
+INDEXITERATOR_TYPE BPLUSTREE_TYPE::RBegin(const KeyType &key)
+{
+    Page* Frame = FindLeafPage(key, false);
+    int index = 0;
+    if (Frame)
+    {
+        auto* Leaf = reinterpret_cast<LEAFPAGE_TYPE*>(Frame->GetData());
+        index = Leaf->KeyIndex(key, comparator_);
+        if (index == Leaf->GetSize() || comparator_(Leaf->KeyAt(index), key) > 0) index--;
+    }
+    return IndexIterator<KeyType, ValueType, KeyComparator>(this, Frame, index, buffer_pool_manager_, comparator_, true);
 }
 
 /*****************************************************************************
@@ -407,21 +954,349 @@ INDEXITERATOR_TYPE BPLUSTREE_TYPE::Begin(const KeyType &key)
 /*
  * Find leaf page containing particular key, if leftMost flag == true, find
  * the left most leaf page
+ * An optimistic descent is tried first. If that does not work out, readers
+ * latch the child before letting go of the parent, and writers keep the
+ * latches in the transaction's page set, starting with the root latch, and
+ * drop all of them whenever they reach a page that is safe for op.
+ * @return: the pinned and latched leaf, nullptr if the tree is empty (a writer
+ * still holds the root latch then)
  */
 INDEX_TEMPLATE_ARGUMENTS
-B_PLUS_TREE_LEAF_PAGE_TYPE *BPLUSTREE_TYPE::FindLeafPage(const KeyType &key,bool leftMost) 
+Page *BPLUSTREE_TYPE::FindLeafPage(const KeyType &key, bool leftMost,
+                                   Operation op, Transaction *transaction) 
 {
+    Page* Leaf = FindLeafOptimistic(key, leftMost, op);
+    if (Leaf)
+    {
+        if (op != Operation::READONLY) transaction->AddIntoPageSet(Leaf);
+        return Leaf;
+    }
+    if (op == Operation::READONLY)
+    {
+        root_latch_.RLock();
+        if (IsEmpty())
+        {
+            root_latch_.RUnlock();
+            return nullptr;
+        }
+        Page* Frame = buffer_pool_manager_->FetchPage(root_page_id_);
+        Frame->RLatch();
+        root_latch_.RUnlock();
+        auto* Node = reinterpret_cast<BPlusTreePage*>(Frame->GetData());
+        while (!Node->IsLeafPage()) 
+        {
+            auto Internal = reinterpret_cast<INTERNALPAGE_TYPE*>(Node);
+            page_id_t ChildId = leftMost ? Internal->ValueAt(0) : Internal->Lookup(key, comparator_);
+            Page* Child = buffer_pool_manager_->FetchPage(ChildId);
+            Child->RLatch();
+            Frame->RUnlatch();
+            buffer_pool_manager_->UnpinPage(Frame->GetPageId(), false);
+            Frame = Child;
+            Node = reinterpret_cast<BPlusTreePage*>(Frame->GetData());
+        }
+        return Frame;
+    }
+
+    root_latch_.WLock();
+    transaction->AddIntoPageSet(nullptr);
     if (IsEmpty()) return nullptr;
-    auto* Node = reinterpret_cast<BPlusTreePage*>(buffer_pool_manager_->FetchPage(root_page_id_)->GetData());
-    //buffer_pool_manager_->UnpinPage(root_page_id_,false);
-    while (!Node->IsLeafPage()) 
+    page_id_t PageId = root_page_id_;
+    while (true)
+    {
+        Page* Frame = buffer_pool_manager_->FetchPage(PageId);
+        Frame->WLatch();
+        auto* Node = reinterpret_cast<BPlusTreePage*>(Frame->GetData());
+        if (IsSafe(Node, op)) ReleaseLatches(transaction, false);
+        transaction->AddIntoPageSet(Frame);
+        if (Node->IsLeafPage()) return Frame;
+        auto Internal = reinterpret_cast<INTERNALPAGE_TYPE*>(Node);
+        PageId = leftMost ? Internal->ValueAt(0) : Internal->Lookup(key, comparator_);
+    }
+}
+
+/*
+ * Optimistic lock coupling: internal pages are pinned but never latched. Each
+ * one is read between two looks at its version, and the child found there is
+ * only trusted if neither the page nor its parent changed in the meantime.
+ * Only the leaf gets latched, it is still the right leaf if its parent did not
+ * change by then.
+ * @return: the pinned and latched leaf, nullptr if the tree is empty, the
+ * descent kept failing, or a writer would have to split or merge the leaf
+ */
+INDEX_TEMPLATE_ARGUMENTS
+Page *BPLUSTREE_TYPE::FindLeafOptimistic(const KeyType &key, bool leftMost,
+                                         Operation op) 
+{
+    for (int Restart = 0; Restart < OPTIMISTIC_RESTART_LIMIT; Restart++)
+    {
+        if (Restart) std::this_thread::yield();
+        page_id_t PageId = root_page_id_.load(std::memory_order_acquire);
+        if (PageId == INVALID_PAGE_ID) return nullptr;
+        Page* Parent = nullptr;
+        uint64_t ParentVersion = 0;
+        Page* Frame = buffer_pool_manager_->FetchPage(PageId);
+        while (Frame)
+        {
+            uint64_t Version = Frame->GetVersion();
+            auto* Node = reinterpret_cast<BPlusTreePage*>(Frame->GetData());
+            bool IsLeaf = Node->IsLeafPage();
+            bool Valid = !(Version & 1);
+            if (Valid && !IsLeaf)
+            {
+                auto Internal = reinterpret_cast<INTERNALPAGE_TYPE*>(Node);
+                int Size = Internal->GetSize();
+                Valid = Size > 0 && Size <= Internal->GetMaxSize();
+                if (Valid) PageId = leftMost ? Internal->ValueAt(0) : Internal->Lookup(key, comparator_);
+            }
+            // a page unlinked from the tree keeps its last version, so the
+            // page above must still be the same, or still be the root
+            std::atomic_thread_fence(std::memory_order_acquire);
+            Valid = Valid && Frame->GetVersion() == Version &&
+                    (Parent ? Parent->GetVersion() == ParentVersion
+                            : Frame->GetPageId() == root_page_id_.load());
+            bool Unsafe = false;
+            if (Valid && IsLeaf)
+            {
+                if (op == Operation::READONLY) Frame->RLatch(); else Frame->WLatch();
+                Valid = Parent ? Parent->GetVersion() == ParentVersion
+                               : Frame->GetPageId() == root_page_id_.load();
+                Unsafe = Valid && op != Operation::READONLY && !IsSafe(Node, op);
+                if (Valid && !Unsafe)
+                {
+                    if (Parent) buffer_pool_manager_->UnpinPage(Parent->GetPageId(), false);
+                    return Frame;
+                }
+                if (op == Operation::READONLY) Frame->RUnlatch(); else Frame->WUnlatch();
+            }
+            if (!Valid || IsLeaf)
+            {
+                if (Parent) buffer_pool_manager_->UnpinPage(Parent->GetPageId(), false);
+                buffer_pool_manager_->UnpinPage(Frame->GetPageId(), false);
+                // a split or merge needs the latches anyway
+                if (Unsafe) return nullptr;
+                Parent = Frame = nullptr;
+                break;
+            }
+            if (Parent) buffer_pool_manager_->UnpinPage(Parent->GetPageId(), false);
+            Parent = Frame;
+            ParentVersion = Version;
+            Frame = buffer_pool_manager_->FetchPage(PageId);
+        }
+        if (Parent) buffer_pool_manager_->UnpinPage(Parent->GetPageId(), false);
+    }
+    return nullptr;
+}
+
+/*
+ * Find the right most leaf page, latching like a reader in FindLeafPage
+ * @return: the pinned and read latched leaf, nullptr if the tree is empty
+ */
+INDEX_TEMPLATE_ARGUMENTS
+Page *BPLUSTREE_TYPE::FindLastLeafPage()
+{
+    root_latch_.RLock();
+    if (IsEmpty())
+    {
+        root_latch_.RUnlock();
+        return nullptr;
+    }
+    Page* Frame = buffer_pool_manager_->FetchPage(root_page_id_);
+    Frame->RLatch();
+    root_latch_.RUnlock();
+    auto* Node = reinterpret_cast<BPlusTreePage*>(Frame->GetData());
+    while (!Node->IsLeafPage())
     {
         auto Internal = reinterpret_cast<INTERNALPAGE_TYPE*>(Node);
-        buffer_pool_manager_->UnpinPage(Internal->GetPageId(),false);
-        page_id_t ChildId =leftMost?Internal->ValueAt(0): Internal->Lookup(key, comparator_);       
-        Node = reinterpret_cast<BPlusTreePage*>(buffer_pool_manager_->FetchPage(ChildId)->GetData());
+        Page* Child = buffer_pool_manager_->FetchPage(Internal->ValueAt(Internal->GetSize() - 1));
+        Child->RLatch();
+        Frame->RUnlatch();
+        buffer_pool_manager_->UnpinPage(Frame->GetPageId(), false);
+        Frame = Child;
+        Node = reinterpret_cast<BPlusTreePage*>(Frame->GetData());
     }
-    return reinterpret_cast<LEAFPAGE_TYPE*>(Node);
+    return Frame;
+}
+
+/*
+ * Helper to point the prev link of leaf page_id at prev_page_id. Its left
+ * neighbour is write latched by the caller, so leaves are always latched left
+ * to right; reverse iterators only try to latch leftwards
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void BPLUSTREE_TYPE::SetPrevLeaf(page_id_t page_id, page_id_t prev_page_id)
+{
+    Page* Frame = buffer_pool_manager_->FetchPage(page_id);
+    Frame->WLatch();
+    reinterpret_cast<LEAFPAGE_TYPE*>(Frame->GetData())->SetPrevPageId(prev_page_id);
+    Frame->WUnlatch();
+    buffer_pool_manager_->UnpinPage(page_id, true);
+}
+
+/*
+ * Helper to decide whether node stays within its size limits after op, so
+ * that none of its ancestors can change
+ */
+INDEX_TEMPLATE_ARGUMENTS
+bool BPLUSTREE_TYPE::IsSafe(BPlusTreePage *node, Operation op) 
+{
+    if (node->IsLeafPage())
+    {
+        auto* Leaf = reinterpret_cast<LEAFPAGE_TYPE*>(node);
+        if (op == Operation::INSERT) return !Leaf->IsFull();
+        if (IsRoot(node)) return node->GetSize() > 1;
+        return Leaf->CanLoseEntry();
+    }
+    auto* Internal = reinterpret_cast<INTERNALPAGE_TYPE*>(node);
+    if (op == Operation::INSERT) return !Internal->IsFull();
+    if (IsRoot(node)) return node->GetSize() > 2;
+    return Internal->CanLoseEntry();
+}
+
+/*
+ * Helper to decide whether pages are prefix compressed, which needs keys that
+ * order like their bytes. Narrow keys are searched faster without
+ */
+INDEX_TEMPLATE_ARGUMENTS
+bool BPLUSTREE_TYPE::CompressKeys() const
+{
+    return comparator_.IsNormalized() && sizeof(KeyType) >= VARIABLE_KEY_MIN_SIZE;
+}
+
+/*
+ * Helper to find the key separating the last key of a page from the first one
+ * of the page after it, the shortest one with prefix compression
+ */
+INDEX_TEMPLATE_ARGUMENTS
+KeyType BPLUSTREE_TYPE::Separator(const KeyType &left, const KeyType &right) const
+{
+    return CompressKeys() ? KeyType::Separator(left, right) : right;
+}
+
+/*
+ * Helpers for the fences handed to pages and the fence of node on one side,
+ * nullptr for an open one. Without prefix compression all fences stay open
+ */
+INDEX_TEMPLATE_ARGUMENTS
+const KeyType *BPLUSTREE_TYPE::Fence(const KeyType *key) const
+{
+    return CompressKeys() ? key : nullptr;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+template <typename N>
+const KeyType *BPLUSTREE_TYPE::FenceOf(N *node, bool high, KeyType &key) const
+{
+    return node->GetFence(high, key) ? &key : nullptr;
+}
+
+/*
+ * Helper to split count items between two pages of type N with outer fences
+ * low and high: the first split point where the left page takes at least as
+ * many bytes as the right one, or the nearest one to it where both fit.
+ * separator is the key between them, the shortest one for leaves, the first
+ * key of the right page for internal pages, which moves up
+ * @return: the number of items of the left page, 0 if no split fits
+ */
+INDEX_TEMPLATE_ARGUMENTS
+template <typename N, typename Item>
+int BPLUSTREE_TYPE::SplitPoint(const Item *items, int count, const KeyType *low,
+                               const KeyType *high, bool leaf, KeyType &separator)
+{
+    auto Middle = [&](int split)
+    {
+        return leaf ? Separator(items[split - 1].first, items[split].first) : items[split].first;
+    };
+    int Begin = 1;
+    int End = count - 1;
+    while (Begin < End)
+    {
+        int Split = (Begin + End) / 2;
+        KeyType Key = Middle(Split);
+        if (N::SpaceFor(items, Split, low, Fence(&Key)) >= N::SpaceFor(items + Split, count - Split, Fence(&Key), high))
+            End = Split;
+        else
+            Begin = Split + 1;
+    }
+    for (int Step = 0; Step < 2 * count; Step++)
+    {
+        int Split = Step % 2 ? Begin - (Step + 1) / 2 : Begin + Step / 2;
+        if (Split < 1 || Split >= count) continue;
+        KeyType Key = Middle(Split);
+        if (N::SpaceFor(items, Split, low, Fence(&Key)) <= N::GetAreaSize() &&
+            N::SpaceFor(items + Split, count - Split, Fence(&Key), high) <= N::GetAreaSize())
+        {
+            separator = Key;
+            return Split;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Helper to tell the root from other pages. A writer that holds the root
+ * latched, or the page in question, sees it stay the same
+ */
+INDEX_TEMPLATE_ARGUMENTS
+bool BPLUSTREE_TYPE::IsRoot(const BPlusTreePage *node) const
+{
+    return node->GetPageId() == root_page_id_.load();
+}
+
+/*
+ * Helper to find the parent of node, which is on the way down to it. A node
+ * that is split or merged was not safe, so the page latched right before it
+ * is still in the page set
+ * @return: the parent, latched and pinned through the page set
+ */
+INDEX_TEMPLATE_ARGUMENTS
+INTERNALPAGE_TYPE *BPLUSTREE_TYPE::ParentOf(const BPlusTreePage *node, Transaction *transaction)
+{
+    auto PageSet = transaction->GetPageSet();
+    for (size_t i = PageSet->size(); i-- > 1;)
+    {
+        if ((*PageSet)[i] && (*PageSet)[i]->GetPageId() == node->GetPageId())
+        {
+            assert((*PageSet)[i - 1]);
+            return reinterpret_cast<INTERNALPAGE_TYPE*>((*PageSet)[i - 1]->GetData());
+        }
+    }
+    assert(false);
+    return nullptr;
+}
+
+/*
+ * Helper to release every latch in the transaction's page set, top down, and
+ * unpin the pages
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void BPLUSTREE_TYPE::ReleaseLatches(Transaction *transaction, bool is_dirty) 
+{
+    auto PageSet = transaction->GetPageSet();
+    while (!PageSet->empty())
+    {
+        Page* Frame = PageSet->front();
+        PageSet->pop_front();
+        if (!Frame)
+        {
+            // the root latch
+            root_latch_.WUnlock();
+            continue;
+        }
+        Frame->WUnlatch();
+        buffer_pool_manager_->UnpinPage(Frame->GetPageId(), is_dirty);
+    }
+}
+
+/*
+ * Make page_id the root. Only called once the page is complete, optimistic
+ * descents start at root_page_id_ without any latch.
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void BPLUSTREE_TYPE::PublishRoot(page_id_t page_id, bool insert_record)
+{
+    structure_version_++;
+    root_page_id_.store(page_id, std::memory_order_release);
+    UpdateRootPageId(insert_record);
 }
 
 /*
@@ -436,12 +1311,14 @@ INDEX_TEMPLATE_ARGUMENTS
 void BPLUSTREE_TYPE::UpdateRootPageId(int insert_record) {
   HeaderPage *header_page = static_cast<HeaderPage *>(
       buffer_pool_manager_->FetchPage(HEADER_PAGE_ID));
-  if (insert_record)
-    // create a new record<index_name + root_page_id> in header_page
-    header_page->InsertRecord(index_name_, root_page_id_);
-  else
+  // the header page is shared by all indexes
+  header_page->WLatch();
+  // create a new record<index_name + root_page_id> in header_page, a tree
+  // that was emptied before has one already
+  if (!insert_record || !header_page->InsertRecord(index_name_, root_page_id_))
     // update root_page_id in header_page
     header_page->UpdateRecord(index_name_, root_page_id_);
+  header_page->WUnlatch();
   buffer_pool_manager_->UnpinPage(HEADER_PAGE_ID, true);
 }
 
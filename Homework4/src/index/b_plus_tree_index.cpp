@@ -2,6 +2,13 @@
  * b_plus_tree_index.cpp
  */
 
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <queue>
+
+#include "common/logger.h"
+#include "index/b_epsilon_tree.h"
 #include "index/b_plus_tree_index.h"
 
 namespace scudb {
@@ -12,43 +19,519 @@ INDEX_TEMPLATE_ARGUMENTS
 BPLUSTREE_INDEX_TYPE::BPlusTreeIndex(IndexMetadata *metadata,
                                      BufferPoolManager *buffer_pool_manager,
                                      page_id_t root_page_id)
-    : Index(metadata), comparator_(metadata->GetKeySchema()),
+    : Index(metadata),
+      comparator_(metadata->GetKeySchema(), metadata->HasNormalizedKeys()),
       container_(metadata->GetName(), buffer_pool_manager, comparator_,
-                 root_page_id) {}
+                 root_page_id, metadata->IsUnique()) {}
 
 INDEX_TEMPLATE_ARGUMENTS
 void BPLUSTREE_INDEX_TYPE::InsertEntry(const Tuple &key, RID rid,
                                        Transaction *transaction) {
   // construct insert index key
   KeyType index_key;
-  index_key.SetFromKey(key);
+  SetIndexKey(index_key, key);
 
   container_.Insert(index_key, rid, transaction);
+  changes_++;
 }
 
+/*
+ * Sorted by the tree, see BPlusTree::InsertBatch
+ */
 INDEX_TEMPLATE_ARGUMENTS
-void BPLUSTREE_INDEX_TYPE::DeleteEntry(const Tuple &key,
+void BPLUSTREE_INDEX_TYPE::InsertEntries(
+    const std::vector<std::pair<Tuple, RID>> &entries,
+    Transaction *transaction) {
+  std::vector<MappingType> items(entries.size());
+  for (size_t i = 0; i < entries.size(); i++) {
+    SetIndexKey(items[i].first, entries[i].first);
+    items[i].second = entries[i].second;
+  }
+  container_.InsertBatch(items, transaction);
+  changes_ += items.size();
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void BPLUSTREE_INDEX_TYPE::DeleteEntry(const Tuple &key, RID rid,
                                        Transaction *transaction) {
   // construct delete index key
   KeyType index_key;
-  index_key.SetFromKey(key);
+  SetIndexKey(index_key, key);
 
-  container_.Remove(index_key, transaction);
+  container_.Remove(index_key, rid, transaction);
+  changes_++;
 }
 
+/*
+ * Starts where the last lookup ended, see BPlusTree::GetValues
+ */
 INDEX_TEMPLATE_ARGUMENTS
 void BPLUSTREE_INDEX_TYPE::ScanKey(const Tuple &key, std::vector<RID> &result,
                                    Transaction *transaction) {
   // construct scan index key
-  KeyType index_key;
-  index_key.SetFromKey(key);
+  std::vector<KeyType> index_keys(1);
+  SetIndexKey(index_keys[0], key);
+
+  LeafFinger finger;
+  {
+    std::lock_guard<std::mutex> guard(finger_latch_);
+    finger = finger_;
+  }
+  container_.GetValues(index_keys, result, &finger, transaction);
+  std::lock_guard<std::mutex> guard(finger_latch_);
+  finger_ = finger;
+}
+
+/*
+ * Keys are sorted first, so neighbouring keys share leaves
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void BPLUSTREE_INDEX_TYPE::ScanKeys(const std::vector<Tuple> &keys,
+                                    std::vector<RID> &result,
+                                    Transaction *transaction) {
+  std::vector<KeyType> index_keys(keys.size());
+  for (size_t i = 0; i < keys.size(); i++)
+    SetIndexKey(index_keys[i], keys[i]);
+  std::sort(index_keys.begin(), index_keys.end(),
+            [this](const KeyType &a, const KeyType &b) {
+              return comparator_(a, b) < 0;
+            });
+  index_keys.erase(std::unique(index_keys.begin(), index_keys.end(),
+                               [this](const KeyType &a, const KeyType &b) {
+                                 return comparator_(a, b) == 0;
+                               }),
+                   index_keys.end());
+  container_.GetValues(index_keys, result, nullptr, transaction);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void BPLUSTREE_INDEX_TYPE::SetIndexKey(KeyType &index_key, const Tuple &key) {
+  if (comparator_.IsNormalized())
+    index_key.SetFromKey(key, GetKeySchema());
+  else
+    index_key.SetFromKey(key);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void BPLUSTREE_INDEX_TYPE::GetKeyValues(const KeyType &index_key,
+                                        std::vector<Value> &values) {
+  for (int i = 0; i < GetIndexColumnCount(); i++)
+    values.push_back(comparator_.IsNormalized()
+                         ? index_key.FromNormalized(GetKeySchema(), i)
+                         : index_key.ToValue(GetKeySchema(), i));
+}
+
+/*
+ * Keys with varchars may be cut off, see GenericKey
+ */
+INDEX_TEMPLATE_ARGUMENTS
+bool BPLUSTREE_INDEX_TYPE::StoresKeyValues() const {
+  return GetKeySchema()->GetUnlinedColumnCount() == 0 &&
+         GetKeySchema()->GetLength() <= (int32_t)sizeof(KeyType);
+}
+
+/*
+ * The tree is sampled again once a tenth of its entries may have changed.
+ * Neighbouring keys within the sampled leaves show how often the leading key
+ * columns change from one key to the next, which gives their distinct values,
+ * though no fewer than the sampled keys have. The histogram comes from the
+ * keys of the sampled leaves too, each one weighted with the entries it
+ * stands for.
+ */
+INDEX_TEMPLATE_ARGUMENTS
+bool BPLUSTREE_INDEX_TYPE::GetStatistics(IndexStatistics &statistics,
+                                         Transaction *) {
+  std::lock_guard<std::mutex> guard(statistics_latch_);
+  if (sampled_ && changes_ <= statistics_.entry_count / 10) {
+    statistics = statistics_;
+    return true;
+  }
+  sampled_ = true;
+  changes_ = 0;
+  TreeSample<KeyType> sample;
+  container_.Sample(INDEX_STATS_SAMPLE_SIZE, sample);
+  statistics_ = IndexStatistics();
+  statistics_.height = sample.height;
+  statistics_.leaf_count = sample.leaf_count;
+  statistics_.entry_count = sample.value_count;
+
+  // key columns that two keys have in common
+  int columns = GetIndexColumnCount();
+  auto common = [columns](const std::vector<Value> &a,
+                          const std::vector<Value> &b) {
+    int length = 0;
+    while (length < columns && a[length].CompareEquals(b[length]) == CMP_TRUE)
+      length++;
+    return length;
+  };
+  // neighbouring keys, and those among them that differ in the first
+  // length key columns
+  double pairs = 0;
+  std::vector<double> changes(columns, 0);
+  std::vector<Value> previous, values;
+  for (auto &leaf : sample.leaves) {
+    for (size_t i = 0; i < leaf.keys.size(); i++) {
+      values.clear();
+      GetKeyValues(leaf.keys[i].first, values);
+      if (i > 0) {
+        pairs += leaf.weight;
+        for (int length = common(values, previous) + 1; length <= columns;
+             length++)
+          changes[length - 1] += leaf.weight;
+      }
+      previous.swap(values);
+    }
+  }
+
+  // sampled keys in order, each with the entries it stands for
+  std::vector<std::pair<KeyType, double>> keys;
+  double total = 0;
+  for (auto &leaf : sample.leaves)
+    for (auto &key : leaf.keys) {
+      keys.push_back(std::make_pair(key.first, leaf.weight * key.second));
+      total += keys.back().second;
+    }
+  std::sort(keys.begin(), keys.end(),
+            [this](const std::pair<KeyType, double> &a,
+                   const std::pair<KeyType, double> &b) {
+              return comparator_(a.first, b.first) < 0;
+            });
+  std::vector<double> seen(columns, keys.empty() ? 0 : 1);
+  double passed = 0;
+  size_t part = 1;
+  previous.clear();
+  for (size_t i = 0; i < keys.size(); i++) {
+    values.clear();
+    GetKeyValues(keys[i].first, values);
+    if (i > 0)
+      for (int length = common(values, previous) + 1; length <= columns;
+           length++)
+        seen[length - 1]++;
+    // the keys where the entries pass a multiple of a part
+    passed += keys[i].second;
+    if (part < INDEX_HISTOGRAM_BUCKETS &&
+        passed >= total * part / INDEX_HISTOGRAM_BUCKETS) {
+      statistics_.histogram.emplace_back(values, GetKeySchema());
+      while (part < INDEX_HISTOGRAM_BUCKETS &&
+             passed >= total * part / INDEX_HISTOGRAM_BUCKETS)
+        part++;
+    }
+    previous.swap(values);
+  }
+  for (int length = 1; length <= columns; length++) {
+    double rate = pairs > 0 ? changes[length - 1] / pairs : 1;
+    double distinct = sample.key_count < 1
+                          ? sample.key_count
+                          : 1 + (sample.key_count - 1) * rate;
+    statistics_.distinct.push_back(std::max(distinct, seen[length - 1]));
+  }
+  statistics = statistics_;
+  return true;
+}
 
-  container_.GetValue(index_key, result, transaction);
+INDEX_TEMPLATE_ARGUMENTS
+void BPLUSTREE_INDEX_TYPE::ScanRange(const std::vector<Value> &low,
+                                     bool low_inclusive,
+                                     const std::vector<Value> &high,
+                                     bool high_inclusive,
+                                     std::vector<RID> &result, Transaction *) {
+  BPlusTreeIndexScan<KeyType, ValueType, KeyComparator> scan(
+      &container_, comparator_, GetKeySchema(), low, low_inclusive, high,
+      high_inclusive, false, SIZE_MAX);
+  std::vector<RID> batch;
+  scan.Next(batch);
+  result.insert(result.end(), batch.begin(), batch.end());
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+IndexScan *BPLUSTREE_INDEX_TYPE::OpenScan(const std::vector<Value> &low,
+                                          bool low_inclusive,
+                                          const std::vector<Value> &high,
+                                          bool high_inclusive, bool descending,
+                                          Transaction *) {
+  return new BPlusTreeIndexScan<KeyType, ValueType, KeyComparator>(
+      &container_, comparator_, GetKeySchema(), low, low_inclusive, high,
+      high_inclusive, descending);
+}
+
+/*
+ * External sort: entries are sorted in runs of BULK_LOAD_RUN_SIZE, which are
+ * spilled to temporary files once there is more than one, and merged on the
+ * fly while the tree is loaded. Entries with a key seen before are dropped by a
+ * unique index, like InsertEntry does, a non-unique one puts the RIDs of a key
+ * into a posting list.
+ */
+INDEX_TEMPLATE_ARGUMENTS
+bool BPLUSTREE_INDEX_TYPE::BulkLoad(
+    const std::function<bool(Tuple &, RID &)> &next, Transaction *) {
+  auto less = [this](const MappingType &a, const MappingType &b) {
+    return comparator_(a.first, b.first) < 0;
+  };
+  std::vector<MappingType> run;
+  std::vector<FILE *> files;
+  bool ok = true;
+  Tuple key;
+  RID rid;
+  bool more = next(key, rid);
+  while (more && ok) {
+    run.resize(run.size() + 1);
+    SetIndexKey(run.back().first, key);
+    run.back().second = rid;
+    more = next(key, rid);
+    if (run.size() < BULK_LOAD_RUN_SIZE && more)
+      continue;
+    std::sort(run.begin(), run.end(), less);
+    if (!more && files.empty())
+      break;
+    // spill the run
+    FILE *file = tmpfile();
+    ok = file != nullptr;
+    if (ok) {
+      files.push_back(file);
+      ok = fwrite(run.data(), sizeof(MappingType), run.size(), file) ==
+           run.size();
+      rewind(file);
+    }
+    run.clear();
+  }
+
+  // k-way merge of the runs, the in memory run is the only one if none spilled
+  typedef std::pair<MappingType, size_t> Head;
+  auto greater = [&less](const Head &a, const Head &b) {
+    return less(b.first, a.first);
+  };
+  std::priority_queue<Head, std::vector<Head>, decltype(greater)> heads(
+      greater);
+  MappingType entry;
+  for (size_t i = 0; ok && i < files.size(); i++)
+    if (fread(&entry, sizeof(MappingType), 1, files[i]) == 1)
+      heads.push(Head(entry, i));
+  size_t position = 0;
+  auto pop = [&](MappingType &popped) {
+    if (files.empty()) {
+      if (position == run.size())
+        return false;
+      popped = run[position++];
+      return true;
+    }
+    if (heads.empty())
+      return false;
+    Head head = heads.top();
+    heads.pop();
+    popped = head.first;
+    if (fread(&head.first, sizeof(MappingType), 1, files[head.second]) == 1)
+      heads.push(head);
+    return true;
+  };
+  // entry is the first one of the next key, if pending
+  bool pending = ok && pop(entry);
+  std::vector<RID> rids;
+  auto next_entry = [&](KeyType &index_key, ValueType &value) {
+    if (!pending)
+      return false;
+    index_key = entry.first;
+    rids.assign(1, entry.second);
+    while ((pending = pop(entry)) && comparator_(entry.first, index_key) == 0)
+      rids.push_back(entry.second);
+    value = rids[0];
+    if (GetMetadata()->IsUnique() || rids.size() == 1)
+      return true;
+    std::sort(rids.begin(), rids.end(),
+              [](const RID &a, const RID &b) { return a.Get() < b.Get(); });
+    rids.erase(std::unique(rids.begin(), rids.end()), rids.end());
+    value = container_.MakePostings(rids);
+    return true;
+  };
+  if (ok) {
+    ok = container_.BulkLoad(next_entry);
+  } else {
+    LOG_DEBUG("failed to spill bulk load run of %s", GetName().c_str());
+  }
+  for (FILE *file : files)
+    fclose(file);
+  return ok;
+}
+INDEX_SCAN_TEMPLATE_ARGUMENTS
+BPLUSTREE_INDEX_SCAN_TYPE::BPlusTreeIndexScan(
+    TreeType *tree,
+    const KeyComparator &comparator, Schema *key_schema,
+    const std::vector<Value> &low, bool low_inclusive,
+    const std::vector<Value> &high, bool high_inclusive, bool descending,
+    size_t batch_size)
+    : tree_(tree), comparator_(comparator), key_schema_(key_schema), low_(low),
+      low_inclusive_(low_inclusive), high_(high),
+      high_inclusive_(high_inclusive), descending_(descending),
+      batch_size_(batch_size) {
+  if (comparator_.IsNormalized()) {
+    low_length_ = low_key_.SetFromValues(low_, key_schema_);
+    high_length_ = high_key_.SetFromValues(high_, key_schema_);
+  }
+}
+
+INDEX_SCAN_TEMPLATE_ARGUMENTS
+bool BPLUSTREE_INDEX_SCAN_TYPE::Next(std::vector<RID> &batch) {
+  batch.clear();
+  if (!done_)
+    Collect(batch, nullptr);
+  return !batch.empty();
+}
+
+INDEX_SCAN_TEMPLATE_ARGUMENTS
+bool BPLUSTREE_INDEX_SCAN_TYPE::Next(std::vector<RID> &batch,
+                                     std::vector<Tuple> &keys) {
+  batch.clear();
+  keys.clear();
+  if (!done_)
+    Collect(batch, &keys);
+  return !batch.empty();
+}
+
+/*
+ * The first call starts at the bound the scan begins with, later calls at the
+ * last key handed out. Both stop at the first key past the other bound. The
+ * RIDs of a key are never split between batches, so a batch may run over; a
+ * tree with an entry per RID is read up to the first entry of the next key.
+ */
+INDEX_SCAN_TEMPLATE_ARGUMENTS
+void BPLUSTREE_INDEX_SCAN_TYPE::Collect(std::vector<RID> &batch,
+                                        std::vector<Tuple> *keys) {
+  bool resumed = started_;
+  KeyType index_key = last_;
+  bool seek = resumed || SeekKey(index_key);
+  auto iter = descending_
+                  ? (seek ? tree_->RBegin(index_key) : tree_->RBegin())
+                  : (seek ? tree_->Begin(index_key) : tree_->Begin());
+  for (; !iter.isEnd(); ++iter) {
+    const MappingType &entry = *iter;
+    if (resumed) {
+      int cmp = comparator_(entry.first, index_key);
+      if (descending_ ? cmp >= 0 : cmp <= 0)
+        continue;
+    } else if (descending_ ? AboveHigh(entry.first) : BelowLow(entry.first)) {
+      continue;
+    }
+    if (descending_ ? BelowLow(entry.first) : AboveHigh(entry.first))
+      break;
+    if (batch.size() >= batch_size_ && comparator_(entry.first, last_) != 0)
+      return;
+    // the leaf stays latched while its posting list is read
+    size_t count = batch.size();
+    tree_->GetPostings(entry.second, batch);
+    if (keys != nullptr) {
+      std::vector<Value> values;
+      for (int i = 0; i < key_schema_->GetColumnCount(); i++)
+        values.push_back(comparator_.IsNormalized()
+                             ? entry.first.FromNormalized(key_schema_, i)
+                             : entry.first.ToValue(key_schema_, i));
+      keys->insert(keys->end(), batch.size() - count,
+                   Tuple(values, key_schema_));
+    }
+    last_ = entry.first;
+    started_ = true;
+  }
+  done_ = true;
 }
+
+/*
+ * Helper to build the key the scan starts at: the bound it begins with, the
+ * remaining key columns filled with their minimum, or their maximum when
+ * descending
+ * @return: false if the scan starts at the end of the tree instead, that is
+ * if the bound is open or does not fit a key
+ */
+INDEX_SCAN_TEMPLATE_ARGUMENTS
+bool BPLUSTREE_INDEX_SCAN_TYPE::SeekKey(KeyType &key) {
+  const std::vector<Value> &bound = descending_ ? high_ : low_;
+  if (bound.empty())
+    return false;
+  // the normalized bound followed by the smallest or largest bytes
+  if (comparator_.IsNormalized()) {
+    key = descending_ ? high_key_ : low_key_;
+    if (descending_)
+      memset(key.data + high_length_, 0xFF, sizeof(KeyType) - high_length_);
+    return true;
+  }
+  std::vector<Value> values(bound);
+  for (int i = bound.size(); i < key_schema_->GetColumnCount(); i++) {
+    TypeId type = key_schema_->GetType(i);
+    // there is no largest string
+    if (descending_ && type == TypeId::VARCHAR)
+      return false;
+    values.push_back(descending_ ? Type::GetMaxValue(type)
+                                 : Type::GetMinValue(type));
+  }
+  Tuple bound_key(values, key_schema_);
+  // a long varchar bound does not fit the key
+  if (bound_key.GetLength() > (int)sizeof(KeyType))
+    return false;
+  key.SetFromKey(bound_key);
+  return true;
+}
+
+INDEX_SCAN_TEMPLATE_ARGUMENTS
+bool BPLUSTREE_INDEX_SCAN_TYPE::BelowLow(const KeyType &key) {
+  if (low_.empty())
+    return false;
+  int cmp = ComparePrefix(key, low_, low_key_, low_length_);
+  return cmp < 0 || (cmp == 0 && !low_inclusive_);
+}
+
+INDEX_SCAN_TEMPLATE_ARGUMENTS
+bool BPLUSTREE_INDEX_SCAN_TYPE::AboveHigh(const KeyType &key) {
+  if (high_.empty())
+    return false;
+  int cmp = ComparePrefix(key, high_, high_key_, high_length_);
+  return cmp > 0 || (cmp == 0 && !high_inclusive_);
+}
+
+/*
+ * Helper to compare the leading key columns of key with bound, normalized keys
+ * start with the bytes of the normalized bound when the columns are equal
+ * @return: negative, 0 or positive like the comparator
+ */
+INDEX_SCAN_TEMPLATE_ARGUMENTS
+int BPLUSTREE_INDEX_SCAN_TYPE::ComparePrefix(const KeyType &key,
+                                             const std::vector<Value> &bound,
+                                             const KeyType &bound_key,
+                                             size_t bound_length) {
+  if (comparator_.IsNormalized())
+    return memcmp(key.data, bound_key.data, bound_length);
+  for (size_t i = 0; i < bound.size(); i++) {
+    Value value = key.ToValue(key_schema_, i);
+    if (value.CompareLessThan(bound[i]) == CMP_TRUE)
+      return -1;
+    if (value.CompareGreaterThan(bound[i]) == CMP_TRUE)
+      return 1;
+  }
+  return 0;
+}
+
 template class BPlusTreeIndex<GenericKey<4>, RID, GenericComparator<4>>;
 template class BPlusTreeIndex<GenericKey<8>, RID, GenericComparator<8>>;
 template class BPlusTreeIndex<GenericKey<16>, RID, GenericComparator<16>>;
 template class BPlusTreeIndex<GenericKey<32>, RID, GenericComparator<32>>;
 template class BPlusTreeIndex<GenericKey<64>, RID, GenericComparator<64>>;
 
+template class BPlusTreeIndexScan<GenericKey<4>, RID, GenericComparator<4>>;
+template class BPlusTreeIndexScan<GenericKey<8>, RID, GenericComparator<8>>;
+template class BPlusTreeIndexScan<GenericKey<16>, RID, GenericComparator<16>>;
+template class BPlusTreeIndexScan<GenericKey<32>, RID, GenericComparator<32>>;
+template class BPlusTreeIndexScan<GenericKey<64>, RID, GenericComparator<64>>;
+
+template class BPlusTreeIndexScan<GenericKey<4>, RID, GenericComparator<4>,
+                                  BEpsilonTree<GenericKey<4>, RID,
+                                               GenericComparator<4>>>;
+template class BPlusTreeIndexScan<GenericKey<8>, RID, GenericComparator<8>,
+                                  BEpsilonTree<GenericKey<8>, RID,
+                                               GenericComparator<8>>>;
+template class BPlusTreeIndexScan<GenericKey<16>, RID, GenericComparator<16>,
+                                  BEpsilonTree<GenericKey<16>, RID,
+                                               GenericComparator<16>>>;
+template class BPlusTreeIndexScan<GenericKey<32>, RID, GenericComparator<32>,
+                                  BEpsilonTree<GenericKey<32>, RID,
+                                               GenericComparator<32>>>;
+template class BPlusTreeIndexScan<GenericKey<64>, RID, GenericComparator<64>,
+                                  BEpsilonTree<GenericKey<64>, RID,
+                                               GenericComparator<64>>>;
+
 } // namespace scudb
@@ -3,6 +3,7 @@
  */
 #include <cassert>
 
+#include "index/b_plus_tree.h"
 #include "index/index_iterator.h"
 
 namespace scudb {
@@ -12,38 +13,130 @@ namespace scudb {
  * set your own input parameters
  */
 INDEX_TEMPLATE_ARGUMENTS
-INDEXITERATOR_TYPE::IndexIterator(BPlusTreeLeafPage<KeyType, ValueType, KeyComparator>* InPage,int InIndex, BufferPoolManager* InManager) :
-        Page(InPage), Index(InIndex), Manager(InManager) {}
+INDEXITERATOR_TYPE::IndexIterator(BPlusTree<KeyType, ValueType, KeyComparator>* InTree, scudb::Page* InFrame,int InIndex, BufferPoolManager* InManager, const KeyComparator& InComparator, bool InReverse) :
+        Tree(InTree), Frame(InFrame), Page(InFrame ? reinterpret_cast<BPlusTreeLeafPage<KeyType, ValueType, KeyComparator>*>(InFrame->GetData()) : nullptr),
+        Index(InIndex), Manager(InManager), Comparator(InComparator), Reverse(InReverse)
+{
+    // a lookup key past the last one of its leaf starts on the next leaf
+    if (Reverse) SkipFinishedLeavesBackward();
+    else SkipFinishedLeaves();
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+INDEXITERATOR_TYPE::IndexIterator(IndexIterator&& Other) :
+        Tree(Other.Tree), Frame(Other.Frame), Page(Other.Page), Index(Other.Index), Manager(Other.Manager),
+        Comparator(Other.Comparator), Reverse(Other.Reverse)
+{
+    Other.Frame = nullptr;
+    Other.Page = nullptr;
+}
 
 INDEX_TEMPLATE_ARGUMENTS
 INDEXITERATOR_TYPE::~IndexIterator() 
 {
-	Manager->UnpinPage(Page->GetPageId(),true);
+    if (!Frame) return;
+    Frame->RUnlatch();
+	Manager->UnpinPage(Frame->GetPageId(),false);
 }
 INDEX_TEMPLATE_ARGUMENTS
 bool INDEXITERATOR_TYPE::isEnd() 
 {
+    if (Reverse) return (!Page || (Index < 0 && Page->GetPrevPageId() == INVALID_PAGE_ID));
     return (!Page || (Index == Page->GetSize() && Page->GetNextPageId() == INVALID_PAGE_ID));
 }
 
 INDEX_TEMPLATE_ARGUMENTS
 const MappingType& INDEXITERATOR_TYPE::operator*() 
 {
-    return Page->GetItem(Index);
+    Item = Page->GetItem(Index);
+    return Item;
 }
 
 INDEX_TEMPLATE_ARGUMENTS
 INDEXITERATOR_TYPE& INDEXITERATOR_TYPE::operator++() 
 {
+    if (Reverse)
+    {
+        Index--;
+        SkipFinishedLeavesBackward();
+        return *this;
+    }
     Index++;
-    if (Index == Page->GetSize() && Page->GetNextPageId() != INVALID_PAGE_ID) 
+    SkipFinishedLeaves();
+    return *this;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void INDEXITERATOR_TYPE::SkipFinishedLeaves()
+{
+    while (Page && Index == Page->GetSize() && Page->GetNextPageId() != INVALID_PAGE_ID) 
     {
+        // crab over to the next leaf. A writer may hold it and wait for this
+        // one (it latches left siblings), so only try; on failure let go first
+        // and skip whatever was moved over from this leaf in the meantime
+        scudb::Page* Next = Manager->FetchPage(Page->GetNextPageId());
+        bool Crabbed = Next->TryRLatch();
+        bool Skip = !Crabbed && Page->GetSize() > 0;
+        KeyType Last;
+        if (Skip) Last = Page->KeyAt(Page->GetSize() - 1);
+        Frame->RUnlatch();
+        Manager->UnpinPage(Frame->GetPageId(),false);
+        if (!Crabbed) Next->RLatch();
+        Frame = Next;
+        Page = reinterpret_cast<BPlusTreeLeafPage<KeyType, ValueType,KeyComparator>*>(Next->GetData());
         Index = 0;
-        Manager->UnpinPage(Page->GetPageId(),true);
-        Page = reinterpret_cast<BPlusTreeLeafPage<KeyType, ValueType,KeyComparator>*>(Manager->FetchPage(Page->GetNextPageId())->GetData());
+        if (Skip)
+        {
+            // emptied: it was merged into its left sibling while we waited
+            // and its next page id is stale, so look Last up again
+            if (!Page->GetSize())
+            {
+                Frame->RUnlatch();
+                Manager->UnpinPage(Frame->GetPageId(),false);
+                Frame = Tree->FindLeafPage(Last);
+                Page = Frame ? reinterpret_cast<BPlusTreeLeafPage<KeyType, ValueType,KeyComparator>*>(Frame->GetData()) : nullptr;
+                if (!Page) break;
+            }
+            Index = Page->KeyIndex(Last, Comparator);
+            if (Index < Page->GetSize() && Comparator(Page->KeyAt(Index), Last) == 0) Index++;
+        }
+    }
+}
+INDEX_TEMPLATE_ARGUMENTS
+void INDEXITERATOR_TYPE::SkipFinishedLeavesBackward()
+{
+    // first key of the last leaf left that had one
+    KeyType First;
+    bool Known = false;
+    while (Page && Index < 0 && Page->GetPrevPageId() != INVALID_PAGE_ID)
+    {
+        // crab over to the previous leaf. Writers latch leaves left to right,
+        // so only try; while this leaf is latched its prev link is current
+        scudb::Page* Prev = Manager->FetchPage(Page->GetPrevPageId());
+        Known = Known || Page->GetSize() > 0;
+        if (Page->GetSize()) First = Page->KeyAt(0);
+        if (Prev->TryRLatch())
+        {
+            Frame->RUnlatch();
+            Manager->UnpinPage(Frame->GetPageId(),false);
+            Frame = Prev;
+            Page = reinterpret_cast<BPlusTreeLeafPage<KeyType, ValueType,KeyComparator>*>(Prev->GetData());
+            Index = Page->GetSize() - 1;
+            continue;
+        }
+        // on failure let go, the leaves to the left may change meanwhile, and
+        // look up the first key of this leaf again. An empty leaf has no first
+        // key of its own, so the last one seen on the way there is used
+        Manager->UnpinPage(Prev->GetPageId(),false);
+        Frame->RUnlatch();
+        Manager->UnpinPage(Frame->GetPageId(),false);
+        Frame = Known ? Tree->FindLeafPage(First) : nullptr;
+        Page = Frame ? reinterpret_cast<BPlusTreeLeafPage<KeyType, ValueType,KeyComparator>*>(Frame->GetData()) : nullptr;
+        if (!Page) break;
+        Index = Page->KeyIndex(First, Comparator) - 1;
     }
-    return *this;
 }
+
 template class IndexIterator<GenericKey<4>, RID, GenericComparator<4>>;
 template class IndexIterator<GenericKey<8>, RID, GenericComparator<8>>;
 template class IndexIterator<GenericKey<16>, RID, GenericComparator<16>>;
@@ -0,0 +1,144 @@
+/**
+ * key_search.cpp
+ */
+#include "index/key_search.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define KEY_SEARCH_HAS_SIMD
+#endif
+
+namespace scudb {
+
+// keys left when the binary search hands over to counting
+#define KEY_SEARCH_WINDOW 32
+
+/*
+ * Helpers to count the keys of a window that are greater than key
+ */
+template <int F>
+static int CountGreaterScalar(const char *keys, size_t stride, int count,
+                              int64_t key) {
+  int greater = 0;
+  for (int i = 0; i < count; i++)
+    greater += KeySearch::Load(keys + i * stride, (KeySearch::Format)F) > key;
+  return greater;
+}
+
+#ifdef KEY_SEARCH_HAS_SIMD
+template <int F>
+__attribute__((target("avx2"))) static int
+CountGreaterAVX2(const char *keys, size_t stride, int count, int64_t key) {
+  const KeySearch::Format format = (KeySearch::Format)F;
+  const __m256i target = _mm256_set1_epi64x(key);
+  int greater = 0;
+  int i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m256i values = _mm256_set_epi64x(
+        KeySearch::Load(keys + (i + 3) * stride, format),
+        KeySearch::Load(keys + (i + 2) * stride, format),
+        KeySearch::Load(keys + (i + 1) * stride, format),
+        KeySearch::Load(keys + i * stride, format));
+    __m256i mask = _mm256_cmpgt_epi64(values, target);
+    greater += __builtin_popcount(_mm256_movemask_pd(_mm256_castsi256_pd(mask)));
+  }
+  return greater +
+         CountGreaterScalar<F>(keys + i * stride, stride, count - i, key);
+}
+
+template <int F>
+__attribute__((target("sse4.2"))) static int
+CountGreaterSSE42(const char *keys, size_t stride, int count, int64_t key) {
+  const KeySearch::Format format = (KeySearch::Format)F;
+  const __m128i target = _mm_set1_epi64x(key);
+  int greater = 0;
+  int i = 0;
+  for (; i + 2 <= count; i += 2) {
+    __m128i values =
+        _mm_set_epi64x(KeySearch::Load(keys + (i + 1) * stride, format),
+                       KeySearch::Load(keys + i * stride, format));
+    __m128i mask = _mm_cmpgt_epi64(values, target);
+    greater += __builtin_popcount(_mm_movemask_pd(_mm_castsi128_pd(mask)));
+  }
+  return greater +
+         CountGreaterScalar<F>(keys + i * stride, stride, count - i, key);
+}
+#endif
+
+/*
+ * Helper to pick the implementation on first use
+ */
+typedef int (*CountFunction)(const char *, size_t, int, int64_t);
+enum Level { LEVEL_SCALAR, LEVEL_SSE42, LEVEL_AVX2 };
+
+static Level SelectLevel() {
+#ifdef KEY_SEARCH_HAS_SIMD
+  if (__builtin_cpu_supports("avx2"))
+    return LEVEL_AVX2;
+  if (__builtin_cpu_supports("sse4.2"))
+    return LEVEL_SSE42;
+#endif
+  return LEVEL_SCALAR;
+}
+
+static Level GetLevel() {
+  static const Level level = SelectLevel();
+  return level;
+}
+
+template <int F> static CountFunction GetCountGreater() {
+#ifdef KEY_SEARCH_HAS_SIMD
+  if (GetLevel() == LEVEL_AVX2)
+    return CountGreaterAVX2<F>;
+  if (GetLevel() == LEVEL_SSE42)
+    return CountGreaterSSE42<F>;
+#endif
+  return CountGreaterScalar<F>;
+}
+
+template <int F>
+static int CountFormat(const char *keys, size_t stride, int count, int64_t key,
+                       bool inclusive) {
+  const KeySearch::Format format = (KeySearch::Format)F;
+  // first key not below key, or above it if inclusive
+  int low = 0, high = count;
+  while (high - low > KEY_SEARCH_WINDOW) {
+    int mid = low + (high - low) / 2;
+    int64_t value = KeySearch::Load(keys + mid * stride, format);
+    if (value < key || (inclusive && value == key))
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  // the window keys above key, or not below it, are past the result
+  static const CountFunction count_greater = GetCountGreater<F>();
+  int64_t bound = key;
+  int window = high - low;
+  if (!inclusive) {
+    // not below key is above key - 1
+    if (key == INT64_MIN)
+      return low;
+    bound = key - 1;
+  }
+  return high - count_greater(keys + low * stride, stride, window, bound);
+}
+
+int KeySearch::Count(const char *keys, size_t stride, int count, int64_t key,
+                     Format format, bool inclusive) {
+  switch (format) {
+  case INT32:
+    return CountFormat<INT32>(keys, stride, count, key, inclusive);
+  case INT64:
+    return CountFormat<INT64>(keys, stride, count, key, inclusive);
+  case NORMALIZED4:
+    return CountFormat<NORMALIZED4>(keys, stride, count, key, inclusive);
+  case NORMALIZED8:
+    return CountFormat<NORMALIZED8>(keys, stride, count, key, inclusive);
+  default:
+    return 0;
+  }
+}
+
+bool KeySearch::IsHardwareAccelerated() { return GetLevel() != LEVEL_SCALAR; }
+
+} // namespace scudb
@@ -0,0 +1,352 @@
+/**
+ * posting_list.cpp
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include "index/posting_list.h"
+#include "page/b_plus_tree_posting_page.h"
+
+namespace scudb {
+
+/*
+ * Helpers for the varints of the deltas, 7 bits a byte, low bits first
+ */
+static size_t VarintSize(uint64_t value)
+{
+    size_t Size = 1;
+    while (value >>= 7) Size++;
+    return Size;
+}
+
+static void PutVarint(std::string &data, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        data.push_back((char)(value | 0x80));
+        value >>= 7;
+    }
+    data.push_back((char)value);
+}
+
+static uint64_t GetVarint(const char *data, size_t size, size_t &offset)
+{
+    uint64_t Value = 0;
+    for (int Shift = 0; offset < size && Shift < 64; Shift += 7)
+    {
+        unsigned char Byte = data[offset++];
+        Value |= (uint64_t)(Byte & 0x7F) << Shift;
+        if (!(Byte & 0x80)) break;
+    }
+    return Value;
+}
+
+// bytes of the delta from prev to rid
+static size_t DeltaSize(const RID &prev, const RID &rid)
+{
+    if (rid.GetPageId() == prev.GetPageId()) return VarintSize((uint64_t)(rid.GetSlotNum() - prev.GetSlotNum()) << 1);
+    return VarintSize((uint64_t)(rid.GetPageId() - prev.GetPageId()) << 1 | 1) + VarintSize(rid.GetSlotNum());
+}
+
+// bytes in front of the deltas
+#define SEGMENT_HEADER_SIZE (2 * sizeof(RID) + sizeof(uint16_t))
+
+PostingList::PostingList(BufferPoolManager *buffer_pool_manager)
+    : buffer_pool_manager_(buffer_pool_manager) {}
+
+bool PostingList::IsList(const RID &value)
+{
+    return value.GetPageId() != INVALID_PAGE_ID && value.GetSlotNum() >= LIST_FLAG;
+}
+
+/*
+ * Segments are read from the highest RIDs down, so they are collected first
+ */
+void PostingList::Read(const RID &value, std::vector<RID> &result)
+{
+    if (!IsList(value))
+    {
+        result.push_back(value);
+        return;
+    }
+    std::vector<std::vector<RID>> Segments;
+    Segment Current;
+    for (RID Ref = value; Ref.GetPageId() != INVALID_PAGE_ID; Ref = Current.next)
+    {
+        Load(Ref, Current);
+        Segments.push_back(std::move(Current.rids));
+    }
+    for (auto It = Segments.rbegin(); It != Segments.rend(); ++It)
+        result.insert(result.end(), It->begin(), It->end());
+}
+
+/*
+ * A segment that grows beyond a page is split, its lower half goes to a new
+ * segment right after it. One that no longer fits its page moves.
+ */
+bool PostingList::Add(RID &value, const RID &rid)
+{
+    if (!IsList(value))
+    {
+        if (value == rid) return false;
+        Segment Pair;
+        Pair.rids.push_back(Less(rid, value) ? rid : value);
+        Pair.rids.push_back(Less(rid, value) ? value : rid);
+        value = Allocate(Pair);
+        return true;
+    }
+    Segment Prev, Current;
+    Find(value, rid, Prev, Current);
+    auto It = std::lower_bound(Current.rids.begin(), Current.rids.end(), rid, Less);
+    if (It != Current.rids.end() && *It == rid) return false;
+    Current.rids.insert(It, rid);
+    if (Encode(Current).size() > BPlusTreePostingPage::GetMaxSegmentSize())
+    {
+        Segment Low;
+        size_t Half = Current.rids.size() / 2;
+        Low.next = Current.next;
+        Low.rids.assign(Current.rids.begin(), Current.rids.begin() + Half);
+        Current.rids.erase(Current.rids.begin(), Current.rids.begin() + Half);
+        Current.next = Allocate(Low);
+    }
+    if (!Store(Current))
+    {
+        RID Old = Current.ref;
+        Relink(value, Prev, Allocate(Current));
+        Release(Old);
+    }
+    return true;
+}
+
+bool PostingList::Remove(RID &value, const RID &rid)
+{
+    Segment Prev, Current;
+    Find(value, rid, Prev, Current);
+    auto It = std::lower_bound(Current.rids.begin(), Current.rids.end(), rid, Less);
+    if (It == Current.rids.end() || !(*It == rid)) return false;
+    Current.rids.erase(It);
+    if (Current.rids.empty())
+    {
+        Relink(value, Prev, Current.next);
+        Release(Current.ref);
+    }
+    else
+    {
+        // removing a RID never makes a segment longer
+        Store(Current);
+    }
+    Segment Head;
+    Load(value, Head);
+    if (Head.next.GetPageId() == INVALID_PAGE_ID && Head.rids.size() == 1)
+    {
+        value = Head.rids[0];
+        Release(Head.ref);
+    }
+    return true;
+}
+
+/*
+ * Segments are filled up from the lowest RIDs, each one pointing at the one
+ * before it
+ */
+RID PostingList::Build(const std::vector<RID> &rids)
+{
+    if (rids.size() == 1) return rids[0];
+    Segment Current;
+    size_t Begin = 0;
+    while (Begin < rids.size())
+    {
+        size_t Size = SEGMENT_HEADER_SIZE;
+        size_t End = Begin + 1;
+        while (End < rids.size() && Size + DeltaSize(rids[End - 1], rids[End]) <= BPlusTreePostingPage::GetMaxSegmentSize())
+        {
+            Size += DeltaSize(rids[End - 1], rids[End]);
+            End++;
+        }
+        Current.rids.assign(rids.begin() + Begin, rids.begin() + End);
+        Current.next = Allocate(Current);
+        Begin = End;
+    }
+    return Current.next;
+}
+
+void PostingList::Free(const RID &value)
+{
+    if (!IsList(value)) return;
+    Segment Current;
+    for (RID Ref = value; Ref.GetPageId() != INVALID_PAGE_ID; Ref = Current.next)
+    {
+        Load(Ref, Current);
+        Release(Ref);
+    }
+}
+
+/*
+ * RID order, that of RID::Get()
+ */
+bool PostingList::Less(const RID &left, const RID &right)
+{
+    if (left.GetPageId() != right.GetPageId()) return left.GetPageId() < right.GetPageId();
+    return left.GetSlotNum() < right.GetSlotNum();
+}
+
+std::string PostingList::Encode(const Segment &segment)
+{
+    std::string Data(SEGMENT_HEADER_SIZE, '\0');
+    uint16_t Count = segment.rids.size();
+    memcpy(&Data[0], &segment.next, sizeof(RID));
+    memcpy(&Data[sizeof(RID)], &Count, sizeof(uint16_t));
+    memcpy(&Data[sizeof(RID) + sizeof(uint16_t)], &segment.rids[0], sizeof(RID));
+    for (size_t i = 1; i < segment.rids.size(); i++)
+    {
+        const RID &Prev = segment.rids[i - 1];
+        const RID &Rid = segment.rids[i];
+        if (Rid.GetPageId() == Prev.GetPageId())
+            PutVarint(Data, (uint64_t)(Rid.GetSlotNum() - Prev.GetSlotNum()) << 1);
+        else
+        {
+            PutVarint(Data, (uint64_t)(Rid.GetPageId() - Prev.GetPageId()) << 1 | 1);
+            PutVarint(Data, Rid.GetSlotNum());
+        }
+    }
+    return Data;
+}
+
+void PostingList::Decode(const char *data, size_t size, Segment &segment)
+{
+    segment.next = RID();
+    segment.rids.clear();
+    if (size < SEGMENT_HEADER_SIZE) return;
+    uint16_t Count;
+    RID Rid;
+    memcpy(&segment.next, data, sizeof(RID));
+    memcpy(&Count, data + sizeof(RID), sizeof(uint16_t));
+    memcpy(&Rid, data + sizeof(RID) + sizeof(uint16_t), sizeof(RID));
+    segment.rids.push_back(Rid);
+    size_t Offset = SEGMENT_HEADER_SIZE;
+    while (segment.rids.size() < Count && Offset < size)
+    {
+        uint64_t Delta = GetVarint(data, size, Offset);
+        if (Delta & 1)
+        {
+            page_id_t PageId = Rid.GetPageId() + (page_id_t)(Delta >> 1);
+            Rid = RID(PageId, (int)GetVarint(data, size, Offset));
+        }
+        else
+            Rid = RID(Rid.GetPageId(), Rid.GetSlotNum() + (int)(Delta >> 1));
+        segment.rids.push_back(Rid);
+    }
+}
+
+void PostingList::Load(const RID &ref, Segment &segment)
+{
+    Page* Frame = buffer_pool_manager_->FetchPage(ref.GetPageId());
+    Frame->RLatch();
+    auto* Posting = reinterpret_cast<BPlusTreePostingPage*>(Frame->GetData());
+    size_t Size = 0;
+    const char* Data = Posting->GetSegment(ref.GetSlotNum() - LIST_FLAG, Size);
+    Decode(Data, Data ? Size : 0, segment);
+    segment.ref = ref;
+    Frame->RUnlatch();
+    buffer_pool_manager_->UnpinPage(ref.GetPageId(), false);
+}
+
+/*
+ * Write segment back where it is
+ * @return: false if it does not fit there anymore
+ */
+bool PostingList::Store(const Segment &segment)
+{
+    std::string Data = Encode(segment);
+    Page* Frame = buffer_pool_manager_->FetchPage(segment.ref.GetPageId());
+    Frame->WLatch();
+    auto* Posting = reinterpret_cast<BPlusTreePostingPage*>(Frame->GetData());
+    bool Stored = Posting->UpdateSegment(segment.ref.GetSlotNum() - LIST_FLAG, Data.data(), Data.size());
+    Frame->WUnlatch();
+    buffer_pool_manager_->UnpinPage(segment.ref.GetPageId(), Stored);
+    return Stored;
+}
+
+/*
+ * Store segment in the posting page new segments go to, a new one once it
+ * is full
+ * @return: where the segment is
+ */
+RID PostingList::Allocate(const Segment &segment)
+{
+    std::string Data = Encode(segment);
+    std::lock_guard<std::mutex> Guard(latch_);
+    if (page_id_ != INVALID_PAGE_ID)
+    {
+        Page* Frame = buffer_pool_manager_->FetchPage(page_id_);
+        Frame->WLatch();
+        int Slot = reinterpret_cast<BPlusTreePostingPage*>(Frame->GetData())->InsertSegment(Data.data(), Data.size());
+        Frame->WUnlatch();
+        buffer_pool_manager_->UnpinPage(page_id_, Slot >= 0);
+        if (Slot >= 0) return RID(page_id_, Slot | LIST_FLAG);
+    }
+    // nobody knows the new page yet
+    page_id_t PageId;
+    auto* Posting = reinterpret_cast<BPlusTreePostingPage*>(buffer_pool_manager_->NewPage(PageId)->GetData());
+    Posting->Init(PageId);
+    int Slot = Posting->InsertSegment(Data.data(), Data.size());
+    buffer_pool_manager_->UnpinPage(PageId, true);
+    page_id_ = PageId;
+    return RID(PageId, Slot | LIST_FLAG);
+}
+
+/*
+ * Free the segment at ref and give its page back once it is empty, unless new
+ * segments go there. Segments only get into an empty page through Allocate, so
+ * the page is checked again under its latch
+ */
+void PostingList::Release(const RID &ref)
+{
+    page_id_t PageId = ref.GetPageId();
+    Page* Frame = buffer_pool_manager_->FetchPage(PageId);
+    Frame->WLatch();
+    auto* Posting = reinterpret_cast<BPlusTreePostingPage*>(Frame->GetData());
+    Posting->RemoveSegment(ref.GetSlotNum() - LIST_FLAG);
+    bool Empty = Posting->IsEmpty();
+    Frame->WUnlatch();
+    buffer_pool_manager_->UnpinPage(PageId, true);
+    if (!Empty) return;
+    std::lock_guard<std::mutex> Guard(latch_);
+    if (PageId == page_id_) return;
+    Frame = buffer_pool_manager_->FetchPage(PageId);
+    Frame->RLatch();
+    Empty = reinterpret_cast<BPlusTreePostingPage*>(Frame->GetData())->IsEmpty();
+    Frame->RUnlatch();
+    buffer_pool_manager_->UnpinPage(PageId, false);
+    if (Empty) buffer_pool_manager_->DeletePage(PageId);
+}
+
+/*
+ * Helper to find the segment rid belongs in: the first one that does not
+ * start above it, or the last one
+ */
+void PostingList::Find(const RID &value, const RID &rid, Segment &prev, Segment &segment)
+{
+    prev.ref = RID();
+    Load(value, segment);
+    while (segment.next.GetPageId() != INVALID_PAGE_ID && Less(rid, segment.rids[0]))
+    {
+        prev = std::move(segment);
+        Load(prev.next, segment);
+    }
+}
+
+void PostingList::Relink(RID &value, Segment &prev, const RID &ref)
+{
+    if (prev.ref.GetPageId() == INVALID_PAGE_ID)
+    {
+        value = ref;
+        return;
+    }
+    // the same size, it stays where it is
+    prev.next = ref;
+    Store(prev);
+}
+
+} // namespace scudb
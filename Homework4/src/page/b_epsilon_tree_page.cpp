@@ -0,0 +1,139 @@
+/**
+ * b_epsilon_tree_page.cpp
+ */
+
+#include <algorithm>
+
+#include "common/rid.h"
+#include "page/b_epsilon_tree_page.h"
+
+namespace scudb {
+
+// room for entries, or children and messages
+#define B_EPSILON_PAGE_AREA (PAGE_CHECKSUM_OFFSET - sizeof(BEpsilonTreePage))
+#define B_EPSILON_CHILD_SIZE (sizeof(MappingType) + sizeof(page_id_t))
+
+/*
+ * Init method after creating a new page
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void BEPSILONPAGE_TYPE::Init(page_id_t page_id, bool leaf)
+{
+    page_type_ = leaf ? IndexPageType::LEAF_PAGE : IndexPageType::INTERNAL_PAGE;
+    page_id_ = page_id;
+    next_page_id_ = INVALID_PAGE_ID;
+    size_ = 0;
+    message_count_ = 0;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+bool BEPSILONPAGE_TYPE::IsLeafPage() const
+{
+    return page_type_ == IndexPageType::LEAF_PAGE;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+page_id_t BEPSILONPAGE_TYPE::GetPageId() const
+{
+    return page_id_;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+page_id_t BEPSILONPAGE_TYPE::GetNextPageId() const
+{
+    return next_page_id_;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void BEPSILONPAGE_TYPE::SetNextPageId(page_id_t next_page_id)
+{
+    next_page_id_ = next_page_id;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+int BEPSILONPAGE_TYPE::GetMaxEntries()
+{
+    return B_EPSILON_PAGE_AREA / sizeof(MappingType);
+}
+
+/*
+ * B_EPSILON_TREE_FANOUT, fewer for wide keys so that a page buffers at least
+ * a message per child
+ */
+INDEX_TEMPLATE_ARGUMENTS
+int BEPSILONPAGE_TYPE::GetMaxChildren()
+{
+    int Fit = B_EPSILON_PAGE_AREA / (B_EPSILON_CHILD_SIZE + sizeof(Message));
+    return std::max(2, std::min(B_EPSILON_TREE_FANOUT, Fit));
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+int BEPSILONPAGE_TYPE::GetMaxMessages()
+{
+    return (B_EPSILON_PAGE_AREA - GetMaxChildren() * B_EPSILON_CHILD_SIZE) / sizeof(Message);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void BEPSILONPAGE_TYPE::GetEntries(std::vector<MappingType> &entries) const
+{
+    const MappingType *Entries = reinterpret_cast<const MappingType *>(data_);
+    entries.assign(Entries, Entries + size_);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void BEPSILONPAGE_TYPE::SetEntries(const MappingType *entries, int count)
+{
+    assert(count <= GetMaxEntries());
+    std::copy(entries, entries + count, reinterpret_cast<MappingType *>(data_));
+    size_ = count;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void BEPSILONPAGE_TYPE::GetChildren(std::vector<MappingType> &pivots, std::vector<page_id_t> &children) const
+{
+    const MappingType *Pivots = reinterpret_cast<const MappingType *>(data_);
+    const page_id_t *Children = reinterpret_cast<const page_id_t *>(data_ + GetMaxChildren() * sizeof(MappingType));
+    pivots.assign(Pivots, Pivots + size_);
+    children.assign(Children, Children + size_);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void BEPSILONPAGE_TYPE::SetChildren(const MappingType *pivots, const page_id_t *children, int count)
+{
+    assert(count <= GetMaxChildren());
+    std::copy(pivots, pivots + count, reinterpret_cast<MappingType *>(data_));
+    std::copy(children, children + count, reinterpret_cast<page_id_t *>(data_ + GetMaxChildren() * sizeof(MappingType)));
+    size_ = count;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void BEPSILONPAGE_TYPE::GetMessages(std::vector<Message> &messages) const
+{
+    const Message *Messages = reinterpret_cast<const Message *>(MessageArea());
+    messages.assign(Messages, Messages + message_count_);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void BEPSILONPAGE_TYPE::SetMessages(const Message *messages, int count)
+{
+    assert(count <= GetMaxMessages());
+    std::copy(messages, messages + count, reinterpret_cast<Message *>(const_cast<char *>(MessageArea())));
+    message_count_ = count;
+}
+
+/*
+ * Messages follow the room for children
+ */
+INDEX_TEMPLATE_ARGUMENTS
+const char *BEPSILONPAGE_TYPE::MessageArea() const
+{
+    return data_ + GetMaxChildren() * B_EPSILON_CHILD_SIZE;
+}
+
+template class BEpsilonTreePage<GenericKey<4>, RID, GenericComparator<4>>;
+template class BEpsilonTreePage<GenericKey<8>, RID, GenericComparator<8>>;
+template class BEpsilonTreePage<GenericKey<16>, RID, GenericComparator<16>>;
+template class BEpsilonTreePage<GenericKey<32>, RID, GenericComparator<32>>;
+template class BEpsilonTreePage<GenericKey<64>, RID, GenericComparator<64>>;
+
+} // namespace scudb
@@ -1,6 +1,8 @@
 ﻿/**
  * b_plus_tree_internal_page.cpp
  */
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 #include <sstream>
 
@@ -8,39 +10,56 @@
 #include "page/b_plus_tree_internal_page.h"
 
 namespace scudb {
+
+// room for fences and entries
+#define INTERNAL_PAGE_AREA (PAGE_CHECKSUM_OFFSET - sizeof(BPlusTreeInternalPage))
+
 /*****************************************************************************
  * HELPER METHODS AND UTILITIES
  *****************************************************************************/
 /*
  * Init method after creating a new internal page
- * Including set page type, set current size, set page id, set parent id and set
- * max page size
+ * Including set page type, set current size, set page id and set max page size
  */
 INDEX_TEMPLATE_ARGUMENTS
-void B_PLUS_TREE_INTERNAL_PAGE_TYPE::Init(page_id_t page_id,
-                                          page_id_t parent_id) 
+void B_PLUS_TREE_INTERNAL_PAGE_TYPE::Init(page_id_t page_id) 
 {
     page_type_ = IndexPageType::INTERNAL_PAGE;
-    size_=1;   
     page_id_ = page_id;
-    parent_page_id_ = parent_id;
-    max_size_ = (PAGE_SIZE - sizeof(BPlusTreeInternalPage)) / (sizeof(KeyType) + sizeof(ValueType));
+    InitEntries(INTERNAL_PAGE_AREA, sizeof(KeyType), sizeof(ValueType));
+    ValueType Child = ValueType();
+    InsertEntry(data_, INTERNAL_PAGE_AREA, sizeof(KeyType), sizeof(ValueType), 0,
+                nullptr, reinterpret_cast<const char*>(&Child));
 }
 /*
  * Helper method to get/set the key associated with input "index"(a.k.a
  * array offset)
+ * A slotted page gets a new entry for the key, there has to be room for it,
+ * see HasRoomFor
  */
 INDEX_TEMPLATE_ARGUMENTS
 KeyType B_PLUS_TREE_INTERNAL_PAGE_TYPE::KeyAt(int index) const 
 {
-  // replace with your own code
-    return array[index].first;
+    KeyType Key;
+    return KeyRef(index, Key);
 }
 
 INDEX_TEMPLATE_ARGUMENTS
 void B_PLUS_TREE_INTERNAL_PAGE_TYPE::SetKeyAt(int index, const KeyType &key) 
 {
-    array[index].first = key;
+    const char* Key = reinterpret_cast<const char*>(&key);
+    if (!IsSlotted(sizeof(KeyType)))
+    {
+        size_t Length;
+        char* Stored = const_cast<char*>(StoredKey(data_, INTERNAL_PAGE_AREA, sizeof(KeyType), sizeof(ValueType), index, Length));
+        memcpy(Stored, Key + prefix_size_, Length);
+        return;
+    }
+    if (!index) return;
+    ValueType Value = ValueAt(index);
+    RemoveEntry(data_, INTERNAL_PAGE_AREA, sizeof(KeyType), sizeof(ValueType), index);
+    InsertEntry(data_, INTERNAL_PAGE_AREA, sizeof(KeyType), sizeof(ValueType), index,
+                Key, reinterpret_cast<const char*>(&Value));
 }
 
 /*
@@ -52,7 +71,7 @@ int B_PLUS_TREE_INTERNAL_PAGE_TYPE::ValueIndex(const ValueType &value) const
 {
     for (int i = 0; i < size_; i++) 
     {
-        if (array[i].second == value)
+        if (ValueAt(i) == value)
             return i;
     }
     return size_;
@@ -65,7 +84,137 @@ int B_PLUS_TREE_INTERNAL_PAGE_TYPE::ValueIndex(const ValueType &value) const
 INDEX_TEMPLATE_ARGUMENTS
 ValueType B_PLUS_TREE_INTERNAL_PAGE_TYPE::ValueAt(int index) const 
 {
-    return array[index].second;
+    size_t Length;
+    const char* Key = StoredKey(data_, INTERNAL_PAGE_AREA, sizeof(KeyType), sizeof(ValueType), index, Length);
+    ValueType Value;
+    memcpy(&Value, Key + Length, sizeof(ValueType));
+    return Value;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void B_PLUS_TREE_INTERNAL_PAGE_TYPE::SetValueAt(int index, const ValueType &value) 
+{
+    size_t Length;
+    const char* Key = StoredKey(data_, INTERNAL_PAGE_AREA, sizeof(KeyType), sizeof(ValueType), index, Length);
+    memcpy(const_cast<char*>(Key) + Length, &value, sizeof(ValueType));
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+MappingType B_PLUS_TREE_INTERNAL_PAGE_TYPE::GetItem(int index) const
+{
+    return std::make_pair(KeyAt(index), ValueAt(index));
+}
+
+/*
+ * The key at index, right in the page if it is stored whole, otherwise put
+ * together in scratch
+ */
+INDEX_TEMPLATE_ARGUMENTS
+const KeyType &B_PLUS_TREE_INTERNAL_PAGE_TYPE::KeyRef(int index, KeyType &scratch) const
+{
+    size_t Length;
+    const char* Key = StoredKey(data_, INTERNAL_PAGE_AREA, sizeof(KeyType), sizeof(ValueType), index, Length);
+    if (Length == sizeof(KeyType)) return *reinterpret_cast<const KeyType*>(Key);
+    GetKey(data_, INTERNAL_PAGE_AREA, sizeof(KeyType), sizeof(ValueType), index, reinterpret_cast<char*>(&scratch));
+    return scratch;
+}
+
+/*
+ * Helper methods for the fence keys, see b_plus_tree_page.h
+ */
+INDEX_TEMPLATE_ARGUMENTS
+bool B_PLUS_TREE_INTERNAL_PAGE_TYPE::GetFence(bool high, KeyType &key) const
+{
+    return BPlusTreePage::GetFence(data_, high, reinterpret_cast<char*>(&key), sizeof(KeyType));
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void B_PLUS_TREE_INTERNAL_PAGE_TYPE::SetFences(const KeyType *low, const KeyType *high)
+{
+    BPlusTreePage::SetFences(data_, INTERNAL_PAGE_AREA, sizeof(KeyType), sizeof(ValueType),
+                             reinterpret_cast<const char*>(low), reinterpret_cast<const char*>(high), false);
+}
+
+/*
+ * Helper methods for the room in the page, see b_plus_tree_leaf_page.cpp
+ */
+INDEX_TEMPLATE_ARGUMENTS
+size_t B_PLUS_TREE_INTERNAL_PAGE_TYPE::GetAreaSize()
+{
+    return INTERNAL_PAGE_AREA;
+}
+
+/*
+ * Bytes the items take in a page with fences low and high, the key of the
+ * first one is left out
+ */
+INDEX_TEMPLATE_ARGUMENTS
+size_t B_PLUS_TREE_INTERNAL_PAGE_TYPE::SpaceFor(const MappingType *items, int count,
+                                                const KeyType *low, const KeyType *high)
+{
+    size_t Prefix;
+    size_t Space = FencesSize(reinterpret_cast<const char*>(low), reinterpret_cast<const char*>(high),
+                              sizeof(KeyType), Prefix);
+    for (int i = 0; i < count; i++)
+        Space += EntrySize(i ? reinterpret_cast<const char*>(&items[i].first) : nullptr,
+                           sizeof(KeyType), sizeof(ValueType), Prefix);
+    return Space;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+size_t B_PLUS_TREE_INTERNAL_PAGE_TYPE::MaxEntrySize() const
+{
+    size_t Size = sizeof(KeyType) - prefix_size_ + sizeof(ValueType);
+    return IsSlotted(sizeof(KeyType)) ? sizeof(uint16_t) + 1 + Size : Size;
+}
+
+/*
+ * Whether an entry for key fits, in place of the one at replaced if given
+ */
+INDEX_TEMPLATE_ARGUMENTS
+bool B_PLUS_TREE_INTERNAL_PAGE_TYPE::HasRoomFor(const KeyType &key, int replaced) const
+{
+    size_t Free = FreeSpace(INTERNAL_PAGE_AREA, sizeof(KeyType), sizeof(ValueType));
+    if (replaced >= 0) Free += EntrySizeAt(data_, INTERNAL_PAGE_AREA, sizeof(KeyType), sizeof(ValueType), replaced);
+    return Free >= EntrySize(reinterpret_cast<const char*>(&key), sizeof(KeyType), sizeof(ValueType), prefix_size_);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+bool B_PLUS_TREE_INTERNAL_PAGE_TYPE::IsFull() const
+{
+    return FreeSpace(INTERNAL_PAGE_AREA, sizeof(KeyType), sizeof(ValueType)) < MaxEntrySize();
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+bool B_PLUS_TREE_INTERNAL_PAGE_TYPE::IsUnderfull() const
+{
+    if (!IsSlotted(sizeof(KeyType))) return size_ <= GetMinSize();
+    size_t Used = INTERNAL_PAGE_AREA - FreeSpace(INTERNAL_PAGE_AREA, sizeof(KeyType), sizeof(ValueType));
+    return Used + MaxEntrySize() < INTERNAL_PAGE_AREA / 2;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+bool B_PLUS_TREE_INTERNAL_PAGE_TYPE::CanLoseEntry() const
+{
+    if (!IsSlotted(sizeof(KeyType))) return size_ > GetMinSize() + 1;
+    size_t Used = INTERNAL_PAGE_AREA - FreeSpace(INTERNAL_PAGE_AREA, sizeof(KeyType), sizeof(ValueType));
+    return Used >= INTERNAL_PAGE_AREA / 2;
+}
+
+/*
+ * Replace the entries with the items and move the fences to low and high.
+ * They have to fit, see SpaceFor
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void B_PLUS_TREE_INTERNAL_PAGE_TYPE::Assign(const MappingType *items, int count,
+                                            const KeyType *low, const KeyType *high)
+{
+    InitEntries(INTERNAL_PAGE_AREA, sizeof(KeyType), sizeof(ValueType));
+    SetFences(low, high);
+    for (int i = 0; i < count; i++)
+        InsertEntry(data_, INTERNAL_PAGE_AREA, sizeof(KeyType), sizeof(ValueType), i,
+                    i ? reinterpret_cast<const char*>(&items[i].first) : nullptr,
+                    reinterpret_cast<const char*>(&items[i].second));
 }
 
 /*****************************************************************************
@@ -75,25 +224,48 @@ ValueType B_PLUS_TREE_INTERNAL_PAGE_TYPE::ValueAt(int index) const
  * Find and return the child pointer(page_id) which points to the child page
  * that contains input "key"
  * Start the search from the second key(the first key should always be invalid)
+ * Optimistic readers may look at a page that is being written, the search
+ * stays within the page then
  */
 INDEX_TEMPLATE_ARGUMENTS
 ValueType
 B_PLUS_TREE_INTERNAL_PAGE_TYPE::Lookup(const KeyType &key,
                                        const KeyComparator &comparator) const 
 {
-	if(comparator(key,array[1].first)<0)return array[0].second;
-	else if(comparator(key,array[size_-1].first)>=0)return array[size_-1].second;
+    bool Slotted = IsSlotted(sizeof(KeyType));
+    size_t Room = INTERNAL_PAGE_AREA - std::min<size_t>(FenceSize(), INTERNAL_PAGE_AREA);
+    int Size = std::min<int>(size_, Room / (Slotted ? sizeof(uint16_t) : sizeof(KeyType) - prefix_size_ + sizeof(ValueType)));
+    if (Size < 2) return ValueAt(0);
+    const char* Key = reinterpret_cast<const char*>(&key);
+    KeySearch::Format Format = comparator.GetSearchFormat();
+    if (Format != KeySearch::NONE && !Slotted && !prefix_size_)
+    {
+        // the last child whose key is not above key
+        size_t Length;
+        const char* Keys = StoredKey(data_, INTERNAL_PAGE_AREA, sizeof(KeyType), sizeof(ValueType), 1, Length);
+        int Index = KeySearch::Count(Keys, sizeof(KeyType) + sizeof(ValueType), Size - 1,
+                                     KeySearch::Load(Key, Format), Format, true);
+        return ValueAt(Index);
+    }
+    bool Normalized = comparator.IsNormalized();
+    if (Normalized && prefix_size_)
+    {
+        int Order = ComparePrefix(data_, Key);
+        if (Order) return ValueAt(Order < 0 ? 0 : Size - 1);
+    }
+    // the first key above key, its child is the one after the right child
+    KeyType Scratch;
     int Low = 1;
-    int High = size_-1;
-    int Mid;
-    while (Low < High-1)
+    int High = Size;
+    while (Low < High)
     {
-        Mid = (High + Low) / 2;
-        if (comparator(key, array[Mid].first) < 0) High = Mid;
-        else if (comparator(key, array[Mid].first) > 0)Low = Mid;
-        else return array[Mid].second;
+        int Mid = (Low + High) / 2;
+        int Order = Normalized ? CompareKey(data_, INTERNAL_PAGE_AREA, sizeof(KeyType), sizeof(ValueType), Mid, Key)
+                               : comparator(key, KeyRef(Mid, Scratch));
+        if (Order >= 0) Low = Mid + 1;
+        else High = Mid;
     }
-    return array[Low].second;
+    return ValueAt(Low - 1);
 }
 
 /*****************************************************************************
@@ -110,13 +282,14 @@ void B_PLUS_TREE_INTERNAL_PAGE_TYPE::PopulateNewRoot(
     const ValueType &old_value, const KeyType &new_key,
     const ValueType &new_value) 
 {
-    array[0].second = old_value;
-    array[1] = { new_key, new_value };
-    size_++;
+    SetValueAt(0, old_value);
+    InsertEntry(data_, INTERNAL_PAGE_AREA, sizeof(KeyType), sizeof(ValueType), 1,
+                reinterpret_cast<const char*>(&new_key), reinterpret_cast<const char*>(&new_value));
 }
 /*
  * Insert new_key & new_value pair right after the pair with its value ==
  * old_value
+ * There has to be room for it, see HasRoomFor
  * @return:  new size after insertion
  */
 INDEX_TEMPLATE_ARGUMENTS
@@ -124,53 +297,12 @@ int B_PLUS_TREE_INTERNAL_PAGE_TYPE::InsertNodeAfter(
     const ValueType &old_value, const KeyType &new_key,
     const ValueType &new_value) 
 {
-    for (int i = size_; i > 0; i--) 
-    {
-        if (array[i - 1].second == old_value) 
-        {
-            array[i] = { new_key, new_value };
-            size_++;
-            break;
-        }
-        array[i] = array[i - 1];
-    }
+    int Index = ValueIndex(old_value) + 1;
+    InsertEntry(data_, INTERNAL_PAGE_AREA, sizeof(KeyType), sizeof(ValueType), Index,
+                reinterpret_cast<const char*>(&new_key), reinterpret_cast<const char*>(&new_value));
     return size_;
 }
 
-/*****************************************************************************
- * SPLIT
- *****************************************************************************/
-/*
- * Remove half of key & value pairs from this page to "recipient" page
- */
-INDEX_TEMPLATE_ARGUMENTS
-void B_PLUS_TREE_INTERNAL_PAGE_TYPE::MoveHalfTo(
-    BPlusTreeInternalPage *recipient,
-    BufferPoolManager *buffer_pool_manager) 
-{
-    int HalfSize = (size_+1)/2;
-    recipient->CopyHalfFrom(array + size_-HalfSize, HalfSize, buffer_pool_manager);
-
-    for (int i = size_ - HalfSize; i < size_; i++) 
-    {
-        auto Child = FetchPage(buffer_pool_manager, ValueAt(i));
-        Child->SetParentPageId(recipient->GetPageId());
-        buffer_pool_manager->UnpinPage(Child->GetPageId(), true);
-    }
-    size_-=HalfSize;
-}
-
-INDEX_TEMPLATE_ARGUMENTS
-void B_PLUS_TREE_INTERNAL_PAGE_TYPE::CopyHalfFrom(
-    MappingType *items, int size, BufferPoolManager *buffer_pool_manager) 
-{
-    for (int i = 0; i < size; i++) 
-    {
-        array[i] = *(items++);
-    }
-    size_ += size-1;
-}
-
 /*****************************************************************************
  * REMOVE
  *****************************************************************************/
@@ -182,11 +314,13 @@ void B_PLUS_TREE_INTERNAL_PAGE_TYPE::CopyHalfFrom(
 INDEX_TEMPLATE_ARGUMENTS
 void B_PLUS_TREE_INTERNAL_PAGE_TYPE::Remove(int index) 
 {
-    for (int i = index; i < size_ - 1; i++) 
-    {
-        array[i] = array[i + 1];
-    }
-    size_--;
+    RemoveEntry(data_, INTERNAL_PAGE_AREA, sizeof(KeyType), sizeof(ValueType), index);
+    if (index || !size_ || !IsSlotted(sizeof(KeyType))) return;
+    // the new first key is not kept either
+    ValueType Child = ValueAt(0);
+    RemoveEntry(data_, INTERNAL_PAGE_AREA, sizeof(KeyType), sizeof(ValueType), 0);
+    InsertEntry(data_, INTERNAL_PAGE_AREA, sizeof(KeyType), sizeof(ValueType), 0,
+                nullptr, reinterpret_cast<const char*>(&Child));
 }
 
 /*
@@ -196,96 +330,9 @@ void B_PLUS_TREE_INTERNAL_PAGE_TYPE::Remove(int index)
 INDEX_TEMPLATE_ARGUMENTS
 ValueType B_PLUS_TREE_INTERNAL_PAGE_TYPE::RemoveAndReturnOnlyChild() 
 {
-    size_--;
-    return ValueAt(0);
-}
-/*****************************************************************************
- * MERGE
- *****************************************************************************/
-/*
- * Remove all of key & value pairs from this page to "recipient" page, then
- * update relavent key & value pair in its parent page.
- */
-INDEX_TEMPLATE_ARGUMENTS
-void B_PLUS_TREE_INTERNAL_PAGE_TYPE::MoveAllTo(
-    BPlusTreeInternalPage *recipient, int index_in_parent,
-    BufferPoolManager *buffer_pool_manager) 
-{
-    auto* Parent = FetchInternalPage(buffer_pool_manager,parent_page_id_);
-    SetKeyAt(0, Parent->KeyAt(index_in_parent));
-    assert(Parent->ValueAt(index_in_parent) == GetPageId());
-    buffer_pool_manager->UnpinPage(Parent->GetPageId(), true);
-    recipient->CopyAllFrom(array, size_, buffer_pool_manager);
-    for (int i = 0; i < size_; i++) 
-    {
-        auto Child = FetchPage(buffer_pool_manager,ValueAt(i));
-        Child->SetParentPageId(recipient->GetPageId());
-        buffer_pool_manager->UnpinPage(Child->GetPageId(), true);
-    }
-}
-
-INDEX_TEMPLATE_ARGUMENTS
-void B_PLUS_TREE_INTERNAL_PAGE_TYPE::CopyAllFrom(
-    MappingType *items, int size, BufferPoolManager *buffer_pool_manager) 
-{
-    for (int i = 0; i < size; i++) {
-        array[size_ + i] = *items++;
-    }
-    size_+=size;
-}
-INDEX_TEMPLATE_ARGUMENTS
-void B_PLUS_TREE_INTERNAL_PAGE_TYPE::MoveFirstToEndOf(
-    BPlusTreeInternalPage *recipient,
-    BufferPoolManager *buffer_pool_manager) 
-{
-    MappingType First{ KeyAt(1), ValueAt(0) };
-    SetValueAt(0, ValueAt(1));
-    Remove(1);
-    recipient->CopyLastFrom(First, buffer_pool_manager);
-    auto Child = FetchPage(buffer_pool_manager, ValueAt(0));
-    Child->SetParentPageId(recipient->GetPageId());
-    buffer_pool_manager->UnpinPage(Child->GetPageId(), true);
-}
-
-INDEX_TEMPLATE_ARGUMENTS
-void B_PLUS_TREE_INTERNAL_PAGE_TYPE::CopyLastFrom(
-    const MappingType &pair, BufferPoolManager *buffer_pool_manager) 
-{
-    auto Parent = FetchInternalPage(buffer_pool_manager, parent_page_id_);
-    auto Index = Parent->ValueIndex(page_id_);
-    auto Key = Parent->KeyAt(Index + 1);
-    array[size_] = { Key, pair.second };
-    size_++;
-    Parent->SetKeyAt(Index + 1, pair.first);
-    buffer_pool_manager->UnpinPage(Parent->GetPageId(), true);
-}
-
-/*
- * Remove the last key & value pair from this page to head of "recipient"
- * page, then update relavent key & value pair in its parent page.
- */
-INDEX_TEMPLATE_ARGUMENTS
-void B_PLUS_TREE_INTERNAL_PAGE_TYPE::MoveLastToFrontOf(
-    BPlusTreeInternalPage *recipient, int parent_index,
-    BufferPoolManager *buffer_pool_manager) 
-{
-    size_--;
-    MappingType Pair = array[size_];
-    recipient->CopyFirstFrom(Pair, parent_index, buffer_pool_manager);
-    auto Child = FetchPage(buffer_pool_manager,Pair.second);
-    Child->SetParentPageId(recipient->GetPageId());
-    buffer_pool_manager->UnpinPage(Child->GetPageId(), true);
-}
-INDEX_TEMPLATE_ARGUMENTS
-void B_PLUS_TREE_INTERNAL_PAGE_TYPE::CopyFirstFrom(
-    const MappingType &pair, int parent_index,
-    BufferPoolManager *buffer_pool_manager) 
-{
-    auto Parent = FetchInternalPage(buffer_pool_manager,parent_page_id_);
-    Parent->SetKeyAt(parent_index, pair.first);
-    InsertNodeAfter(array[0].second, Parent->KeyAt(parent_index), array[0].second);
-    array[0].second = pair.second;
-    buffer_pool_manager->UnpinPage(Parent->GetPageId(), true);
+    ValueType Child = ValueAt(0);
+    RemoveEntry(data_, INTERNAL_PAGE_AREA, sizeof(KeyType), sizeof(ValueType), 0);
+    return Child;
 }
 
 /*****************************************************************************
@@ -296,7 +343,7 @@ void B_PLUS_TREE_INTERNAL_PAGE_TYPE::QueueUpChildren(
     std::queue<BPlusTreePage *> *queue,
     BufferPoolManager *buffer_pool_manager) {
   for (int i = 0; i < size_; i++) {
-    auto *page = buffer_pool_manager->FetchPage(array[i].second);
+    auto *page = buffer_pool_manager->FetchPage(ValueAt(i));
     if (page == nullptr)
       throw Exception(EXCEPTION_TYPE_INDEX,
                       "all page are pinned while printing");
@@ -313,8 +360,7 @@ std::string B_PLUS_TREE_INTERNAL_PAGE_TYPE::ToString(bool verbose) const {
   }
   std::ostringstream os;
   if (verbose) {
-    os << "[pageId: " << page_id_ << " parentId: " << GetParentPageId()
-       << "]<" << size_ << "> ";
+    os << "[pageId: " << page_id_ << "]<" << size_ << "> ";
   }
 
   int entry = verbose ? 0 : 1;
@@ -326,9 +372,9 @@ std::string B_PLUS_TREE_INTERNAL_PAGE_TYPE::ToString(bool verbose) const {
     } else {
       os << " ";
     }
-    os << std::dec << array[entry].first.ToString();
+    os << std::dec << KeyAt(entry).ToString();
     if (verbose) {
-      os << "(" << array[entry].second << ")";
+      os << "(" << ValueAt(entry) << ")";
     }
     ++entry;
   }
@@ -2,6 +2,7 @@
  * b_plus_tree_leaf_page.cpp
  */
 
+#include <cstring>
 #include <sstream>
 
 #include "common/exception.h"
@@ -10,24 +11,26 @@
 #include "page/b_plus_tree_internal_page.h"
 namespace scudb {
 
+// room for fences and entries
+#define LEAF_PAGE_AREA (PAGE_CHECKSUM_OFFSET - sizeof(BPlusTreeLeafPage))
+
 /*****************************************************************************
  * HELPER METHODS AND UTILITIES
  *****************************************************************************/
 
 /**
  * Init method after creating a new leaf page
- * Including set page type, set current size to zero, set page id/parent id, set
- * next page id and set max size
+ * Including set page type, set current size to zero, set page id, set
+ * next/prev page id and set max size
  */
 INDEX_TEMPLATE_ARGUMENTS
-void B_PLUS_TREE_LEAF_PAGE_TYPE::Init(page_id_t page_id, page_id_t parent_id) 
+void B_PLUS_TREE_LEAF_PAGE_TYPE::Init(page_id_t page_id) 
 {
     page_type_=IndexPageType::LEAF_PAGE;
-    size_=0;
     page_id_=page_id;
-    parent_page_id_=parent_id;
     next_page_id_=INVALID_PAGE_ID;
-    max_size_ = (PAGE_SIZE - sizeof(BPlusTreeLeafPage)) /(sizeof(KeyType) + sizeof(ValueType));
+    prev_page_id_=INVALID_PAGE_ID;
+    InitEntries(LEAF_PAGE_AREA, sizeof(KeyType), sizeof(ValueType));
 }
 
 /**
@@ -46,28 +49,57 @@ void B_PLUS_TREE_LEAF_PAGE_TYPE::SetNextPageId(page_id_t next_page_id)
 }
 
 /**
- * Helper method to find the first index i so that array[i].first >= key
+ * Helper methods to set/get previous page id
+ */
+INDEX_TEMPLATE_ARGUMENTS
+page_id_t B_PLUS_TREE_LEAF_PAGE_TYPE::GetPrevPageId() const 
+{
+    return prev_page_id_;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void B_PLUS_TREE_LEAF_PAGE_TYPE::SetPrevPageId(page_id_t prev_page_id) 
+{
+    prev_page_id_ = prev_page_id;
+}
+
+/**
+ * Helper method to find the first index i so that KeyAt(i) >= key
  * NOTE: This method is only used when generating index iterator
+ * Keys that order like integers are searched with KeySearch, normalized ones
+ * are compared with the bytes in the page
  */
 INDEX_TEMPLATE_ARGUMENTS
 int B_PLUS_TREE_LEAF_PAGE_TYPE::KeyIndex(
     const KeyType &key, const KeyComparator &comparator) const
 {
-	if(!size_||comparator(key,array[size_-1].first)>0)
-	{
-		return size_;
-	}
+    const char* Key = reinterpret_cast<const char*>(&key);
+    KeySearch::Format Format = comparator.GetSearchFormat();
+    if (Format != KeySearch::NONE && !IsSlotted(sizeof(KeyType)) && !prefix_size_)
+    {
+        size_t Length;
+        const char* Keys = StoredKey(data_, LEAF_PAGE_AREA, sizeof(KeyType), sizeof(ValueType), 0, Length);
+        return KeySearch::Count(Keys, sizeof(KeyType) + sizeof(ValueType), size_,
+                                KeySearch::Load(Key, Format), Format, false);
+    }
+    bool Normalized = comparator.IsNormalized();
+    if (Normalized && prefix_size_)
+    {
+        int Order = ComparePrefix(data_, Key);
+        if (Order) return Order < 0 ? 0 : size_;
+    }
+    KeyType Scratch;
     int Low = 0;
     int High = size_;
-    int Mid=(High + Low) / 2;
-    while (Low < High-1) 
+    while (Low < High)
     {
-        if (comparator(array[Mid].first,key)>0) High = Mid;
-        else if (comparator(array[Mid].first,key)<0) Low = Mid;
-        else return Mid;
-        Mid = (High + Low) / 2;
+        int Mid = (Low + High) / 2;
+        int Order = Normalized ? CompareKey(data_, LEAF_PAGE_AREA, sizeof(KeyType), sizeof(ValueType), Mid, Key)
+                               : comparator(key, KeyRef(Mid, Scratch));
+        if (Order > 0) Low = Mid + 1;
+        else High = Mid;
     }
-    return comparator(array[Mid].first,key)>=0?Mid:High;
+    return Low;
 }
 
 /*
@@ -77,7 +109,26 @@ int B_PLUS_TREE_LEAF_PAGE_TYPE::KeyIndex(
 INDEX_TEMPLATE_ARGUMENTS
 KeyType B_PLUS_TREE_LEAF_PAGE_TYPE::KeyAt(int index) const 
 {
-    return array[index].first;
+    KeyType Key;
+    return KeyRef(index, Key);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+ValueType B_PLUS_TREE_LEAF_PAGE_TYPE::ValueAt(int index) const 
+{
+    size_t Length;
+    const char* Key = StoredKey(data_, LEAF_PAGE_AREA, sizeof(KeyType), sizeof(ValueType), index, Length);
+    ValueType Value;
+    memcpy(&Value, Key + Length, sizeof(ValueType));
+    return Value;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void B_PLUS_TREE_LEAF_PAGE_TYPE::SetValueAt(int index, const ValueType &value)
+{
+    size_t Length;
+    const char* Key = StoredKey(data_, LEAF_PAGE_AREA, sizeof(KeyType), sizeof(ValueType), index, Length);
+    memcpy(const_cast<char*>(Key) + Length, &value, sizeof(ValueType));
 }
 
 /*
@@ -85,62 +136,155 @@ KeyType B_PLUS_TREE_LEAF_PAGE_TYPE::KeyAt(int index) const
  * "index"(a.k.a array offset)
  */
 INDEX_TEMPLATE_ARGUMENTS
-const MappingType &B_PLUS_TREE_LEAF_PAGE_TYPE::GetItem(int index) 
+MappingType B_PLUS_TREE_LEAF_PAGE_TYPE::GetItem(int index) const
 {
-    return array[index];
+    return std::make_pair(KeyAt(index), ValueAt(index));
 }
 
-/*****************************************************************************
- * INSERTION
- *****************************************************************************/
 /*
- * Insert key & value pair into leaf page ordered by key
- * @return  page size after insertion
+ * The key at index, right in the page if it is stored whole, otherwise put
+ * together in scratch
  */
 INDEX_TEMPLATE_ARGUMENTS
-int B_PLUS_TREE_LEAF_PAGE_TYPE::Insert(const KeyType &key,
-                                       const ValueType &value,
-                                       const KeyComparator &comparator) 
+const KeyType &B_PLUS_TREE_LEAF_PAGE_TYPE::KeyRef(int index, KeyType &scratch) const
 {
-    int SearchKeyIndex = KeyIndex(key, comparator);
-    if (comparator(key,KeyAt(SearchKeyIndex)))
-    {
-        for (int i = size_; i > SearchKeyIndex; i--)
-        {
-            array[i] = array[i-1];
-        }
-        size_++;
-        array[SearchKeyIndex].first = key;
-        array[SearchKeyIndex].second = value;
-    }
-    return size_;
+    size_t Length;
+    const char* Key = StoredKey(data_, LEAF_PAGE_AREA, sizeof(KeyType), sizeof(ValueType), index, Length);
+    if (Length == sizeof(KeyType)) return *reinterpret_cast<const KeyType*>(Key);
+    GetKey(data_, LEAF_PAGE_AREA, sizeof(KeyType), sizeof(ValueType), index, reinterpret_cast<char*>(&scratch));
+    return scratch;
+}
+
+/*
+ * Order of key against the key at index
+ */
+INDEX_TEMPLATE_ARGUMENTS
+int B_PLUS_TREE_LEAF_PAGE_TYPE::CompareAt(int index, const KeyType &key,
+                                          const KeyComparator &comparator) const
+{
+    KeyType Scratch;
+    if (!comparator.IsNormalized()) return comparator(key, KeyRef(index, Scratch));
+    const char* Key = reinterpret_cast<const char*>(&key);
+    int Order = ComparePrefix(data_, Key);
+    return Order ? Order : CompareKey(data_, LEAF_PAGE_AREA, sizeof(KeyType), sizeof(ValueType), index, Key);
+}
+
+/*
+ * Helper methods for the fence keys, see b_plus_tree_page.h
+ */
+INDEX_TEMPLATE_ARGUMENTS
+bool B_PLUS_TREE_LEAF_PAGE_TYPE::GetFence(bool high, KeyType &key) const
+{
+    return BPlusTreePage::GetFence(data_, high, reinterpret_cast<char*>(&key), sizeof(KeyType));
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void B_PLUS_TREE_LEAF_PAGE_TYPE::SetFences(const KeyType *low, const KeyType *high)
+{
+    BPlusTreePage::SetFences(data_, LEAF_PAGE_AREA, sizeof(KeyType), sizeof(ValueType),
+                             reinterpret_cast<const char*>(low), reinterpret_cast<const char*>(high), true);
+}
+
+/*
+ * Helper methods for the room in the page. Fixed size entries go by their
+ * number like the max size says, slotted pages by bytes: they are underfull
+ * if less than half full by more than an entry, which a split never leaves
+ */
+INDEX_TEMPLATE_ARGUMENTS
+size_t B_PLUS_TREE_LEAF_PAGE_TYPE::GetAreaSize()
+{
+    return LEAF_PAGE_AREA;
+}
+
+/*
+ * Bytes the items take in a page with fences low and high
+ */
+INDEX_TEMPLATE_ARGUMENTS
+size_t B_PLUS_TREE_LEAF_PAGE_TYPE::SpaceFor(const MappingType *items, int count,
+                                            const KeyType *low, const KeyType *high)
+{
+    size_t Prefix;
+    size_t Space = FencesSize(reinterpret_cast<const char*>(low), reinterpret_cast<const char*>(high),
+                              sizeof(KeyType), Prefix);
+    for (int i = 0; i < count; i++)
+        Space += EntrySize(reinterpret_cast<const char*>(&items[i].first), sizeof(KeyType), sizeof(ValueType), Prefix);
+    return Space;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+size_t B_PLUS_TREE_LEAF_PAGE_TYPE::MaxEntrySize() const
+{
+    size_t Size = sizeof(KeyType) - prefix_size_ + sizeof(ValueType);
+    return IsSlotted(sizeof(KeyType)) ? sizeof(uint16_t) + 1 + Size : Size;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+bool B_PLUS_TREE_LEAF_PAGE_TYPE::HasRoomFor(const KeyType &key) const
+{
+    return FreeSpace(LEAF_PAGE_AREA, sizeof(KeyType), sizeof(ValueType)) >=
+           EntrySize(reinterpret_cast<const char*>(&key), sizeof(KeyType), sizeof(ValueType), prefix_size_);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+bool B_PLUS_TREE_LEAF_PAGE_TYPE::IsFull() const
+{
+    return FreeSpace(LEAF_PAGE_AREA, sizeof(KeyType), sizeof(ValueType)) < MaxEntrySize();
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+bool B_PLUS_TREE_LEAF_PAGE_TYPE::IsUnderfull() const
+{
+    if (!IsSlotted(sizeof(KeyType))) return size_ < GetMinSize();
+    size_t Used = LEAF_PAGE_AREA - FreeSpace(LEAF_PAGE_AREA, sizeof(KeyType), sizeof(ValueType));
+    return Used + MaxEntrySize() < LEAF_PAGE_AREA / 2;
 }
 
-/*****************************************************************************
- * SPLIT
- *****************************************************************************/
 /*
- * Remove half of key & value pairs from this page to "recipient" page
+ * Whether the page is not underfull once any one entry is gone
  */
 INDEX_TEMPLATE_ARGUMENTS
-void B_PLUS_TREE_LEAF_PAGE_TYPE::MoveHalfTo(
-    BPlusTreeLeafPage *recipient,
-    __attribute__((unused)) BufferPoolManager *buffer_pool_manager) 
+bool B_PLUS_TREE_LEAF_PAGE_TYPE::CanLoseEntry() const
 {
-    int HalfSize = size_ / 2;
-    MappingType* src = array + size_ - HalfSize;
-    recipient->CopyHalfFrom(src, HalfSize);
-    size_ -= HalfSize;
+    if (!IsSlotted(sizeof(KeyType))) return size_ > GetMinSize();
+    size_t Used = LEAF_PAGE_AREA - FreeSpace(LEAF_PAGE_AREA, sizeof(KeyType), sizeof(ValueType));
+    return Used >= LEAF_PAGE_AREA / 2;
 }
 
+/*
+ * Replace the entries with the items, ordered by key, and move the fences to
+ * low and high. They have to fit, see SpaceFor
+ */
 INDEX_TEMPLATE_ARGUMENTS
-void B_PLUS_TREE_LEAF_PAGE_TYPE::CopyHalfFrom(MappingType *items, int size) 
+void B_PLUS_TREE_LEAF_PAGE_TYPE::Assign(const MappingType *items, int count,
+                                        const KeyType *low, const KeyType *high)
 {
-    for (int i = 0; i < size; i++) 
+    InitEntries(LEAF_PAGE_AREA, sizeof(KeyType), sizeof(ValueType));
+    SetFences(low, high);
+    for (int i = 0; i < count; i++)
+        InsertEntry(data_, LEAF_PAGE_AREA, sizeof(KeyType), sizeof(ValueType), i,
+                    reinterpret_cast<const char*>(&items[i].first), reinterpret_cast<const char*>(&items[i].second));
+}
+
+/*****************************************************************************
+ * INSERTION
+ *****************************************************************************/
+/*
+ * Insert key & value pair into leaf page ordered by key
+ * There has to be room for it, see HasRoomFor
+ * @return  page size after insertion
+ */
+INDEX_TEMPLATE_ARGUMENTS
+int B_PLUS_TREE_LEAF_PAGE_TYPE::Insert(const KeyType &key,
+                                       const ValueType &value,
+                                       const KeyComparator &comparator) 
+{
+    int SearchKeyIndex = KeyIndex(key, comparator);
+    if (SearchKeyIndex == size_ || CompareAt(SearchKeyIndex, key, comparator))
     {
-        array[i] = *(items++);
+        InsertEntry(data_, LEAF_PAGE_AREA, sizeof(KeyType), sizeof(ValueType), SearchKeyIndex,
+                    reinterpret_cast<const char*>(&key), reinterpret_cast<const char*>(&value));
     }
-    size_+=size;
+    return size_;
 }
 
 /*****************************************************************************
@@ -158,9 +302,9 @@ bool B_PLUS_TREE_LEAF_PAGE_TYPE::Lookup(const KeyType &key, ValueType &value,
     if(!size_)return false;
     int SearchKeyIndex = KeyIndex(key, comparator);
     if(SearchKeyIndex==size_)return false;
-    if (SearchKeyIndex<size_&&!comparator(key,KeyAt(SearchKeyIndex)))
+    if (!CompareAt(SearchKeyIndex, key, comparator))
     {
-        value = array[SearchKeyIndex].second;
+        value = ValueAt(SearchKeyIndex);
         return true;
     }
     return false;
@@ -180,93 +324,13 @@ int B_PLUS_TREE_LEAF_PAGE_TYPE::RemoveAndDeleteRecord(
     const KeyType &key, const KeyComparator &comparator) 
 {
     int SearchKeyIndex = KeyIndex(key, comparator);
-    if (!comparator(key,KeyAt(SearchKeyIndex)))
+    if (SearchKeyIndex < size_ && !CompareAt(SearchKeyIndex, key, comparator))
     {
-        for (int i = SearchKeyIndex; i < size_-1; i++)
-        {
-            array[i] = array[i + 1];
-        }
-        size_--;
+        RemoveEntry(data_, LEAF_PAGE_AREA, sizeof(KeyType), sizeof(ValueType), SearchKeyIndex);
     }
     return size_;
 }
 
-/*****************************************************************************
- * MERGE
- *****************************************************************************/
-/*
- * Remove all of key & value pairs from this page to "recipient" page, then
- * update next page id
- */
-INDEX_TEMPLATE_ARGUMENTS
-void B_PLUS_TREE_LEAF_PAGE_TYPE::MoveAllTo(BPlusTreeLeafPage *recipient,
-                                           int, BufferPoolManager *) 
-{
-    recipient->CopyAllFrom(array, size_);
-    recipient->SetNextPageId(next_page_id_);
-}
-INDEX_TEMPLATE_ARGUMENTS
-void B_PLUS_TREE_LEAF_PAGE_TYPE::CopyAllFrom(MappingType *items, int size) 
-{
-    for (int i = 0; i < size; i++) {
-        array[size_ + i] = *(items++);
-    }
-    size_ += size;
-}
-
-/*****************************************************************************
- * REDISTRIBUTE
- *****************************************************************************/
-/*
- * Remove the first key & value pair from this page to "recipient" page, then
- * update relavent key & value pair in its parent page.
- */
-INDEX_TEMPLATE_ARGUMENTS
-void B_PLUS_TREE_LEAF_PAGE_TYPE::MoveFirstToEndOf(
-    BPlusTreeLeafPage *recipient,
-    BufferPoolManager *buffer_pool_manager) 
-{
-    MappingType& First = array[0];
-    size_--;
-    memmove(array, array + 1, size_ * sizeof(MappingType));
-    recipient->CopyLastFrom(First);
-    auto Parent = reinterpret_cast<BPlusTreeInternalPage<KeyType, page_id_t, KeyComparator> *>(buffer_pool_manager->FetchPage(parent_page_id_)->GetData());
-    Parent->SetKeyAt(Parent->ValueIndex(page_id_), First.first);
-    buffer_pool_manager->UnpinPage(parent_page_id_, true);
-}
-
-INDEX_TEMPLATE_ARGUMENTS
-void B_PLUS_TREE_LEAF_PAGE_TYPE::CopyLastFrom(const MappingType &item) 
-{
-    array[size_] = item;
-    size_++;
-}
-/*
- * Remove the last key & value pair from this page to "recipient" page, then
- * update relavent key & value pair in its parent page.
- */
-INDEX_TEMPLATE_ARGUMENTS
-void B_PLUS_TREE_LEAF_PAGE_TYPE::MoveLastToFrontOf(
-    BPlusTreeLeafPage *recipient, int parentIndex,
-    BufferPoolManager *buffer_pool_manager) 
-{
-    size_--;
-    recipient->CopyFirstFrom(array[size_], parentIndex, buffer_pool_manager);
-}
-
-INDEX_TEMPLATE_ARGUMENTS
-void B_PLUS_TREE_LEAF_PAGE_TYPE::CopyFirstFrom(
-    const MappingType &item, int parentIndex,
-    BufferPoolManager *buffer_pool_manager) 
-{
-    memmove(array + 1, array, size_ * sizeof(MappingType));
-    size_++;
-    array[0] = item;
-    auto Parent = reinterpret_cast<BPlusTreeInternalPage<KeyType, page_id_t, KeyComparator> *>(buffer_pool_manager->FetchPage(parent_page_id_)->GetData());
-    Parent->SetKeyAt(parentIndex, item.first);
-    buffer_pool_manager->UnpinPage(parent_page_id_, true);
-}
-
 /*****************************************************************************
  * DEBUG
  *****************************************************************************/
@@ -277,8 +341,7 @@ std::string B_PLUS_TREE_LEAF_PAGE_TYPE::ToString(bool verbose) const {
   }
   std::ostringstream stream;
   if (verbose) {
-    stream << "[pageId: " << page_id_ << " parentId: " << parent_page_id_
-           << "]<" << size_ << "> ";
+    stream << "[pageId: " << page_id_ << "]<" << size_ << "> ";
   }
   int entry = 0;
   int end = size_;
@@ -290,9 +353,9 @@ std::string B_PLUS_TREE_LEAF_PAGE_TYPE::ToString(bool verbose) const {
     } else {
       stream << " ";
     }
-    stream << std::dec << array[entry].first;
+    stream << std::dec << KeyAt(entry);
     if (verbose) {
-      stream << "(" << array[entry].second << ")";
+      stream << "(" << ValueAt(entry) << ")";
     }
     ++entry;
   }
@@ -1,6 +1,10 @@
 /**
  * b_plus_tree_page.cpp
  */
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
 #include "page/b_plus_tree_page.h"
 
 namespace scudb {
@@ -13,10 +17,6 @@ bool BPlusTreePage::IsLeafPage() const
 {
 	return page_type_ == IndexPageType::LEAF_PAGE;
 }
-bool BPlusTreePage::IsRootPage() const 
-{ 
-	return parent_page_id_ == INVALID_PAGE_ID;
-}
 void BPlusTreePage::SetPageType(IndexPageType page_type) 
 {
 	page_type_ = page_type;
@@ -60,18 +60,6 @@ int BPlusTreePage::GetMinSize() const
 	return max_size_ / 2;
 }
 
-/*
- * Helper methods to get/set parent page id
- */
-page_id_t BPlusTreePage::GetParentPageId() const 
-{
-	return parent_page_id_;
-}
-void BPlusTreePage::SetParentPageId(page_id_t parent_page_id) 
-{
-	parent_page_id_ = parent_page_id;
-}
-
 /*
  * Helper methods to get/set self page id
  */
@@ -89,4 +77,305 @@ void BPlusTreePage::SetPageId(page_id_t page_id)
  */
 void BPlusTreePage::SetLSN(lsn_t lsn) { lsn_ = lsn; }
 
+/*
+ * Helpers for the fence keys and entries, see b_plus_tree_page.h
+ * Length of key once its trailing zero bytes are cut off
+ */
+static size_t TrimmedSize(const char *key, size_t key_size)
+{
+	while (key_size && !key[key_size - 1]) key_size--;
+	return key_size;
+}
+
+/*
+ * Bytes every key between low and high starts with, none if high is open. An
+ * open low side is the key of zero bytes
+ */
+static size_t CommonPrefix(const char *low, const char *high, size_t key_size)
+{
+	if (!high) return 0;
+	size_t Size = 0;
+	while (Size < key_size && (low ? low[Size] : 0) == high[Size]) Size++;
+	return Size;
+}
+
+/*
+ * Bytes of key a slotted page keeps, nullptr is the empty key
+ */
+static size_t SuffixSize(const char *key, size_t key_size, size_t prefix)
+{
+	size_t Size = key ? TrimmedSize(key, key_size) : 0;
+	return Size > prefix ? Size - prefix : 0;
+}
+
+/*
+ * Most entries that fit in room bytes
+ */
+static int MaxEntries(size_t room, size_t key_size, size_t value_size, size_t prefix)
+{
+	if (key_size >= VARIABLE_KEY_MIN_SIZE) return room / (sizeof(uint16_t) + 1 + value_size);
+	return room / (key_size - prefix + value_size);
+}
+
+bool BPlusTreePage::IsSlotted(size_t key_size)
+{
+	return key_size >= VARIABLE_KEY_MIN_SIZE;
+}
+
+void BPlusTreePage::InitEntries(size_t area, size_t key_size, size_t value_size)
+{
+	size_ = 0;
+	prefix_size_ = 0;
+	low_fence_size_ = 0;
+	high_fence_size_ = UNBOUNDED;
+	heap_size_ = 0;
+	max_size_ = MaxEntries(area, key_size, value_size, 0);
+}
+
+/*
+ * Bytes the fences take in front of the entries
+ */
+size_t BPlusTreePage::FenceSize() const
+{
+	if (high_fence_size_ == UNBOUNDED || high_fence_size_ <= prefix_size_) return low_fence_size_;
+	return low_fence_size_ + high_fence_size_ - prefix_size_;
+}
+
+/*
+ * Copy the low or high fence to key
+ * @return: false if that side is open
+ */
+bool BPlusTreePage::GetFence(const char *data, bool high, char *key, size_t key_size) const
+{
+	memset(key, 0, key_size);
+	if (!high)
+	{
+		memcpy(key, data, low_fence_size_);
+		return low_fence_size_ > 0;
+	}
+	if (high_fence_size_ == UNBOUNDED) return false;
+	GetPrefix(data, key);
+	if (high_fence_size_ > prefix_size_)
+		memcpy(key + prefix_size_, data + low_fence_size_, high_fence_size_ - prefix_size_);
+	return true;
+}
+
+/*
+ * Copy the prefix the entries leave out to the front of key, it is the start
+ * of the low fence
+ */
+void BPlusTreePage::GetPrefix(const char *data, char *key) const
+{
+	memset(key, 0, prefix_size_);
+	memcpy(key, data, std::min(prefix_size_, low_fence_size_));
+}
+
+/*
+ * memcmp order of the front of key against the prefix
+ */
+int BPlusTreePage::ComparePrefix(const char *data, const char *key) const
+{
+	size_t Size = std::min(prefix_size_, low_fence_size_);
+	int Order = memcmp(key, data, Size);
+	if (Order) return Order;
+	for (size_t i = Size; i < prefix_size_; i++)
+		if (key[i]) return 1;
+	return 0;
+}
+
+/*
+ * Move the fences to low and high, nullptr opens a side, and lay the entries
+ * out again for the new prefix. They have to fit, see FencesSize. The first
+ * key is dropped unless keep_first_key, internal pages never look at it
+ */
+void BPlusTreePage::SetFences(char *data, size_t area, size_t key_size, size_t value_size,
+                              const char *low, const char *high, bool keep_first_key)
+{
+	int Size = size_;
+	std::vector<char> Keys(Size * key_size), Values(Size * value_size);
+	for (int i = 0; i < Size; i++)
+	{
+		size_t Length;
+		const char* Key = StoredKey(data, area, key_size, value_size, i, Length);
+		GetKey(data, area, key_size, value_size, i, &Keys[i * key_size]);
+		memcpy(&Values[i * value_size], Key + Length, value_size);
+	}
+	std::vector<char> Fences(2 * key_size, 0);
+	if (low) memcpy(&Fences[0], low, key_size);
+	if (high) memcpy(&Fences[key_size], high, key_size);
+	size_t Prefix;
+	FencesSize(low ? &Fences[0] : nullptr, high ? &Fences[key_size] : nullptr, key_size, Prefix);
+	size_ = 0;
+	heap_size_ = 0;
+	low_fence_size_ = low ? TrimmedSize(&Fences[0], key_size) : 0;
+	prefix_size_ = Prefix;
+	high_fence_size_ = high ? TrimmedSize(&Fences[key_size], key_size) : UNBOUNDED;
+	memcpy(data, &Fences[0], low_fence_size_);
+	memcpy(data + low_fence_size_, &Fences[key_size] + prefix_size_, FenceSize() - low_fence_size_);
+	max_size_ = MaxEntries(area - FenceSize(), key_size, value_size, prefix_size_);
+	assert(IsSlotted(key_size) || Size <= max_size_);
+	for (int i = 0; i < Size; i++)
+		InsertEntry(data, area, key_size, value_size, i,
+		            i || keep_first_key ? &Keys[i * key_size] : nullptr, &Values[i * value_size]);
+}
+
+/*
+ * Bytes fences low and high take, nullptr for an open side, and the prefix
+ * they give
+ */
+size_t BPlusTreePage::FencesSize(const char *low, const char *high, size_t key_size,
+                                 size_t &prefix)
+{
+	prefix = CommonPrefix(low, high, key_size);
+	size_t HighSize = high ? TrimmedSize(high, key_size) : 0;
+	return (low ? TrimmedSize(low, key_size) : 0) + (HighSize > prefix ? HighSize - prefix : 0);
+}
+
+/*
+ * Bytes an entry for key takes with prefix left out, its slot included
+ */
+size_t BPlusTreePage::EntrySize(const char *key, size_t key_size, size_t value_size,
+                                size_t prefix)
+{
+	if (!IsSlotted(key_size)) return key_size - prefix + value_size;
+	return sizeof(uint16_t) + 1 + SuffixSize(key, key_size, prefix) + value_size;
+}
+
+size_t BPlusTreePage::EntrySizeAt(const char *data, size_t area, size_t key_size,
+                                  size_t value_size, int index) const
+{
+	if (!IsSlotted(key_size)) return key_size - prefix_size_ + value_size;
+	size_t Length;
+	StoredKey(data, area, key_size, value_size, index, Length);
+	return sizeof(uint16_t) + 1 + Length + value_size;
+}
+
+/*
+ * Bytes left for more entries
+ */
+size_t BPlusTreePage::FreeSpace(size_t area, size_t key_size, size_t value_size) const
+{
+	size_t Used = FenceSize();
+	if (IsSlotted(key_size)) Used += size_ * sizeof(uint16_t) + heap_size_;
+	else Used += size_ * (key_size - prefix_size_ + value_size);
+	return Used < area ? area - Used : 0;
+}
+
+/*
+ * The part of the key at index the page keeps and its length, the value
+ * follows right after it. Optimistic readers may look at a slotted page that
+ * is being written, the entry stays within the page then
+ */
+const char *BPlusTreePage::StoredKey(const char *data, size_t area, size_t key_size,
+                                     size_t value_size, int index, size_t &length) const
+{
+	if (!IsSlotted(key_size))
+	{
+		length = key_size - prefix_size_;
+		return data + FenceSize() + index * (length + value_size);
+	}
+	uint16_t Offset;
+	memcpy(&Offset, data + FenceSize() + index * sizeof(uint16_t), sizeof(uint16_t));
+	Offset = std::min<size_t>(Offset, area - 1 - value_size);
+	length = std::min<size_t>(std::min<size_t>((unsigned char)data[Offset], area - Offset - 1 - value_size),
+	                          key_size - std::min<size_t>(prefix_size_, key_size));
+	return data + Offset + 1;
+}
+
+/*
+ * Put the key at index together in key
+ */
+void BPlusTreePage::GetKey(const char *data, size_t area, size_t key_size,
+                           size_t value_size, int index, char *key) const
+{
+	size_t Length;
+	const char* Stored = StoredKey(data, area, key_size, value_size, index, Length);
+	GetPrefix(data, key);
+	memcpy(key + prefix_size_, Stored, Length);
+	memset(key + prefix_size_ + Length, 0, key_size - prefix_size_ - Length);
+}
+
+/*
+ * memcmp order of key against the key at index, key has to start with the
+ * prefix, see ComparePrefix
+ */
+int BPlusTreePage::CompareKey(const char *data, size_t area, size_t key_size,
+                              size_t value_size, int index, const char *key) const
+{
+	size_t Length;
+	const char* Stored = StoredKey(data, area, key_size, value_size, index, Length);
+	int Order = memcmp(key + prefix_size_, Stored, Length);
+	if (Order) return Order;
+	for (size_t i = prefix_size_ + Length; i < key_size; i++)
+		if (key[i]) return 1;
+	return 0;
+}
+
+/*
+ * Insert an entry for key, which has to start with the prefix, and value at
+ * index. nullptr is the empty key. There has to be room, see EntrySize
+ */
+void BPlusTreePage::InsertEntry(char *data, size_t area, size_t key_size, size_t value_size,
+                                int index, const char *key, const char *value)
+{
+	char* Entry;
+	size_t Length = key_size - prefix_size_;
+	if (!IsSlotted(key_size))
+	{
+		size_t Stride = Length + value_size;
+		Entry = data + FenceSize() + index * Stride;
+		memmove(Entry + Stride, Entry, (size_ - index) * Stride);
+	}
+	else
+	{
+		Length = SuffixSize(key, key_size, prefix_size_);
+		assert(FreeSpace(area, key_size, value_size) >= sizeof(uint16_t) + 1 + Length + value_size);
+		heap_size_ += 1 + Length + value_size;
+		uint16_t Offset = area - heap_size_;
+		char* Slot = data + FenceSize() + index * sizeof(uint16_t);
+		memmove(Slot + sizeof(uint16_t), Slot, (size_ - index) * sizeof(uint16_t));
+		memcpy(Slot, &Offset, sizeof(uint16_t));
+		data[Offset] = Length;
+		Entry = data + Offset + 1;
+	}
+	if (key) memcpy(Entry, key + prefix_size_, Length);
+	else memset(Entry, 0, Length);
+	memcpy(Entry + Length, value, value_size);
+	size_++;
+}
+
+/*
+ * Remove the entry at index, the heap of a slotted page closes up behind it
+ */
+void BPlusTreePage::RemoveEntry(char *data, size_t area, size_t key_size, size_t value_size,
+                                int index)
+{
+	if (!IsSlotted(key_size))
+	{
+		size_t Stride = key_size - prefix_size_ + value_size;
+		char* Entry = data + FenceSize() + index * Stride;
+		memmove(Entry, Entry + Stride, (size_ - index - 1) * Stride);
+		size_--;
+		return;
+	}
+	char* Slots = data + FenceSize();
+	uint16_t Offset;
+	memcpy(&Offset, Slots + index * sizeof(uint16_t), sizeof(uint16_t));
+	size_t Size = 1 + (unsigned char)data[Offset] + value_size;
+	size_t Start = area - heap_size_;
+	memmove(data + Start + Size, data + Start, Offset - Start);
+	heap_size_ -= Size;
+	memmove(Slots + index * sizeof(uint16_t), Slots + (index + 1) * sizeof(uint16_t),
+	        (size_ - index - 1) * sizeof(uint16_t));
+	size_--;
+	for (int i = 0; i < size_; i++)
+	{
+		uint16_t Other;
+		memcpy(&Other, Slots + i * sizeof(uint16_t), sizeof(uint16_t));
+		if (Other >= Offset) continue;
+		Other += Size;
+		memcpy(Slots + i * sizeof(uint16_t), &Other, sizeof(uint16_t));
+	}
+}
+
 } // namespace scudb
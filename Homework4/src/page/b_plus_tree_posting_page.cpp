@@ -0,0 +1,125 @@
+/**
+ * b_plus_tree_posting_page.cpp
+ */
+
+#include <cstring>
+
+#include "page/b_plus_tree_posting_page.h"
+
+namespace scudb {
+
+// room for slots and segments
+#define POSTING_PAGE_AREA (PAGE_CHECKSUM_OFFSET - sizeof(BPlusTreePostingPage))
+#define POSTING_SLOT_SIZE (2 * sizeof(uint16_t))
+
+/*
+ * Init method after creating a new posting page
+ */
+void BPlusTreePostingPage::Init(page_id_t page_id)
+{
+    page_type_ = IndexPageType::POSTING_PAGE;
+    page_id_ = page_id;
+    slot_count_ = 0;
+    heap_size_ = 0;
+}
+
+page_id_t BPlusTreePostingPage::GetPageId() const
+{
+    return page_id_;
+}
+
+size_t BPlusTreePostingPage::GetMaxSegmentSize()
+{
+    return POSTING_PAGE_AREA - POSTING_SLOT_SIZE;
+}
+
+const char *BPlusTreePostingPage::GetSegment(int slot, size_t &size) const
+{
+    uint16_t Slot[2];
+    if (slot < 0 || slot >= slot_count_) return nullptr;
+    memcpy(Slot, data_ + slot * POSTING_SLOT_SIZE, POSTING_SLOT_SIZE);
+    size = Slot[1];
+    return size ? data_ + Slot[0] : nullptr;
+}
+
+/*
+ * The first free slot is taken, a new one only if there is none
+ */
+int BPlusTreePostingPage::InsertSegment(const char *segment, size_t size)
+{
+    int Slot = 0;
+    size_t Size;
+    while (Slot < slot_count_ && GetSegment(Slot, Size)) Slot++;
+    if (FreeSpace() < size + (Slot == slot_count_ ? POSTING_SLOT_SIZE : 0)) return -1;
+    if (Slot == slot_count_)
+    {
+        memset(data_ + Slot * POSTING_SLOT_SIZE, 0, POSTING_SLOT_SIZE);
+        slot_count_++;
+    }
+    PlaceSegment(Slot, segment, size);
+    return Slot;
+}
+
+bool BPlusTreePostingPage::UpdateSegment(int slot, const char *segment, size_t size)
+{
+    size_t Size;
+    if (!GetSegment(slot, Size) || FreeSpace() + Size < size) return false;
+    RemoveSegment(slot);
+    if (slot >= slot_count_)
+    {
+        memset(data_ + slot_count_ * POSTING_SLOT_SIZE, 0, (slot + 1 - slot_count_) * POSTING_SLOT_SIZE);
+        slot_count_ = slot + 1;
+    }
+    PlaceSegment(slot, segment, size);
+    return true;
+}
+
+/*
+ * The heap closes up behind the segment, free slots at the end are dropped
+ */
+void BPlusTreePostingPage::RemoveSegment(int slot)
+{
+    size_t Size;
+    const char* Segment = GetSegment(slot, Size);
+    if (!Segment) return;
+    uint16_t Offset = Segment - data_;
+    size_t Start = POSTING_PAGE_AREA - heap_size_;
+    memmove(data_ + Start + Size, data_ + Start, Offset - Start);
+    heap_size_ -= Size;
+    memset(data_ + slot * POSTING_SLOT_SIZE, 0, POSTING_SLOT_SIZE);
+    for (int i = 0; i < slot_count_; i++)
+    {
+        uint16_t Slot[2];
+        memcpy(Slot, data_ + i * POSTING_SLOT_SIZE, POSTING_SLOT_SIZE);
+        if (!Slot[1] || Slot[0] >= Offset) continue;
+        Slot[0] += Size;
+        memcpy(data_ + i * POSTING_SLOT_SIZE, Slot, POSTING_SLOT_SIZE);
+    }
+    while (slot_count_ && !GetSegment(slot_count_ - 1, Size)) slot_count_--;
+}
+
+bool BPlusTreePostingPage::IsEmpty() const
+{
+    return !slot_count_;
+}
+
+/*
+ * Bytes left for more slots and segments
+ */
+size_t BPlusTreePostingPage::FreeSpace() const
+{
+    return POSTING_PAGE_AREA - slot_count_ * POSTING_SLOT_SIZE - heap_size_;
+}
+
+/*
+ * Put the segment at the front of the heap and point the free slot at it
+ */
+void BPlusTreePostingPage::PlaceSegment(int slot, const char *segment, size_t size)
+{
+    heap_size_ += size;
+    uint16_t Slot[2] = {(uint16_t)(POSTING_PAGE_AREA - heap_size_), (uint16_t)size};
+    memcpy(data_ + Slot[0], segment, size);
+    memcpy(data_ + slot * POSTING_SLOT_SIZE, Slot, POSTING_SLOT_SIZE);
+}
+
+} // namespace scudb
@@ -0,0 +1,94 @@
+/**
+ * clustered_tree_page.cpp
+ */
+
+#include <cassert>
+#include <cstring>
+
+#include "page/clustered_tree_page.h"
+
+namespace scudb {
+
+/*
+ * Init method after creating a new page
+ */
+void ClusteredTreePage::Init(page_id_t page_id, bool leaf) {
+  page_type_ = leaf ? IndexPageType::LEAF_PAGE : IndexPageType::INTERNAL_PAGE;
+  page_id_ = page_id;
+  next_page_id_ = INVALID_PAGE_ID;
+  size_ = 0;
+}
+
+bool ClusteredTreePage::IsLeafPage() const {
+  return page_type_ == IndexPageType::LEAF_PAGE;
+}
+
+page_id_t ClusteredTreePage::GetPageId() const { return page_id_; }
+
+page_id_t ClusteredTreePage::GetNextPageId() const { return next_page_id_; }
+
+void ClusteredTreePage::SetNextPageId(page_id_t next_page_id) {
+  next_page_id_ = next_page_id;
+}
+
+size_t ClusteredTreePage::GetCapacity() {
+  return PAGE_CHECKSUM_OFFSET - sizeof(ClusteredTreePage);
+}
+
+size_t ClusteredTreePage::GetRowSize(const std::string &row) {
+  return sizeof(int64_t) + row.size();
+}
+
+size_t ClusteredTreePage::GetChildSize() {
+  return sizeof(int64_t) + sizeof(page_id_t);
+}
+
+void ClusteredTreePage::GetRows(std::vector<int64_t> &keys,
+                                std::vector<std::string> &rows) const {
+  keys.resize(size_);
+  rows.resize(size_);
+  const char *position = data_;
+  for (int i = 0; i < size_; i++) {
+    int32_t length;
+    memcpy(&keys[i], position, sizeof(int64_t));
+    memcpy(&length, position + sizeof(int64_t), sizeof(int32_t));
+    rows[i].assign(position + sizeof(int64_t), sizeof(int32_t) + length);
+    position += sizeof(int64_t) + sizeof(int32_t) + length;
+  }
+}
+
+void ClusteredTreePage::SetRows(const int64_t *keys, const std::string *rows,
+                                int count) {
+  char *position = data_;
+  for (int i = 0; i < count; i++) {
+    assert(position + GetRowSize(rows[i]) <= data_ + GetCapacity());
+    memcpy(position, &keys[i], sizeof(int64_t));
+    memcpy(position + sizeof(int64_t), rows[i].data(), rows[i].size());
+    position += GetRowSize(rows[i]);
+  }
+  size_ = count;
+}
+
+void ClusteredTreePage::GetChildren(std::vector<int64_t> &keys,
+                                    std::vector<page_id_t> &children) const {
+  keys.resize(size_);
+  children.resize(size_);
+  for (int i = 0; i < size_; i++) {
+    memcpy(&keys[i], data_ + i * GetChildSize(), sizeof(int64_t));
+    memcpy(&children[i], data_ + i * GetChildSize() + sizeof(int64_t),
+           sizeof(page_id_t));
+  }
+}
+
+void ClusteredTreePage::SetChildren(const int64_t *keys,
+                                    const page_id_t *children, int count) {
+  assert(count * GetChildSize() <= GetCapacity());
+  for (int i = 0; i < count; i++) {
+    memcpy(data_ + i * GetChildSize(), &keys[i], sizeof(int64_t));
+    memcpy(data_ + i * GetChildSize() + sizeof(int64_t), &children[i],
+           sizeof(page_id_t));
+  }
+  size_ = count;
+}
+
+} // namespace scudb
@@ -8,6 +8,22 @@
 
 namespace scudb {
 
+// magic, version and record count come first
+static const int RECORDS_OFFSET = 12;
+
+void HeaderPage::Init() {
+  int magic = DB_FILE_MAGIC;
+  int version = DB_FORMAT_VERSION;
+  memcpy(GetData(), &magic, 4);
+  memcpy(GetData() + 4, &version, 4);
+  SetRecordCount(0);
+}
+
+bool HeaderPage::HasCurrentFormat() {
+  return *reinterpret_cast<int *>(GetData()) == DB_FILE_MAGIC &&
+         *reinterpret_cast<int *>(GetData() + 4) == DB_FORMAT_VERSION;
+}
+
 /**
  * Record related
  */
@@ -17,7 +33,7 @@ bool HeaderPage::InsertRecord(const std::string &name,
   assert(root_id > INVALID_PAGE_ID);
 
   int record_num = GetRecordCount();
-  int offset = 4 + record_num * 36;
+  int offset = RECORDS_OFFSET + record_num * 36;
   // check for duplicate name
   if (FindRecord(name) != -1)
     return false;
@@ -37,7 +53,7 @@ bool HeaderPage::DeleteRecord(const std::string &name) {
   // record does not exsit
   if (index == -1)
     return false;
-  int offset = index * 36 + 4;
+  int offset = index * 36 + RECORDS_OFFSET;
   memmove(GetData() + offset, GetData() + offset + 36,
           (record_num - index - 1) * 36);
 
@@ -53,7 +69,7 @@ bool HeaderPage::UpdateRecord(const std::string &name,
   // record does not exsit
   if (index == -1)
     return false;
-  int offset = index * 36 + 4;
+  int offset = index * 36 + RECORDS_OFFSET;
   // update record content, only root_id
   memcpy((GetData() + offset + 32), &root_id, 4);
 
@@ -67,7 +83,7 @@ bool HeaderPage::GetRootId(const std::string &name, page_id_t &root_id) {
   // record does not exsit
   if (index == -1)
     return false;
-  int offset = (index + 1) * 36;
+  int offset = index * 36 + RECORDS_OFFSET + 32;
   root_id = *reinterpret_cast<page_id_t *>(GetData() + offset);
 
   return true;
@@ -77,17 +93,20 @@ bool HeaderPage::GetRootId(const std::string &name, page_id_t &root_id) {
  * helper functions
  */
 // record count
-int HeaderPage::GetRecordCount() { return *reinterpret_cast<int *>(GetData()); }
+int HeaderPage::GetRecordCount() {
+  return *reinterpret_cast<int *>(GetData() + 8);
+}
 
 void HeaderPage::SetRecordCount(int record_count) {
-  memcpy(GetData(), &record_count, 4);
+  memcpy(GetData() + 8, &record_count, 4);
 }
 
 int HeaderPage::FindRecord(const std::string &name) {
   int record_num = GetRecordCount();
 
   for (int i = 0; i < record_num; i++) {
-    char *raw_name = reinterpret_cast<char *>(GetData() + (4 + i * 36));
+    char *raw_name =
+        reinterpret_cast<char *>(GetData() + (RECORDS_OFFSET + i * 36));
     if (strcmp(raw_name, name.c_str()) == 0)
       return i;
   }
@@ -0,0 +1,301 @@
+/**
+ * clustered_tree.cpp
+ */
+
+#include <algorithm>
+#include <cstdint>
+
+#include "page/header_page.h"
+#include "table/clustered_tree.h"
+
+namespace scudb {
+
+ClusteredTree::ClusteredTree(const std::string &name,
+                             BufferPoolManager *buffer_pool_manager,
+                             page_id_t root_page_id)
+    : name_(name), root_page_id_(root_page_id),
+      buffer_pool_manager_(buffer_pool_manager) {
+  if (root_page_id_ != INVALID_PAGE_ID)
+    return;
+  Node root;
+  std::vector<Split> splits;
+  Store(root, splits);
+  root_page_id_ = root.page_id;
+}
+
+bool ClusteredTree::Fits(const Tuple &tuple) {
+  return sizeof(int64_t) + sizeof(int32_t) + tuple.GetLength() <=
+         ClusteredTreePage::GetCapacity();
+}
+
+bool ClusteredTree::Insert(int64_t key, const Tuple &tuple) {
+  return Write(key, Change::INSERT, &tuple);
+}
+
+bool ClusteredTree::Update(int64_t key, const Tuple &tuple) {
+  return Write(key, Change::UPDATE, &tuple);
+}
+
+bool ClusteredTree::Remove(int64_t key) {
+  return Write(key, Change::REMOVE, nullptr);
+}
+
+bool ClusteredTree::GetTuple(int64_t key, Tuple &tuple) {
+  latch_.RLock();
+  Node leaf;
+  int64_t low_fence;
+  FindLeaf(key, leaf, low_fence);
+  auto it = std::lower_bound(leaf.keys.begin(), leaf.keys.end(), key);
+  bool found = it != leaf.keys.end() && *it == key;
+  if (found)
+    tuple.DeserializeFrom(leaf.rows[it - leaf.keys.begin()].data());
+  latch_.RUnlock();
+  return found;
+}
+
+/*
+ * Forward reads follow the leaf chain. Leaves do not link backwards, so a
+ * reverse read descends again for the keys below the lowest one the leaf it
+ * is done with may hold.
+ */
+void ClusteredTree::Read(int64_t low, int64_t high, bool reverse, size_t limit,
+                         std::vector<std::pair<int64_t, Tuple>> &result) {
+  // @return: false once the row is past the range or the limit is reached
+  auto take = [&](int64_t key, const std::string &row) {
+    if (key < low || key > high)
+      return reverse ? key > high : key < low;
+    if (result.size() >= limit)
+      return false;
+    Tuple tuple;
+    tuple.DeserializeFrom(row.data());
+    result.emplace_back(key, tuple);
+    return true;
+  };
+  latch_.RLock();
+  Node leaf;
+  int64_t low_fence;
+  bool more = true;
+  if (!reverse) {
+    FindLeaf(low, leaf, low_fence);
+    while (more) {
+      for (size_t i = 0; more && i < leaf.keys.size(); i++)
+        more = take(leaf.keys[i], leaf.rows[i]);
+      if (!more || leaf.next_page_id == INVALID_PAGE_ID)
+        break;
+      Load(leaf.next_page_id, leaf);
+    }
+  } else {
+    while (more) {
+      FindLeaf(high, leaf, low_fence);
+      for (size_t i = leaf.keys.size(); more && i > 0; i--)
+        more = take(leaf.keys[i - 1], leaf.rows[i - 1]);
+      if (!more || low_fence == INT64_MIN || low_fence <= low)
+        break;
+      high = low_fence - 1;
+    }
+  }
+  latch_.RUnlock();
+}
+
+/*
+ * Change the row of key in its leaf. Pages split off the root go under a new
+ * one, as many times as it takes.
+ */
+bool ClusteredTree::Write(int64_t key, Change change, const Tuple *tuple) {
+  std::string row;
+  if (tuple != nullptr) {
+    row.resize(sizeof(int32_t) + tuple->GetLength());
+    tuple->SerializeTo(&row[0]);
+  }
+  latch_.WLock();
+  Node root;
+  std::vector<Split> splits;
+  Load(root_page_id_, root);
+  bool changed = Apply(root, key, change, row, splits);
+  while (!splits.empty()) {
+    Node new_root;
+    new_root.leaf = false;
+    new_root.keys.push_back(splits[0].first);
+    new_root.children.push_back(root_page_id_);
+    for (auto &split : splits) {
+      new_root.keys.push_back(split.first);
+      new_root.children.push_back(split.second);
+    }
+    splits.clear();
+    Store(new_root, splits);
+    root_page_id_ = new_root.page_id;
+    UpdateRootPageId();
+  }
+  latch_.WUnlock();
+  return changed;
+}
+
+/*
+ * A leaf takes the change, an internal page passes it on to the child that
+ * holds key and adds the pages the child split into. Pages node itself
+ * splits into are added to splits.
+ * @return: false if the change does not apply, nothing is written then
+ */
+bool ClusteredTree::Apply(Node &node, int64_t key, Change change,
+                          const std::string &row, std::vector<Split> &splits) {
+  if (node.leaf) {
+    auto it = std::lower_bound(node.keys.begin(), node.keys.end(), key);
+    size_t i = it - node.keys.begin();
+    bool found = it != node.keys.end() && *it == key;
+    if (found == (change == Change::INSERT))
+      return false;
+    if (change == Change::INSERT) {
+      node.keys.insert(it, key);
+      node.rows.insert(node.rows.begin() + i, row);
+    } else if (change == Change::UPDATE) {
+      node.rows[i] = row;
+    } else {
+      node.keys.erase(it);
+      node.rows.erase(node.rows.begin() + i);
+    }
+    Store(node, splits);
+    return true;
+  }
+  int child = Route(node, key);
+  Node child_node;
+  std::vector<Split> child_splits;
+  Load(node.children[child], child_node);
+  if (!Apply(child_node, key, change, row, child_splits))
+    return false;
+  if (child_splits.empty())
+    return true;
+  for (size_t i = 0; i < child_splits.size(); i++) {
+    node.keys.insert(node.keys.begin() + child + 1 + i, child_splits[i].first);
+    node.children.insert(node.children.begin() + child + 1 + i,
+                         child_splits[i].second);
+  }
+  Store(node, splits);
+  return true;
+}
+
+/*
+ * Helper to read the leaf that holds key, low_fence is the lowest key it may
+ * hold, INT64_MIN for the first leaf
+ */
+void ClusteredTree::FindLeaf(int64_t key, Node &leaf, int64_t &low_fence) {
+  low_fence = INT64_MIN;
+  Load(root_page_id_, leaf);
+  while (!leaf.leaf) {
+    int child = Route(leaf, key);
+    if (child > 0)
+      low_fence = leaf.keys[child];
+    page_id_t child_page_id = leaf.children[child];
+    Load(child_page_id, leaf);
+  }
+}
+
+// child of an internal page that holds key
+int ClusteredTree::Route(const Node &node, int64_t key) const {
+  return std::upper_bound(node.keys.begin() + 1, node.keys.end(), key) -
+         node.keys.begin() - 1;
+}
+
+void ClusteredTree::Load(page_id_t page_id, Node &node) {
+  Page *frame = buffer_pool_manager_->FetchPage(page_id);
+  frame->RLatch();
+  auto page = reinterpret_cast<ClusteredTreePage *>(frame->GetData());
+  node.page_id = page_id;
+  node.leaf = page->IsLeafPage();
+  node.next_page_id = page->GetNextPageId();
+  node.rows.clear();
+  node.children.clear();
+  if (node.leaf)
+    page->GetRows(node.keys, node.rows);
+  else
+    page->GetChildren(node.keys, node.children);
+  frame->RUnlatch();
+  buffer_pool_manager_->UnpinPage(page_id, false);
+}
+
+/*
+ * Write node back, split into as few pages of about even size as its records
+ * fit in: a page is cut before a record that runs over it, or once it has
+ * its share of the bytes. The first one keeps the page id of node, a new
+ * node gets one. The pages after it are added to splits, leaves are chained
+ * in order.
+ */
+void ClusteredTree::Store(Node &node, std::vector<Split> &splits) {
+  size_t count = node.keys.size(), total = 0;
+  std::vector<size_t> sizes(count);
+  for (size_t i = 0; i < count; i++) {
+    sizes[i] = node.leaf ? ClusteredTreePage::GetRowSize(node.rows[i])
+                         : ClusteredTreePage::GetChildSize();
+    total += sizes[i];
+  }
+  size_t capacity = ClusteredTreePage::GetCapacity();
+  size_t share = total / std::max<size_t>(1, (total + capacity - 1) / capacity);
+  std::vector<size_t> begins(1, 0);
+  size_t used = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (i > begins.back() && (used + sizes[i] > capacity || used >= share)) {
+      begins.push_back(i);
+      used = 0;
+    }
+    used += sizes[i];
+  }
+  begins.push_back(count);
+  int parts = begins.size() - 1;
+
+  std::vector<page_id_t> page_ids(parts, node.page_id);
+  // backwards, so that the page a leaf links to exists
+  for (int p = parts - 1; p >= 0; p--) {
+    Page *frame;
+    if (p == 0 && node.page_id != INVALID_PAGE_ID)
+      frame = buffer_pool_manager_->FetchPage(node.page_id);
+    else
+      frame = buffer_pool_manager_->NewPage(page_ids[p]);
+    frame->WLatch();
+    auto page = reinterpret_cast<ClusteredTreePage *>(frame->GetData());
+    page->Init(page_ids[p], node.leaf);
+    page->SetNextPageId(p + 1 < parts ? page_ids[p + 1] : node.next_page_id);
+    int begin = begins[p], size = begins[p + 1] - begins[p];
+    if (node.leaf)
+      page->SetRows(node.keys.data() + begin, node.rows.data() + begin, size);
+    else
+      page->SetChildren(node.keys.data() + begin,
+                        node.children.data() + begin, size);
+    frame->WUnlatch();
+    buffer_pool_manager_->UnpinPage(page_ids[p], true);
+  }
+  node.page_id = page_ids[0];
+  for (int p = 1; p < parts; p++)
+    splits.push_back(std::make_pair(node.keys[begins[p]], page_ids[p]));
+}
+
+/*
+ * Update the root page id in header page, the record is named after the
+ * table
+ */
+void ClusteredTree::UpdateRootPageId() {
+  HeaderPage *header_page = static_cast<HeaderPage *>(
+      buffer_pool_manager_->FetchPage(HEADER_PAGE_ID));
+  header_page->WLatch();
+  if (!header_page->UpdateRecord(name_, root_page_id_))
+    header_page->InsertRecord(name_, root_page_id_);
+  header_page->WUnlatch();
+  buffer_pool_manager_->UnpinPage(HEADER_PAGE_ID, true);
+}
+
+bool ClusteredTreeScan::Next(std::vector<std::pair<int64_t, Tuple>> &batch) {
+  batch.clear();
+  if (done_)
+    return false;
+  tree_->Read(low_, high_, descending_, INDEX_SCAN_BATCH_SIZE, batch);
+  if (batch.size() < INDEX_SCAN_BATCH_SIZE) {
+    done_ = true;
+  } else if (descending_) {
+    done_ = batch.back().first == low_;
+    high_ = batch.back().first - (done_ ? 0 : 1);
+  } else {
+    done_ = batch.back().first == high_;
+    low_ = batch.back().first + (done_ ? 0 : 1);
+  }
+  return !batch.empty();
+}
+
+} // namespace scudb
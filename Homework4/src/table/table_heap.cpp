@@ -28,13 +28,14 @@ TableHeap::TableHeap(BufferPoolManager *buffer_pool_manager,
   first_page->WLatch();
   LOG_DEBUG("new table page created %d", first_page_id_);
 
-  first_page->Init(first_page_id_, PAGE_SIZE, INVALID_LSN, log_manager_, txn);
+  first_page->Init(first_page_id_, PAGE_CHECKSUM_OFFSET, INVALID_LSN,
+                   log_manager_, txn);
   first_page->WUnlatch();
   buffer_pool_manager_->UnpinPage(first_page_id_, true);
 }
 
 bool TableHeap::InsertTuple(const Tuple &tuple, RID &rid, Transaction *txn) {
-  if (tuple.size_ + 32 > PAGE_SIZE) { // larger than one page size
+  if (tuple.size_ + 32 > PAGE_CHECKSUM_OFFSET) { // larger than one page size
     txn->SetState(TransactionState::ABORTED);
     return false;
   }
@@ -70,7 +71,7 @@ bool TableHeap::InsertTuple(const Tuple &tuple, RID &rid, Transaction *txn) {
       // std::cout << "new table page " << next_page_id << " created" <<
       // std::endl;
       cur_page->SetNextPageId(next_page_id);
-      new_page->Init(next_page_id, PAGE_SIZE, cur_page->GetPageId(),
+      new_page->Init(next_page_id, PAGE_CHECKSUM_OFFSET, cur_page->GetPageId(),
                      log_manager_, txn);
       cur_page->WUnlatch();
       buffer_pool_manager_->UnpinPage(cur_page->GetPageId(), true);
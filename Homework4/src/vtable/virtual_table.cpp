@@ -2,6 +2,7 @@
  * virtual_table.cpp
  */
 #include <algorithm>
+#include <cmath>
 #include <cstring>
 #include <iostream>
 #include <sys/stat.h>
@@ -24,10 +25,18 @@ int VtabCreate(sqlite3 *db, void *pAux, int argc, const char *const *argv,
       storage_engine_->buffer_pool_manager_;
   LockManager *lock_manager = storage_engine_->lock_manager_;
   LogManager *log_manager = storage_engine_->log_manager_;
+  if (storage_engine_->disk_manager_->IsReadOnly()) {
+    *pzErr = sqlite3_mprintf("vtable db file is opened read-only");
+    return SQLITE_READONLY;
+  }
 
   // fetch header page from buffer pool
   HeaderPage *header_page =
       static_cast<HeaderPage *>(buffer_pool_manager->FetchPage(HEADER_PAGE_ID));
+  if (header_page == nullptr) {
+    *pzErr = sqlite3_mprintf("can't read the header page of the vtable db file");
+    return SQLITE_CORRUPT;
+  }
 
   // the first three parameter:(1) module name (2) database name (3)table name
   assert(argc >= 4);
@@ -38,17 +47,28 @@ int VtabCreate(sqlite3 *db, void *pAux, int argc, const char *const *argv,
 
   // parse arg[4](string that defines table index)
   Index *index = nullptr;
+  int key_column = -1;
   if (argc > 4) {
     std::string index_string(argv[4]);
     index_string = index_string.substr(1, (index_string.size() - 2));
     // create index object, allocate memory space
     IndexMetadata *index_metadata =
         ParseIndexStatement(index_string, std::string(argv[2]), schema);
-    index = ConstructIndex(index_metadata, buffer_pool_manager);
+    // a clustered index is the table itself
+    if (index_metadata->IsClustered()) {
+      key_column = index_metadata->GetKeyAttrs()[0];
+      delete index_metadata;
+    } else {
+      index = ConstructIndex(index_metadata, buffer_pool_manager);
+    }
   }
   // create table object, allocate memory space
-  VirtualTable *table = new VirtualTable(schema, buffer_pool_manager,
-                                         lock_manager, log_manager, index);
+  VirtualTable *table =
+      key_column >= 0
+          ? new VirtualTable(schema, buffer_pool_manager, std::string(argv[2]),
+                             key_column)
+          : new VirtualTable(schema, buffer_pool_manager, lock_manager,
+                             log_manager, index);
 
   // insert table root page info into header page
   header_page->InsertRecord(std::string(argv[2]), table->GetFirstPageId());
@@ -79,10 +99,17 @@ int VtabConnect(sqlite3 *db, void *pAux, int argc, const char *const *argv,
   // Retrieve table root page info from header page
   HeaderPage *header_page =
       static_cast<HeaderPage *>(buffer_pool_manager->FetchPage(HEADER_PAGE_ID));
+  if (header_page == nullptr) {
+    delete schema;
+    *pzErr = sqlite3_mprintf("can't read the header page of the vtable db file");
+    return SQLITE_CORRUPT;
+  }
   page_id_t table_root_id;
   header_page->GetRootId(std::string(argv[2]), table_root_id);
   // parse arg[4](string that defines table index)
   Index *index = nullptr;
+  int key_column = -1;
+  bool build_index = false;
   if (argc > 4) {
     std::string index_string(argv[4]);
     index_string = index_string.substr(1, (index_string.size() - 2));
@@ -90,13 +117,27 @@ int VtabConnect(sqlite3 *db, void *pAux, int argc, const char *const *argv,
     IndexMetadata *index_metadata =
         ParseIndexStatement(index_string, std::string(argv[2]), schema);
     // Retrieve index root page info from header page
-    page_id_t index_root_id;
-    header_page->GetRootId(index_metadata->GetName(), index_root_id);
-    index = ConstructIndex(index_metadata, buffer_pool_manager, index_root_id);
+    page_id_t index_root_id = INVALID_PAGE_ID;
+    if (index_metadata->IsClustered()) {
+      key_column = index_metadata->GetKeyAttrs()[0];
+      delete index_metadata;
+    } else {
+      build_index =
+          !header_page->GetRootId(index_metadata->GetName(), index_root_id);
+      index =
+          ConstructIndex(index_metadata, buffer_pool_manager, index_root_id);
+    }
   }
+  // the table root of a clustered table is the root of its tree
   VirtualTable *table =
-      new VirtualTable(schema, buffer_pool_manager, lock_manager, log_manager,
-                       index, table_root_id);
+      key_column >= 0
+          ? new VirtualTable(schema, buffer_pool_manager, std::string(argv[2]),
+                             key_column, table_root_id)
+          : new VirtualTable(schema, buffer_pool_manager, lock_manager,
+                             log_manager, index, table_root_id);
+  // the table has no index on disk yet, build it out of its tuples
+  if (build_index && !storage_engine_->disk_manager_->IsReadOnly())
+    table->BuildIndex();
 
   // register virtual table within sqlite system
   schema_string = "CREATE TABLE X(" + schema_string + ");";
@@ -108,43 +149,186 @@ int VtabConnect(sqlite3 *db, void *pAux, int argc, const char *const *argv,
 }
 
 /*
- * we only support
- * (1) equlity check. e.g select * from foo where a = 1
- * (2) indexed column == predicated column
+ * Helper to check whether the index hands out rows in ORDER BY order. Terms
+ * on key columns fixed by an equality may come anywhere, the others must
+ * follow the remaining key columns in one direction
+ * @return: true if SQLite can skip sorting, descending gives the direction
+ */
+static bool IndexOrdersBy(const sqlite3_index_info *pIdxInfo,
+                          const std::vector<int> &key_attrs, size_t equalities,
+                          bool &descending) {
+  size_t next = equalities;
+  bool directed = false;
+  descending = false;
+  if (pIdxInfo->nOrderBy == 0)
+    return false;
+  for (int i = 0; i < pIdxInfo->nOrderBy; i++) {
+    int column = pIdxInfo->aOrderBy[i].iColumn;
+    if (std::find(key_attrs.begin(), key_attrs.begin() + equalities, column) !=
+        key_attrs.begin() + equalities)
+      continue;
+    if (next == key_attrs.size() || column != key_attrs[next++])
+      return false;
+    bool desc = pIdxInfo->aOrderBy[i].desc;
+    if (directed && desc != descending)
+      return false;
+    descending = desc;
+    directed = true;
+  }
+  return true;
+}
+
+/*
+ * The index serves equalities on the leading key columns, optionally followed
+ * by a lower and an upper bound on the next key column, as well as ORDER BY
+ * clauses on the key columns. Constraints are not omitted, so SQLite re-checks
+ * them and bounds may be widened (see ConstructBound).
+ * Costs count page reads: a full scan reads about a page per row, an index
+ * scan descends the tree, reads the leaves of the rows and fetches each row
+ * unless the index covers the columns the query reads. Index statistics give
+ * the table size and the rows per key, otherwise they are guessed.
+ * A clustered table is planned like a unique index on its key, which covers
+ * every column and also answers constraints on the rowid.
  */
 int VtabBestIndex(sqlite3_vtab *tab, sqlite3_index_info *pIdxInfo) {
   // LOG_DEBUG("VtabBestIndex");
   VirtualTable *table = reinterpret_cast<VirtualTable *>(tab);
-  if (table->GetIndex() == nullptr)
+  double rows = ESTIMATED_TABLE_ROWS;
+  pIdxInfo->estimatedCost = rows;
+  pIdxInfo->estimatedRows = (sqlite3_int64)rows;
+  bool clustered = table->IsClustered();
+  if (table->GetIndex() == nullptr && !clustered)
     return SQLITE_OK;
-  const std::vector<int> key_attrs = table->GetIndex()->GetKeyAttrs();
-  // make sure indexed column == predicate column
-  // e.g select * from foo where a = 1 and b =2; indexed column must be {a,b}
-  if (pIdxInfo->nConstraint != (int)(key_attrs.size()))
-    return SQLITE_OK;
-
-  int counter = 0;
-  bool is_index_scan = true;
-  for (int i = 0; i < pIdxInfo->nConstraint; i++) {
-    if (pIdxInfo->aConstraint[i].usable == 0)
-      continue;
-    int item = pIdxInfo->aConstraint[i].iColumn;
-    // if predicate column is part of indexed column
-    if (std::find(key_attrs.begin(), key_attrs.end(), item) !=
-        key_attrs.end()) {
-      // equlity check
-      if (pIdxInfo->aConstraint[i].op != SQLITE_INDEX_CONSTRAINT_EQ) {
-        is_index_scan = false;
+  const std::vector<int> key_attrs =
+      clustered ? std::vector<int>(1, table->GetKeyColumn())
+                : table->GetIndex()->GetKeyAttrs();
+  IndexStatistics statistics;
+  bool known = !clustered && table->GetIndex()->GetStatistics(statistics);
+  if (known) {
+    rows = std::max(statistics.entry_count, 1.0);
+    pIdxInfo->estimatedCost = rows;
+    pIdxInfo->estimatedRows = (sqlite3_int64)rows;
+  }
+  double height = known ? statistics.height : std::log2(rows);
+  // the query reads key columns only, bit 63 stands for all columns from 63 on
+  bool covering = clustered || table->GetIndex()->StoresKeyValues();
+  for (int i = 0; covering && !clustered &&
+                  i < table->GetSchema()->GetColumnCount();
+       i++)
+    if ((pIdxInfo->colUsed & ((sqlite3_uint64)1 << std::min(i, 63))) &&
+        std::find(key_attrs.begin(), key_attrs.end(), i) == key_attrs.end())
+      covering = false;
+
+  // constraint used for each prefix key column, then the bounds
+  std::vector<int> equalities;
+  int low = -1, high = -1;
+  for (size_t k = 0; k < key_attrs.size(); k++) {
+    int equality = -1;
+    for (int i = 0; i < pIdxInfo->nConstraint; i++) {
+      const auto &constraint = pIdxInfo->aConstraint[i];
+      int column = clustered && constraint.iColumn < 0 ? key_attrs[0]
+                                                       : constraint.iColumn;
+      if (constraint.usable == 0 || column != key_attrs[k])
+        continue;
+      switch (constraint.op) {
+      case SQLITE_INDEX_CONSTRAINT_EQ:
+        if (equality < 0)
+          equality = i;
+        break;
+      case SQLITE_INDEX_CONSTRAINT_GT:
+      case SQLITE_INDEX_CONSTRAINT_GE:
+        if (low < 0)
+          low = i;
+        break;
+      case SQLITE_INDEX_CONSTRAINT_LT:
+      case SQLITE_INDEX_CONSTRAINT_LE:
+        if (high < 0)
+          high = i;
+        break;
+      default:
         break;
       }
-      pIdxInfo->aConstraintUsage[i].argvIndex = (i + 1);
-      counter++;
     }
+    if (equality < 0)
+      break;
+    equalities.push_back(equality);
+    low = high = -1;
+  }
+  // a unique index is unique over the key columns in front of "include", an
+  // equality on each of them finds a row at most
+  bool unique = clustered || table->GetIndex()->GetMetadata()->IsUnique();
+  size_t unique_columns =
+      clustered ? key_attrs.size()
+                : key_attrs.size() -
+                      table->GetIndex()->GetMetadata()->GetIncludedColumnCount();
+  if (unique && equalities.size() > unique_columns)
+    equalities.resize(unique_columns);
+  bool descending;
+  bool ordered =
+      IndexOrdersBy(pIdxInfo, key_attrs, equalities.size(), descending);
+  if (equalities.empty() && low < 0 && high < 0 && !ordered)
+    return SQLITE_OK;
+
+  int argc = 0;
+  for (int i : equalities)
+    pIdxInfo->aConstraintUsage[i].argvIndex = ++argc;
+  pIdxInfo->orderByConsumed = ordered;
+  // a non-unique index scans the range of the key instead. the scan is not
+  // flagged SQLITE_INDEX_SCAN_UNIQUE: SQLite would then delete or update the
+  // row in one pass, after VtabClose has committed the transaction. without
+  // the included columns the key is a prefix, whose range holds the row
+  if (unique && equalities.size() == unique_columns) {
+    pIdxInfo->idxNum =
+        (unique_columns == key_attrs.size()
+             ? INDEX_POINT_SCAN
+             : INDEX_RANGE_SCAN | (int)unique_columns << INDEX_EQ_SHIFT) |
+        (covering ? INDEX_COVERING : 0);
+    pIdxInfo->estimatedRows = 1;
+    pIdxInfo->estimatedCost = height + (covering ? 0 : 1);
+    return SQLITE_OK;
   }
 
-  if (counter == (int)key_attrs.size() && is_index_scan) {
-    pIdxInfo->idxNum = 1;
+  // the equalities keep the rows of one value of their key columns, a tenth
+  // of the rows each without statistics. bound values are not known here, a
+  // bound is guessed to keep a quarter
+  int idx_num = INDEX_RANGE_SCAN | (int)equalities.size() << INDEX_EQ_SHIFT;
+  if (known && !equalities.empty())
+    rows /= std::max(statistics.distinct[equalities.size() - 1], 1.0);
+  else
+    rows /= std::pow(10.0, (double)equalities.size());
+  if (ordered && descending)
+    idx_num |= INDEX_DESCENDING;
+  if (covering)
+    idx_num |= INDEX_COVERING;
+  if (low >= 0) {
+    pIdxInfo->aConstraintUsage[low].argvIndex = ++argc;
+    idx_num |= INDEX_LOW_BOUND;
+    if (pIdxInfo->aConstraint[low].op == SQLITE_INDEX_CONSTRAINT_GE)
+      idx_num |= INDEX_LOW_INCLUSIVE;
+    rows /= 4;
   }
+  if (high >= 0) {
+    pIdxInfo->aConstraintUsage[high].argvIndex = ++argc;
+    idx_num |= INDEX_HIGH_BOUND;
+    if (pIdxInfo->aConstraint[high].op == SQLITE_INDEX_CONSTRAINT_LE)
+      idx_num |= INDEX_HIGH_INCLUSIVE;
+    rows /= 4;
+  }
+  if (rows < 1)
+    rows = 1;
+  // SQLite takes the rows in any order, fetch them page by page
+  if (!ordered && !covering && rows >= HEAP_ORDER_MIN_ROWS)
+    idx_num |= INDEX_HEAP_ORDER;
+  // without statistics the leaves are not known, a covering scan is then
+  // charged a read per row too
+  double leaves =
+      known ? rows * statistics.leaf_count /
+                  std::max(statistics.entry_count, 1.0)
+            : 0;
+  double fetches = covering && known ? 0 : rows;
+  pIdxInfo->idxNum = idx_num;
+  pIdxInfo->estimatedRows = (sqlite3_int64)rows;
+  pIdxInfo->estimatedCost = height + leaves + fetches;
   return SQLITE_OK;
 }
 
@@ -173,11 +357,49 @@ int VtabClose(sqlite3_vtab_cursor *cur) {
   // LOG_DEBUG("VtabClose");
   Cursor *cursor = reinterpret_cast<Cursor *>(cur);
   // if read operation, commit transaction here
+  cursor->GetVirtualTable()->FlushEntries();
   VtabCommit(nullptr);
   delete cursor;
   return SQLITE_OK;
 }
 
+/*
+ * Helper to scan a clustered table, idxNum is read as for an index on its key
+ * column. Bounds are made inclusive, a full scan reads all keys in order
+ */
+static void ClusteredFilter(Cursor *cursor, int idxNum, sqlite3_value **argv) {
+  VirtualTable *table = cursor->GetVirtualTable();
+  TypeId type = table->GetSchema()->GetType(table->GetKeyColumn());
+  int64_t low = INT64_MIN, high = INT64_MAX;
+  Value bound(type);
+  int next = 0;
+  if (idxNum & INDEX_POINT_SCAN) {
+    low = high = table->GetClusteredKey(ConstructValue(type, argv[0]));
+  }
+  if ((idxNum & INDEX_RANGE_SCAN) && (idxNum & INDEX_LOW_BOUND)) {
+    bool inclusive = idxNum & INDEX_LOW_INCLUSIVE;
+    if (ConstructBound(type, argv[next++], true, bound, inclusive)) {
+      low = table->GetClusteredKey(bound);
+      // no key lies above the largest one
+      if (!inclusive && low == INT64_MAX)
+        high = INT64_MIN;
+      else if (!inclusive)
+        low++;
+    }
+  }
+  if ((idxNum & INDEX_RANGE_SCAN) && (idxNum & INDEX_HIGH_BOUND)) {
+    bool inclusive = idxNum & INDEX_HIGH_INCLUSIVE;
+    if (ConstructBound(type, argv[next++], false, bound, inclusive)) {
+      int64_t key = table->GetClusteredKey(bound);
+      if (!inclusive && key == INT64_MIN)
+        low = INT64_MAX;
+      else
+        high = std::min(high, inclusive ? key : key - 1);
+    }
+  }
+  cursor->OpenClusteredScan(low, high, idxNum & INDEX_DESCENDING);
+}
+
 /*
 ** This method is called to "rewind" the cursor object back
 ** to the first row of output. This method is always called at least
@@ -189,13 +411,57 @@ int VtabFilter(sqlite3_vtab_cursor *pVtabCursor, int idxNum, const char *idxStr,
   // LOG_DEBUG("VtabFilter");
   Cursor *cursor = reinterpret_cast<Cursor *>(pVtabCursor);
   Schema *key_schema;
+  // the index has to hold the rows inserted so far
+  if (idxNum != 0)
+    cursor->GetVirtualTable()->FlushEntries();
+  // hint a mapped db file about the upcoming access pattern
+  storage_engine_->buffer_pool_manager_->AdviseAccess(
+      idxNum != 0 ? AccessPattern::RANDOM : AccessPattern::SEQUENTIAL);
+  if (cursor->GetVirtualTable()->IsClustered()) {
+    ClusteredFilter(cursor, idxNum, argv);
+    return SQLITE_OK;
+  }
   // if indexed scan
-  if (idxNum == 1) {
+  if (idxNum & INDEX_POINT_SCAN) {
     cursor->SetScanFlag(true);
     // Construct the tuple for point query
     key_schema = cursor->GetKeySchema();
     Tuple scan_tuple = ConstructTuple(key_schema, argv);
-    cursor->ScanKey(scan_tuple);
+    cursor->ScanKey(scan_tuple, idxNum & INDEX_COVERING);
+  } else if (idxNum & INDEX_RANGE_SCAN) {
+    cursor->SetScanFlag(true);
+    key_schema = cursor->GetKeySchema();
+    // the equalities make up the common prefix of both bounds
+    int equalities = idxNum >> INDEX_EQ_SHIFT;
+    std::vector<Value> low, high;
+    for (int i = 0; i < equalities; i++)
+      low.push_back(ConstructValue(key_schema->GetType(i), argv[i]));
+    high = low;
+    // bounds are on the key column after the equalities, a non-unique index
+    // may have an equality on every key column instead
+    TypeId type = equalities < key_schema->GetColumnCount()
+                      ? key_schema->GetType(equalities)
+                      : TypeId::INVALID;
+    Value bound(type);
+    int next = equalities;
+    bool low_inclusive = true, high_inclusive = true;
+    if (idxNum & INDEX_LOW_BOUND) {
+      bool inclusive = idxNum & INDEX_LOW_INCLUSIVE;
+      if (ConstructBound(type, argv[next++], true, bound, inclusive)) {
+        low.push_back(bound);
+        low_inclusive = inclusive;
+      }
+    }
+    if (idxNum & INDEX_HIGH_BOUND) {
+      bool inclusive = idxNum & INDEX_HIGH_INCLUSIVE;
+      if (ConstructBound(type, argv[next++], false, bound, inclusive)) {
+        high.push_back(bound);
+        high_inclusive = inclusive;
+      }
+    }
+    cursor->OpenScan(low, low_inclusive, high, high_inclusive,
+                     idxNum & INDEX_DESCENDING, idxNum & INDEX_COVERING,
+                     idxNum & INDEX_HEAP_ORDER);
   }
   return SQLITE_OK;
 }
@@ -254,10 +520,44 @@ int VtabRowid(sqlite3_vtab_cursor *cur, sqlite3_int64 *pRowid) {
   return SQLITE_OK;
 }
 
+/*
+ * Helper to change a clustered table, rowids are the keys. A key may be taken
+ * once, changing the key of a row moves it in the tree.
+ */
+static int ClusteredUpdate(VirtualTable *table, int argc, sqlite3_value **argv,
+                           sqlite_int64 *pRowid) {
+  ClusteredTree *tree = table->GetClusteredTree();
+  if (argc == 1) {
+    tree->Remove(sqlite3_value_int64(argv[0]));
+    return SQLITE_OK;
+  }
+  Tuple tuple = ConstructTuple(table->GetSchema(), (argv + 2));
+  int64_t key = table->GetClusteredKey(tuple);
+  if (!ClusteredTree::Fits(tuple))
+    return SQLITE_TOOBIG;
+  if (sqlite3_value_type(argv[0]) == SQLITE_NULL) {
+    if (!tree->Insert(key, tuple))
+      return SQLITE_CONSTRAINT;
+    *pRowid = key;
+  } else if (sqlite3_value_int64(argv[0]) == key) {
+    tree->Update(key, tuple);
+  } else {
+    if (!tree->Insert(key, tuple))
+      return SQLITE_CONSTRAINT;
+    tree->Remove(sqlite3_value_int64(argv[0]));
+  }
+  return SQLITE_OK;
+}
+
 int VtabUpdate(sqlite3_vtab *pVTab, int argc, sqlite3_value **argv,
                sqlite_int64 *pRowid) {
   // LOG_DEBUG("VtabUpdate");
   VirtualTable *table = reinterpret_cast<VirtualTable *>(pVTab);
+  // pages of a read-only db file are mapped read-only
+  if (storage_engine_->disk_manager_->IsReadOnly())
+    return SQLITE_READONLY;
+  if (table->IsClustered())
+    return ClusteredUpdate(table, argc, argv, pRowid);
   // The single row with rowid equal to argv[0] is deleted
   if (argc == 1) {
     const RID rid(sqlite3_value_int64(argv[0]));
@@ -308,6 +608,8 @@ int VtabBegin(sqlite3_vtab *pVTab) {
 
 int VtabCommit(sqlite3_vtab *pVTab) {
   // LOG_DEBUG("VtabCommit");
+  if (pVTab != nullptr)
+    reinterpret_cast<VirtualTable *>(pVTab)->FlushEntries();
   auto transaction = GetTransaction();
   if (transaction == nullptr)
     return SQLITE_OK;
@@ -357,19 +659,46 @@ __declspec(dllexport)
   std::string db_file_name = "vtable.db";
   struct stat buffer;
   bool is_file_exist = (stat(db_file_name.c_str(), &buffer) == 0);
+  // a read-only connection maps an existing db file read-only, the URI
+  // parameter vtable_compressed=1 compresses the pages of a new one, e.g.
+  // sqlite3_open_v2("file:x.db?vtable_compressed=1", ..., SQLITE_OPEN_URI)
+  bool read_only = is_file_exist && sqlite3_db_readonly(db, "main") == 1;
+  bool compressed = sqlite3_uri_boolean(sqlite3_db_filename(db, "main"),
+                                        "vtable_compressed", 0);
 
   // init storage engine
-  storage_engine_ = new StorageEngine(db_file_name);
-  // start the logging
-  storage_engine_->log_manager_->RunFlushThread();
-  // create header page from BufferPoolManager if necessary
+  storage_engine_ = new StorageEngine(db_file_name, read_only, compressed);
+  BufferPoolManager *buffer_pool_manager =
+      storage_engine_->buffer_pool_manager_;
+  // create header page from BufferPoolManager if necessary, it is written
+  // right away so that the file is recognized when it is opened again
   if (!is_file_exist) {
     page_id_t header_page_id;
-    storage_engine_->buffer_pool_manager_->NewPage(header_page_id);
+    HeaderPage *header_page =
+        static_cast<HeaderPage *>(buffer_pool_manager->NewPage(header_page_id));
 
     assert(header_page_id == HEADER_PAGE_ID);
-    storage_engine_->buffer_pool_manager_->UnpinPage(header_page_id, true);
+    header_page->Init();
+    buffer_pool_manager->UnpinPage(header_page_id, true);
+    buffer_pool_manager->FlushPage(header_page_id);
+  } else {
+    // refuse files of another format instead of misreading them
+    HeaderPage *header_page =
+        static_cast<HeaderPage *>(buffer_pool_manager->FetchPage(HEADER_PAGE_ID));
+    bool valid = header_page != nullptr && header_page->HasCurrentFormat();
+    if (header_page != nullptr)
+      buffer_pool_manager->UnpinPage(HEADER_PAGE_ID, false);
+    if (!valid) {
+      *pzErrMsg = sqlite3_mprintf(
+          "%s is not a vtable db file of format version %d",
+          db_file_name.c_str(), DB_FORMAT_VERSION);
+      delete storage_engine_;
+      storage_engine_ = nullptr;
+      return SQLITE_ERROR;
+    }
   }
+  // start the logging
+  storage_engine_->log_manager_->RunFlushThread();
 
   int rc = sqlite3_create_module(db, "vtable", &VtableModule, nullptr);
   return rc;
@@ -445,25 +774,74 @@ IndexMetadata *ParseIndexStatement(std::string &sql,
   int column_id = -1;
   // prepocess, transform sql string into lower case
   std::transform(sql.begin(), sql.end(), sql.begin(), ::tolower);
+  // "nonunique" in front of the index name lets keys repeat, "buffered" puts
+  // the index on a b-epsilon tree (see index/b_epsilon_tree.h), "clustered"
+  // keeps the tuples in the index (see table/clustered_tree.h)
+  auto prefix = [&sql](const std::string &word) {
+    if (sql.compare(0, word.size(), word) != 0 ||
+        sql.find(' ', word.size()) == std::string::npos)
+      return false;
+    sql = sql.substr(word.size());
+    return true;
+  };
+  bool unique = true;
+  bool buffered = false;
+  bool clustered = false;
+  while (true) {
+    if (prefix("nonunique "))
+      unique = false;
+    else if (prefix("buffered "))
+      buffered = true;
+    else if (prefix("clustered "))
+      clustered = true;
+    else
+      break;
+  }
   n = sql.find_first_of(' ');
   // NOTE: must use whitespace to seperate index name and indexed column names
   assert(n != std::string::npos);
   index_name = sql.substr(0, n);
   sql = sql.substr(n + 1);
+  // columns after "include" are kept as trailing key columns, which index
+  // entries hold, so that queries reading them skip the table
+  std::string included;
+  n = sql.find(" include ");
+  if (n != std::string::npos) {
+    included = sql.substr(n + std::string(" include ").size());
+    sql = sql.substr(0, n);
+  }
 
-  std::vector<std::string> tok = StringUtility::Split(sql, ',');
-  // iterate through returned result
-  for (std::string &t : tok) {
-    StringUtility::Trim(t);
-    column_id = schema->GetColumnID(t);
-    if (column_id != -1)
-      key_attrs.emplace_back(column_id);
+  int included_count = 0;
+  for (std::string *columns : {&sql, &included}) {
+    std::vector<std::string> tok = StringUtility::Split(*columns, ',');
+    // iterate through returned result
+    for (std::string &t : tok) {
+      StringUtility::Trim(t);
+      column_id = schema->GetColumnID(t);
+      if (column_id != -1) {
+        key_attrs.emplace_back(column_id);
+        included_count += columns == &included;
+      }
+    }
   }
   if ((int)key_attrs.size() > schema->GetColumnCount())
     throw Exception(EXCEPTION_TYPE_INDEX, "can't create index, format error");
+  // the key of a clustered table is its rowid, one unique integer column
+  if (clustered) {
+    TypeId type = key_attrs.size() == 1 ? schema->GetType(key_attrs[0])
+                                        : TypeId::INVALID;
+    if (!unique || buffered ||
+        (type != TypeId::TINYINT && type != TypeId::SMALLINT &&
+         type != TypeId::INTEGER && type != TypeId::BIGINT))
+      throw Exception(EXCEPTION_TYPE_INDEX,
+                      "can't create clustered index, key must be one unique "
+                      "integer column");
+  }
 
   IndexMetadata *metadata =
-      new IndexMetadata(index_name, table_name, schema, key_attrs);
+      new IndexMetadata(index_name, table_name, schema, key_attrs,
+                        INDEX_NORMALIZED_KEYS, unique, buffered, clustered,
+                        included_count);
 
   // LOG_DEBUG("%s", metadata->ToString().c_str());
   return metadata;
@@ -471,39 +849,127 @@ IndexMetadata *ParseIndexStatement(std::string &sql,
 
 Tuple ConstructTuple(Schema *schema, sqlite3_value **argv) {
   int column_count = schema->GetColumnCount();
-  Value v(TypeId::INVALID);
   std::vector<Value> values;
   // iterate through schema, generate column value to insert
-  for (int i = 0; i < column_count; i++) {
-    TypeId type = schema->GetType(i);
-
-    switch (type) {
-    case TypeId::BOOLEAN:
-    case TypeId::INTEGER:
-    case TypeId::SMALLINT:
-    case TypeId::TINYINT:
-      v = Value(type, (int32_t)sqlite3_value_int(argv[i]));
-      break;
-    case TypeId::BIGINT:
-      v = Value(type, (int64_t)sqlite3_value_int64(argv[i]));
-      break;
-    case TypeId::DECIMAL:
-      v = Value(type, sqlite3_value_double(argv[i]));
-      break;
-    case TypeId::VARCHAR:
-      v = Value(type, std::string(reinterpret_cast<const char *>(
-                          sqlite3_value_text(argv[i]))));
-      break;
-    default:
-      break;
-    } // End of switch
-    values.emplace_back(v);
-  }
+  for (int i = 0; i < column_count; i++)
+    values.emplace_back(ConstructValue(schema->GetType(i), argv[i]));
   Tuple tuple(values, schema);
 
   return tuple;
 }
 
+Value ConstructValue(TypeId type, sqlite3_value *value) {
+  Value v(TypeId::INVALID);
+  switch (type) {
+  case TypeId::BOOLEAN:
+  case TypeId::INTEGER:
+  case TypeId::SMALLINT:
+  case TypeId::TINYINT:
+    v = Value(type, (int32_t)sqlite3_value_int(value));
+    break;
+  case TypeId::BIGINT:
+    v = Value(type, (int64_t)sqlite3_value_int64(value));
+    break;
+  case TypeId::DECIMAL:
+    v = Value(type, sqlite3_value_double(value));
+    break;
+  case TypeId::VARCHAR:
+    // NULL reads as an empty string, SQLite re-checks constraints on it
+    v = Value(type, sqlite3_value_type(value) == SQLITE_NULL
+                        ? std::string()
+                        : std::string(reinterpret_cast<const char *>(
+                              sqlite3_value_text(value))));
+    break;
+  default:
+    break;
+  } // End of switch
+  return v;
+}
+
+/*
+ * Turn the value of a range constraint into a bound on a key column. SQLite
+ * re-checks the constraint, so a bound that does not convert exactly is
+ * widened: a fractional or out of range bound on an integer column is
+ * rounded outwards and made inclusive, a non numeric one is dropped. A NULL
+ * bound matches nothing and is dropped as well.
+ * @return: false if the bound is dropped, leaving that side open
+ */
+bool ConstructBound(TypeId type, sqlite3_value *value, bool low, Value &bound,
+                    bool &inclusive) {
+  if (sqlite3_value_type(value) == SQLITE_NULL)
+    return false;
+  int64_t min = 0, max = 1;
+  switch (type) {
+  case TypeId::TINYINT:
+    min = PELOTON_INT8_MIN, max = PELOTON_INT8_MAX;
+    break;
+  case TypeId::SMALLINT:
+    min = PELOTON_INT16_MIN, max = PELOTON_INT16_MAX;
+    break;
+  case TypeId::INTEGER:
+    min = PELOTON_INT32_MIN, max = PELOTON_INT32_MAX;
+    break;
+  case TypeId::BIGINT:
+    min = PELOTON_INT64_MIN, max = PELOTON_INT64_MAX;
+    break;
+  case TypeId::BOOLEAN:
+    break;
+  case TypeId::DECIMAL:
+    if (sqlite3_value_numeric_type(value) != SQLITE_INTEGER &&
+        sqlite3_value_numeric_type(value) != SQLITE_FLOAT)
+      return false;
+    bound = Value(type, sqlite3_value_double(value));
+    return true;
+  case TypeId::VARCHAR:
+    bound = ConstructValue(type, value);
+    return true;
+  default:
+    return false;
+  }
+
+  int64_t integer;
+  if (sqlite3_value_numeric_type(value) == SQLITE_INTEGER) {
+    integer = sqlite3_value_int64(value);
+  } else if (sqlite3_value_numeric_type(value) == SQLITE_FLOAT) {
+    double real = sqlite3_value_double(value);
+    if (std::isnan(real))
+      return false;
+    real = low ? std::floor(real) : std::ceil(real);
+    inclusive = true;
+    if (real < (double)min)
+      integer = min;
+    else if (real >= (double)max)
+      integer = max;
+    else
+      integer = (int64_t)real;
+  } else {
+    return false;
+  }
+  if (integer < min || integer > max) {
+    integer = integer < min ? min : max;
+    inclusive = true;
+  }
+  if (type == TypeId::BIGINT)
+    bound = Value(type, integer);
+  else
+    bound = Value(type, (int32_t)integer);
+  return true;
+}
+
+// index of the kind metadata asks for, on keys of KeySize bytes
+template <size_t KeySize>
+static Index *NewIndex(IndexMetadata *metadata,
+                       BufferPoolManager *buffer_pool_manager,
+                       page_id_t root_id) {
+  if (metadata->IsBuffered())
+    return new BEpsilonTreeIndex<GenericKey<KeySize>, RID,
+                                 GenericComparator<KeySize>>(
+        metadata, buffer_pool_manager, root_id);
+  return new BPlusTreeIndex<GenericKey<KeySize>, RID,
+                            GenericComparator<KeySize>>(
+      metadata, buffer_pool_manager, root_id);
+}
+
 // serve the functionality of index factory
 Index *ConstructIndex(IndexMetadata *metadata,
                       BufferPoolManager *buffer_pool_manager,
@@ -511,24 +977,20 @@ Index *ConstructIndex(IndexMetadata *metadata,
   // The size of the key in bytes
   Schema *key_schema = metadata->GetKeySchema();
   int key_size = key_schema->GetLength();
-  // for each varchar attribute, we assume the largest size is 16 bytes
-  key_size += 16 * key_schema->GetUnlinedColumnCount();
+  // varchar attributes get the widest key, wide keys only take the bytes
+  // they use in index pages (see page/b_plus_tree_page.h)
+  if (key_schema->GetUnlinedColumnCount()) key_size = 64;
 
   if (key_size <= 4) {
-    return new BPlusTreeIndex<GenericKey<4>, RID, GenericComparator<4>>(
-        metadata, buffer_pool_manager, root_id);
+    return NewIndex<4>(metadata, buffer_pool_manager, root_id);
   } else if (key_size <= 8) {
-    return new BPlusTreeIndex<GenericKey<8>, RID, GenericComparator<8>>(
-        metadata, buffer_pool_manager, root_id);
+    return NewIndex<8>(metadata, buffer_pool_manager, root_id);
   } else if (key_size <= 16) {
-    return new BPlusTreeIndex<GenericKey<16>, RID, GenericComparator<16>>(
-        metadata, buffer_pool_manager, root_id);
+    return NewIndex<16>(metadata, buffer_pool_manager, root_id);
   } else if (key_size <= 32) {
-    return new BPlusTreeIndex<GenericKey<32>, RID, GenericComparator<32>>(
-        metadata, buffer_pool_manager, root_id);
+    return NewIndex<32>(metadata, buffer_pool_manager, root_id);
   } else {
-    return new BPlusTreeIndex<GenericKey<64>, RID, GenericComparator<64>>(
-        metadata, buffer_pool_manager, root_id);
+    return NewIndex<64>(metadata, buffer_pool_manager, root_id);
   }
 }
 
@@ -0,0 +1,64 @@
+/**
+ * group_commit_benchmark.cpp
+ *
+ * Commits per second of DiskManager::WriteLog for a growing number of
+ * committing threads. Concurrent commits share one fsync, so the number of
+ * log syncs should stay well below the number of commits as threads are added.
+ * Usage: group_commit_benchmark [commits per thread] [record size]
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "disk/disk_manager.h"
+
+using namespace scudb;
+
+int main(int argc, char **argv) {
+  int per_thread = argc > 1 ? atoi(argv[1]) : 200;
+  int record_size = argc > 2 ? atoi(argv[2]) : 64;
+  bool ok = true;
+
+  for (int threads = 1; threads <= 16; threads *= 2) {
+    remove("group_commit_benchmark.db");
+    remove("group_commit_benchmark.log");
+    remove("group_commit_benchmark.map");
+    DiskManager disk_manager("group_commit_benchmark.db");
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> committers;
+    for (int t = 0; t < threads; t++)
+      committers.emplace_back([&, t] {
+        std::vector<char> record(record_size, 'a' + t);
+        for (int i = 0; i < per_thread; i++)
+          disk_manager.WriteLog(record.data(), record_size);
+      });
+    for (auto &committer : committers)
+      committer.join();
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+
+    // every record is in the log, and nothing past them
+    int commits = threads * per_thread;
+    int log_size = commits * record_size;
+    char last;
+    if (disk_manager.GetNumFlushes() != commits ||
+        !disk_manager.ReadLog(&last, 1, log_size - 1) ||
+        disk_manager.ReadLog(&last, 1, log_size)) {
+      printf("%d committers: log does not hold %d records\n", threads,
+             commits);
+      ok = false;
+    }
+    printf("%2d committers: %8.0f commits/s, %5d commits, %5d syncs\n",
+           threads, commits / seconds, commits,
+           disk_manager.GetNumLogSyncs());
+  }
+  remove("group_commit_benchmark.db");
+  remove("group_commit_benchmark.log");
+  remove("group_commit_benchmark.map");
+  return ok ? 0 : 1;
+}
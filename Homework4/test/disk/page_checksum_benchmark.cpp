@@ -0,0 +1,83 @@
+/**
+ * page_checksum_benchmark.cpp
+ *
+ * Cost of the page checksum next to the page write and read it is part of.
+ * Checks CRC32C against a known answer first, then times the checksum of a
+ * page alone and DiskManager page writes and verified reads.
+ * Usage: page_checksum_benchmark [pages]
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "common/crc32c.h"
+#include "disk/disk_manager.h"
+
+using namespace scudb;
+
+static double NanosSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::nano>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+int main(int argc, char **argv) {
+  int pages = argc > 1 ? atoi(argv[1]) : 200000;
+
+  // crc32c("123456789") is 0xE3069283
+  uint32_t check = CRC32C::Compute("123456789", 9);
+  if (check != 0xE3069283) {
+    printf("crc32c(\"123456789\") is %08x, expected e3069283\n", check);
+    return 1;
+  }
+  printf("crc32c %s\n", CRC32C::IsHardwareAccelerated() ? "sse4.2" : "table");
+
+  char page[PAGE_SIZE];
+  memset(page, 3, PAGE_SIZE);
+  volatile uint32_t sink = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < pages; i++) {
+    page[i % PAGE_CHECKSUM_OFFSET] = i;
+    sink = sink + CRC32C::Compute(page, PAGE_CHECKSUM_OFFSET);
+  }
+  double checksum_ns = NanosSince(start) / pages;
+
+  remove("checksum_benchmark.db");
+  remove("checksum_benchmark.log");
+  remove("checksum_benchmark.map");
+  bool ok = true;
+  double write_ns, read_ns;
+  {
+    const int page_count = 64;
+    DiskManager disk_manager("checksum_benchmark.db");
+    page_id_t first_page_id = disk_manager.AllocateExtent(page_count);
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < pages; i++) {
+      page[0] = i;
+      disk_manager.WritePage(first_page_id + i % page_count, page);
+    }
+    write_ns = NanosSince(start) / pages;
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < pages; i++) {
+      if (!disk_manager.ReadPage(first_page_id + i % page_count, page)) {
+        printf("page %d fails its checksum\n", first_page_id + i % page_count);
+        ok = false;
+        break;
+      }
+    }
+    read_ns = NanosSince(start) / pages;
+  }
+  remove("checksum_benchmark.db");
+  remove("checksum_benchmark.log");
+  remove("checksum_benchmark.map");
+
+  printf("checksum %6.1f ns/page\n", checksum_ns);
+  printf("write    %6.1f ns/page, checksum %4.1f%%\n", write_ns,
+         100 * checksum_ns / write_ns);
+  printf("read     %6.1f ns/page, checksum %4.1f%%\n", read_ns,
+         100 * checksum_ns / read_ns);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,165 @@
+/**
+ * page_compression_benchmark.cpp
+ *
+ * Compression ratio and throughput of PageCompressor for a few kinds of page
+ * content, then page write and read throughput of a compressed db file next
+ * to a plain one. Every page is decompressed and compared on the way.
+ * Usage: page_compression_benchmark [pages]
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "disk/disk_manager.h"
+#include "disk/page_compressor.h"
+
+using namespace scudb;
+
+static double Seconds(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+// fill page like a b+ tree leaf: a header, then ascending bigint keys with
+// their rids, the tail of the page unused
+static void FillLeaf(char *page, std::mt19937 &rng) {
+  memset(page, 0, PAGE_SIZE);
+  int32_t header[6] = {2, 0, (int32_t)(rng() % 1000), 1, 0, 30};
+  memcpy(page, header, sizeof(header));
+  int64_t key = rng() % 100000;
+  int count = 20 + rng() % 10;
+  for (int i = 0; i < count; i++) {
+    int32_t rid[2] = {(int32_t)(key / 16), (int32_t)(key % 16)};
+    memcpy(page + 24 + i * 16, &key, 8);
+    memcpy(page + 32 + i * 16, rid, 8);
+    key += 1 + rng() % 8;
+  }
+}
+
+static void FillPage(char *page, int kind, std::mt19937 &rng) {
+  switch (kind) {
+  case 0: // leaf page
+    FillLeaf(page, rng);
+    break;
+  case 1: // mostly empty page
+    memset(page, 0, PAGE_SIZE);
+    for (int i = 0; i < 64; i++)
+      page[i] = rng();
+    break;
+  case 2: // text tuples
+    for (int i = 0; i < PAGE_SIZE; i++)
+      page[i] = "scudb tuple "[(i + rng() % 2) % 12];
+    break;
+  default: // random bytes, does not compress
+    for (int i = 0; i < PAGE_SIZE; i++)
+      page[i] = rng();
+    break;
+  }
+}
+
+static const char *kind_names[] = {"leaf", "sparse", "text", "random"};
+
+static bool BenchmarkCodec(int pages) {
+  std::mt19937 rng(28);
+  for (int kind = 0; kind < 4; kind++) {
+    std::vector<char> src((size_t)pages * PAGE_SIZE);
+    std::vector<char> dst((size_t)pages * PAGE_SIZE);
+    std::vector<int> sizes(pages);
+    for (int i = 0; i < pages; i++)
+      FillPage(&src[(size_t)i * PAGE_SIZE], kind, rng);
+
+    auto start = std::chrono::steady_clock::now();
+    size_t total = 0;
+    for (int i = 0; i < pages; i++) {
+      sizes[i] =
+          PageCompressor::Compress(&src[(size_t)i * PAGE_SIZE], PAGE_SIZE,
+                                   &dst[(size_t)i * PAGE_SIZE], PAGE_SIZE);
+      total += sizes[i] ? sizes[i] : PAGE_SIZE;
+    }
+    double compress_time = Seconds(start);
+
+    // pages that did not compress are stored as is and not decompressed
+    char back[PAGE_SIZE];
+    int decompressed = 0;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < pages; i++) {
+      if (sizes[i] == 0)
+        continue;
+      decompressed++;
+      int size = PageCompressor::Decompress(&dst[(size_t)i * PAGE_SIZE],
+                                            sizes[i], back, PAGE_SIZE);
+      if (size != PAGE_SIZE ||
+          memcmp(back, &src[(size_t)i * PAGE_SIZE], PAGE_SIZE) != 0) {
+        printf("%s page %d does not round trip\n", kind_names[kind], i);
+        return false;
+      }
+    }
+    double decompress_time = Seconds(start);
+    double mb = (double)pages * PAGE_SIZE / (1 << 20);
+    printf("%-6s ratio %5.2f  compress %7.1f MB/s", kind_names[kind],
+           (double)pages * PAGE_SIZE / total, mb / compress_time);
+    if (decompressed > 0)
+      printf("  decompress %7.1f MB/s\n",
+             (double)decompressed * PAGE_SIZE / (1 << 20) / decompress_time);
+    else
+      printf("  stored as is\n");
+  }
+  return true;
+}
+
+// write every page twice then read it back, leaf pages with a few others
+static bool BenchmarkDisk(int pages, bool compressed) {
+  remove("compression_benchmark.db");
+  remove("compression_benchmark.log");
+  remove("compression_benchmark.map");
+  std::mt19937 rng(28);
+  std::vector<char> data((size_t)pages * PAGE_SIZE);
+  for (int i = 0; i < pages; i++)
+    FillPage(&data[(size_t)i * PAGE_SIZE], i % 8 == 7 ? 3 : i % 4 == 3, rng);
+
+  bool ok = true;
+  {
+    DiskManager disk_manager("compression_benchmark.db", false, compressed);
+    std::vector<page_id_t> page_ids;
+    for (int i = 0; i < pages; i++)
+      page_ids.push_back(disk_manager.AllocatePage());
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < 2; round++)
+      for (int i = 0; i < pages; i++)
+        disk_manager.WritePage(page_ids[i], &data[(size_t)i * PAGE_SIZE]);
+    double write_time = Seconds(start);
+
+    char page[PAGE_SIZE];
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < pages; i++) {
+      disk_manager.ReadPage(page_ids[i], page);
+      // the checksum is kept in the tail of the page
+      if (memcmp(page, &data[(size_t)i * PAGE_SIZE], PAGE_CHECKSUM_OFFSET)) {
+        printf("page %d read back wrong\n", page_ids[i]);
+        ok = false;
+        break;
+      }
+    }
+    double read_time = Seconds(start);
+    printf("%-10s ratio %5.2f  write %8.0f pages/s  read %8.0f pages/s\n",
+           compressed ? "compressed" : "plain",
+           disk_manager.GetCompressionRatio(), 2 * pages / write_time,
+           pages / read_time);
+  }
+  remove("compression_benchmark.db");
+  remove("compression_benchmark.log");
+  remove("compression_benchmark.map");
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  int pages = argc > 1 ? atoi(argv[1]) : 20000;
+  bool ok = BenchmarkCodec(pages) && BenchmarkDisk(pages, false) &&
+            BenchmarkDisk(pages, true);
+  return ok ? 0 : 1;
+}
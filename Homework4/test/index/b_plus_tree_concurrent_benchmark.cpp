@@ -0,0 +1,105 @@
+/**
+ * b_plus_tree_concurrent_benchmark.cpp
+ *
+ * Throughput of BPlusTree inserts, lookups and a remove/lookup mix for a
+ * growing number of threads, each working on its own interleaved keys.
+ * Usage: b_plus_tree_concurrent_benchmark [keys per thread] [pool size]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "buffer/buffer_pool_manager.h"
+#include "index/b_plus_tree.h"
+
+using namespace scudb;
+
+typedef BPlusTree<GenericKey<8>, RID, GenericComparator<8>> Tree;
+
+// seconds taken by threads running work(t) side by side
+static double RunThreads(int threads, const std::function<void(int)> &work) {
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; t++)
+    workers.emplace_back(work, t);
+  for (auto &worker : workers)
+    worker.join();
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+static void Run(int threads, int per_thread, int pool_size) {
+  int64_t key_count = (int64_t)threads * per_thread;
+  remove("concurrent_benchmark.db");
+  remove("concurrent_benchmark.log");
+  remove("concurrent_benchmark.map");
+
+  std::vector<Column> columns{Column(TypeId::BIGINT, 8, "k")};
+  Schema key_schema(columns);
+  GenericComparator<8> comparator(&key_schema);
+  DiskManager disk_manager("concurrent_benchmark.db");
+  BufferPoolManager buffer_pool_manager(pool_size, &disk_manager);
+  page_id_t header_page_id;
+  buffer_pool_manager.NewPage(header_page_id);
+  buffer_pool_manager.UnpinPage(header_page_id, true);
+  Tree tree("concurrent_benchmark", &buffer_pool_manager, comparator);
+  auto key_of = [&](int t, int i) { return (int64_t)i * threads + t + 1; };
+
+  double insert_time = RunThreads(threads, [&](int t) {
+    std::mt19937 rng(t);
+    std::vector<int64_t> keys;
+    for (int i = 0; i < per_thread; i++)
+      keys.push_back(key_of(t, i));
+    std::shuffle(keys.begin(), keys.end(), rng);
+    for (int64_t k : keys) {
+      GenericKey<8> key;
+      key.SetFromInteger(k);
+      tree.Insert(key, RID(k));
+    }
+  });
+  double lookup_time = RunThreads(threads, [&](int t) {
+    std::mt19937 rng(t + 100);
+    for (int i = 0; i < per_thread; i++) {
+      GenericKey<8> key;
+      key.SetFromInteger(rng() % key_count + 1);
+      std::vector<RID> result;
+      tree.GetValue(key, result);
+    }
+  });
+  double mixed_time = RunThreads(threads, [&](int t) {
+    std::mt19937 rng(t + 200);
+    for (int i = 0; i < per_thread; i++) {
+      GenericKey<8> key;
+      int64_t k = key_of(t, i);
+      if (k % 2) {
+        key.SetFromInteger(k);
+        tree.Remove(key);
+      }
+      key.SetFromInteger((int64_t)(rng() % (key_count / 2)) * 2 + 2);
+      std::vector<RID> result;
+      tree.GetValue(key, result);
+    }
+  });
+  printf("%2d threads: insert %9.0f/s  lookup %9.0f/s  mixed %9.0f/s\n",
+         threads, key_count / insert_time, key_count / lookup_time,
+         key_count / mixed_time);
+
+  remove("concurrent_benchmark.db");
+  remove("concurrent_benchmark.log");
+  remove("concurrent_benchmark.map");
+}
+
+int main(int argc, char **argv) {
+  int per_thread = argc > 1 ? atoi(argv[1]) : 20000;
+  int pool_size = argc > 2 ? atoi(argv[2]) : 256;
+  for (int threads = 1; threads <= 8; threads *= 2)
+    Run(threads, per_thread, pool_size);
+  return 0;
+}
@@ -0,0 +1,160 @@
+/**
+ * b_plus_tree_concurrent_test.cpp
+ *
+ * Stress test of the latch crabbing in BPlusTree. Threads insert, look up and
+ * remove interleaved keys at the same time, while two more threads scan the
+ * tree forwards and backwards and check that keys come in order.
+ * Usage: b_plus_tree_concurrent_test [threads] [keys per thread] [pool size]
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "buffer/buffer_pool_manager.h"
+#include "index/b_plus_tree.h"
+
+using namespace scudb;
+
+typedef BPlusTree<GenericKey<8>, RID, GenericComparator<8>> Tree;
+
+static std::atomic<bool> failed(false);
+
+#define CHECK(condition, ...)                                                  \
+  do {                                                                         \
+    if (!(condition)) {                                                        \
+      printf(__VA_ARGS__);                                                     \
+      printf("\n");                                                            \
+      failed = true;                                                           \
+    }                                                                          \
+  } while (0)
+
+static void RunThreads(int threads, const std::function<void(int)> &work) {
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; t++)
+    workers.emplace_back(work, t);
+  for (auto &worker : workers)
+    worker.join();
+}
+
+int main(int argc, char **argv) {
+  int threads = argc > 1 ? atoi(argv[1]) : 8;
+  int per_thread = argc > 2 ? atoi(argv[2]) : 2000;
+  int pool_size = argc > 3 ? atoi(argv[3]) : 64;
+  int64_t key_count = (int64_t)threads * per_thread;
+  remove("concurrent_test.db");
+  remove("concurrent_test.log");
+  remove("concurrent_test.map");
+
+  std::vector<Column> columns{Column(TypeId::BIGINT, 8, "k")};
+  Schema key_schema(columns);
+  GenericComparator<8> comparator(&key_schema);
+  DiskManager disk_manager("concurrent_test.db");
+  BufferPoolManager buffer_pool_manager(pool_size, &disk_manager);
+  page_id_t header_page_id;
+  buffer_pool_manager.NewPage(header_page_id);
+  buffer_pool_manager.UnpinPage(header_page_id, true);
+  Tree tree("concurrent_test", &buffer_pool_manager, comparator);
+
+  // thread t owns the keys i * threads + t + 1, the odd ones go again later
+  auto key_of = [&](int t, int i) { return (int64_t)i * threads + t + 1; };
+  auto lookup = [&](int64_t k, std::vector<RID> &result) {
+    GenericKey<8> key;
+    key.SetFromInteger(k);
+    return tree.GetValue(key, result);
+  };
+
+  // scanners run until the end, once the odd keys are gone they must see
+  // every even key
+  std::atomic<bool> done(false);
+  std::atomic<int> phase(1);
+  auto scan = [&](bool reverse) {
+    while (!done) {
+      int scan_phase = phase;
+      int64_t prev = reverse ? INT64_MAX : 0;
+      int64_t evens = 0;
+      for (auto it = reverse ? tree.RBegin() : tree.Begin(); !it.isEnd();
+           ++it) {
+        int64_t k = (*it).first.ToString();
+        CHECK(reverse ? k < prev : k > prev, "%s scan: %ld after %ld",
+              reverse ? "backward" : "forward", (long)k, (long)prev);
+        prev = k;
+        evens += k % 2 == 0;
+      }
+      CHECK(scan_phase != 3 || phase != 3 || evens == key_count / 2,
+            "scan saw %ld even keys", (long)evens);
+    }
+  };
+  std::thread forward(scan, false), backward(scan, true);
+
+  // concurrent inserts in random order, each key is found right after
+  RunThreads(threads, [&](int t) {
+    std::mt19937 rng(t);
+    std::vector<int64_t> keys;
+    for (int i = 0; i < per_thread; i++)
+      keys.push_back(key_of(t, i));
+    std::shuffle(keys.begin(), keys.end(), rng);
+    for (int64_t k : keys) {
+      GenericKey<8> key;
+      key.SetFromInteger(k);
+      CHECK(tree.Insert(key, RID(k)), "insert %ld failed", (long)k);
+      std::vector<RID> result;
+      CHECK(lookup(k, result), "inserted key %ld not found", (long)k);
+    }
+  });
+
+  // every thread removes its odd keys while looking up even ones
+  phase = 2;
+  RunThreads(threads, [&](int t) {
+    std::mt19937 rng(t + 100);
+    for (int i = 0; i < per_thread; i++) {
+      int64_t k = key_of(t, i);
+      if (k % 2) {
+        GenericKey<8> key;
+        key.SetFromInteger(k);
+        tree.Remove(key);
+      }
+      int64_t even = (int64_t)(rng() % (key_count / 2)) * 2 + 2;
+      std::vector<RID> result;
+      CHECK(lookup(even, result) && result[0].Get() == even,
+            "even key %ld not found", (long)even);
+    }
+  });
+  phase = 3;
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  done = true;
+  forward.join();
+  backward.join();
+
+  for (int64_t k = 1; k <= key_count; k++) {
+    std::vector<RID> result;
+    CHECK(lookup(k, result) == (k % 2 == 0), "key %ld %s", (long)k,
+          k % 2 ? "not removed" : "lost");
+  }
+
+  // remove the rest concurrently, the empty tree must take new keys
+  RunThreads(threads, [&](int t) {
+    for (int i = 0; i < per_thread; i++) {
+      GenericKey<8> key;
+      key.SetFromInteger(key_of(t, i));
+      tree.Remove(key);
+    }
+  });
+  CHECK(tree.IsEmpty(), "tree not empty after removing every key");
+  GenericKey<8> key;
+  key.SetFromInteger(5);
+  tree.Insert(key, RID(5));
+  std::vector<RID> result;
+  CHECK(lookup(5, result), "emptied tree does not take keys");
+
+  remove("concurrent_test.db");
+  remove("concurrent_test.log");
+  remove("concurrent_test.map");
+  printf("%s\n", failed ? "FAILED" : "PASSED");
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,141 @@
+/**
+ * key_comparator_benchmark.cpp
+ *
+ * GenericComparator next to comparing deserialized Values column by column,
+ * the way every key comparison used to go, for a few key schemas. Both must
+ * order every pair of keys the same. Then lookups per second of a BPlusTree
+ * built on each schema.
+ * Usage: key_comparator_benchmark [keys] [lookups]
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "buffer/buffer_pool_manager.h"
+#include "index/b_plus_tree.h"
+
+using namespace scudb;
+
+static double Seconds(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+// column by column through Value, the fallback of GenericComparator
+template <size_t KeySize>
+static int CompareValues(const GenericKey<KeySize> &lhs,
+                         const GenericKey<KeySize> &rhs, Schema *key_schema) {
+  for (int i = 0; i < key_schema->GetColumnCount(); i++) {
+    Value lhs_value = lhs.ToValue(key_schema, i);
+    Value rhs_value = rhs.ToValue(key_schema, i);
+    if (lhs_value.CompareLessThan(rhs_value) == CMP_TRUE)
+      return -1;
+    if (lhs_value.CompareGreaterThan(rhs_value) == CMP_TRUE)
+      return 1;
+  }
+  return 0;
+}
+
+template <size_t KeySize>
+static bool Run(const char *name, std::vector<Column> columns, int key_count,
+                int lookups) {
+  Schema key_schema(columns);
+  GenericComparator<KeySize> comparator(&key_schema);
+  std::vector<GenericKey<KeySize>> keys(key_count);
+  for (int i = 0; i < key_count; i++) {
+    int64_t k = i * 7919LL % key_count;
+    std::vector<Value> values;
+    for (auto &column : columns) {
+      if (column.GetType() == TypeId::VARCHAR) {
+        char text[16];
+        snprintf(text, sizeof(text), "key%08ld", (long)k);
+        values.push_back(Value(TypeId::VARCHAR, std::string(text)));
+      } else if (column.GetType() == TypeId::BIGINT) {
+        values.push_back(Value(TypeId::BIGINT, k));
+      } else {
+        values.push_back(Value(TypeId::INTEGER,
+                               (int32_t)(values.empty() ? k / 97 : k % 97)));
+      }
+    }
+    keys[i].SetFromKey(Tuple(values, &key_schema));
+  }
+
+  // neighbours in insert order, a mix of all orderings
+  int pairs = key_count - 1;
+  int rounds = 2000000 / pairs + 1;
+  volatile long sink = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int r = 0; r < rounds; r++)
+    for (int i = 0; i < pairs; i++)
+      sink = sink + comparator(keys[i], keys[i + 1]);
+  double planned_ns = Seconds(start) * 1e9 / ((double)rounds * pairs);
+  start = std::chrono::steady_clock::now();
+  for (int r = 0; r < rounds; r++)
+    for (int i = 0; i < pairs; i++)
+      sink = sink + CompareValues(keys[i], keys[i + 1], &key_schema);
+  double values_ns = Seconds(start) * 1e9 / ((double)rounds * pairs);
+  for (int i = 0; i < pairs; i++) {
+    int planned = comparator(keys[i], keys[i + 1]);
+    int expected = CompareValues(keys[i], keys[i + 1], &key_schema);
+    if ((planned > 0) != (expected > 0) || (planned < 0) != (expected < 0)) {
+      printf("%s: keys %d and %d compare %d, expected %d\n", name, i, i + 1,
+             planned, expected);
+      return false;
+    }
+  }
+
+  remove("comparator_benchmark.db");
+  remove("comparator_benchmark.log");
+  remove("comparator_benchmark.map");
+  long found = 0;
+  double lookup_time;
+  {
+    DiskManager disk_manager("comparator_benchmark.db");
+    BufferPoolManager buffer_pool_manager(256, &disk_manager);
+    page_id_t header_page_id;
+    buffer_pool_manager.NewPage(header_page_id);
+    buffer_pool_manager.UnpinPage(header_page_id, true);
+    BPlusTree<GenericKey<KeySize>, RID, GenericComparator<KeySize>> tree(
+        "comparator_benchmark", &buffer_pool_manager, comparator);
+    for (int i = 0; i < key_count; i++)
+      tree.Insert(keys[i], RID(i));
+
+    std::mt19937 rng(37);
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < lookups; i++) {
+      std::vector<RID> result;
+      found += tree.GetValue(keys[rng() % key_count], result);
+    }
+    lookup_time = Seconds(start);
+  }
+  remove("comparator_benchmark.db");
+  remove("comparator_benchmark.log");
+  remove("comparator_benchmark.map");
+
+  printf("%-8s compare %5.1f ns (values %6.1f ns)  lookup %8.0f/s\n", name,
+         planned_ns, values_ns, lookups / lookup_time);
+  if (found != lookups) {
+    printf("%s: %ld of %d keys found\n", name, found, lookups);
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  int key_count = argc > 1 ? atoi(argv[1]) : 20000;
+  int lookups = argc > 2 ? atoi(argv[2]) : 200000;
+  bool ok = Run<8>("bigint", {Column(TypeId::BIGINT, 8, "a")}, key_count,
+                   lookups) &&
+            Run<8>("int,int",
+                   {Column(TypeId::INTEGER, 4, "a"),
+                    Column(TypeId::INTEGER, 4, "b")},
+                   key_count, lookups) &&
+            Run<32>("varchar", {Column(TypeId::VARCHAR, 12, "a")}, key_count,
+                    lookups);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,125 @@
+/**
+ * key_search_benchmark.cpp
+ *
+ * One search of the sorted keys of a page with KeySearch next to a binary
+ * search through GenericComparator, for the current page size and larger
+ * ones. KeySearch is first checked against std::lower_bound and
+ * std::upper_bound on random pages of bigint keys, plain and normalized.
+ * Usage: key_search_benchmark [searches]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "index/generic_key.h"
+
+using namespace scudb;
+
+typedef std::pair<GenericKey<8>, RID> MappingType;
+
+static GenericKey<8> MakeKey(int64_t value, Schema *key_schema,
+                             bool normalized) {
+  GenericKey<8> key;
+  Tuple tuple({Value(TypeId::BIGINT, value)}, key_schema);
+  if (normalized)
+    key.SetFromKey(tuple, key_schema);
+  else
+    key.SetFromKey(tuple);
+  return key;
+}
+
+static int Count(const std::vector<MappingType> &array,
+                 const GenericKey<8> &key, KeySearch::Format format,
+                 bool inclusive) {
+  return KeySearch::Count((const char *)&array[0].first, sizeof(MappingType),
+                          array.size(), KeySearch::Load(key.data, format),
+                          format, inclusive);
+}
+
+static bool Check(Schema *key_schema, bool normalized) {
+  GenericComparator<8> comparator(key_schema, normalized);
+  KeySearch::Format format = comparator.GetSearchFormat();
+  std::mt19937_64 rng(39);
+  for (int round = 0; round < 20000; round++) {
+    // small ranges give duplicates of the searched key, large ones do not
+    int64_t range = round % 2 ? 50 : INT64_MAX;
+    std::vector<int64_t> values(rng() % 200);
+    for (auto &value : values)
+      value = (int64_t)(rng() % (uint64_t)range) * (rng() % 2 ? 1 : -1);
+    std::sort(values.begin(), values.end());
+    values.erase(std::unique(values.begin(), values.end()), values.end());
+    std::vector<MappingType> array(values.size());
+    for (size_t i = 0; i < values.size(); i++)
+      array[i].first = MakeKey(values[i], key_schema, normalized);
+
+    int64_t search = !values.empty() && rng() % 2
+                         ? values[rng() % values.size()] + (int)(rng() % 3) - 1
+                         : (int64_t)(rng() % 100) - 50;
+    GenericKey<8> key = MakeKey(search, key_schema, normalized);
+    int lower = std::lower_bound(values.begin(), values.end(), search) -
+                values.begin();
+    int upper = std::upper_bound(values.begin(), values.end(), search) -
+                values.begin();
+    if (!array.empty() && (Count(array, key, format, false) != lower ||
+                           Count(array, key, format, true) != upper)) {
+      printf("%s keys: search of %ld among %d keys is wrong\n",
+             normalized ? "normalized" : "bigint", (long)search,
+             (int)values.size());
+      return false;
+    }
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  int searches = argc > 1 ? atoi(argv[1]) : 2000000;
+  std::vector<Column> columns{Column(TypeId::BIGINT, 8, "a")};
+  Schema key_schema(columns);
+  if (!Check(&key_schema, false) || !Check(&key_schema, true))
+    return 1;
+  printf("window counted with %s\n",
+         KeySearch::IsHardwareAccelerated() ? "simd" : "scalar loop");
+
+  // normalized bigint keys, a leaf page full of them
+  GenericComparator<8> comparator(&key_schema, true);
+  KeySearch::Format format = comparator.GetSearchFormat();
+  std::mt19937_64 rng(39);
+  for (int page_size : {PAGE_SIZE, 4096, 16384}) {
+    int size = (page_size - 28) / sizeof(MappingType);
+    std::vector<MappingType> array(size);
+    for (int i = 0; i < size; i++)
+      array[i].first = MakeKey((int64_t)i * 3, &key_schema, true);
+    std::vector<GenericKey<8>> keys(4096);
+    for (auto &key : keys)
+      key = MakeKey(rng() % (3 * size), &key_schema, true);
+
+    auto less = [&](const MappingType &entry, const GenericKey<8> &key) {
+      return comparator(entry.first, key) < 0;
+    };
+    long sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < searches; i++)
+      sink += std::lower_bound(array.begin(), array.end(), keys[i & 4095],
+                               less) -
+              array.begin();
+    auto middle = std::chrono::steady_clock::now();
+    for (int i = 0; i < searches; i++)
+      sink -= Count(array, keys[i & 4095], format, false);
+    auto end = std::chrono::steady_clock::now();
+    if (sink != 0) {
+      printf("KeySearch and the comparator disagree\n");
+      return 1;
+    }
+    printf("page %5d (%4d keys): comparator %6.1f ns, KeySearch %6.1f ns\n",
+           page_size, size,
+           std::chrono::duration<double, std::nano>(middle - start).count() /
+               searches,
+           std::chrono::duration<double, std::nano>(end - middle).count() /
+               searches);
+  }
+  return 0;
+}